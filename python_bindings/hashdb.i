@@ -11,3 +11,22 @@
 %feature("autodoc", "1");
 
 %include "hashdb.hpp"
+
+// iterate over cursors, yielding each block hash or file hash
+%extend hashdb::hash_cursor_t {
+%pythoncode %{
+    def __iter__(self):
+        while not self.at_end():
+            yield self.block_hash()
+            self.next()
+%}
+}
+
+%extend hashdb::source_cursor_t {
+%pythoncode %{
+    def __iter__(self):
+        while not self.at_end():
+            yield self.file_hash()
+            self.next()
+%}
+}
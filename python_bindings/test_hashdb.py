@@ -157,9 +157,34 @@ next_binary_source = scan_manager.next_source(next_binary_source)
 next_binary_source = scan_manager.next_source(next_binary_source)
 str_equals(hashdb.bin_to_hex(next_binary_source), "")
 
+hash_cursor = hashdb.hash_cursor_t(scan_manager)
+str_equals(hashdb.bin_to_hex(hash_cursor.block_hash()), "6868686868686868")
+int_equals(hash_cursor.count(), 1)
+str_equals(hash_cursor.export_hash_json(), '{"block_hash":"6868686868686868","k_entropy":2000,"block_label":"blocklabel","source_sub_counts":["7373737373737373",1]}')
+hash_cursor.next()
+str_equals(hashdb.bin_to_hex(hash_cursor.block_hash()), "7676767676767676")
+hash_cursor.next()
+bool_equals(hash_cursor.at_end(), True)
+hash_cursor.seek("i")
+str_equals(hashdb.bin_to_hex(hash_cursor.block_hash()), "7676767676767676")
+int_equals(len(list(hashdb.hash_cursor_t(scan_manager))), 2)
+hash_cursor = None
+
+source_cursor = hashdb.source_cursor_t(scan_manager)
+str_equals(hashdb.bin_to_hex(source_cursor.file_hash()), "7373737373737373")
+str_equals(source_cursor.export_source_json(), '{"file_hash":"7373737373737373","filesize":0,"file_type":"","zero_count":0,"nonprobative_count":0,"name_pairs":[]}')
+source_cursor.seek("u")
+str_equals(hashdb.bin_to_hex(source_cursor.file_hash()), "7777777777777777")
+source_cursor.next()
+bool_equals(source_cursor.at_end(), True)
+str_equals([hashdb.bin_to_hex(h) for h in hashdb.source_cursor_t(scan_manager)], ["7373737373737373", "7474747474747474", "7777777777777777"])
+source_cursor = None
+
 str_equals(scan_manager.size(), '{"hash_data_store":2, "hash_store":2, "source_data_store":3, "source_id_store":3, "source_name_store":2}')
 int_equals(scan_manager.size_hashes(), 2)
 int_equals(scan_manager.size_sources(), 3)
+bool_equals(scan_manager.has_source_index(), False)
+bool_equals(scan_manager.has_repository_index(), False)
 
 def temp_out_equals(a):
     infile = open("temp_out", "r")
@@ -169,7 +194,7 @@ def temp_out_equals(a):
 
 # Settings
 settings.block_size = 1
-str_equals(settings.settings_string(), '{"settings_version":4, "block_size":1}')
+str_equals(settings.settings_string(), '{"settings_version":5, "block_size":1, "source_index":false}')
 
 # Timestamp
 ts = hashdb.timestamp_t()
@@ -21,6 +21,7 @@
  * \file
  * Facilitate adding from database A to B.
  * Read operations read from A.  Write operations write to B.
+ * Hashes are read at a hash cursor walking A.
  */
 
 #ifndef ADDER_HPP
@@ -46,10 +47,11 @@ class adder_t {
   hashdb::import_manager_t* const manager_b;
   const std::string repository_name;
   progress_tracker_t* const tracker;
-  std::set<std::string> preexisting_sources;
-  std::set<std::string> processed_sources;
-  std::set<std::string> repository_sources;
-  std::set<std::string> non_repository_sources;
+  std::vector<hashdb::hash_key_t> preexisting_sources;  // sorted
+  std::set<hashdb::hash_key_t> processed_sources;
+  std::set<hashdb::hash_key_t> repository_sources;
+  std::set<hashdb::hash_key_t> non_repository_sources;
+  hashdb::hash_result_t hash_result;
 
   // do not allow copy or assignment
   adder_t(const adder_t&);
@@ -59,14 +61,16 @@ class adder_t {
   void load_preexisting_sources() {
     std::string file_hash = manager_b->first_source();
     while (file_hash != "") {
-      preexisting_sources.insert(file_hash);
+      preexisting_sources.push_back(hashdb::hash_key_t(file_hash));
       file_hash = manager_b->next_source(file_hash);
     }
+    std::sort(preexisting_sources.begin(), preexisting_sources.end());
   }
 
   // helper function
-  inline bool is_preexisting_source(const std::string& data) {
-    return (preexisting_sources.find(data) != preexisting_sources.end());
+  inline bool is_preexisting_source(const hashdb::hash_key_t& data) {
+    return std::binary_search(preexisting_sources.begin(),
+                              preexisting_sources.end(), data);
   }
 
   // add source data
@@ -170,10 +174,10 @@ class adder_t {
                                it != names->end(); ++it) {
       if (it->first == repository_name) {
         // the source has the repository name
-        repository_sources.insert(file_block_hash);
+        repository_sources.insert(hashdb::hash_key_t(file_block_hash));
       } else {
         // the source has a non-repository name
-        non_repository_sources.insert(file_block_hash);
+        non_repository_sources.insert(hashdb::hash_key_t(file_block_hash));
       }
     }
     delete names;
@@ -191,7 +195,8 @@ class adder_t {
                   preexisting_sources(),
                   processed_sources(),
                   repository_sources(),
-                  non_repository_sources() {
+                  non_repository_sources(),
+                  hash_result() {
     load_preexisting_sources();
   }
 
@@ -207,23 +212,17 @@ class adder_t {
                   preexisting_sources(),
                   processed_sources(),
                   repository_sources(),
-                  non_repository_sources() {
+                  non_repository_sources(),
+                  hash_result() {
     load_preexisting_sources();
   }
 
   // add hash and source information and do not re-add sources
-  void add(const std::string& block_hash) {
-
-    // hash data
-    uint64_t k_entropy;
-    std::string block_label;
-    uint64_t count;
-    hashdb::source_sub_counts_t* source_sub_counts =
-                                   new hashdb::source_sub_counts_t;
-
-    // get hash data from A
-    bool found_hash = manager_a->find_hash(block_hash, k_entropy, block_label,
-                                           count, *source_sub_counts);
+  void add(const hashdb::hash_cursor_t& cursor) {
+
+    // get hash data from A at the cursor
+    const std::string& block_hash = cursor.block_hash();
+    bool found_hash = cursor.read(hash_result);
     // hash required
     if (!found_hash) {
       // program error
@@ -231,48 +230,84 @@ class adder_t {
     }
 
     // process each source in source_sub_counts
-    for (hashdb::source_sub_counts_t::const_iterator it =
-         source_sub_counts->begin(); it != source_sub_counts->end(); ++it) {
+    for (size_t i=0; i<hash_result.size(); ++i) {
+      const std::string& file_hash = hash_result.file_hash(i);
+      const hashdb::hash_key_t file_key(file_hash);
 
       // skip preexisting sources
-      if (is_preexisting_source(it->file_hash)) {
+      if (is_preexisting_source(file_key)) {
         continue;
       }
 
       // add hash for source
-      manager_b->merge_hash(block_hash, k_entropy, block_label,
-                            it->file_hash, it->sub_count);
+      manager_b->merge_hash(block_hash, hash_result.k_entropy,
+                            hash_result.block_label,
+                            file_hash, hash_result.sub_count(i));
 
-      if (processed_sources.find(it->file_hash) == processed_sources.end()) {
+      if (processed_sources.find(file_key) == processed_sources.end()) {
         // add source information
-        add_source_data(it->file_hash);
-        add_source_names(it->file_hash);
-        processed_sources.insert(it->file_hash);
+        add_source_data(file_hash);
+        add_source_names(file_hash);
+        processed_sources.insert(file_key);
       } else {
         // already processed
       }
     }
 
     // track these hashes
-    tracker->track_hash_data(source_sub_counts->size());
+    tracker->track_hash_data(hash_result.size());
+  }
+
+  // Add hash and source information from a hash result already read
+  // from A, and do not re-add sources.  Sources in merged_sources,
+  // sorted, were merged into B for this hash by another adder, so only
+  // their source information is added.  Newly merged sources are added
+  // to merged_sources.
+  void add_combined(const std::string& block_hash,
+                    const hashdb::hash_result_t& p_hash_result,
+                    std::vector<hashdb::hash_key_t>& merged_sources) {
+
+    // process each source in source_sub_counts
+    for (size_t i=0; i<p_hash_result.size(); ++i) {
+      const std::string& file_hash = p_hash_result.file_hash(i);
+      const hashdb::hash_key_t file_key(file_hash);
+
+      // skip preexisting sources
+      if (is_preexisting_source(file_key)) {
+        continue;
+      }
+
+      // add hash for source unless another adder already did
+      std::vector<hashdb::hash_key_t>::iterator merged = std::lower_bound(
+                  merged_sources.begin(), merged_sources.end(), file_key);
+      if (merged == merged_sources.end() || *merged != file_key) {
+        manager_b->merge_hash(block_hash, p_hash_result.k_entropy,
+                              p_hash_result.block_label,
+                              file_hash, p_hash_result.sub_count(i));
+        merged_sources.insert(merged, file_key);
+      }
+
+      if (processed_sources.find(file_key) == processed_sources.end()) {
+        // add source information
+        add_source_data(file_hash);
+        add_source_names(file_hash);
+        processed_sources.insert(file_key);
+      } else {
+        // already processed
+      }
+    }
 
-    delete source_sub_counts;
+    // track these hashes
+    tracker->track_hash_data(p_hash_result.size());
   }
 
   // add hash and source information in count range and do not re-add sources
-  void add_range(const std::string& block_hash,
+  void add_range(const hashdb::hash_cursor_t& cursor,
                  size_t m, size_t n) {
 
-    // hash data
-    uint64_t k_entropy;
-    std::string block_label;
-    uint64_t count;
-    hashdb::source_sub_counts_t* source_sub_counts =
-                                     new hashdb::source_sub_counts_t;
-
-    // get hash data from A
-    bool found_hash = manager_a->find_hash(block_hash, k_entropy, block_label,
-                                           count, *source_sub_counts);
+    // get hash data from A at the cursor
+    const std::string& block_hash = cursor.block_hash();
+    bool found_hash = cursor.read(hash_result);
     // hash required
     if (!found_hash) {
       // program error
@@ -280,26 +315,28 @@ class adder_t {
     }
 
     // add if in range
-    if (count >= m && (n==0 || count <= n)) {
+    if (hash_result.count >= m && (n==0 || hash_result.count <= n)) {
 
       // process each source in source_sub_counts
-      for (hashdb::source_sub_counts_t::const_iterator it =
-           source_sub_counts->begin(); it != source_sub_counts->end(); ++it) {
+      for (size_t i=0; i<hash_result.size(); ++i) {
+        const std::string& file_hash = hash_result.file_hash(i);
+        const hashdb::hash_key_t file_key(file_hash);
 
         // skip preexisting sources
-        if (is_preexisting_source(it->file_hash)) {
+        if (is_preexisting_source(file_key)) {
           continue;
         }
 
         // add hash for source
-        manager_b->merge_hash(block_hash, k_entropy, block_label,
-                              it->file_hash, it->sub_count);
+        manager_b->merge_hash(block_hash, hash_result.k_entropy,
+                              hash_result.block_label,
+                              file_hash, hash_result.sub_count(i));
 
-        if (processed_sources.find(it->file_hash) == processed_sources.end()) {
+        if (processed_sources.find(file_key) == processed_sources.end()) {
           // add source information
-          add_source_data(it->file_hash);
-          add_source_names(it->file_hash);
-          processed_sources.insert(it->file_hash);
+          add_source_data(file_hash);
+          add_source_names(file_hash);
+          processed_sources.insert(file_key);
         } else {
           // already processed
         }
@@ -307,24 +344,15 @@ class adder_t {
     }
 
     // track these hashes
-    tracker->track_hash_data(source_sub_counts->size());
-
-    delete source_sub_counts;
+    tracker->track_hash_data(hash_result.size());
   }
 
   // add hashes and source references when the repository name matches
-  void add_repository(const std::string& block_hash) {
-
-    // hash data
-    uint64_t k_entropy;
-    std::string block_label;
-    uint64_t count;
-    hashdb::source_sub_counts_t* source_sub_counts =
-                                 new hashdb::source_sub_counts_t;
-
-    // get hash data from A
-    bool found_hash = manager_a->find_hash(block_hash, k_entropy, block_label,
-                                           count, *source_sub_counts);
+  void add_repository(const hashdb::hash_cursor_t& cursor) {
+
+    // get hash data from A at the cursor
+    const std::string& block_hash = cursor.block_hash();
+    bool found_hash = cursor.read(hash_result);
     // hash required
     if (!found_hash) {
       // program error
@@ -332,35 +360,37 @@ class adder_t {
     }
 
     // process each source in source_sub_counts
-    for (hashdb::source_sub_counts_t::const_iterator it =
-         source_sub_counts->begin(); it != source_sub_counts->end(); ++it) {
+    for (size_t i=0; i<hash_result.size(); ++i) {
+      const std::string& file_hash = hash_result.file_hash(i);
+      const hashdb::hash_key_t file_key(file_hash);
 
       // skip preexisting sources
-      if (is_preexisting_source(it->file_hash)) {
+      if (is_preexisting_source(file_key)) {
         continue;
       }
 
       // make sure the source is classified as copied or skipped
-      if (processed_sources.find(it->file_hash) == processed_sources.end() &&
-          non_repository_sources.find(it->file_hash) == non_repository_sources.end()) {
+      if (processed_sources.find(file_key) == processed_sources.end() &&
+          non_repository_sources.find(file_key) == non_repository_sources.end()) {
 
         // not classified so classify it
-        classify_repository_source(it->file_hash);
+        classify_repository_source(file_hash);
       }
 
       // only process sources matching repository_name
-      if (repository_sources.find(it->file_hash) !=
+      if (repository_sources.find(file_key) !=
                               repository_sources.end()) {
 
         // add hash for source
-        manager_b->merge_hash(block_hash, k_entropy, block_label,
-                              it->file_hash, it->sub_count);
+        manager_b->merge_hash(block_hash, hash_result.k_entropy,
+                              hash_result.block_label,
+                              file_hash, hash_result.sub_count(i));
 
-        if (processed_sources.find(it->file_hash) == processed_sources.end()) {
+        if (processed_sources.find(file_key) == processed_sources.end()) {
           // add source information
-          add_source_data(it->file_hash);
-          add_repository_source_names(it->file_hash);
-          processed_sources.insert(it->file_hash);
+          add_source_data(file_hash);
+          add_repository_source_names(file_hash);
+          processed_sources.insert(file_key);
         } else {
           // already processed
         }
@@ -368,24 +398,15 @@ class adder_t {
     }
 
     // track these hashes
-    tracker->track_hash_data(source_sub_counts->size());
-
-    delete source_sub_counts;
+    tracker->track_hash_data(hash_result.size());
   }
 
   // add hashes and source references when the repository name does not match
-  void add_non_repository(const std::string& block_hash) {
-
-    // hash data
-    uint64_t k_entropy;
-    std::string block_label;
-    uint64_t count;
-    hashdb::source_sub_counts_t* source_sub_counts =
-                                      new hashdb::source_sub_counts_t;
-
-    // get hash data from A
-    bool found_hash = manager_a->find_hash(block_hash, k_entropy, block_label,
-                                           count, *source_sub_counts);
+  void add_non_repository(const hashdb::hash_cursor_t& cursor) {
+
+    // get hash data from A at the cursor
+    const std::string& block_hash = cursor.block_hash();
+    bool found_hash = cursor.read(hash_result);
     // hash required
     if (!found_hash) {
       // program error
@@ -393,35 +414,37 @@ class adder_t {
     }
 
     // process each source in source_sub_counts
-    for (hashdb::source_sub_counts_t::const_iterator it =
-         source_sub_counts->begin(); it != source_sub_counts->end(); ++it) {
+    for (size_t i=0; i<hash_result.size(); ++i) {
+      const std::string& file_hash = hash_result.file_hash(i);
+      const hashdb::hash_key_t file_key(file_hash);
 
       // skip preexisting sources
-      if (is_preexisting_source(it->file_hash)) {
+      if (is_preexisting_source(file_key)) {
         continue;
       }
 
       // make sure the source is classified as copied or skipped
-      if (processed_sources.find(it->file_hash) == processed_sources.end() &&
-          non_repository_sources.find(it->file_hash) == non_repository_sources.end()) {
+      if (processed_sources.find(file_key) == processed_sources.end() &&
+          non_repository_sources.find(file_key) == non_repository_sources.end()) {
 
         // not classified so classify it
-        classify_repository_source(it->file_hash);
+        classify_repository_source(file_hash);
       }
 
       // process sources that have at least one non-matching repository_name
-      if (non_repository_sources.find(it->file_hash) !=
+      if (non_repository_sources.find(file_key) !=
                               non_repository_sources.end()) {
 
         // add hash for source
-        manager_b->merge_hash(block_hash, k_entropy, block_label,
-                              it->file_hash, it->sub_count);
+        manager_b->merge_hash(block_hash, hash_result.k_entropy,
+                              hash_result.block_label,
+                              file_hash, hash_result.sub_count(i));
 
-        if (processed_sources.find(it->file_hash) == processed_sources.end()) {
+        if (processed_sources.find(file_key) == processed_sources.end()) {
           // add source information
-          add_source_data(it->file_hash);
-          add_non_repository_source_names(it->file_hash);
-          processed_sources.insert(it->file_hash);
+          add_source_data(file_hash);
+          add_non_repository_source_names(file_hash);
+          processed_sources.insert(file_key);
         } else {
           // already processed
         }
@@ -429,9 +452,7 @@ class adder_t {
     }
 
     // track these hashes
-    tracker->track_hash_data(source_sub_counts->size());
-
-    delete source_sub_counts;
+    tracker->track_hash_data(hash_result.size());
   }
 };
 
@@ -0,0 +1,169 @@
+// Author:  Bruce Allen
+// Created: 2/25/2013
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on February 25, 2013 by Bruce Allen.
+
+/**
+ * \file
+ * Add multiple databases into one destination database in block hash
+ * order.  Each producer is read with its own cursor.  A binary heap of
+ * the current hash of each producer selects the next hash, and
+ * producers at the same hash are combined so that each source of the
+ * hash is merged into the destination once.  When producers have the
+ * same source for a hash, the sub_count of the producer listed first is
+ * kept.
+ *
+ * The merge may be limited to a range of block hashes so that the key
+ * space can be divided among several adder_multiple_t objects.  Create
+ * all of them before any of them adds, so that they agree on which
+ * destination sources were preexisting.
+ */
+
+#ifndef ADDER_MULTIPLE_HPP
+#define ADDER_MULTIPLE_HPP
+
+#include "../src_libhashdb/hashdb.hpp"
+#include "adder.hpp"
+
+// Standard includes
+#include <cstdlib>
+#include <cassert>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+class adder_multiple_t {
+  private:
+
+  // a producer database, its cursor, and its adder
+  struct producer_t {
+    hashdb::hash_cursor_t cursor;
+    adder_t adder;
+    hashdb::hash_result_t hash_result;
+    producer_t(const hashdb::scan_manager_t* const manager,
+               hashdb::import_manager_t* const consumer,
+               progress_tracker_t* const tracker) :
+                  cursor(*manager),
+                  adder(manager, consumer, tracker),
+                  hash_result() {
+    }
+  };
+
+  // The current hash of a producer.  Ordered so that std heap functions
+  // yield the lowest hash first and, for equal hashes, the producer
+  // listed first.
+  struct head_t {
+    hashdb::hash_key_t block_hash;
+    size_t index;
+    head_t(const std::string& p_block_hash, const size_t p_index) :
+                   block_hash(p_block_hash), index(p_index) {
+    }
+    bool operator<(const head_t& that) const {
+      if (block_hash != that.block_hash) {
+        return that.block_hash < block_hash;
+      }
+      return that.index < index;
+    }
+  };
+
+  const std::string end_hash;     // "" means no end
+  std::vector<producer_t*> producers;
+  std::vector<head_t> heads;      // binary heap
+  std::vector<size_t> at_hash;    // producers at the current hash
+  std::vector<hashdb::hash_key_t> merged_sources;
+
+  // do not allow copy or assignment
+  adder_multiple_t(const adder_multiple_t&);
+  adder_multiple_t& operator=(const adder_multiple_t&);
+
+  // enqueue the producer at its current hash unless it is done
+  void push_head(const size_t index) {
+    const hashdb::hash_cursor_t& cursor = producers[index]->cursor;
+    if (cursor.at_end() ||
+        (end_hash.size() != 0 && !(cursor.block_hash() < end_hash))) {
+      // this producer is done
+      return;
+    }
+    heads.push_back(head_t(cursor.block_hash(), index));
+    std::push_heap(heads.begin(), heads.end());
+  }
+
+  public:
+  /**
+   * Prepare to add the hashes of the producer databases that are in
+   * the range [begin_hash, end_hash) into the consumer database.  An
+   * empty begin_hash or end_hash leaves that end of the range open.
+   */
+  adder_multiple_t(const std::vector<hashdb::scan_manager_t*>& managers,
+                   hashdb::import_manager_t* const consumer,
+                   progress_tracker_t* const tracker,
+                   const std::string& begin_hash = "",
+                   const std::string& p_end_hash = "") :
+                  end_hash(p_end_hash),
+                  producers(),
+                  heads(),
+                  at_hash(),
+                  merged_sources() {
+
+    for (size_t i=0; i<managers.size(); ++i) {
+      producers.push_back(new producer_t(managers[i], consumer, tracker));
+      if (begin_hash.size() != 0) {
+        producers.back()->cursor.seek(begin_hash);
+      }
+      push_head(i);
+    }
+  }
+
+  ~adder_multiple_t() {
+    for (size_t i=0; i<producers.size(); ++i) {
+      delete producers[i];
+    }
+  }
+
+  // add ordered hashes from producers until all hashes are consumed
+  void add() {
+    while (heads.size() != 0) {
+
+      // take every producer at the lowest hash, in producer order
+      at_hash.clear();
+      const hashdb::hash_key_t block_hash = heads.front().block_hash;
+      while (heads.size() != 0 && heads.front().block_hash == block_hash) {
+        at_hash.push_back(heads.front().index);
+        std::pop_heap(heads.begin(), heads.end());
+        heads.pop_back();
+      }
+
+      // combine the producers into the consumer
+      merged_sources.clear();
+      for (size_t i=0; i<at_hash.size(); ++i) {
+        producer_t& producer = *producers[at_hash[i]];
+        producer.cursor.read(producer.hash_result);
+        producer.adder.add_combined(producer.cursor.block_hash(),
+                                    producer.hash_result, merged_sources);
+      }
+
+      // advance these producers
+      for (size_t i=0; i<at_hash.size(); ++i) {
+        producers[at_hash[i]]->cursor.next();
+        push_head(at_hash[i]);
+      }
+    }
+  }
+};
+
+#endif
+
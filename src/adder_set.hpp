@@ -19,13 +19,21 @@
 
 /**
  * \file
- * Add database A and B into C based on a Set rule.
+ * Add database A and B into C based on a Set rule.  A and B are walked
+ * together in block hash order using one cursor each.
+ *
+ * The walk may be divided into ranges of block hashes run in parallel
+ * by adder_set_worker_t objects.  Create all of them before any of them
+ * adds, so that they agree on which sources in C were preexisting.
+ * Each range is staged and then committed into C in range order, so
+ * C gets the same source IDs as from a serial walk.
  */
 
 #ifndef ADDER_SET_HPP
 #define ADDER_SET_HPP
 
 #include "../src_libhashdb/hashdb.hpp"
+#include "range_runner.hpp"
 
 // Standard includes
 #include <cstdlib>
@@ -36,24 +44,59 @@
 #include <algorithm>
 #include <vector>
 #include <map>
+#include <set>
 
 class adder_set_t {
   private:
 
+  // a hash for a source staged to be merged into C
+  struct staged_merge_t {
+    std::string block_hash;
+    uint64_t k_entropy;
+    std::string block_label;
+    std::string file_hash;
+    uint64_t sub_count;
+    staged_merge_t(const std::string& p_block_hash,
+                   const uint64_t p_k_entropy,
+                   const std::string& p_block_label,
+                   const std::string& p_file_hash,
+                   const uint64_t p_sub_count) :
+                  block_hash(p_block_hash),
+                  k_entropy(p_k_entropy),
+                  block_label(p_block_label),
+                  file_hash(p_file_hash),
+                  sub_count(p_sub_count) {
+    }
+  };
+
   const hashdb::scan_manager_t* const manager_a;
   const hashdb::scan_manager_t* const manager_b;
   hashdb::import_manager_t* const manager_c;
   progress_tracker_t* const tracker;
-  std::set<std::string> preexisting_sources;
-  std::set<std::string> processed_sources;
+  std::vector<hashdb::hash_key_t> preexisting_sources;  // sorted
+
+  // sources added into C, shared by the adders of one set operation
+  std::set<hashdb::hash_key_t>& processed_sources;
+
+  // merges staged by add_range and not yet committed
+  std::vector<staged_merge_t> staged_merges;
+
+  // A and B are walked together in block hash order
+  hashdb::hash_cursor_t cursor_a;
+  hashdb::hash_cursor_t cursor_b;
+
+  // reused for each hash
+  hashdb::hash_result_t hash_result_a;
+  hashdb::hash_result_t hash_result_b;
 
   // do not allow copy or assignment
   adder_set_t(const adder_set_t&);
   adder_set_t& operator=(const adder_set_t&);
 
   // helper function
-  inline bool is_preexisting_source(const std::string& data) {
-    return (preexisting_sources.find(data) != preexisting_sources.end());
+  inline bool is_preexisting_source(const hashdb::hash_key_t& data) {
+    return std::binary_search(preexisting_sources.begin(),
+                              preexisting_sources.end(), data);
   }
 
   // add source data
@@ -103,261 +146,238 @@ class adder_set_t {
     }
   }
 
-  public:
-  adder_set_t(const hashdb::scan_manager_t* const p_manager_a,
-              const hashdb::scan_manager_t* const p_manager_b,
-              hashdb::import_manager_t* const p_manager_c,
-              progress_tracker_t* const p_tracker) :
-                  manager_a(p_manager_a),
-                  manager_b(p_manager_b),
-                  manager_c(p_manager_c),
-                  tracker(p_tracker),
-                  preexisting_sources(),
-                  processed_sources() {
+  // stage hash for source to be added into C
+  void add_source(const std::string& binary_hash,
+                  const std::string& file_hash, const uint64_t sub_count) {
 
-    // identify all preexisting sources in C and skip them during processing
-    std::string file_hash = manager_c->first_source();
-    while (file_hash != "") {
-      preexisting_sources.insert(file_hash);
-      file_hash = manager_c->next_source(file_hash);
+    // skip preexisting sources
+    if (is_preexisting_source(hashdb::hash_key_t(file_hash))) {
+      return;
     }
+
+    // stage hash for source
+    staged_merges.push_back(staged_merge_t(binary_hash,
+                          hash_result_a.k_entropy, hash_result_a.block_label,
+                          file_hash, sub_count));
   }
 
-  // add A and B into C where A and B hash sources are common
-  void intersect(const std::string& binary_hash) {
-
-    // read hash data from A
-    uint64_t k_entropy_a;
-    std::string block_label_a;
-    uint64_t count_a;
-    hashdb::source_sub_counts_t source_sub_counts_a;
-    bool found_hash_a = manager_a->find_hash(binary_hash, k_entropy_a,
-                                 block_label_a, count_a, source_sub_counts_a);
-    // hash required
-    if (!found_hash_a) {
-      // program error
-      assert(0);
+  // Move cursor B forward to binary_hash, true if B has it.  Nearby
+  // hashes are reached by stepping, distant hashes by seeking.
+  static bool advance_to(hashdb::hash_cursor_t& cursor,
+                         const std::string& binary_hash) {
+    static const size_t max_steps = 8;
+    for (size_t i=0; i<max_steps; ++i) {
+      if (cursor.at_end() || !(cursor.block_hash() < binary_hash)) {
+        break;
+      }
+      cursor.next();
     }
+    if (!cursor.at_end() && cursor.block_hash() < binary_hash) {
+      cursor.seek(binary_hash);
+    }
+    return (!cursor.at_end() && cursor.block_hash() == binary_hash);
+  }
 
-    // read hash data from B
-    uint64_t k_entropy_b;
-    std::string block_label_b;
-    uint64_t count_b;
-    hashdb::source_sub_counts_t source_sub_counts_b;
-    bool found_hash_b = manager_b->find_hash(binary_hash, k_entropy_b,
-                                 block_label_b, count_b, source_sub_counts_b);
-    if (found_hash_b) {
-
-      // go through source offsets in A and look for matches in B
-      for (hashdb::source_sub_counts_t::const_iterator it_a =
-         source_sub_counts_a.begin(); it_a != source_sub_counts_a.end();
-         ++it_a) {
-
-        // skip preexisting sources
-        if (is_preexisting_source(it_a->file_hash)) {
-          continue;
-        }
-
-        if (source_sub_counts_b.find(*it_a) != source_sub_counts_b.end()) {
-          // in A and B so put into C
-          manager_c->merge_hash(binary_hash, k_entropy_a, block_label_a,
-                                it_a->file_hash, it_a->sub_count);
-
-          if (processed_sources.find(it_a->file_hash) == processed_sources.end()) {
-            // add source information
-            add_source_data(it_a->file_hash);
-            add_source_names(it_a->file_hash);
-            processed_sources.insert(it_a->file_hash);
-          } else {
-            // already processed
-          }
-        }
+  // Sources in hash results are ordered by file hash, so the source
+  // set operations below also walk A and B together.
+
+  // add sources common to A and B
+  void intersect_sources(const std::string& binary_hash) {
+    size_t i = 0;
+    size_t j = 0;
+    while (i < hash_result_a.size() && j < hash_result_b.size()) {
+      const std::string& file_hash_a = hash_result_a.file_hash(i);
+      const std::string& file_hash_b = hash_result_b.file_hash(j);
+      if (file_hash_a < file_hash_b) {
+        ++i;
+      } else if (file_hash_b < file_hash_a) {
+        ++j;
+      } else {
+        // in A and B so put into C
+        add_source(binary_hash, file_hash_a, hash_result_a.sub_count(i));
+        ++i;
+        ++j;
       }
     }
-
-    // track these hashes
-    tracker->track_hash_data(source_sub_counts_a.size());
   }
 
-  // add A and B into C when A and B hash is common
-  void intersect_hash(const std::string& binary_hash) {
-
-    // read hash data from A
-    uint64_t k_entropy_a;
-    std::string block_label_a;
-    uint64_t count_a;
-    hashdb::source_sub_counts_t source_sub_counts_a;
-    bool found_hash_a = manager_a->find_hash(binary_hash, k_entropy_a,
-                                 block_label_a, count_a, source_sub_counts_a);
-    // hash required
-    if (!found_hash_a) {
-      // program error
-      assert(0);
+  // add union of sources A and B, preferring A
+  void union_sources(const std::string& binary_hash) {
+    size_t i = 0;
+    size_t j = 0;
+    while (i < hash_result_a.size() || j < hash_result_b.size()) {
+      if (j == hash_result_b.size() || (i < hash_result_a.size() &&
+                hash_result_a.file_hash(i) < hash_result_b.file_hash(j))) {
+        add_source(binary_hash, hash_result_a.file_hash(i),
+                   hash_result_a.sub_count(i));
+        ++i;
+      } else if (i == hash_result_a.size() ||
+                hash_result_b.file_hash(j) < hash_result_a.file_hash(i)) {
+        add_source(binary_hash, hash_result_b.file_hash(j),
+                   hash_result_b.sub_count(j));
+        ++j;
+      } else {
+        add_source(binary_hash, hash_result_a.file_hash(i),
+                   hash_result_a.sub_count(i));
+        ++i;
+        ++j;
+      }
     }
+  }
 
-    // read hash data from B
-    uint64_t k_entropy_b;
-    std::string block_label_b;
-    uint64_t count_b;
-    hashdb::source_sub_counts_t source_sub_counts_b;
-    bool found_hash_b = manager_b->find_hash(binary_hash, k_entropy_b,
-                                 block_label_b, count_b, source_sub_counts_b);
-    if (found_hash_b) {
-
-      // union sources A and B into C
-      hashdb::source_sub_counts_t source_sub_counts_c;
-      for (hashdb::source_sub_counts_t::const_iterator it_a =
-           source_sub_counts_a.begin(); it_a != source_sub_counts_a.end();
-           ++it_a) {
-        source_sub_counts_c.insert(*it_a);
+  // add sources in A and not in B
+  void subtract_sources(const std::string& binary_hash) {
+    size_t j = 0;
+    for (size_t i=0; i<hash_result_a.size(); ++i) {
+      const std::string& file_hash_a = hash_result_a.file_hash(i);
+      while (j < hash_result_b.size() &&
+             hash_result_b.file_hash(j) < file_hash_a) {
+        ++j;
       }
-      for (hashdb::source_sub_counts_t::const_iterator it_b =
-           source_sub_counts_b.begin(); it_b != source_sub_counts_b.end();
-           ++it_b) {
-        source_sub_counts_c.insert(*it_b);
-      }
-
-      // copy union of sources
-      for (hashdb::source_sub_counts_t::const_iterator it =
-           source_sub_counts_c.begin(); it != source_sub_counts_c.end();
-           ++it) {
-
-        // skip preexisting sources
-        if (is_preexisting_source(it->file_hash)) {
-          continue;
-        }
-
-        // add hash for source
-        manager_c->merge_hash(binary_hash, k_entropy_a, block_label_a,
-                              it->file_hash, it->sub_count);
-
-        if (processed_sources.find(it->file_hash) == processed_sources.end()) {
-          // add source information
-          add_source_data(it->file_hash);
-          add_source_names(it->file_hash);
-          processed_sources.insert(it->file_hash);
-        } else {
-          // already processed
-        }
+      if (j < hash_result_b.size() && hash_result_b.file_hash(j) ==
+                                                            file_hash_a) {
+        // subtracted
+        continue;
       }
+      add_source(binary_hash, file_hash_a, hash_result_a.sub_count(i));
     }
-
-    // track these hashes
-    tracker->track_hash_data(source_sub_counts_a.size());
   }
 
-  // add A into C when A hash and source is not in B
-  void subtract(const std::string& binary_hash) {
-
-    // read hash data from A
-    uint64_t k_entropy_a;
-    std::string block_label_a;
-    uint64_t count_a;
-    hashdb::source_sub_counts_t source_sub_counts_a;
-    bool found_hash_a = manager_a->find_hash(binary_hash, k_entropy_a,
-                                 block_label_a, count_a, source_sub_counts_a);
-    // hash required
-    if (!found_hash_a) {
-      // program error
-      assert(0);
+  // add all sources in A
+  void copy_sources(const std::string& binary_hash) {
+    for (size_t i=0; i<hash_result_a.size(); ++i) {
+      add_source(binary_hash, hash_result_a.file_hash(i),
+                 hash_result_a.sub_count(i));
     }
+  }
 
-    // read hash data from B
-    uint64_t k_entropy_b;
-    std::string block_label_b;
-    uint64_t count_b;
-    hashdb::source_sub_counts_t source_sub_counts_b;
-    manager_b->find_hash(binary_hash, k_entropy_b,
-                                 block_label_b, count_b, source_sub_counts_b);
- 
-    // put sources in A and not in B into C
-    hashdb::source_sub_counts_t source_sub_counts_c;
-    for (hashdb::source_sub_counts_t::const_iterator it_a =
-         source_sub_counts_a.begin(); it_a != source_sub_counts_a.end();
-         ++it_a) {
-      if (source_sub_counts_b.find(*it_a) == source_sub_counts_b.end()) {
-        source_sub_counts_c.insert(*it_a);
+  public:
+  enum set_op_t {INTERSECT, INTERSECT_HASH, SUBTRACT, SUBTRACT_HASH};
+
+  // Walk every hash of the range in A with a cursor on B following
+  // along, staging the hashes to add into C.
+  void add_range(const set_op_t set_op, const hash_range_t& range) {
+    range.start(cursor_a);
+    range.start(cursor_b);
+    for (; range.contains(cursor_a); cursor_a.next()) {
+      const std::string& binary_hash = cursor_a.block_hash();
+      cursor_a.read(hash_result_a);
+      const bool found_hash_b = advance_to(cursor_b, binary_hash);
+
+      switch(set_op) {
+        case INTERSECT:
+          if (found_hash_b) {
+            cursor_b.read(hash_result_b);
+            intersect_sources(binary_hash);
+          }
+          break;
+        case INTERSECT_HASH:
+          if (found_hash_b) {
+            cursor_b.read(hash_result_b);
+            union_sources(binary_hash);
+          }
+          break;
+        case SUBTRACT:
+          if (found_hash_b) {
+            cursor_b.read(hash_result_b);
+          } else {
+            hash_result_b.clear();
+          }
+          subtract_sources(binary_hash);
+          break;
+        case SUBTRACT_HASH:
+          if (!found_hash_b) {
+            copy_sources(binary_hash);
+          }
+          break;
+        default:
+          assert(0);
       }
-    }
 
-    // copy sources in A that were not subtracted
-    for (hashdb::source_sub_counts_t::const_iterator it =
-         source_sub_counts_c.begin(); it != source_sub_counts_c.end();
-         ++it) {
+      // track these hashes
+      tracker->track_hash_data(hash_result_a.size());
+    }
+  }
 
-      // skip preexisting sources
-      if (is_preexisting_source(it->file_hash)) {
-        continue;
-      }
+  // Add the staged hashes into C along with any new source information.
+  // Adders that share processed_sources must not commit concurrently.
+  void commit() {
+    for (std::vector<staged_merge_t>::const_iterator it =
+              staged_merges.begin(); it != staged_merges.end(); ++it) {
 
       // add hash for source
-      manager_c->merge_hash(binary_hash, k_entropy_a, block_label_a,
+      manager_c->merge_hash(it->block_hash, it->k_entropy, it->block_label,
                             it->file_hash, it->sub_count);
 
-      if (processed_sources.find(it->file_hash) == processed_sources.end()) {
+      const hashdb::hash_key_t file_key(it->file_hash);
+      if (processed_sources.find(file_key) == processed_sources.end()) {
         // add source information
         add_source_data(it->file_hash);
         add_source_names(it->file_hash);
-        processed_sources.insert(it->file_hash);
+        processed_sources.insert(file_key);
       } else {
         // already processed
       }
     }
-
-    // track these hashes
-    tracker->track_hash_data(source_sub_counts_a.size());
+    staged_merges.clear();
   }
 
-  // add A into C when A hash is not in B
-  void subtract_hash(const std::string& binary_hash) {
-
-    // read hash data from A
-    uint64_t k_entropy_a;
-    std::string block_label_a;
-    uint64_t count_a;
-    hashdb::source_sub_counts_t source_sub_counts_a;
-    bool found_hash_a = manager_a->find_hash(binary_hash, k_entropy_a,
-                                 block_label_a, count_a, source_sub_counts_a);
-    // hash required
-    if (!found_hash_a) {
-      // program error
-      assert(0);
-    }
+  adder_set_t(const hashdb::scan_manager_t* const p_manager_a,
+              const hashdb::scan_manager_t* const p_manager_b,
+              hashdb::import_manager_t* const p_manager_c,
+              progress_tracker_t* const p_tracker,
+              std::set<hashdb::hash_key_t>& p_processed_sources) :
+                  manager_a(p_manager_a),
+                  manager_b(p_manager_b),
+                  manager_c(p_manager_c),
+                  tracker(p_tracker),
+                  preexisting_sources(),
+                  processed_sources(p_processed_sources),
+                  staged_merges(),
+                  cursor_a(*p_manager_a),
+                  cursor_b(*p_manager_b),
+                  hash_result_a(),
+                  hash_result_b() {
 
-    // read hash count from B
-    size_t count = manager_b->find_hash_count(binary_hash);
-    if (count == 0) {
-      // hash not in B so copy to C
-
-      // copy A sources
-      for (hashdb::source_sub_counts_t::const_iterator it =
-           source_sub_counts_a.begin(); it != source_sub_counts_a.end();
-           ++it) {
-
-        // skip preexisting sources
-        if (is_preexisting_source(it->file_hash)) {
-          continue;
-        }
-
-        // add hash for source
-        manager_c->merge_hash(binary_hash, k_entropy_a, block_label_a,
-                              it->file_hash, it->sub_count);
-
-        if (processed_sources.find(it->file_hash) == processed_sources.end()) {
-          // add source information
-          add_source_data(it->file_hash);
-          add_source_names(it->file_hash);
-          processed_sources.insert(it->file_hash);
-        } else {
-          // already processed
-        }
-      }
+    // identify all preexisting sources in C and skip them during processing
+    std::string file_hash = manager_c->first_source();
+    while (file_hash != "") {
+      preexisting_sources.push_back(hashdb::hash_key_t(file_hash));
+      file_hash = manager_c->next_source(file_hash);
     }
+    std::sort(preexisting_sources.begin(), preexisting_sources.end());
+  }
+};
 
-    // track these hashes
-    tracker->track_hash_data(source_sub_counts_a.size());
+// run a set operation over ranges of block hashes
+class adder_set_worker_t : public range_worker_t {
+  private:
+  adder_set_t adder_set;
+  const adder_set_t::set_op_t set_op;
+
+  // do not allow copy or assignment
+  adder_set_worker_t(const adder_set_worker_t&);
+  adder_set_worker_t& operator=(const adder_set_worker_t&);
+
+  public:
+  adder_set_worker_t(const hashdb::scan_manager_t* const p_manager_a,
+                     const hashdb::scan_manager_t* const p_manager_b,
+                     hashdb::import_manager_t* const p_manager_c,
+                     progress_tracker_t* const p_tracker,
+                     std::set<hashdb::hash_key_t>& p_processed_sources,
+                     const adder_set_t::set_op_t p_set_op) :
+                  adder_set(p_manager_a, p_manager_b, p_manager_c, p_tracker,
+                            p_processed_sources),
+                  set_op(p_set_op) {
+  }
+
+  void run(const hash_range_t& range, std::ostream& os) {
+    adder_set.add_range(set_op, range);
   }
 
+  void commit() {
+    adder_set.commit();
+  }
 };
 
 #endif
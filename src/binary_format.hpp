@@ -0,0 +1,290 @@
+// Author:  Bruce Allen
+// Created: 2/25/2013
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on February 25, 2013 by Bruce Allen.
+
+/**
+ * \file
+ * The binary export format, a compact alternative to JSON that is
+ * written and read front to back so it can be piped:
+ *
+ *   file     := magic section('s') section('n') section('h') 'e'
+ *   magic    := the 16 bytes "hashdb binary 1\n"
+ *   section  := type byte, block*, 4-byte zero length
+ *   block    := 4-byte length > 0, payload of records, 4-byte CRC-32
+ *               of the payload
+ *
+ * Lengths and CRCs are little-endian.  Record fields are unsigned
+ * LEB128 varints or varint-length-prefixed bytes.  Records do not span
+ * blocks, so each block is checked and decoded on its own.
+ *
+ * 's' source: file_hash, filesize, file_type, zero_count,
+ *     nonprobative_count.  Sources are in file hash order and a source
+ *     is referred to by its index in this section, starting at 0.
+ * 'n' name: source index, repository_name, filename.
+ * 'h' hash: length of the prefix shared with the previous hash in the
+ *     block, the rest of block_hash, k_entropy, block_label, number of
+ *     sources, then source index and sub_count for each source.  Hashes
+ *     are in block hash order.
+ */
+
+#ifndef BINARY_FORMAT_HPP
+#define BINARY_FORMAT_HPP
+
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <stdint.h>
+#include "../src_libhashdb/crc32.h"
+
+namespace binary_format {
+
+static const char magic[] = "hashdb binary 1\n";
+static const size_t magic_size = 16;
+
+// section types
+static const char sources_section = 's';
+static const char names_section = 'n';
+static const char hashes_section = 'h';
+static const char end_of_file = 'e';
+
+// blocks are written when their payload reaches this size
+static const size_t nominal_block_size = 1<<20;
+
+// a larger block length indicates corruption
+static const size_t max_block_size = 1<<30;
+
+inline void put_uint32(const uint32_t n, std::string& out) {
+  char b[4];
+  b[0] = static_cast<char>(n & 0xff);
+  b[1] = static_cast<char>((n >> 8) & 0xff);
+  b[2] = static_cast<char>((n >> 16) & 0xff);
+  b[3] = static_cast<char>((n >> 24) & 0xff);
+  out.append(b, 4);
+}
+
+inline uint32_t get_uint32(const char* const p) {
+  const uint8_t* const b = reinterpret_cast<const uint8_t*>(p);
+  return static_cast<uint32_t>(b[0]) |
+         static_cast<uint32_t>(b[1]) << 8 |
+         static_cast<uint32_t>(b[2]) << 16 |
+         static_cast<uint32_t>(b[3]) << 24;
+}
+
+inline void put_varint(uint64_t n, std::string& out) {
+  while (n >= 0x80) {
+    out.push_back(static_cast<char>((n & 0x7f) | 0x80));
+    n >>= 7;
+  }
+  out.push_back(static_cast<char>(n));
+}
+
+inline void put_bytes(const std::string& bytes, std::string& out) {
+  put_varint(bytes.size(), out);
+  out.append(bytes);
+}
+
+/**
+ * Accumulate records into blocks and append the blocks to output.
+ */
+class block_writer_t {
+  private:
+  std::string payload;
+
+  // do not allow copy or assignment
+  block_writer_t(const block_writer_t&);
+  block_writer_t& operator=(const block_writer_t&);
+
+  public:
+  block_writer_t() : payload() {
+    payload.reserve(nominal_block_size + 4096);
+  }
+
+  // the payload to append the next record to
+  std::string& record() {
+    return payload;
+  }
+
+  // the payload is empty, the next record starts a block
+  bool at_block_start() const {
+    return payload.size() == 0;
+  }
+
+  // write the block if it is full
+  void maybe_flush(std::string& out) {
+    if (payload.size() >= nominal_block_size) {
+      flush(out);
+    }
+  }
+
+  // write any pending records as a block
+  void flush(std::string& out) {
+    if (payload.size() == 0) {
+      return;
+    }
+    put_uint32(static_cast<uint32_t>(payload.size()), out);
+    out.append(payload);
+    put_uint32(hashdb::crc32(0, reinterpret_cast<const uint8_t*>(
+                               payload.data()), payload.size()), out);
+    payload.clear();
+  }
+};
+
+/**
+ * Decode the fields of records in a block payload.  Reads past the end
+ * of the payload set the error flag instead of reading.
+ */
+class record_reader_t {
+  private:
+  const char* p;
+  const char* const end;
+  bool is_bad;
+
+  public:
+  record_reader_t(const std::string& payload) :
+                  p(payload.data()), end(payload.data() + payload.size()),
+                  is_bad(false) {
+  }
+
+  bool at_end() const {
+    return p == end || is_bad;
+  }
+
+  bool bad() const {
+    return is_bad;
+  }
+
+  uint64_t get_varint() {
+    uint64_t n = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      if (p == end) {
+        break;
+      }
+      const uint8_t b = static_cast<uint8_t>(*p++);
+      n |= static_cast<uint64_t>(b & 0x7f) << shift;
+      if ((b & 0x80) == 0) {
+        return n;
+      }
+    }
+    is_bad = true;
+    return 0;
+  }
+
+  // read bytes, appending them to bytes
+  void append_bytes(std::string& bytes) {
+    const uint64_t size = get_varint();
+    if (is_bad || size > static_cast<uint64_t>(end - p)) {
+      is_bad = true;
+      return;
+    }
+    bytes.append(p, size);
+    p += size;
+  }
+
+  void get_bytes(std::string& bytes) {
+    bytes.clear();
+    append_bytes(bytes);
+  }
+};
+
+/**
+ * Read the blocks of sections from a stream.
+ */
+class block_reader_t {
+  private:
+  std::istream& in;
+
+  // do not allow copy or assignment
+  block_reader_t(const block_reader_t&);
+  block_reader_t& operator=(const block_reader_t&);
+
+  public:
+  block_reader_t(std::istream& p_in) : in(p_in) {
+  }
+
+  // read and check the magic, return "" or error
+  std::string read_magic() {
+    char b[magic_size];
+    in.read(b, magic_size);
+    if (static_cast<size_t>(in.gcount()) != magic_size ||
+        memcmp(b, magic, magic_size) != 0) {
+      return "not a hashdb binary file";
+    }
+    return "";
+  }
+
+  // read a section type byte, return "" or error
+  std::string read_section(const char expected_type) {
+    char type;
+    if (!in.get(type)) {
+      return "unexpected end of file";
+    }
+    if (type != expected_type) {
+      return std::string("unexpected section type '") + type + "'";
+    }
+    return "";
+  }
+
+  // Read the next block of the section into payload, return "" or error.
+  // An empty payload marks the end of the section.
+  std::string read_block(std::string& payload) {
+    char b[4];
+    in.read(b, 4);
+    if (in.gcount() != 4) {
+      return "unexpected end of file";
+    }
+    const size_t size = get_uint32(b);
+    if (size > max_block_size) {
+      return "invalid block length";
+    }
+    payload.resize(size);
+    if (size == 0) {
+      return "";
+    }
+    in.read(&payload[0], size);
+    if (static_cast<size_t>(in.gcount()) != size) {
+      return "unexpected end of file";
+    }
+    in.read(b, 4);
+    if (in.gcount() != 4) {
+      return "unexpected end of file";
+    }
+    if (get_uint32(b) != hashdb::crc32(0, reinterpret_cast<const uint8_t*>(
+                                       payload.data()), payload.size())) {
+      return "block checksum mismatch";
+    }
+    return "";
+  }
+
+  // Read the blocks of a section without decoding them, checking their
+  // lengths and checksums, return "" or error.
+  std::string skip_section(const char expected_type) {
+    std::string error_message = read_section(expected_type);
+    std::string payload;
+    while (error_message.size() == 0) {
+      error_message = read_block(payload);
+      if (error_message.size() == 0 && payload.size() == 0) {
+        break;
+      }
+    }
+    return error_message;
+  }
+};
+
+} // end namespace binary_format
+
+#endif
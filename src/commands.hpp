@@ -28,9 +28,13 @@
 #include "import_tab.hpp"
 #include "import_json.hpp"
 #include "export_json.hpp"
+#include "import_binary.hpp"
+#include "export_binary.hpp"
 #include "scan_list.hpp"
 #include "adder.hpp"
 #include "adder_set.hpp"
+#include "adder_multiple.hpp"
+#include "range_runner.hpp"
 
 // Standard includes
 #include <cerrno>
@@ -117,11 +121,13 @@ class in_ptr_t {
   in_ptr_t& operator=(const in_ptr_t&);
 
   public:
-  in_ptr_t(const std::string& in_filename) : in(NULL) {
+  in_ptr_t(const std::string& in_filename,
+           const std::ios_base::openmode mode = std::ios_base::in) :
+                                                               in(NULL) {
     if (in_filename == "-") {
       in = &std::cin;
     } else {
-      std::ifstream* inf = new std::ifstream(in_filename.c_str());
+      std::ifstream* inf = new std::ifstream(in_filename.c_str(), mode);
       if (!inf->is_open()) {
         std::cerr << "Error: Cannot open " << in_filename
                   << ": " << strerror(errno) << "\n";
@@ -151,11 +157,13 @@ class out_ptr_t {
   out_ptr_t& operator=(const out_ptr_t&);
 
   public:
-  out_ptr_t(const std::string& out_filename) : out(NULL) {
+  out_ptr_t(const std::string& out_filename,
+            const std::ios_base::openmode mode = std::ios_base::out) :
+                                                               out(NULL) {
     if (out_filename == "-") {
       out = &std::cout;
     } else {
-      std::ofstream* outf = new std::ofstream(out_filename.c_str());
+      std::ofstream* outf = new std::ofstream(out_filename.c_str(), mode);
       if (!outf->is_open()) {
         std::cerr << "Error: Cannot open " << out_filename
                   << ": " << strerror(errno) << "\n";
@@ -176,6 +184,193 @@ class out_ptr_t {
   }
 };
 
+// calculate a hash histogram over ranges of hashes
+class histogram_worker_t : public range_worker_t {
+  private:
+  hashdb::hash_cursor_t cursor;
+  progress_tracker_t& progress_tracker;
+
+  // do not allow copy or assignment
+  histogram_worker_t(const histogram_worker_t&);
+  histogram_worker_t& operator=(const histogram_worker_t&);
+
+  public:
+  uint64_t total_hashes;
+  uint64_t total_distinct_hashes;
+  std::map<uint32_t, uint64_t> hash_histogram;
+
+  histogram_worker_t(const hashdb::scan_manager_t& manager,
+                     progress_tracker_t& p_progress_tracker) :
+                  cursor(manager),
+                  progress_tracker(p_progress_tracker),
+                  total_hashes(0),
+                  total_distinct_hashes(0),
+                  hash_histogram() {
+  }
+
+  void run(const hash_range_t& range, std::ostream& os) {
+    uint64_t count;
+    size_t num_sources;
+    for (range.start(cursor); range.contains(cursor); cursor.next()) {
+      // only the count is needed so do not read sources
+      cursor.read_count(count, num_sources);
+
+      // update total hashes observed
+      total_hashes += count;
+      // update total distinct hashes
+      if (count == 1) {
+        ++total_distinct_hashes;
+      }
+
+      // update hash_histogram information
+      ++hash_histogram[count];
+
+      // move forward
+      progress_tracker.track_hash_data(num_sources);
+    }
+  }
+};
+
+// Print the hashes that workers find over ranges of hashes.  Workers
+// find hashes in parallel and print them in commit(), in range order,
+// because EXPANDED_OPTIMIZED output depends on the hashes printed
+// before.
+class print_hashes_worker_t : public range_worker_t {
+  private:
+  hashdb::scan_manager_t& manager;
+  const hashdb::scan_mode_t scan_mode;
+  std::ostream& print_os;
+  std::string found_text;                  // lines not yet printed
+  std::vector<std::string> found_hashes;   // not yet expanded and printed
+
+  // do not allow copy or assignment
+  print_hashes_worker_t(const print_hashes_worker_t&);
+  print_hashes_worker_t& operator=(const print_hashes_worker_t&);
+
+  protected:
+  hashdb::hash_cursor_t cursor;
+  progress_tracker_t& progress_tracker;
+
+  // Stage the hash at the cursor to be printed.  Expand it here, in
+  // parallel, unless what it expands to depends on the hashes printed
+  // before it, in which case expand it in commit.
+  void found() {
+    if (scan_mode == hashdb::scan_mode_t::EXPANDED_OPTIMIZED) {
+      found_hashes.push_back(cursor.block_hash());
+    } else {
+      found_text += hashdb::bin_to_hex(cursor.block_hash()) + "\t" +
+                 manager.find_hash_json(scan_mode, cursor.block_hash()) + "\n";
+    }
+  }
+
+  public:
+  bool any_found;
+
+  print_hashes_worker_t(hashdb::scan_manager_t& p_manager,
+                        progress_tracker_t& p_progress_tracker,
+                        const hashdb::scan_mode_t p_scan_mode,
+                        std::ostream& p_os) :
+                  manager(p_manager),
+                  scan_mode(p_scan_mode),
+                  print_os(p_os),
+                  found_text(),
+                  found_hashes(),
+                  cursor(p_manager),
+                  progress_tracker(p_progress_tracker),
+                  any_found(false) {
+  }
+
+  void commit() {
+    for (std::vector<std::string>::const_iterator it =
+              found_hashes.begin(); it != found_hashes.end(); ++it) {
+      found_text += hashdb::bin_to_hex(*it) + "\t" +
+                    manager.find_hash_json(scan_mode, *it) + "\n";
+    }
+    found_hashes.clear();
+    if (found_text.size() != 0) {
+      any_found = true;
+
+      // one write so that progress lines do not split it
+      print_os << found_text;
+      found_text.clear();
+    }
+  }
+};
+
+// print hashes with a given count over ranges of hashes
+class duplicates_worker_t : public print_hashes_worker_t {
+  private:
+  const uint32_t number;
+
+  public:
+  duplicates_worker_t(hashdb::scan_manager_t& p_manager,
+                      progress_tracker_t& p_progress_tracker,
+                      const uint32_t p_number,
+                      const hashdb::scan_mode_t p_scan_mode,
+                      std::ostream& p_os) :
+                  print_hashes_worker_t(p_manager, p_progress_tracker,
+                                        p_scan_mode, p_os),
+                  number(p_number) {
+  }
+
+  void run(const hash_range_t& range, std::ostream& os) {
+    uint64_t count;
+    size_t num_sources;
+    for (range.start(cursor); range.contains(cursor); cursor.next()) {
+
+      // read sources only for hashes that match
+      cursor.read_count(count, num_sources);
+      if (count == number) {
+        // show hash with requested duplicates number
+        found();
+      }
+
+      // move forward
+      progress_tracker.track_hash_data(num_sources);
+    }
+  }
+};
+
+// print hashes that belong to a source over ranges of hashes
+class hash_table_worker_t : public print_hashes_worker_t {
+  private:
+  const std::string file_binary_hash;
+  hashdb::hash_result_t hash_result;
+
+  public:
+  hash_table_worker_t(hashdb::scan_manager_t& p_manager,
+                      progress_tracker_t& p_progress_tracker,
+                      const std::string& p_file_binary_hash,
+                      const hashdb::scan_mode_t p_scan_mode,
+                      std::ostream& p_os) :
+                  print_hashes_worker_t(p_manager, p_progress_tracker,
+                                        p_scan_mode, p_os),
+                  file_binary_hash(p_file_binary_hash),
+                  hash_result() {
+  }
+
+  void run(const hash_range_t& range, std::ostream& os) {
+    for (range.start(cursor); range.contains(cursor); cursor.next()) {
+
+      // read hash data for the hash
+      cursor.read(hash_result);
+
+      // find sources that match the source we are looking for
+      for (size_t i=0; i<hash_result.size(); ++i) {
+        if (hash_result.file_hash(i) == file_binary_hash) {
+
+          // the source matches so print the hash and move on
+          found();
+          break;
+        }
+      }
+
+      // move forward
+      progress_tracker.track_hash_data(hash_result.size());
+    }
+  }
+};
+
   // ************************************************************
   // new database
   // ************************************************************
@@ -206,6 +401,8 @@ class out_ptr_t {
                      const bool disable_recursive_processing,
                      const bool disable_calculate_entropy,
                      const bool disable_calculate_labels,
+                     const bool use_file_hash_cache,
+                     const size_t num_readers,
                      const std::string& cmd) {
 
     // ingest
@@ -215,6 +412,8 @@ class out_ptr_t {
                     disable_recursive_processing,
                     disable_calculate_entropy,
                     disable_calculate_labels,
+                    use_file_hash_cache,
+                    num_readers,
                     cmd);
     if (error_message.size() != 0) {
       std::cerr << "Error: " << error_message << "\n";
@@ -241,10 +440,14 @@ class out_ptr_t {
     }
     progress_tracker_t progress_tracker(hashdb_dir, 0, cmd);
 
-    // open the tab file for reading
-    in_ptr_t in_ptr(tab_file);
-    ::import_tab(manager, repository_name, tab_file, whitelist_manager,
-                 progress_tracker, *in_ptr());
+    // import from stdin or from the tab file
+    if (tab_file == "-") {
+      ::import_tab(manager, repository_name, tab_file, whitelist_manager,
+                   progress_tracker, std::cin);
+    } else {
+      ::import_tab(manager, repository_name, tab_file, whitelist_manager,
+                   progress_tracker);
+    }
 
     // done
     if (whitelist_manager != NULL) {
@@ -264,9 +467,12 @@ class out_ptr_t {
     hashdb::import_manager_t manager(hashdb_dir, cmd);
     progress_tracker_t progress_tracker(hashdb_dir, 0, cmd);
 
-    // open the JSON file for reading
-    in_ptr_t in_ptr(json_file);
-    ::import_json(manager, progress_tracker, *in_ptr());
+    // import from stdin or from the JSON file
+    if (json_file == "-") {
+      ::import_json(manager, progress_tracker, std::cin);
+    } else {
+      ::import_json(manager, progress_tracker, json_file);
+    }
   }
 
   // export json
@@ -319,6 +525,49 @@ class out_ptr_t {
                         progress_tracker, *out_ptr());
   }
 
+  // import binary
+  static void import_binary(const std::string& hashdb_dir,
+                            const std::string& binary_file,
+                            const std::string& cmd) {
+
+    // validate hashdb_dir path
+    require_hashdb_dir(hashdb_dir);
+
+    // resources
+    hashdb::import_manager_t manager(hashdb_dir, cmd);
+    progress_tracker_t progress_tracker(hashdb_dir, 0, cmd);
+
+    // open the binary file for reading
+    in_ptr_t in_ptr(binary_file, std::ios_base::in | std::ios_base::binary);
+    std::string error_message =
+                     ::import_binary(manager, progress_tracker, *in_ptr());
+    if (error_message.size() != 0) {
+      std::cerr << "Error: Invalid binary file " << binary_file << ": "
+                << error_message << "\n";
+      exit(1);
+    }
+  }
+
+  // export binary
+  static void export_binary(const std::string& hashdb_dir,
+                            const std::string& binary_file,
+                            const std::string& cmd) {
+
+    // validate hashdb_dir path
+    require_hashdb_dir(hashdb_dir);
+
+    // resources
+    hashdb::scan_manager_t manager(hashdb_dir);
+    progress_tracker_t progress_tracker(hashdb_dir, manager.size_hashes(), cmd);
+
+    // open the binary file for writing
+    out_ptr_t out_ptr(binary_file,
+                      std::ios_base::out | std::ios_base::binary);
+
+    // export the hashdb
+    ::export_binary(manager, progress_tracker, *out_ptr());
+  }
+
   // ************************************************************
   // database manipulation
   // ************************************************************
@@ -338,22 +587,17 @@ class out_ptr_t {
                                 dest_dir, manager_a.size_hashes(), cmd);
     adder_t adder(&manager_a, &manager_b, &progress_tracker);
 
-    // add data for binary_hash from A to B
-    std::string binary_hash = manager_a.first_hash();
-    while (binary_hash.size() != 0) {
+    // add data for each hash from A to B
+    for (hashdb::hash_cursor_t cursor(manager_a); !cursor.at_end();
+                                                           cursor.next()) {
       // add the hash
-      adder.add(binary_hash);
-      binary_hash = manager_a.next_hash(binary_hash);
+      adder.add(cursor);
     }
   }
 
   // add_multiple
-  // Flow:
-  //   1) Create an ordered multimap of key=hash, value=producer_t
-  //      where key is the first key from a producer.
-  //   2) Consume elements from the ordered multimap and copy them
-  //      until the producers are depleted.  Do not enque when a producer
-  //      is depleted.  Done when the ordered multimap becomes empty.
+  // Walk all producers together in block hash order and combine
+  // producers at the same hash.  See adder_multiple_t.
   static void add_multiple(const std::vector<std::string>& p_hashdb_dirs,
                            const std::string& cmd) {
 
@@ -373,73 +617,81 @@ class out_ptr_t {
     // open the consumer at dest_dir
     hashdb::import_manager_t consumer(dest_dir, cmd);
 
-    // calculate the total hash records for the tracker
+    // open the producers and calculate the total hash records for the
+    // tracker
+    std::vector<hashdb::scan_manager_t*> producers;
     size_t total_hash_records = 0;
     for (std::vector<std::string>::const_iterator it = hashdb_dirs.begin();
                     it != hashdb_dirs.end(); ++it) {
-      hashdb::scan_manager_t scan_manager(*it);
-      total_hash_records += scan_manager.size_hashes();
+      producers.push_back(new hashdb::scan_manager_t(*it));
+      total_hash_records += producers.back()->size_hashes();
     }
 
     // start progress tracker
     progress_tracker_t progress_tracker(dest_dir, total_hash_records, cmd);
 
-    // define the ordered multimap of key=hash, value=producer_t
-    typedef std::pair<hashdb::scan_manager_t*, adder_t*> producer_t;
-    typedef std::pair<std::string, producer_t> ordered_producers_value_t;
-    typedef std::multimap<std::string, producer_t> ordered_producers_t;
+    // add ordered hashes from producers until all hashes are consumed
+    {
+      adder_multiple_t adder_multiple(producers, &consumer,
+                                      &progress_tracker);
+      adder_multiple.add();
+    }
 
-    // create the multimap of ordered producers
-    ordered_producers_t ordered_producers;
+    // close the producers
+    for (size_t i=0; i<producers.size(); ++i) {
+      delete producers[i];
+    }
+  }
 
-    // open the producers
-    for (std::vector<std::string>::const_iterator it = hashdb_dirs.begin();
-                    it != hashdb_dirs.end(); ++it) {
-      std::string hashdb_dir = *it;
-      hashdb::scan_manager_t* producer = new hashdb::scan_manager_t(hashdb_dir);
-      std::string binary_hash = producer->first_hash();
-      if (binary_hash.size() != 0) {
-        // the producer is not empty, so enqueue it
-        // create the adder
-        adder_t* adder = new adder_t(producer, &consumer, &progress_tracker);
-        ordered_producers.insert(ordered_producers_value_t(binary_hash,
-                                      producer_t(producer, adder)));
-
-      // also track total hashes to be processed
-      total_hash_records += producer->size_hashes();
-
-      } else {
-        // no hashes for this producer so close it
-        delete producer;
+  // the block hashes of sources having the repository name, in block
+  // hash order, read from the source index
+  static void repository_hashes(const hashdb::scan_manager_t& manager,
+                                const std::string& repository_name,
+                                std::vector<std::string>& block_hashes) {
+
+    block_hashes.clear();
+
+    // candidate sources, from the repository index if there is one
+    std::vector<std::string> file_hashes;
+    if (manager.has_repository_index()) {
+      manager.find_repository_sources(repository_name, file_hashes);
+    } else {
+      for (hashdb::source_cursor_t cursor(manager); !cursor.at_end();
+                                                           cursor.next()) {
+        file_hashes.push_back(cursor.file_hash());
       }
     }
 
-    // add ordered hashes from producers until all hashes are consumed
-    while (ordered_producers.size() != 0) {
-      // get the hash, producer, and adder for the first hash
-      ordered_producers_t::iterator it = ordered_producers.begin();
-      hashdb::scan_manager_t* producer = it->second.first;
-      adder_t* adder = it->second.second;
-
-      // add the hash to the consumer
-      adder->add(it->first);
-
-      // get the next hash from this producer
-      std::string binary_hash = producer->next_hash(it->first);
-
-      // remove this hash, producer_t entry
-      ordered_producers.erase(it);
-
-      if (binary_hash.size() != 0) {
-        // hash exists so add the hash, producer, and adder
-        ordered_producers.insert(ordered_producers_value_t(binary_hash,
-                                      producer_t(producer, adder)));
-      } else {
-        // no hashes for this producer so close it
-        delete producer;
-        delete adder;
+    hashdb::source_names_t source_names;
+    std::vector<std::string> source_hashes;
+    for (std::vector<std::string>::const_iterator file_hash =
+                  file_hashes.begin(); file_hash != file_hashes.end();
+                  ++file_hash) {
+
+      // skip sources without the repository name
+      manager.find_source_names(*file_hash, source_names);
+      bool in_repository = false;
+      for (hashdb::source_names_t::const_iterator it = source_names.begin();
+                                     it != source_names.end(); ++it) {
+        if (it->first == repository_name) {
+          in_repository = true;
+          break;
+        }
       }
+      if (!in_repository) {
+        continue;
+      }
+
+      // add the hashes of this source
+      manager.find_source_hashes(*file_hash, source_hashes);
+      block_hashes.insert(block_hashes.end(), source_hashes.begin(),
+                          source_hashes.end());
     }
+
+    // sources share hashes so order them and remove duplicates
+    std::sort(block_hashes.begin(), block_hashes.end());
+    block_hashes.erase(std::unique(block_hashes.begin(), block_hashes.end()),
+                       block_hashes.end());
   }
 
   // add_repository
@@ -459,12 +711,29 @@ class out_ptr_t {
                                         manager_a.size_hashes(), cmd);
     adder_t adder(&manager_a, &manager_b, repository_name, &progress_tracker);
 
-    // add data for binary_hash from A to B
-    std::string binary_hash = manager_a.first_hash();
-    while (binary_hash.size() != 0) {
+    // visit only the hashes of the repository's sources if A has a
+    // source index
+    if (manager_a.has_source_index()) {
+      std::vector<std::string> block_hashes;
+      repository_hashes(manager_a, repository_name, block_hashes);
+      hashdb::hash_cursor_t cursor(manager_a);
+      for (std::vector<std::string>::const_iterator it =
+                    block_hashes.begin(); it != block_hashes.end(); ++it) {
+        cursor.seek(*it);
+        if (cursor.at_end() || cursor.block_hash() != *it) {
+          // program error
+          assert(0);
+        }
+        adder.add_repository(cursor);
+      }
+      return;
+    }
+
+    // add data for each hash from A to B
+    for (hashdb::hash_cursor_t cursor(manager_a); !cursor.at_end();
+                                                           cursor.next()) {
       // add the hash
-      adder.add_repository(binary_hash);
-      binary_hash = manager_a.next_hash(binary_hash);
+      adder.add_repository(cursor);
     }
   }
 
@@ -486,12 +755,36 @@ class out_ptr_t {
                                         manager_a.size_hashes(), cmd);
     adder_t adder(&manager_a, &manager_b, &progress_tracker);
 
-    // add data for binary_hash from A to B
-    std::string binary_hash = manager_a.first_hash();
-    while (binary_hash.size() != 0) {
+    // add data for each hash from A to B
+    for (hashdb::hash_cursor_t cursor(manager_a); !cursor.at_end();
+                                                           cursor.next()) {
       // add the hash
-      adder.add_range(binary_hash, m, n);
-      binary_hash = manager_a.next_hash(binary_hash);
+      adder.add_range(cursor, m, n);
+    }
+  }
+
+  // run a set operation on A and B into C over ranges of hashes in parallel
+  static void run_set_op(const hashdb::scan_manager_t& manager_a,
+                         const hashdb::scan_manager_t& manager_b,
+                         hashdb::import_manager_t& manager_c,
+                         progress_tracker_t& progress_tracker,
+                         const adder_set_t::set_op_t set_op) {
+
+    // create every worker before any of them adds
+    std::set<hashdb::hash_key_t> processed_sources;
+    std::vector<range_worker_t*> workers;
+    for (size_t i=0; i<range_runner_t::num_workers(); ++i) {
+      workers.push_back(new adder_set_worker_t(&manager_a, &manager_b,
+                 &manager_c, &progress_tracker, processed_sources, set_op));
+    }
+
+    // run the ranges, committing them into C in range order
+    range_runner_t range_runner(workers, manager_a.size_hashes(), NULL, true);
+    range_runner.run();
+
+    // release the workers
+    for (size_t i=0; i<workers.size(); ++i) {
+      delete workers[i];
     }
   }
 
@@ -511,15 +804,10 @@ class out_ptr_t {
     hashdb::scan_manager_t manager_b(hashdb_dir2);
     hashdb::import_manager_t manager_c(dest_dir, cmd);
     progress_tracker_t progress_tracker(dest_dir, manager_a.size_hashes(), cmd);
-    adder_set_t adder_set(&manager_a, &manager_b, &manager_c,
-                                                           &progress_tracker);
-
-    // iterate A to intersect A and B into C
-    std::string binary_hash = manager_a.first_hash();
-    while (binary_hash.size() != 0) {
-      adder_set.intersect(binary_hash);
-      binary_hash = manager_a.next_hash(binary_hash);
-    }
+
+    // walk A and B to intersect A and B into C
+    run_set_op(manager_a, manager_b, manager_c, progress_tracker,
+               adder_set_t::INTERSECT);
   }
 
   // intersect_hash
@@ -538,15 +826,10 @@ class out_ptr_t {
     hashdb::scan_manager_t manager_b(hashdb_dir2);
     hashdb::import_manager_t manager_c(dest_dir, cmd);
     progress_tracker_t progress_tracker(dest_dir, manager_a.size_hashes(), cmd);
-    adder_set_t adder_set(&manager_a, &manager_b, &manager_c,
-                                                          & progress_tracker);
-
-    // iterate A to intersect_hash A and B into C
-    std::string binary_hash = manager_a.first_hash();
-    while (binary_hash.size() != 0) {
-      adder_set.intersect_hash(binary_hash);
-      binary_hash = manager_a.next_hash(binary_hash);
-    }
+
+    // walk A and B to intersect_hash A and B into C
+    run_set_op(manager_a, manager_b, manager_c, progress_tracker,
+               adder_set_t::INTERSECT_HASH);
   }
 
   // subtract
@@ -565,17 +848,10 @@ class out_ptr_t {
     hashdb::scan_manager_t manager_b(hashdb_dir2);
     hashdb::import_manager_t manager_c(dest_dir, cmd);
     progress_tracker_t progress_tracker(dest_dir, manager_a.size_hashes(), cmd);
-    adder_set_t adder_set(&manager_a, &manager_b, &manager_c,
-                                                          &progress_tracker);
 
-    // iterate A to add A to C if A hash and source not in B
-    std::string binary_hash = manager_a.first_hash();
-    while (binary_hash.size() != 0) {
-
-      // add A to C if A hash and source not in B
-      adder_set.subtract(binary_hash);
-      binary_hash = manager_a.next_hash(binary_hash);
-    }
+    // walk A and B to add A to C if A hash and source not in B
+    run_set_op(manager_a, manager_b, manager_c, progress_tracker,
+               adder_set_t::SUBTRACT);
   }
 
   // subtract_hash
@@ -594,17 +870,10 @@ class out_ptr_t {
     hashdb::scan_manager_t manager_b(hashdb_dir2);
     hashdb::import_manager_t manager_c(dest_dir, cmd);
     progress_tracker_t progress_tracker(dest_dir, manager_a.size_hashes(), cmd);
-    adder_set_t adder_set(&manager_a, &manager_b, &manager_c,
-                                                          &progress_tracker);
 
-    // iterate A to add A to C if A hash not in B
-    std::string binary_hash = manager_a.first_hash();
-    while (binary_hash.size() != 0) {
-
-      // add A to C if A hash not in B
-      adder_set.subtract_hash(binary_hash);
-      binary_hash = manager_a.next_hash(binary_hash);
-    }
+    // walk A and B to add A to C if A hash not in B
+    run_set_op(manager_a, manager_b, manager_c, progress_tracker,
+               adder_set_t::SUBTRACT_HASH);
   }
 
   // subtract_repository
@@ -624,12 +893,42 @@ class out_ptr_t {
                                         manager_a.size_hashes(), cmd);
     adder_t adder(&manager_a, &manager_b, repository_name, &progress_tracker);
 
-    // add data for binary_hash from A to B
-    std::string binary_hash = manager_a.first_hash();
-    while (binary_hash.size() != 0) {
+    // add data for each hash from A to B
+    for (hashdb::hash_cursor_t cursor(manager_a); !cursor.at_end();
+                                                           cursor.next()) {
       // add the hash
-      adder.add_non_repository(binary_hash);
-      binary_hash = manager_a.next_hash(binary_hash);
+      adder.add_non_repository(cursor);
+    }
+  }
+
+  // index_sources
+  static void index_sources(const std::string& hashdb_dir,
+                            const std::string& cmd) {
+
+    // validate hashdb_dir path
+    require_hashdb_dir(hashdb_dir);
+
+    std::string error_message = hashdb::create_source_index(hashdb_dir);
+    if (error_message.size() == 0) {
+      std::cout << "Source indexes created.\n";
+    } else {
+      std::cerr << "Error: " << error_message << "\n";
+      exit(1);
+    }
+  }
+
+  // upgrade
+  static void upgrade(const std::string& hashdb_dir,
+                      const std::string& cmd) {
+
+    // upgrade_hashdb validates hashdb_dir, which may be at an earlier
+    // settings version
+    std::string error_message = hashdb::upgrade_hashdb(hashdb_dir);
+    if (error_message.size() == 0) {
+      std::cout << "Hash database is current.\n";
+    } else {
+      std::cerr << "Error: " << error_message << "\n";
+      exit(1);
     }
   }
 
@@ -645,8 +944,8 @@ class out_ptr_t {
     // validate hashdb_dir path
     require_hashdb_dir(hashdb_dir);
 
-    // resources
-    hashdb::scan_manager_t manager(hashdb_dir);
+    // resources, caching up to 64MiB of results for repeated hashes
+    hashdb::scan_manager_t manager(hashdb_dir, 100000, 67108864);
 
     // open the hashes list file for reading
     in_ptr_t in_ptr(hashes_file);
@@ -699,6 +998,7 @@ class out_ptr_t {
                          const size_t step_size,
                          const bool disable_recursive_processing,
                          const hashdb::scan_mode_t scan_mode,
+                         const double sample_fraction,
                          const std::string& cmd) {
 
     // print header information
@@ -707,7 +1007,8 @@ class out_ptr_t {
     // scan
     std::string error_message = hashdb::scan_media(hashdb_dir,
                              media_image_filename, step_size,
-                             disable_recursive_processing, scan_mode);
+                             disable_recursive_processing, scan_mode,
+                             sample_fraction);
     if (error_message.size() == 0) {
       std::cout << "# scan_media completed.\n";
     } else {
@@ -762,6 +1063,19 @@ class out_ptr_t {
     // start progress tracker
     progress_tracker_t progress_tracker(hashdb_dir, manager.size_hashes(), cmd);
 
+    // note if the DB is empty
+    if (manager.size_hashes() == 0) {
+      std::cout << "The map is empty.\n";
+    }
+
+    // calculate the histogram over ranges of hashes in parallel
+    std::vector<range_worker_t*> workers;
+    for (size_t i=0; i<range_runner_t::num_workers(); ++i) {
+      workers.push_back(new histogram_worker_t(manager, progress_tracker));
+    }
+    range_runner_t range_runner(workers, manager.size_hashes(), NULL);
+    range_runner.run();
+
     // total number of hashes in the database
     uint64_t total_hashes = 0;
 
@@ -771,52 +1085,18 @@ class out_ptr_t {
     // hash histogram as <count, number of hashes with count>
     std::map<uint32_t, uint64_t> hash_histogram;
 
-    // space for variables
-    uint64_t k_entropy;
-    std::string block_label;
-    uint64_t count;
-    hashdb::source_sub_counts_t source_sub_counts;
-
-    // iterate over hashdb and set variables for calculating the histogram
-    std::string binary_hash = manager.first_hash();
-
-    // note if the DB is empty
-    if (binary_hash.size() == 0) {
-      std::cout << "The map is empty.\n";
-    }
-
-    while (binary_hash.size() != 0) {
-      manager.find_hash(binary_hash, k_entropy, block_label, count,
-                        source_sub_counts);
-      // update total hashes observed
-      total_hashes += count;
-      // update total distinct hashes
-      if (count == 1) {
-        ++total_distinct_hashes;
-      }
-
-      // update hash_histogram information
-      // look for existing entry
-      std::map<uint32_t, uint64_t>::iterator hash_histogram_it =
-                                              hash_histogram.find(count);
-      if (hash_histogram_it == hash_histogram.end()) {
-
-        // this is the first hash found with this count value
-        // so start a new element for it
-        hash_histogram.insert(std::pair<uint32_t, uint64_t>(count, 1));
-
-      } else {
-
-        // increment existing value for number of hashes with this count
-        uint64_t old_number = hash_histogram_it->second;
-        hash_histogram.erase(count);
-        hash_histogram.insert(std::pair<uint32_t, uint64_t>(
-                                           count, old_number + 1));
+    // combine the histograms of the workers
+    for (size_t i=0; i<workers.size(); ++i) {
+      histogram_worker_t* worker = static_cast<histogram_worker_t*>(
+                                                               workers[i]);
+      total_hashes += worker->total_hashes;
+      total_distinct_hashes += worker->total_distinct_hashes;
+      for (std::map<uint32_t, uint64_t>::const_iterator it =
+                     worker->hash_histogram.begin();
+                     it != worker->hash_histogram.end(); ++it) {
+        hash_histogram[it->first] += it->second;
       }
-
-      // move forward
-      progress_tracker.track_hash_data(source_sub_counts.size());
-      binary_hash = manager.next_hash(binary_hash);
+      delete worker;
     }
 
     // show totals
@@ -861,32 +1141,21 @@ class out_ptr_t {
     // start progress tracker
     progress_tracker_t progress_tracker(hashdb_dir, manager.size_hashes(), cmd);
 
-    bool any_found = false;
-
-    // space for variables
-    uint64_t k_entropy;
-    std::string block_label;
-    uint64_t count;
-    hashdb::source_sub_counts_t source_sub_counts;
-
-    // iterate over hashdb and set variables for finding duplicates
-    std::string binary_hash = manager.first_hash();
+    // find duplicates over ranges of hashes in parallel, printing in order
+    std::vector<range_worker_t*> workers;
+    for (size_t i=0; i<range_runner_t::num_workers(); ++i) {
+      workers.push_back(new duplicates_worker_t(manager, progress_tracker,
+                                                number, scan_mode, std::cout));
+    }
+    range_runner_t range_runner(workers, manager.size_hashes(), NULL, true);
+    range_runner.run();
 
-    while (binary_hash.size() != 0) {
-      manager.find_hash(binary_hash, k_entropy, block_label, count,
-                                  source_sub_counts);
-      if (count == number) {
-        // show hash with requested duplicates number
-        std::string expanded_text = manager.find_hash_json(
-                                                    scan_mode, binary_hash);
-        std::cout << hashdb::bin_to_hex(binary_hash) << "\t"
-                  << expanded_text << "\n";
+    bool any_found = false;
+    for (size_t i=0; i<workers.size(); ++i) {
+      if (static_cast<duplicates_worker_t*>(workers[i])->any_found) {
         any_found = true;
       }
-
-      // move forward
-      progress_tracker.track_hash_data(source_sub_counts.size());
-      binary_hash = manager.next_hash(binary_hash);
+      delete workers[i];
     }
 
     // say so if nothing was found
@@ -930,39 +1199,32 @@ class out_ptr_t {
     // start progress tracker
     progress_tracker_t progress_tracker(hashdb_dir, manager.size_hashes(), cmd);
 
-    // space for variables
-    uint64_t k_entropy;
-    std::string block_label;
-    uint64_t count;
-    hashdb::source_sub_counts_t source_sub_counts;
-
-    // look for hashes that belong to this source
-    // get the first hash
-    std::string binary_hash = manager.first_hash();
-    while (binary_hash.size() != 0) {
-
-      // read hash data for the hash
-      manager.find_hash(binary_hash, k_entropy, block_label, count,
-                                                    source_sub_counts);
-
-      // find sources that match the source we are looking for
-      for (hashdb::source_sub_counts_t::const_iterator it =
-                       source_sub_counts.begin();
-                       it!= source_sub_counts.end(); ++it) {
-        if (it->file_hash == file_binary_hash) {
-
-          // the source matches so print the hash and move on
-          std::string expanded_text = manager.find_hash_json(
-                                                    scan_mode, binary_hash);
-          std::cout << hashdb::bin_to_hex(binary_hash) << "\t" << expanded_text
-                    << "\n";
-          break;
-        }
+    // read the hashes of this source directly from the source index,
+    // which covers the whole hash table
+    if (manager.has_source_index()) {
+      std::vector<std::string> block_hashes;
+      manager.find_source_hashes(file_binary_hash, block_hashes);
+      for (std::vector<std::string>::const_iterator it =
+                    block_hashes.begin(); it != block_hashes.end(); ++it) {
+        std::string expanded_text = manager.find_hash_json(scan_mode, *it);
+        std::cout << hashdb::bin_to_hex(*it) << "\t" << expanded_text
+                  << "\n";
       }
+      progress_tracker.track_count(manager.size_hashes());
+      return;
+    }
 
-      // move forward
-      progress_tracker.track_hash_data(source_sub_counts.size());
-      binary_hash = manager.next_hash(binary_hash);
+    // look for hashes that belong to this source over ranges of hashes
+    // in parallel, printing in order
+    std::vector<range_worker_t*> workers;
+    for (size_t i=0; i<range_runner_t::num_workers(); ++i) {
+      workers.push_back(new hash_table_worker_t(manager, progress_tracker,
+                                    file_binary_hash, scan_mode, std::cout));
+    }
+    range_runner_t range_runner(workers, manager.size_hashes(), NULL, true);
+    range_runner.run();
+    for (size_t i=0; i<workers.size(); ++i) {
+      delete workers[i];
     }
   }
 
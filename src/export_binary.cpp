@@ -0,0 +1,211 @@
+// Author:  Bruce Allen
+// Created: 2/25/2013
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on February 25, 2013 by Bruce Allen.
+
+
+/**
+ * \file
+ * Export data in the binary format, see binary_format.hpp.
+ */
+
+#include <config.h>
+// this process of getting WIN32 defined was inspired
+// from i686-w64-mingw32/sys-root/mingw/include/windows.h.
+// All this to include winsock2.h before windows.h to avoid a warning.
+#if defined(__MINGW64__) && defined(__cplusplus)
+#  ifndef WIN32
+#    define WIN32
+#  endif
+#endif
+#ifdef WIN32
+  // including winsock2.h now keeps an included header somewhere from
+  // including windows.h first, resulting in a warning.
+  #include <winsock2.h>
+#endif
+
+#include <iostream>
+#include <cassert>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "../src_libhashdb/hashdb.hpp"
+#include "progress_tracker.hpp"
+#include "range_runner.hpp"
+#include "binary_format.hpp"
+
+// the index of the source in the sources section
+static uint64_t source_index(const std::vector<std::string>& file_hashes,
+                             const std::string& file_hash) {
+  std::vector<std::string>::const_iterator it = std::lower_bound(
+                        file_hashes.begin(), file_hashes.end(), file_hash);
+
+  // program error, every source of a hash is in the sources section
+  if (it == file_hashes.end() || *it != file_hash) {
+    assert(0);
+  }
+  return it - file_hashes.begin();
+}
+
+// export the hashes over ranges of hashes
+class export_binary_worker_t : public range_worker_t {
+  private:
+  hashdb::hash_cursor_t cursor;
+  const std::vector<std::string>& file_hashes;
+  progress_tracker_t& progress_tracker;
+  hashdb::hash_result_t hash_result;
+  binary_format::block_writer_t writer;
+  std::string previous_hash;
+  std::string out;
+
+  // do not allow copy or assignment
+  export_binary_worker_t(const export_binary_worker_t&);
+  export_binary_worker_t& operator=(const export_binary_worker_t&);
+
+  public:
+  export_binary_worker_t(const hashdb::scan_manager_t& p_manager,
+                         const std::vector<std::string>& p_file_hashes,
+                         progress_tracker_t& p_progress_tracker) :
+                  cursor(p_manager),
+                  file_hashes(p_file_hashes),
+                  progress_tracker(p_progress_tracker),
+                  hash_result(),
+                  writer(),
+                  previous_hash(),
+                  out() {
+  }
+
+  void run(const hash_range_t& range, std::ostream& os) {
+    out.clear();
+    for (range.start(cursor); range.contains(cursor); cursor.next()) {
+
+      // get hash data
+      cursor.read(hash_result);
+      const std::string& block_hash = cursor.block_hash();
+
+      // block hash, sharing a prefix with the previous hash in the block
+      if (writer.at_block_start()) {
+        previous_hash.clear();
+      }
+      size_t prefix = 0;
+      while (prefix < previous_hash.size() && prefix < block_hash.size() &&
+             previous_hash[prefix] == block_hash[prefix]) {
+        ++prefix;
+      }
+      std::string& record = writer.record();
+      binary_format::put_varint(prefix, record);
+      binary_format::put_varint(block_hash.size() - prefix, record);
+      record.append(block_hash, prefix, std::string::npos);
+      previous_hash = block_hash;
+
+      // hash data
+      binary_format::put_varint(hash_result.k_entropy, record);
+      binary_format::put_bytes(hash_result.block_label, record);
+      binary_format::put_varint(hash_result.size(), record);
+      for (size_t i=0; i<hash_result.size(); ++i) {
+        binary_format::put_varint(source_index(file_hashes,
+                                         hash_result.file_hash(i)), record);
+        binary_format::put_varint(hash_result.sub_count(i), record);
+      }
+      writer.maybe_flush(out);
+
+      // update the progress tracker
+      progress_tracker.track_hash_data(hash_result.size());
+    }
+
+    // end the block so the range is independent of other ranges
+    writer.flush(out);
+    os.write(out.data(), out.size());
+  }
+};
+
+void export_binary(const hashdb::scan_manager_t& manager,
+                   progress_tracker_t& progress_tracker,
+                   std::ostream& os) {
+
+  os.write(binary_format::magic, binary_format::magic_size);
+  binary_format::block_writer_t writer;
+  std::string out;
+
+  // sources, in file hash order
+  std::vector<std::string> file_hashes;
+  os.put(binary_format::sources_section);
+  uint64_t filesize;
+  std::string file_type;
+  uint64_t zero_count;
+  uint64_t nonprobative_count;
+  for (hashdb::source_cursor_t cursor(manager); !cursor.at_end();
+       cursor.next()) {
+    const std::string& file_hash = cursor.file_hash();
+    manager.find_source_data(file_hash, filesize, file_type, zero_count,
+                             nonprobative_count);
+    std::string& record = writer.record();
+    binary_format::put_bytes(file_hash, record);
+    binary_format::put_varint(filesize, record);
+    binary_format::put_bytes(file_type, record);
+    binary_format::put_varint(zero_count, record);
+    binary_format::put_varint(nonprobative_count, record);
+    writer.maybe_flush(out);
+    os.write(out.data(), out.size());
+    out.clear();
+    file_hashes.push_back(file_hash);
+  }
+  writer.flush(out);
+  binary_format::put_uint32(0, out);
+  os.write(out.data(), out.size());
+  out.clear();
+
+  // names, by source index
+  os.put(binary_format::names_section);
+  hashdb::source_names_t names;
+  for (size_t i=0; i<file_hashes.size(); ++i) {
+    manager.find_source_names(file_hashes[i], names);
+    for (hashdb::source_names_t::const_iterator it = names.begin();
+         it != names.end(); ++it) {
+      std::string& record = writer.record();
+      binary_format::put_varint(i, record);
+      binary_format::put_bytes(it->first, record);
+      binary_format::put_bytes(it->second, record);
+      writer.maybe_flush(out);
+      os.write(out.data(), out.size());
+      out.clear();
+    }
+  }
+  writer.flush(out);
+  binary_format::put_uint32(0, out);
+  os.write(out.data(), out.size());
+  out.clear();
+
+  // hashes, exporting ranges of hashes in parallel in order
+  os.put(binary_format::hashes_section);
+  std::vector<range_worker_t*> workers;
+  for (size_t i=0; i<range_runner_t::num_workers(); ++i) {
+    workers.push_back(new export_binary_worker_t(manager, file_hashes,
+                                                 progress_tracker));
+  }
+  range_runner_t range_runner(workers, manager.size_hashes(), &os);
+  range_runner.run();
+  for (size_t i=0; i<workers.size(); ++i) {
+    delete workers[i];
+  }
+  binary_format::put_uint32(0, out);
+  os.write(out.data(), out.size());
+
+  // end of file
+  os.put(binary_format::end_of_file);
+  os.flush();
+}
@@ -40,62 +40,109 @@
 
 #include <iostream>
 #include <cassert>
+#include <vector>
 #include "../src_libhashdb/hashdb.hpp"
 #include "progress_tracker.hpp"
+#include "range_runner.hpp"
 
-void export_json_sources(const hashdb::scan_manager_t& manager,
-                         std::ostream& os) {
+// export the JSON of sources over ranges of file hashes
+class export_json_sources_worker_t : public range_worker_t {
+  private:
+  hashdb::source_cursor_t cursor;
 
-  std::string file_hash = manager.first_source();
-  while (file_hash.size() != 0) {
+  // do not allow copy or assignment
+  export_json_sources_worker_t(const export_json_sources_worker_t&);
+  export_json_sources_worker_t& operator=(
+                                   const export_json_sources_worker_t&);
 
-    // get source data
-    std::string json_source_string = manager.export_source_json(file_hash);
+  public:
+  export_json_sources_worker_t(const hashdb::scan_manager_t& manager) :
+                  cursor(manager) {
+  }
 
-    // program error
-    if (json_source_string.size() == 0) {
-      assert(0);
+  void run(const hash_range_t& range, std::ostream& os) {
+    for (range.start(cursor); range.contains(cursor); cursor.next()) {
+
+      // get source data
+      std::string json_source_string = cursor.export_source_json();
+
+      // program error
+      if (json_source_string.size() == 0) {
+        assert(0);
+      }
+
+      os << json_source_string << "\n";
     }
+  }
+};
 
-    os << json_source_string << "\n";
+void export_json_sources(const hashdb::scan_manager_t& manager,
+                         std::ostream& os) {
 
-    // next
-    file_hash = manager.next_source(file_hash);
+  // export ranges of sources in parallel, emitting them in order
+  std::vector<range_worker_t*> workers;
+  for (size_t i=0; i<range_runner_t::num_workers(); ++i) {
+    workers.push_back(new export_json_sources_worker_t(manager));
+  }
+  range_runner_t range_runner(workers, manager.size_sources(), &os);
+  range_runner.run();
+  for (size_t i=0; i<workers.size(); ++i) {
+    delete workers[i];
   }
 }
 
-void export_json_hashes(const hashdb::scan_manager_t& manager,
-                        progress_tracker_t& progress_tracker,
-                        std::ostream& os) {
+// export the JSON of hashes over ranges of hashes
+class export_json_worker_t : public range_worker_t {
+  private:
+  hashdb::hash_cursor_t cursor;
+  progress_tracker_t& progress_tracker;
+  hashdb::hash_result_t hash_result;
+
+  // do not allow copy or assignment
+  export_json_worker_t(const export_json_worker_t&);
+  export_json_worker_t& operator=(const export_json_worker_t&);
+
+  public:
+  export_json_worker_t(const hashdb::scan_manager_t& p_manager,
+                       progress_tracker_t& p_progress_tracker) :
+                  cursor(p_manager),
+                  progress_tracker(p_progress_tracker),
+                  hash_result() {
+  }
 
-  // space for variables in order to use the tracker
-  std::string block_hash;
-  uint64_t k_entropy;
-  std::string block_label;
-  uint64_t count;
-  hashdb::source_sub_counts_t source_sub_counts;
+  void run(const hash_range_t& range, std::ostream& os) {
+    for (range.start(cursor); range.contains(cursor); cursor.next()) {
 
-  block_hash = manager.first_hash();
-  while (block_hash.size() != 0) {
+      // get hash data
+      std::string json_hash_string = cursor.export_hash_json(hash_result);
 
-    // get hash data
-    std::string json_hash_string = manager.export_hash_json(block_hash);
+      // program error
+      if (json_hash_string.size() == 0) {
+        assert(0);
+      }
 
-    // program error
-    if (json_hash_string.size() == 0) {
-      assert(0);
-    }
+      // emit the JSON
+      os << json_hash_string << "\n";
 
-    // emit the JSON
-    os << json_hash_string << "\n";
+      // update the progress tracker
+      progress_tracker.track_hash_data(hash_result.size());
+    }
+  }
+};
 
-    // update the progress tracker, this accurate approach is expensive
-    manager.find_hash(block_hash, k_entropy, block_label,
-                      count, source_sub_counts);
-    progress_tracker.track_hash_data(source_sub_counts.size());
+void export_json_hashes(const hashdb::scan_manager_t& manager,
+                        progress_tracker_t& progress_tracker,
+                        std::ostream& os) {
 
-    // next
-    block_hash = manager.next_hash(block_hash);
+  // export ranges of hashes in parallel, emitting them in order
+  std::vector<range_worker_t*> workers;
+  for (size_t i=0; i<range_runner_t::num_workers(); ++i) {
+    workers.push_back(new export_json_worker_t(manager, progress_tracker));
+  }
+  range_runner_t range_runner(workers, manager.size_hashes(), &os);
+  range_runner.run();
+  for (size_t i=0; i<workers.size(); ++i) {
+    delete workers[i];
   }
 }
 
@@ -109,45 +156,32 @@ void export_json_range(const hashdb::scan_manager_t& manager,
   std::set<std::string> source_hashes;
 
   // space for variables in order to use the tracker
-  std::string block_hash;
-  uint64_t k_entropy;
-  std::string block_label;
-  uint64_t count;
-  hashdb::source_sub_counts_t source_sub_counts;
+  hashdb::hash_result_t hash_result;
 
   // export the block hashes that are in range
-  block_hash = manager.first_hash();
-  while (block_hash.size() != 0) {
-
-    manager.find_hash(block_hash, k_entropy, block_label,
-                      count, source_sub_counts);
-
-    if (block_hash >= begin_block_hash && block_hash <= end_block_hash) {
-      // process the block hash since it is in range
+  hashdb::hash_cursor_t cursor(manager);
+  for (cursor.seek(begin_block_hash);
+       !cursor.at_end() && cursor.block_hash() <= end_block_hash;
+       cursor.next()) {
 
-      // get JSON hash data
-      std::string json_hash_string = manager.export_hash_json(block_hash);
+    // get JSON hash data
+    std::string json_hash_string = cursor.export_hash_json(hash_result);
 
-      // program error
-      if (json_hash_string.size() == 0) {
-        assert(0);
-      }
+    // program error
+    if (json_hash_string.size() == 0) {
+      assert(0);
+    }
 
-      // emit the JSON
-      os << json_hash_string << "\n";
+    // emit the JSON
+    os << json_hash_string << "\n";
 
-      // note the sources involved
-      for (hashdb::source_sub_counts_t::const_iterator it =
-           source_sub_counts.begin(); it != source_sub_counts.end(); ++it) {
-        source_hashes.insert(it->file_hash);
-      }
+    // note the sources involved
+    for (size_t i=0; i<hash_result.size(); ++i) {
+      source_hashes.insert(hash_result.file_hash(i));
     }
 
     // update the progress tracker
-    progress_tracker.track_hash_data(source_sub_counts.size());
-
-    // next
-    block_hash = manager.next_hash(block_hash);
+    progress_tracker.track_hash_data(hash_result.size());
   }
 
   // export the cited sources
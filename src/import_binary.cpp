@@ -0,0 +1,256 @@
+// Author:  Bruce Allen
+// Created: 2/25/2013
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on February 25, 2013 by Bruce Allen.
+
+
+/**
+ * \file
+ * Import data in the binary format, see binary_format.hpp.
+ *
+ * Sources and names are imported first so hashes can refer to sources
+ * by index.  Hashes arrive in block hash order, so their merges walk
+ * the hash stores front to back, and the hashes of each block are
+ * merged together, one transaction per store per group of hashes.
+ *
+ * A file is checked, every block length and checksum, before any of it
+ * is imported, so a corrupt file imports nothing.  A stream can only be
+ * read once, so its blocks are checked as they are imported, and an
+ * error after the import starts is reported as a partial import.
+ */
+
+#include <config.h>
+// this process of getting WIN32 defined was inspired
+// from i686-w64-mingw32/sys-root/mingw/include/windows.h.
+// All this to include winsock2.h before windows.h to avoid a warning.
+#if defined(__MINGW64__) && defined(__cplusplus)
+#  ifndef WIN32
+#    define WIN32
+#  endif
+#endif
+#ifdef WIN32
+  // including winsock2.h now keeps an included header somewhere from
+  // including windows.h first, resulting in a warning.
+  #include <winsock2.h>
+#endif
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../src_libhashdb/hashdb.hpp"
+#include "progress_tracker.hpp"
+#include "binary_format.hpp"
+
+// import the sources section, return "" or error
+static std::string import_sources(hashdb::import_manager_t& manager,
+                                  binary_format::block_reader_t& reader,
+                                  std::vector<std::string>& file_hashes) {
+
+  std::string error_message =
+                       reader.read_section(binary_format::sources_section);
+  std::string payload;
+  std::string file_type;
+  while (error_message.size() == 0) {
+    error_message = reader.read_block(payload);
+    if (error_message.size() != 0 || payload.size() == 0) {
+      break;
+    }
+    binary_format::record_reader_t record(payload);
+    while (!record.at_end()) {
+      file_hashes.push_back("");
+      record.get_bytes(file_hashes.back());
+      const uint64_t filesize = record.get_varint();
+      record.get_bytes(file_type);
+      const uint64_t zero_count = record.get_varint();
+      const uint64_t nonprobative_count = record.get_varint();
+      if (record.bad()) {
+        return "invalid source record";
+      }
+      manager.insert_source_data(file_hashes.back(), filesize, file_type,
+                                 zero_count, nonprobative_count);
+    }
+  }
+  return error_message;
+}
+
+// import the names section, return "" or error
+static std::string import_names(hashdb::import_manager_t& manager,
+                                binary_format::block_reader_t& reader,
+                                const std::vector<std::string>& file_hashes) {
+
+  std::string error_message =
+                       reader.read_section(binary_format::names_section);
+  std::string payload;
+  std::string repository_name;
+  std::string group_repository_name;
+  std::string filename;
+  std::vector<std::pair<std::string, std::string> > file_hash_filenames;
+  while (error_message.size() == 0) {
+    error_message = reader.read_block(payload);
+    if (error_message.size() != 0 || payload.size() == 0) {
+      break;
+    }
+
+    // insert names of the same repository together
+    binary_format::record_reader_t record(payload);
+    while (!record.at_end()) {
+      const uint64_t index = record.get_varint();
+      record.get_bytes(repository_name);
+      record.get_bytes(filename);
+      if (record.bad() || index >= file_hashes.size()) {
+        return "invalid name record";
+      }
+      if (repository_name != group_repository_name) {
+        if (file_hash_filenames.size() != 0) {
+          manager.insert_source_names(group_repository_name,
+                                      file_hash_filenames);
+          file_hash_filenames.clear();
+        }
+        group_repository_name = repository_name;
+      }
+      file_hash_filenames.push_back(std::pair<std::string, std::string>(
+                                             file_hashes[index], filename));
+    }
+    if (file_hash_filenames.size() != 0) {
+      manager.insert_source_names(group_repository_name,
+                                  file_hash_filenames);
+      file_hash_filenames.clear();
+    }
+  }
+  return error_message;
+}
+
+// import the hashes section, return "" or error
+static std::string import_hashes(hashdb::import_manager_t& manager,
+                                 progress_tracker_t& progress_tracker,
+                                 binary_format::block_reader_t& reader,
+                                 const std::vector<std::string>& file_hashes) {
+
+  std::string error_message =
+                       reader.read_section(binary_format::hashes_section);
+  std::string payload;
+  std::string block_hash;
+  std::vector<hashdb::hash_merge_t> hash_merges;
+  while (error_message.size() == 0) {
+    error_message = reader.read_block(payload);
+    if (error_message.size() != 0 || payload.size() == 0) {
+      break;
+    }
+
+    // decode the whole block before merging any of it
+    binary_format::record_reader_t record(payload);
+    block_hash.clear();
+    hash_merges.clear();
+    while (!record.at_end()) {
+      hash_merges.push_back(hashdb::hash_merge_t());
+      hashdb::hash_merge_t& hash_merge = hash_merges.back();
+
+      // block hash, sharing a prefix with the previous hash in the block
+      const uint64_t prefix = record.get_varint();
+      if (prefix > block_hash.size()) {
+        return "invalid hash record";
+      }
+      block_hash.resize(prefix);
+      record.append_bytes(block_hash);
+      hash_merge.block_hash = block_hash;
+
+      // hash data
+      hash_merge.k_entropy = record.get_varint();
+      record.get_bytes(hash_merge.block_label);
+      const uint64_t num_sources = record.get_varint();
+      for (uint64_t i=0; i<num_sources && !record.bad(); ++i) {
+        const uint64_t index = record.get_varint();
+        const uint64_t sub_count = record.get_varint();
+        if (index >= file_hashes.size()) {
+          return "invalid source index in hash record";
+        }
+        hash_merge.file_hash_sub_counts.push_back(
+                                 std::pair<std::string, uint64_t>(
+                                 file_hashes[index], sub_count));
+      }
+      if (record.bad()) {
+        return "invalid hash record";
+      }
+    }
+    manager.merge_hashes(hash_merges);
+    progress_tracker.track_count(hash_merges.size());
+  }
+  return error_message;
+}
+
+// check the lengths and checksums of every block, return "" or error
+static std::string check_blocks(binary_format::block_reader_t& reader) {
+  std::string error_message = reader.read_magic();
+  if (error_message.size() == 0) {
+    error_message = reader.skip_section(binary_format::sources_section);
+  }
+  if (error_message.size() == 0) {
+    error_message = reader.skip_section(binary_format::names_section);
+  }
+  if (error_message.size() == 0) {
+    error_message = reader.skip_section(binary_format::hashes_section);
+  }
+  if (error_message.size() == 0) {
+    error_message = reader.read_section(binary_format::end_of_file);
+  }
+  return error_message;
+}
+
+std::string import_binary(hashdb::import_manager_t& manager,
+                          progress_tracker_t& progress_tracker,
+                          std::istream& in) {
+
+  binary_format::block_reader_t reader(in);
+
+  // check a file before importing any of it, a stream is checked as it
+  // is imported
+  const std::istream::pos_type start = in.tellg();
+  if (start != std::istream::pos_type(-1)) {
+    std::string error_message = check_blocks(reader);
+    if (error_message.size() != 0) {
+      return error_message + ", nothing was imported";
+    }
+    in.clear();
+    in.seekg(start);
+    if (!in) {
+      return "unable to read the file again after checking it, nothing "
+             "was imported";
+    }
+  }
+
+  std::vector<std::string> file_hashes;
+  std::string error_message = reader.read_magic();
+  if (error_message.size() != 0) {
+    return error_message + ", nothing was imported";
+  }
+  error_message = import_sources(manager, reader, file_hashes);
+  if (error_message.size() == 0) {
+    error_message = import_names(manager, reader, file_hashes);
+  }
+  if (error_message.size() == 0) {
+    error_message = import_hashes(manager, progress_tracker, reader,
+                                  file_hashes);
+  }
+  if (error_message.size() == 0) {
+    error_message = reader.read_section(binary_format::end_of_file);
+  }
+  if (error_message.size() != 0) {
+    return error_message + ", the import is partial: what was read "
+           "before the error was imported";
+  }
+  return "";
+}
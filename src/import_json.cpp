@@ -21,6 +21,11 @@
  * \file
  * Import from data in JSON format.  Lines are one of source data,
  * block hash data, or comment.
+ *
+ * The input is split into newline-aligned chunks that worker threads
+ * parse and import in parallel.  Each line is copied into a worker
+ * buffer and parsed in place by a reader the worker keeps, so parsing
+ * does not allocate a document or set up a parser per line.  Messages about invalid lines are written in line order.
  */
 
 #include <config.h>
@@ -38,38 +43,119 @@
   #include <winsock2.h>
 #endif
 
-#include <sstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstring>
 #include "../src_libhashdb/hashdb.hpp"
 #include "progress_tracker.hpp"
-#include <fstream>
+#include "line_chunks.hpp"
 
-void import_json(hashdb::import_manager_t& manager,
-                 progress_tracker_t& progress_tracker,
-                 std::istream& in) {
-  std::string line;
-  size_t line_number = 0;
-  while(getline(in, line)) {
-    ++line_number;
+// imported lines to accumulate before updating the progress tracker
+static const size_t track_interval = 10000;
 
-    // skip comment lines
-    if (line[0] == '#') {
-      continue;
+class json_importer_t {
+  public:
+  // per-thread state
+  struct worker_t {
+    std::vector<char> line;              // line parsed in place
+    hashdb::json_reader_t json_reader;   // parser reused for each line
+    size_t untracked;
+    worker_t() : line(), json_reader(), untracked(0) {
     }
+  };
+
+  private:
+  hashdb::import_manager_t& manager;
+  progress_tracker_t& progress_tracker;
+
+  // do not allow copy or assignment
+  json_importer_t(const json_importer_t&);
+  json_importer_t& operator=(const json_importer_t&);
+
+  public:
+  json_importer_t(hashdb::import_manager_t& p_manager,
+                  progress_tracker_t& p_progress_tracker) :
+                  manager(p_manager),
+                  progress_tracker(p_progress_tracker) {
+  }
+
+  // import one line
+  void import_line(worker_t& worker, const char* const begin,
+                   const char* const end, const size_t chunk_line_number,
+                   std::vector<line_message_t>& messages) {
 
     // skip empty lines
-    if (line.size() == 0) {
-      continue;
+    if (begin == end) {
+      return;
+    }
+
+    // skip comment lines
+    if (*begin == '#') {
+      return;
     }
 
+    // copy the line since parsing is in place and the line is needed
+    // for any error message
+    worker.line.assign(begin, end);
+    worker.line.push_back('\0');
+
     // import JSON
-    std::string error_message = manager.import_json(line);
+    std::string error_message = manager.import_json(&worker.line[0],
+                                                    worker.json_reader);
     if (error_message.size() != 0) {
-      std::cerr << "Invalid line " << line_number
-                << " error: " << error_message
-                << ": '" << line << "'\n";
-    } else {
-      progress_tracker.track();
+      messages.push_back(line_message_t("Invalid line ",
+               chunk_line_number, " error: " + error_message + ": '" +
+               std::string(begin, end) + "'\n"));
+      return;
+    }
+
+    // update progress tracker
+    if (++worker.untracked == track_interval) {
+      progress_tracker.track_count(worker.untracked);
+      worker.untracked = 0;
     }
   }
+
+  // keep the hashes of the chunk if interrupted later
+  void finish_chunk(worker_t& worker) {
+    manager.flush();
+  }
+
+  // track what is left when the thread is done
+  void finish(worker_t& worker) {
+    progress_tracker.track_count(worker.untracked);
+    worker.untracked = 0;
+  }
+};
+
+void import_json(hashdb::import_manager_t& manager,
+                 progress_tracker_t& progress_tracker,
+                 std::istream& in) {
+
+  line_chunks_t chunks(&in);
+  json_importer_t importer(manager, progress_tracker);
+  line_chunks_runner_t<json_importer_t> runner(importer, chunks,
+                                               "import_json");
+  runner.run();
 }
 
+void import_json(hashdb::import_manager_t& manager,
+                 progress_tracker_t& progress_tracker,
+                 const std::string& filename) {
+
+  // map the JSON file into memory
+  mapped_file_t json_file;
+  std::string error_message = json_file.open(filename);
+  if (error_message.size() != 0) {
+    std::cerr << "Error: Cannot open " << filename << ": "
+              << error_message << "\n";
+    exit(1);
+  }
+
+  line_chunks_t chunks(json_file.data, json_file.size);
+  json_importer_t importer(manager, progress_tracker);
+  line_chunks_runner_t<json_importer_t> runner(importer, chunks,
+                                               "import_json");
+  runner.run();
+}
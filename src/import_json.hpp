@@ -28,11 +28,18 @@
 
 #include "../src_libhashdb/hashdb.hpp"
 #include "progress_tracker.hpp"
-#include <fstream>
+#include <iostream>
+#include <string>
 
+// import from a stream, which is read a chunk at a time
 void import_json(hashdb::import_manager_t& manager,
                  progress_tracker_t& progress_tracker,
                  std::istream& in);
 
+// import from the named file, which is memory-mapped
+void import_json(hashdb::import_manager_t& manager,
+                 progress_tracker_t& progress_tracker,
+                 const std::string& filename);
+
 #endif
 
@@ -26,6 +26,15 @@
  * Note that block offset is not used.  All block hashes for new file
  * hashes are imported.  All block hashes for pre-existing file hashes
  * are ignored.
+ *
+ * The input is split into newline-aligned chunks that worker threads
+ * parse and import in parallel.  A file is memory-mapped and its chunks
+ * are views into the map.  A stream is read a chunk at a time.  Each
+ * worker inserts the hashes it parses in batches, one transaction per
+ * store per batch, and the rest at the end of each chunk.  Whether
+ * a file hash is new is decided once, the first time any worker sees
+ * it, so the result does not depend on thread timing.  Messages about
+ * invalid lines are written in line order.
  */
 
 #include <config.h>
@@ -44,82 +53,167 @@
 #endif
 
 #include <iostream>
-#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstring>
+#include <pthread.h>
 #include "../src_libhashdb/hashdb.hpp"
+#include "../src_libhashdb/mutex_lock.hpp"
 #include "s_to_uint64.hpp"
 #include "progress_tracker.hpp"
+#include "line_chunks.hpp"
 
-void import_tab(hashdb::import_manager_t& manager,
-                const std::string& repository_name,
-                const std::string& filename,
-                const hashdb::scan_manager_t* const whitelist_manager,
-                progress_tracker_t& progress_tracker,
-                std::istream& in) {
+// imported lines to accumulate before updating the progress tracker
+static const size_t track_interval = 10000;
 
-  // only import file hashes that are new to the session
-  std::set<std::string> importable_sources;
+// parsed hashes to accumulate before inserting them as one batch
+static const size_t max_pending_hashes = 4096;
 
-  std::string line;
-  size_t line_number = 0;
-  while(getline(in, line)) {
-    ++line_number;
+class tab_importer_t {
+  private:
 
-    // skip comment lines
-    if (line[0] == '#') {
-      continue;
+  // what is known about a file hash
+  enum source_state_t {PREEXISTING,   // skip its lines
+                       IMPORTABLE,    // import its lines
+                       NAMED};        // source data and name are in
+
+  public:
+  // per-thread state
+  struct worker_t {
+    std::string file_hash;
+    std::string block_hash;
+    std::string last_file_hash;          // with last_state, avoids the lock
+    source_state_t last_state;
+    std::vector<hashdb::hash_insert_t> pending_hashes;
+    size_t untracked;
+    worker_t() : file_hash(), block_hash(), last_file_hash(),
+                 last_state(PREEXISTING), pending_hashes(), untracked(0) {
+    }
+  };
+
+  private:
+  hashdb::import_manager_t& manager;
+  const std::string repository_name;
+  const std::string filename;
+  const hashdb::scan_manager_t* const whitelist_manager;
+  progress_tracker_t& progress_tracker;
+
+  // shared state
+  std::map<std::string, source_state_t> sources;
+#ifdef HAVE_PTHREAD
+  pthread_mutex_t M;                  // mutext
+#else
+  int M;                              // placeholder
+#endif
+
+  // do not allow copy or assignment
+  tab_importer_t(const tab_importer_t&);
+  tab_importer_t& operator=(const tab_importer_t&);
+
+  // the state of the file hash, deciding it on first sight
+  source_state_t source_state(const std::string& file_hash,
+                              const bool naming) {
+    MUTEX_LOCK(&M);
+    std::map<std::string, source_state_t>::iterator it =
+                                                  sources.find(file_hash);
+    if (it == sources.end()) {
+      // The file hash has not been seen yet so see if it is preexisting.
+      // Nothing is inserted for a file hash before it is decided, so
+      // this does not depend on which worker sees it first.
+      it = sources.insert(std::pair<std::string, source_state_t>(file_hash,
+                 manager.has_source(file_hash) ? PREEXISTING : IMPORTABLE))
+                 .first;
     }
+    const source_state_t state = it->second;
+    if (naming && state == IMPORTABLE) {
+      // the caller adds the source data and name
+      it->second = NAMED;
+    }
+    MUTEX_UNLOCK(&M);
+    return state;
+  }
+
+  public:
+  tab_importer_t(hashdb::import_manager_t& p_manager,
+                 const std::string& p_repository_name,
+                 const std::string& p_filename,
+                 const hashdb::scan_manager_t* const p_whitelist_manager,
+                 progress_tracker_t& p_progress_tracker) :
+                  manager(p_manager),
+                  repository_name(p_repository_name),
+                  filename(p_filename),
+                  whitelist_manager(p_whitelist_manager),
+                  progress_tracker(p_progress_tracker),
+                  sources(),
+                  M() {
+    MUTEX_INIT(&M);
+  }
+
+  ~tab_importer_t() {
+    MUTEX_DESTROY(&M);
+  }
+
+  // import one line
+  void import_line(worker_t& worker, const char* const begin,
+                   const char* const end, const size_t chunk_line_number,
+                   std::vector<line_message_t>& messages) {
 
     // skip empty lines
-    if (line.size() == 0) {
-      continue;
+    if (begin == end) {
+      return;
+    }
+
+    // skip comment lines
+    if (*begin == '#') {
+      return;
     }
 
     // find tabs
-    size_t tab_index1 = line.find('\t');
-    if (tab_index1 == std::string::npos) {
-      std::cerr << "Tab not found on line " << line_number << ": '" << line << "'\n";
-      continue;
+    const char* const tab1 = static_cast<const char*>(
+                                   memchr(begin, '\t', end - begin));
+    if (tab1 == NULL) {
+      messages.push_back(line_message_t("Tab not found on line ",
+               chunk_line_number, ": '" + std::string(begin, end) + "'\n"));
+      return;
     }
-    size_t tab_index2 = line.find('\t', tab_index1 + 1);
-    if (tab_index2 == std::string::npos) {
-      std::cerr << "Second tab not found on line " << line_number << ": '" << line << "'\n";
-      continue;
+    const char* const tab2 = static_cast<const char*>(
+                                   memchr(tab1 + 1, '\t', end - tab1 - 1));
+    if (tab2 == NULL) {
+      messages.push_back(line_message_t(
+               "Second tab not found on line ",
+               chunk_line_number, ": '" + std::string(begin, end) + "'\n"));
+      return;
     }
 
     // get file hash
-    std::string file_hash_string = line.substr(0, tab_index1);
-    std::string file_binary_hash = hashdb::hex_to_bin(file_hash_string);
-    if (file_binary_hash.size() == 0) {
-      std::cerr << "file hexdigest is invalid on line " << line_number
-                << ": '" << line << "', '" << file_hash_string << "'\n";
-      continue;
+    if (!hashdb::hex_to_bin(begin, tab1 - begin, worker.file_hash) ||
+        worker.file_hash.size() == 0) {
+      messages.push_back(line_message_t(
+               "file hexdigest is invalid on line ",
+               chunk_line_number, ": '" + std::string(begin, end) + "', '" +
+               std::string(begin, tab1) + "'\n"));
+      return;
     }
 
-    // skip the file hash if it was preexisting else identify it as importable
-    if (importable_sources.find(file_binary_hash) == importable_sources.end()) {
-      // the file hash has not been seen yet so see if it is preexisting
-      if (manager.has_source(file_binary_hash)) {
-        // the file is preexisting so skip it
-        continue;
-      } else {
-        // the file hash is new so identify it as importable
-        importable_sources.insert(file_binary_hash);
-      }
+    // skip the file hash if it was preexisting, lines of a file are
+    // usually together so remember the last one
+    if (worker.file_hash != worker.last_file_hash) {
+      worker.last_file_hash = worker.file_hash;
+      worker.last_state = source_state(worker.file_hash, false);
     }
-
-    // skip the file hash if it has not been identified as importable
-    if (importable_sources.find(file_binary_hash) == importable_sources.end()) {
-      continue;
+    if (worker.last_state == PREEXISTING) {
+      return;
     }
 
     // get block hash
-    std::string block_hashdigest_string = line.substr(
-                                  tab_index1+1, tab_index2 - tab_index1 - 1);
-    std::string block_binary_hash = hashdb::hex_to_bin(block_hashdigest_string);
-    if (block_binary_hash == "") {
-      std::cerr << "Invalid block hash on line " << line_number
-                << ": '" << line << "', '" << block_hashdigest_string << "'\n";
-      continue;
+    if (!hashdb::hex_to_bin(tab1 + 1, tab2 - tab1 - 1, worker.block_hash) ||
+        worker.block_hash.size() == 0) {
+      messages.push_back(line_message_t(
+               "Invalid block hash on line ",
+               chunk_line_number, ": '" + std::string(begin, end) + "', '" +
+               std::string(tab1 + 1, tab2) + "'\n"));
+      return;
     }
 
     // skip the file offset
@@ -127,23 +221,83 @@ void import_tab(hashdb::import_manager_t& manager,
     // mark with "w" if in whitelist
     std::string whitelist_flag = "";
     if (whitelist_manager != NULL) {
-      if (whitelist_manager->find_hash_count(block_binary_hash) > 0) {
+      if (whitelist_manager->find_hash_count(worker.block_hash) > 0) {
         whitelist_flag = "w";
       }
     }
 
-    // add source data
-    manager.insert_source_data(file_binary_hash, 0, "", 0, 0);
-
-    // add name pair
-    manager.insert_source_name(file_binary_hash, repository_name, filename);
+    // add source data and name pair once per source
+    if (worker.last_state == IMPORTABLE) {
+      if (source_state(worker.file_hash, true) == IMPORTABLE) {
+        manager.insert_source_data(worker.file_hash, 0, "", 0, 0);
+        manager.insert_source_name(worker.file_hash, repository_name,
+                                   filename);
+      }
+      worker.last_state = NAMED;
+    }
 
-    // add block hash
-    manager.insert_hash(block_binary_hash, 0.0, whitelist_flag,
-                        file_binary_hash);
+    // add block hash, inserting a batch when there are enough
+    worker.pending_hashes.push_back(hashdb::hash_insert_t(worker.block_hash,
+                                    0, whitelist_flag, worker.file_hash));
+    if (worker.pending_hashes.size() == max_pending_hashes) {
+      manager.insert_hashes(worker.pending_hashes);
+      worker.pending_hashes.clear();
+    }
 
     // update progress tracker
-    progress_tracker.track();
+    if (++worker.untracked == track_interval) {
+      progress_tracker.track_count(worker.untracked);
+      worker.untracked = 0;
+    }
   }
+
+  // insert the rest of the hashes of the chunk and keep them if
+  // interrupted later
+  void finish_chunk(worker_t& worker) {
+    manager.insert_hashes(worker.pending_hashes);
+    worker.pending_hashes.clear();
+    manager.flush();
+  }
+
+  // track what is left when the thread is done
+  void finish(worker_t& worker) {
+    progress_tracker.track_count(worker.untracked);
+    worker.untracked = 0;
+  }
+};
+
+void import_tab(hashdb::import_manager_t& manager,
+                const std::string& repository_name,
+                const std::string& filename,
+                const hashdb::scan_manager_t* const whitelist_manager,
+                progress_tracker_t& progress_tracker,
+                std::istream& in) {
+
+  line_chunks_t chunks(&in);
+  tab_importer_t importer(manager, repository_name, filename,
+                          whitelist_manager, progress_tracker);
+  line_chunks_runner_t<tab_importer_t> runner(importer, chunks, "import_tab");
+  runner.run();
 }
 
+void import_tab(hashdb::import_manager_t& manager,
+                const std::string& repository_name,
+                const std::string& filename,
+                const hashdb::scan_manager_t* const whitelist_manager,
+                progress_tracker_t& progress_tracker) {
+
+  // map the tab file into memory
+  mapped_file_t tab_file;
+  std::string error_message = tab_file.open(filename);
+  if (error_message.size() != 0) {
+    std::cerr << "Error: Cannot open " << filename << ": "
+              << error_message << "\n";
+    exit(1);
+  }
+
+  line_chunks_t chunks(tab_file.data, tab_file.size);
+  tab_importer_t importer(manager, repository_name, filename,
+                          whitelist_manager, progress_tracker);
+  line_chunks_runner_t<tab_importer_t> runner(importer, chunks, "import_tab");
+  runner.run();
+}
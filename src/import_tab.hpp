@@ -32,6 +32,7 @@
 #include "s_to_uint64.hpp"
 #include "progress_tracker.hpp"
 
+// import from a stream, which is read a chunk at a time
 void import_tab(hashdb::import_manager_t& manager,
                 const std::string& repository_name,
                 const std::string& filename,
@@ -39,5 +40,12 @@ void import_tab(hashdb::import_manager_t& manager,
                 progress_tracker_t& progress_tracker,
                 std::istream& in);
 
+// import from the named file, which is memory-mapped
+void import_tab(hashdb::import_manager_t& manager,
+                const std::string& repository_name,
+                const std::string& filename,
+                const hashdb::scan_manager_t* const whitelist_manager,
+                progress_tracker_t& progress_tracker);
+
 #endif
 
@@ -0,0 +1,409 @@
+// Author:  Bruce Allen
+// Created: 2/25/2013
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on February 25, 2013 by Bruce Allen.
+
+/**
+ * \file
+ * Split line-oriented import input into newline-aligned chunks for
+ * worker threads, run the threads, and write messages about invalid
+ * lines in line order as chunks finish.  A file is memory-mapped and its
+ * chunks are views into the map.  A stream is read a chunk at a time.
+ */
+
+#ifndef LINE_CHUNKS_HPP
+#define LINE_CHUNKS_HPP
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstring>
+#include <cerrno>
+#include <cassert>
+#include <pthread.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "../src_libhashdb/mutex_lock.hpp"
+#include "../src_libhashdb/num_cpus.hpp"
+
+/**
+ * A file in memory, mapped when possible else read.
+ */
+class mapped_file_t {
+  private:
+  const char* map;
+  size_t map_size;
+  std::string buffer;
+
+  // do not allow copy or assignment
+  mapped_file_t(const mapped_file_t&);
+  mapped_file_t& operator=(const mapped_file_t&);
+
+  public:
+  const char* data;
+  size_t size;
+
+  mapped_file_t() : map(NULL), map_size(0), buffer(), data(NULL), size(0) {
+  }
+
+  ~mapped_file_t() {
+#ifdef HAVE_SYS_MMAN_H
+    if (map != NULL) {
+      munmap(const_cast<char*>(map), map_size);
+    }
+#endif
+  }
+
+  // Open the file, return "" or error.  Use data and size after this.
+  std::string open(const std::string& filename) {
+#ifdef HAVE_SYS_MMAN_H
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return strerror(errno);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      std::string error_message = strerror(errno);
+      ::close(fd);
+      return error_message;
+    }
+    size = st.st_size;
+    if (size > 0) {
+      void* p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p == MAP_FAILED) {
+        std::string error_message = strerror(errno);
+        ::close(fd);
+        return error_message;
+      }
+      // the file is read front to back
+      madvise(p, size, MADV_SEQUENTIAL);
+      map = static_cast<const char*>(p);
+      map_size = size;
+    }
+    ::close(fd);
+    data = map;
+    return "";
+#else
+    std::ifstream in(filename.c_str(), std::ios::binary);
+    if (!in.is_open()) {
+      return strerror(errno);
+    }
+    std::stringstream ss;
+    ss << in.rdbuf();
+    buffer = ss.str();
+    data = buffer.data();
+    size = buffer.size();
+    return "";
+#endif
+  }
+};
+
+/**
+ * Newline-aligned chunks of a file in memory or of a stream.  Threadsafe.
+ */
+class line_chunks_t {
+  private:
+  // nominal chunk size, chunks end at the first newline after this
+  static const size_t chunk_size = 1<<24;
+
+  // input, a file in memory or a stream
+  const char* const data;
+  const size_t size;
+  std::istream* const in;
+
+  size_t offset;                         // next chunk in data
+  std::string carry;                     // partial line left from in
+  size_t next_chunk;
+#ifdef HAVE_PTHREAD
+  pthread_mutex_t M;                  // mutext
+#else
+  int M;                              // placeholder
+#endif
+
+  // do not allow copy or assignment
+  line_chunks_t(const line_chunks_t&);
+  line_chunks_t& operator=(const line_chunks_t&);
+
+  bool take_memory_chunk(const char*& begin, const char*& end) {
+    if (offset == size) {
+      return false;
+    }
+    begin = data + offset;
+    if (size - offset <= chunk_size) {
+      offset = size;
+    } else {
+      const char* const newline = static_cast<const char*>(
+                  memchr(begin + chunk_size, '\n', size - offset - chunk_size));
+      offset = (newline == NULL) ? size : newline + 1 - data;
+    }
+    end = data + offset;
+    return true;
+  }
+
+  bool take_stream_chunk(std::string& buffer,
+                         const char*& begin, const char*& end) {
+    buffer.swap(carry);
+    carry.clear();
+    size_t newline = std::string::npos;
+    while (newline == std::string::npos && in->good()) {
+      const size_t used = buffer.size();
+      buffer.resize(used + chunk_size);
+      in->read(&buffer[used], chunk_size);
+      buffer.resize(used + in->gcount());
+      newline = buffer.rfind('\n');
+    }
+
+    // keep any partial line for the next chunk unless at end of input
+    if (newline != std::string::npos && in->good()) {
+      carry.assign(buffer, newline + 1, std::string::npos);
+      buffer.resize(newline + 1);
+    }
+    if (buffer.size() == 0) {
+      return false;
+    }
+    begin = buffer.data();
+    end = begin + buffer.size();
+    return true;
+  }
+
+  public:
+  // chunks of a file in memory
+  line_chunks_t(const char* const p_data, const size_t p_size) :
+                  data(p_data), size(p_size), in(NULL),
+                  offset(0), carry(), next_chunk(0), M() {
+    MUTEX_INIT(&M);
+  }
+
+  // chunks of a stream
+  line_chunks_t(std::istream* const p_in) :
+                  data(NULL), size(0), in(p_in),
+                  offset(0), carry(), next_chunk(0), M() {
+    MUTEX_INIT(&M);
+  }
+
+  ~line_chunks_t() {
+    MUTEX_DESTROY(&M);
+  }
+
+  /**
+   * Take the next chunk and its number, false when there are no more.
+   * A stream chunk is read into buffer, which must stay unchanged while
+   * the chunk is in use.
+   */
+  bool take(std::string& buffer, const char*& begin, const char*& end,
+            size_t& chunk) {
+    MUTEX_LOCK(&M);
+    bool has_chunk;
+    if (in == NULL) {
+      has_chunk = take_memory_chunk(begin, end);
+    } else {
+      has_chunk = take_stream_chunk(buffer, begin, end);
+    }
+    if (has_chunk) {
+      chunk = next_chunk++;
+    }
+    MUTEX_UNLOCK(&M);
+    return has_chunk;
+  }
+};
+
+/**
+ * A message about an invalid line, written when its line number is known.
+ */
+struct line_message_t {
+  std::string head;
+  size_t line_number;   // in the chunk
+  std::string tail;
+  line_message_t(const std::string& p_head, const size_t p_line_number,
+                 const std::string& p_tail) :
+             head(p_head), line_number(p_line_number), tail(p_tail) {
+  }
+};
+
+/**
+ * Write line messages to std::cerr in line order as chunks finish out of
+ * order.  Threadsafe.
+ */
+class line_message_writer_t {
+  private:
+
+  // a chunk that is done, held until its messages may be written
+  struct chunk_result_t {
+    size_t line_count;
+    std::vector<line_message_t> messages;
+    chunk_result_t() : line_count(0), messages() {
+    }
+  };
+
+  size_t next_output;
+  size_t line_number;                    // lines before next_output
+  std::map<size_t, chunk_result_t> pending_results;
+#ifdef HAVE_PTHREAD
+  pthread_mutex_t M;                  // mutext
+#else
+  int M;                              // placeholder
+#endif
+
+  // do not allow copy or assignment
+  line_message_writer_t(const line_message_writer_t&);
+  line_message_writer_t& operator=(const line_message_writer_t&);
+
+  public:
+  line_message_writer_t() : next_output(0), line_number(0),
+                            pending_results(), M() {
+    MUTEX_INIT(&M);
+  }
+
+  ~line_message_writer_t() {
+    MUTEX_DESTROY(&M);
+  }
+
+  // put the result of a chunk and write any messages that are now in
+  // order, messages is taken
+  void put(const size_t chunk, const size_t line_count,
+           std::vector<line_message_t>& messages) {
+    MUTEX_LOCK(&M);
+    chunk_result_t& result = pending_results[chunk];
+    result.line_count = line_count;
+    result.messages.swap(messages);
+    std::map<size_t, chunk_result_t>::iterator it = pending_results.begin();
+    while (it != pending_results.end() && it->first == next_output) {
+      for (std::vector<line_message_t>::const_iterator message =
+                      it->second.messages.begin();
+                      message != it->second.messages.end(); ++message) {
+        std::cerr << message->head << line_number + message->line_number
+                  << message->tail;
+      }
+      line_number += it->second.line_count;
+      pending_results.erase(it++);
+      ++next_output;
+    }
+    MUTEX_UNLOCK(&M);
+  }
+};
+
+/**
+ * Run one thread per CPU that takes chunks and passes their lines to
+ * the importer, writing line messages in line order.  The importer
+ * provides:
+ *   - worker_t, its per-thread state, default constructible.
+ *   - import_line(worker, begin, end, chunk_line_number, messages), to
+ *     import one line, adding any line messages to messages.
+ *   - finish_chunk(worker), called after each chunk is imported.
+ *   - finish(worker), called when the thread has no more chunks.
+ */
+template <typename T>
+class line_chunks_runner_t {
+  private:
+
+  // per-thread state
+  struct thread_state_t {
+    line_chunks_runner_t& runner;
+    typename T::worker_t worker;
+    std::string buffer;                  // chunk read from a stream
+    std::vector<line_message_t> messages;
+    thread_state_t(line_chunks_runner_t& p_runner) :
+              runner(p_runner), worker(), buffer(), messages() {
+    }
+
+    private:
+    // do not allow copy or assignment
+    thread_state_t(const thread_state_t&);
+    thread_state_t& operator=(const thread_state_t&);
+  };
+
+  T& importer;
+  line_chunks_t& chunks;
+  const std::string name;                // for thread error messages
+  line_message_writer_t message_writer;
+
+  // do not allow copy or assignment
+  line_chunks_runner_t(const line_chunks_runner_t&);
+  line_chunks_runner_t& operator=(const line_chunks_runner_t&);
+
+  // import chunks until there are no more
+  static void* run_thread(void* const arg) {
+    thread_state_t& state = *static_cast<thread_state_t*>(arg);
+    line_chunks_runner_t& runner = state.runner;
+    const char* begin;
+    const char* end;
+    size_t chunk;
+    while (runner.chunks.take(state.buffer, begin, end, chunk)) {
+      size_t chunk_line_number = 0;
+      const char* line = begin;
+      while (line != end) {
+        const char* newline = static_cast<const char*>(
+                                     memchr(line, '\n', end - line));
+        const char* const line_end = (newline == NULL) ? end : newline;
+        ++chunk_line_number;
+        runner.importer.import_line(state.worker, line, line_end,
+                                    chunk_line_number, state.messages);
+        line = (newline == NULL) ? end : newline + 1;
+      }
+      runner.importer.finish_chunk(state.worker);
+      runner.message_writer.put(chunk, chunk_line_number, state.messages);
+      state.messages.clear();
+    }
+    runner.importer.finish(state.worker);
+    return NULL;
+  }
+
+  public:
+  line_chunks_runner_t(T& p_importer, line_chunks_t& p_chunks,
+                       const std::string& p_name) :
+                  importer(p_importer), chunks(p_chunks), name(p_name),
+                  message_writer() {
+  }
+
+  // import using one thread per CPU
+  void run() {
+    const int num_cpus = hashdb::numCPU();
+    const size_t num_threads = (num_cpus < 1) ? 1 : num_cpus;
+
+    std::vector<thread_state_t*> states;
+    std::vector<pthread_t> threads(num_threads);
+    for (size_t i=0; i<num_threads; ++i) {
+      states.push_back(new thread_state_t(*this));
+      int rc = pthread_create(&threads[i], NULL, run_thread,
+                              static_cast<void*>(states[i]));
+      if (rc != 0) {
+        std::cerr << "Unable to start " << name << " thread: "
+                  << strerror(rc) << ".\n";
+        assert(0);
+      }
+    }
+
+    // wait for the threads
+    for (size_t i=0; i<num_threads; ++i) {
+      int status = pthread_join(threads[i], NULL);
+      if (status != 0) {
+        std::cerr << "Error in " << name << " thread join: "
+                  << strerror(status) << ".\n";
+      }
+      delete states[i];
+    }
+  }
+};
+
+#endif
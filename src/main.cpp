@@ -86,6 +86,9 @@ static bool has_disable_calculate_labels = false;
 static bool has_json_scan_mode = false;
 static bool has_tuning = false;
 static bool has_part_range = false;
+static bool has_file_hash_cache = false;
+static bool has_num_readers = false;
+static bool has_sample_fraction = false;
 
 // option values
 hashdb::settings_t settings;
@@ -95,6 +98,8 @@ static size_t step_size = settings.block_size;
 static hashdb::scan_mode_t scan_mode = hashdb::scan_mode_t::EXPANDED_OPTIMIZED;
 static std::string begin_block_hash = "";
 static std::string end_block_hash = "";
+static size_t num_readers = 0;
+static double sample_fraction = 0;
 
 // arguments
 static std::string cmd= "";         // the command line invocation text
@@ -199,12 +204,15 @@ int main(int argc,char **argv) {
       {"disable_processing",      required_argument, 0, 'x'},
       {"json_scan_mode",          required_argument, 0, 'j'},
       {"part_range",              required_argument, 0, 'p'},
+      {"file_hash_cache",               no_argument, 0, 'c'},
+      {"readers",                 required_argument, 0, 'n'},
+      {"sample_fraction",         required_argument, 0, 'f'},
 
       // end
       {0,0,0,0}
     };
 
-    int ch = getopt_long(argc, argv, "hHvVb:s:r:w:x:j:m:p:",
+    int ch = getopt_long(argc, argv, "hHvVb:s:r:w:x:j:m:p:cn:f:",
                          long_options, &option_index);
     if (ch == -1) {
       // no more arguments
@@ -300,6 +308,34 @@ int main(int argc,char **argv) {
         break;
       }
 
+      case 'c': {	// file hash cache
+        has_file_hash_cache = true;
+        break;
+      }
+
+      case 'n': {	// number of ingest reader threads
+        has_num_readers = true;
+        const int n = std::atoi(optarg);
+        if (n < 1) {
+          std::cerr << "Error: Invalid number of readers: '"
+                    << optarg << "'.  " << see_usage << "\n";
+          exit(1);
+        }
+        num_readers = n;
+        break;
+      }
+
+      case 'f': {	// fraction of media to sample
+        has_sample_fraction = true;
+        sample_fraction = std::atof(optarg);
+        if (!(sample_fraction > 0 && sample_fraction <= 1)) {
+          std::cerr << "Error: Invalid sample fraction: '"
+                    << optarg << "'.  " << see_usage << "\n";
+          exit(1);
+        }
+        break;
+      }
+
       default:
 //        std::cerr << "unexpected command character " << ch << "\n";
         exit(1);
@@ -391,6 +427,21 @@ void check_options(const std::string& options) {
     std::cerr << "The -p part range option is not allowed for this command.\n";
     exit(1);
   }
+  if (has_file_hash_cache && options.find("c") ==
+      std::string::npos) {
+    std::cerr << "The -c file hash cache option is not allowed for this command.\n";
+    exit(1);
+  }
+  if (has_num_readers && options.find("n") ==
+      std::string::npos) {
+    std::cerr << "The -n readers option is not allowed for this command.\n";
+    exit(1);
+  }
+  if (has_sample_fraction && options.find("f") ==
+      std::string::npos) {
+    std::cerr << "The -f sample fraction option is not allowed for this command.\n";
+    exit(1);
+  }
 }
 
 void check_params(const std::string& options, size_t param_count) {
@@ -412,7 +463,7 @@ void run_command() {
 
   // import
   } else if (command == "ingest") {
-    check_params("srwREL", 2);
+    check_params("srwRELcn", 2);
     if (repository_name == "") {
       repository_name = args[1];
     }
@@ -421,6 +472,8 @@ void run_command() {
              has_disable_recursive_processing,
              has_disable_calculate_entropy,
              has_disable_calculate_labels,
+             has_file_hash_cache,
+             num_readers,
              cmd);
 
   } else if (command == "import_tab") {
@@ -443,6 +496,14 @@ void run_command() {
       commands::export_json(args[0], args[1], cmd);
     }
 
+  } else if (command == "import_binary") {
+    check_params("", 2);
+    commands::import_binary(args[0], args[1], cmd);
+
+  } else if (command == "export_binary") {
+    check_params("", 2);
+    commands::export_binary(args[0], args[1], cmd);
+
   // database manipulation
   } else if (command == "add") {
     check_params("", 2);
@@ -499,6 +560,14 @@ void run_command() {
     check_params("", 3);
     commands::subtract_repository(args[0], args[1], args[2], cmd);
 
+  } else if (command == "index_sources") {
+    check_params("", 1);
+    commands::index_sources(args[0], cmd);
+
+  } else if (command == "upgrade") {
+    check_params("", 1);
+    commands::upgrade(args[0], cmd);
+
   // scan
   } else if (command == "scan_list") {
     check_params("j", 2);
@@ -509,9 +578,10 @@ void run_command() {
     commands::scan_hash(args[0], args[1], scan_mode, cmd);
 
   } else if (command == "scan_media") {
-    check_params("sRj", 2);
+    check_params("sRjf", 2);
     commands::scan_media(args[0], args[1], step_size,
-                         has_disable_recursive_processing, scan_mode, cmd);
+                         has_disable_recursive_processing, scan_mode,
+                         sample_fraction, cmd);
 
   // statistics
   } else if (command == "size") {
@@ -21,7 +21,7 @@
  * \file
  * Track progress to show that long iterative actions are not hung.
  * Writes progress to cout and to <dir>/timestamp.json log.
- * Use total=0 if total is not known.
+ * Use total=0 if total is not known.  Tracking is threadsafe.
  */
 
 #ifndef PROGRESS_TRACKER_HPP
@@ -36,6 +36,10 @@
 #include <iostream>
 #include <fstream>
 #include "../src_libhashdb/hashdb.hpp" // for timestamp
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#include "../src_libhashdb/mutex_lock.hpp"
 
 class progress_tracker_t {
   private:
@@ -44,6 +48,11 @@ class progress_tracker_t {
   uint64_t index;
   std::ofstream os;
   hashdb::timestamp_t timestamp;
+#ifdef HAVE_PTHREAD
+  pthread_mutex_t M;                  // mutext
+#else
+  int M;                              // placeholder
+#endif
 
   // do not allow copy or assignment
   progress_tracker_t(const progress_tracker_t&);
@@ -58,7 +67,8 @@ class progress_tracker_t {
       // total is not known
       ss << "# Processing " << index << " of ?";
     }
-    std::cout << ss.str() << "..." << std::endl;
+    // one write so that lines from other threads do not split it
+    std::cout << ss.str() + "...\n" << std::flush;
     os << timestamp.stamp(ss.str()) << std::endl;
   }
 
@@ -69,7 +79,9 @@ class progress_tracker_t {
                          total(p_total),
                          index(0),
                          os(),
-                         timestamp() {
+                         timestamp(),
+                         M() {
+    MUTEX_INIT(&M);
     std::string filename(dir+"/timestamp.json");
 
     // open, fatal if unable to open
@@ -86,18 +98,22 @@ class progress_tracker_t {
   }
 
   void track() {
+    MUTEX_LOCK(&M);
     ++index;
     if (index%100000 == 0) {
       show_progress();
     }
+    MUTEX_UNLOCK(&M);
   }
 
   void track_count(const size_t count) {
+    MUTEX_LOCK(&M);
     size_t old_index = index;
     index += count;
     if ((index > 0) && (index / 100000 > old_index / 100000)) {
       show_progress();
     }
+    MUTEX_UNLOCK(&M);
   }
 
   void track_hash_data(const uint64_t count) {
@@ -119,6 +135,7 @@ class progress_tracker_t {
     os << timestamp.stamp(ss.str()) << std::endl;
 
     os.close();
+    MUTEX_DESTROY(&M);
   }
 };
 
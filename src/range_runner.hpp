@@ -0,0 +1,345 @@
+// Author:  Bruce Allen
+// Created: 2/25/2013
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on February 25, 2013 by Bruce Allen.
+
+/**
+ * \file
+ * Walk the block hash or file hash key space in parallel.  The key
+ * space is split into ranges by hash prefix, and each worker thread
+ * takes the next unprocessed range and walks it with its own cursor,
+ * and so its own read transaction.  Hashes are digests, so ranges of
+ * equal prefix width hold about the same number of hashes.
+ *
+ * Output that a worker writes for a range is written to the output
+ * stream in range order, so parallel output matches serial output.
+ * Workers may run only a bounded number of ranges ahead of the oldest
+ * range not yet written, which bounds memory used for pending output.
+ *
+ * Workers that write to a database may stage their changes for a range
+ * in run() and apply them in commit().  When commit is requested, the
+ * runner calls commit() in range order, one range at a time, so the
+ * database is changed the same way as by a serial walk.
+ */
+
+#ifndef RANGE_RUNNER_HPP
+#define RANGE_RUNNER_HPP
+
+#include "../src_libhashdb/hashdb.hpp"
+#include "../src_libhashdb/num_cpus.hpp"
+#include "../src_libhashdb/mutex_lock.hpp"
+
+// Standard includes
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <vector>
+#include <map>
+#include <stdint.h>
+#include <pthread.h>
+
+/**
+ * The block hashes, or file hashes, in [begin_hash, end_hash).  An
+ * empty end_hash leaves the end of the range open.
+ */
+class hash_range_t {
+  public:
+  const std::string begin_hash;
+  const std::string end_hash;
+
+  // all hashes, hashes are never empty so begin at "\0"
+  hash_range_t() : begin_hash(1, '\0'), end_hash() {
+  }
+
+  hash_range_t(const std::string& p_begin_hash,
+               const std::string& p_end_hash) :
+                  begin_hash(p_begin_hash), end_hash(p_end_hash) {
+  }
+
+  // move the cursor to the first hash in the range
+  void start(hashdb::hash_cursor_t& cursor) const {
+    cursor.seek(begin_hash);
+  }
+
+  void start(hashdb::source_cursor_t& cursor) const {
+    cursor.seek(begin_hash);
+  }
+
+  // true while the cursor is on a hash in the range
+  bool contains(const hashdb::hash_cursor_t& cursor) const {
+    return !cursor.at_end() && before_end(cursor.block_hash());
+  }
+
+  bool contains(const hashdb::source_cursor_t& cursor) const {
+    return !cursor.at_end() && before_end(cursor.file_hash());
+  }
+
+  private:
+  bool before_end(const std::string& hash) const {
+    return end_hash.size() == 0 || hash < end_hash;
+  }
+};
+
+/**
+ * A worker processes one range at a time on its own thread.  Give each
+ * worker its own cursor and its own partial results; the caller
+ * combines the partial results after run() returns.
+ */
+class range_worker_t {
+  public:
+  virtual ~range_worker_t() {
+  }
+
+  // process the hashes in range, writing any ordered output to os
+  virtual void run(const hash_range_t& range, std::ostream& os) = 0;
+
+  // apply what run() staged for its range
+  virtual void commit() {
+  }
+};
+
+class range_runner_t {
+  private:
+  static const uint64_t hashes_per_range = 16384;
+  static const uint64_t max_ranges = 1 << 24;   // three-byte prefixes
+  static const size_t ranges_per_worker = 4;   // how far workers run ahead
+
+  const std::vector<range_worker_t*>& workers;
+  std::ostream* const os;
+  const bool commit_in_order;
+  const uint64_t num_ranges;
+
+  // shared state
+  uint64_t next_range;
+  uint64_t next_output;
+  uint64_t next_commit;
+  std::map<uint64_t, std::string> pending_output;
+#ifdef HAVE_PTHREAD
+  pthread_mutex_t M;                  // mutext
+  pthread_cond_t C;                   // signals output or commit progress
+#else
+  int M;                              // placeholder
+  int C;                              // placeholder
+#endif
+
+  struct thread_data_t {
+    range_runner_t* runner;
+    range_worker_t* worker;
+    thread_data_t(range_runner_t* const p_runner,
+                  range_worker_t* const p_worker) :
+                       runner(p_runner), worker(p_worker) {
+    }
+  };
+
+  // do not allow copy or assignment
+  range_runner_t(const range_runner_t&);
+  range_runner_t& operator=(const range_runner_t&);
+
+  // range i begins at the three-byte prefix i * 2^24 / num_ranges
+  std::string range_begin(const uint64_t i) const {
+    if (i == 0) {
+      return hash_range_t().begin_hash;
+    }
+    const uint64_t prefix = (i << 24) / num_ranges;
+    std::string hash(3, '\0');
+    hash[0] = static_cast<char>((prefix >> 16) & 0xff);
+    hash[1] = static_cast<char>((prefix >> 8) & 0xff);
+    hash[2] = static_cast<char>(prefix & 0xff);
+    return hash;
+  }
+
+  std::string range_end(const uint64_t i) const {
+    return (i + 1 == num_ranges) ? "" : range_begin(i + 1);
+  }
+
+  static uint64_t calculate_num_ranges(const uint64_t total_hashes,
+                                       const size_t num_workers) {
+    uint64_t n = total_hashes / hashes_per_range;
+    if (n < num_workers) {
+      n = num_workers;
+    }
+    if (n > max_ranges) {
+      n = max_ranges;
+    }
+    return (n == 0) ? 1 : n;
+  }
+
+  // wait for output or commit progress, call under lock
+  void wait_for_progress() {
+#ifdef HAVE_PTHREAD
+    pthread_cond_wait(&C, &M);
+#endif
+  }
+
+  // wake threads waiting for progress, call under lock
+  void signal_progress() {
+#ifdef HAVE_PTHREAD
+    pthread_cond_broadcast(&C);
+#endif
+  }
+
+  // take the next range, false when there are no more
+  bool take_range(uint64_t& range) {
+    MUTEX_LOCK(&M);
+
+    // when too far ahead of the output, let the oldest range finish
+    while (os != NULL && next_range < num_ranges &&
+           next_range >= next_output + workers.size() * ranges_per_worker) {
+      wait_for_progress();
+    }
+
+    const bool has_range = next_range < num_ranges;
+    if (has_range) {
+      range = next_range;
+      ++next_range;
+    }
+    MUTEX_UNLOCK(&M);
+    return has_range;
+  }
+
+  // put the output of a range and write any output that is now in order
+  void put_output(const uint64_t range, const std::string& output) {
+    MUTEX_LOCK(&M);
+    pending_output[range] = output;
+    std::map<uint64_t, std::string>::iterator it = pending_output.begin();
+    while (it != pending_output.end() && it->first == next_output) {
+      *os << it->second;
+      pending_output.erase(it++);
+      ++next_output;
+      signal_progress();
+    }
+    MUTEX_UNLOCK(&M);
+  }
+
+  // commit the staged range once every earlier range is committed
+  void commit_range(const uint64_t range, range_worker_t* const worker) {
+    MUTEX_LOCK(&M);
+    while (range != next_commit) {
+      wait_for_progress();
+    }
+    MUTEX_UNLOCK(&M);
+
+    // only this thread may commit now
+    worker->commit();
+
+    MUTEX_LOCK(&M);
+    ++next_commit;
+    signal_progress();
+    MUTEX_UNLOCK(&M);
+  }
+
+  static void* run_worker(void* const arg) {
+    thread_data_t* const thread_data = static_cast<thread_data_t*>(arg);
+    range_runner_t& runner = *thread_data->runner;
+    std::stringstream ss;
+    uint64_t range;
+    while (runner.take_range(range)) {
+      ss.str("");
+      thread_data->worker->run(hash_range_t(runner.range_begin(range),
+                                            runner.range_end(range)), ss);
+      if (runner.os != NULL) {
+        runner.put_output(range, ss.str());
+      }
+      if (runner.commit_in_order) {
+        runner.commit_range(range, thread_data->worker);
+      }
+    }
+    return NULL;
+  }
+
+  public:
+  /**
+   * Prepare to walk a key space of total_hashes hashes with the given
+   * workers, writing ordered output to os, or NULL for no output.  If
+   * p_commit_in_order, call each worker's commit() after it runs a
+   * range, in range order.
+   */
+  range_runner_t(const std::vector<range_worker_t*>& p_workers,
+                 const uint64_t total_hashes,
+                 std::ostream* const p_os,
+                 const bool p_commit_in_order = false) :
+                  workers(p_workers),
+                  os(p_os),
+                  commit_in_order(p_commit_in_order),
+                  num_ranges(calculate_num_ranges(total_hashes,
+                                                  p_workers.size())),
+                  next_range(0),
+                  next_output(0),
+                  next_commit(0),
+                  pending_output(),
+                  M(),
+                  C() {
+    MUTEX_INIT(&M);
+#ifdef HAVE_PTHREAD
+    pthread_cond_init(&C, NULL);
+#endif
+  }
+
+  ~range_runner_t() {
+#ifdef HAVE_PTHREAD
+    pthread_cond_destroy(&C);
+#endif
+    MUTEX_DESTROY(&M);
+  }
+
+  /**
+   * The number of workers to use, one per CPU.  Stores size their LMDB
+   * reader tables for the read transactions of one worker per CPU, see
+   * lmdb_helper::open_env.
+   */
+  static size_t num_workers() {
+    const int n = hashdb::numCPU();
+    return (n < 1) ? 1 : static_cast<size_t>(n);
+  }
+
+  /**
+   * Run the workers over every range and wait for them to finish.
+   */
+  void run() {
+    std::vector<thread_data_t> thread_data;
+    for (size_t i=0; i<workers.size(); ++i) {
+      thread_data.push_back(thread_data_t(this, workers[i]));
+    }
+
+    // start one thread per worker
+    std::vector<pthread_t> threads(workers.size());
+    for (size_t i=0; i<workers.size(); ++i) {
+      int rc = pthread_create(&threads[i], NULL, run_worker,
+                              static_cast<void*>(&thread_data[i]));
+      if (rc != 0) {
+        std::cerr << "Unable to start range thread: "
+                  << strerror(rc) << ".\n";
+        assert(0);
+      }
+    }
+
+    // wait for the threads
+    for (size_t i=0; i<workers.size(); ++i) {
+      int status = pthread_join(threads[i], NULL);
+      if (status != 0) {
+        std::cerr << "Error in range thread join: "
+                  << strerror(status) << ".\n";
+      }
+    }
+  }
+};
+
+#endif
+
@@ -47,10 +47,12 @@ void overview() {
   << "\n"
   << "Import/Export:\n"
   << "  ingest [-r <repository name>] [-w <whitelist.hdb>] [-s <step size>]\n"
-  << "         [-x <rel>] <hashdb.hdb> <import directory>\n"
+  << "         [-x <rel>] [-c] [-n <readers>] <hashdb.hdb> <import directory>\n"
   << "  import_tab [-r <repository name>] [-w <whitelist.hdb>] <hashdb> <tab file>\n"
   << "  import <hashdb> <json file>\n"
   << "  export [-p <begin:end>] <hashdb> <json file>\n"
+  << "  import_binary <hashdb> <binary file>\n"
+  << "  export_binary <hashdb> <binary file>\n"
   << "\n"
   << "Database Manipulation:\n"
   << "  add <source hashdb> <destination hashdb>\n"
@@ -62,11 +64,14 @@ void overview() {
   << "  subtract <source hashdb 1> <source hashdb 2> <destination hashdb>\n"
   << "  subtract_hash <source hashdb 1> <source hashdb 2> <destination hashdb>\n"
   << "  subtract_repository <source hashdb> <destination hashdb> <repository name>\n"
+  << "  index_sources <hashdb>\n"
+  << "  upgrade <hashdb>\n"
   << "\n"
   << "Scan:\n"
   << "  scan_list [-j e|o|c|a] <hashdb> <hash list file>\n"
   << "  scan_hash [-j e|o|c|a] <hashdb> <hex block hash>\n"
-  << "  scan_media [-s <step size>] [-j e|o|c|a] [-x <r>] <hashdb> <media image>\n"
+  << "  scan_media [-s <step size>] [-j e|o|c|a] [-x <r>] [-f <fraction>]\n"
+  << "             <hashdb> <media image>\n"
   << "\n"
   << "Statistics:\n"
   << "  size <hashdb>\n"
@@ -108,7 +113,7 @@ static void create() {
 static void ingest() {
   std::cout
   << "ingest [-r <repository name>] [-w <whitelist.hdb>] [-s <step size>]\n"
-  << "       [-x <rel>] <hashdb.hdb> <import directory>\n"
+  << "       [-x <rel>] [-c] [-n <readers>] <hashdb.hdb> <import directory>\n"
   << "  Import hashes recursively from <import directory> into hash database\n"
   << "    <hashdb>.\n"
   << "\n"
@@ -126,6 +131,14 @@ static void ingest() {
   << "      r disables recursively processing embedded data.\n"
   << "      e disables calculating entropy.\n"
   << "      l disables calculating block labels.\n"
+  << "  -c, --file_hash_cache\n"
+  << "    Remember the file hash of each file in <hashdb> and do not read\n"
+  << "    files again that are unchanged since they were ingested with the\n"
+  << "    same repository name.  A file is unchanged when its path, device,\n"
+  << "    inode, size, and modification time are the same.\n"
+  << "  -n, --readers=<readers>\n"
+  << "    The number of threads reading files (default is one per CPU).\n"
+  << "    Source names are recorded in the same order for any number.\n"
   << "\n"
   << "  Parameters:\n"
   << "  <import dir>   the directory to recursively import from\n"
@@ -179,6 +192,31 @@ static void export_json() {
   ;
 }
 
+static void import_binary() {
+  std::cout
+  << "import_binary <hashdb> <binary file>\n"
+  << "  Import hashes from file <binary file> written by export_binary into\n"
+  << "  hash database <hashdb>.  Use \"-\" to read from stdin.\n"
+  << "\n"
+  << "  Parameters:\n"
+  << "  <hashdb>       the hash database to insert the imported hashes into\n"
+  << "  <binary file>  the binary file to import hashes from\n"
+  ;
+}
+
+static void export_binary() {
+  std::cout
+  << "export_binary <hashdb> <binary file>\n"
+  << "  Export hashes and sources from hash database <hashdb> into file\n"
+  << "  <binary file> in a compact checksummed binary format.  Use \"-\" to\n"
+  << "  write to stdout, for example to pipe into compression.\n"
+  << "\n"
+  << "  Parameters:\n"
+  << "  <hashdb>       the hash database to export\n"
+  << "  <binary file>  the binary file to export the hash database into\n"
+  ;
+}
+
 // Database Manipulation
 static void add() {
   std::cout
@@ -195,7 +233,9 @@ static void add_multiple() {
   std::cout
   << "add_multiple <source hashdb 1> <source hashdb 2> <destination hashdb>\n"
   << "  Perform a union add of <source hashdb 1> and <source hashdb 2>\n"
-  << "  into the <destination hashdb>.\n"
+  << "  into the <destination hashdb>.  If a source has a different sub_count\n"
+  << "  for a block hash in more than one source database, the sub_count from\n"
+  << "  the database listed first is kept.\n"
   << "\n"
   << "  Parameters:\n"
   << "  <source hashdb 1>     a hash database to copy hashes from\n"
@@ -310,6 +350,34 @@ static void subtract_repository() {
   ;
 }
 
+static void index_sources() {
+  std::cout
+  << "index_sources <hashdb>\n"
+  << "  Build the indexes from each source to its hashes and from each\n"
+  << "  repository name to its sources in the <hashdb> database.  The indexes\n"
+  << "  speed up hash_table and add_repository but add a write for each\n"
+  << "  source of each hash added, so databases do not have them until this\n"
+  << "  command builds them.  Once built, they are kept up to date as hashes\n"
+  << "  are added.\n"
+  << "\n"
+  << "  Parameters:\n"
+  << "  <hashdb>       the hash database to index\n"
+  ;
+}
+
+static void upgrade() {
+  std::cout
+  << "upgrade <hashdb>\n"
+  << "  Upgrade the <hashdb> database created by the previous version of hashdb\n"
+  << "  to the current version.  Hashes with many sources are rewritten so\n"
+  << "  that adding sources to them stays fast.  An interrupted upgrade may be\n"
+  << "  run again.\n"
+  << "\n"
+  << "  Parameters:\n"
+  << "  <hashdb>       the hash database to upgrade\n"
+  ;
+}
+
 static void scan_list() {
   std::cout
   << "scan_list [-j e|o|c|a] <hashdb> <hash list file>\n"
@@ -359,7 +427,8 @@ void scan_hash() {
 
 void scan_media() {
   std::cout
-  << "scan_media [-s <step size>] [-j e|o|c|a] [-x <r>] <hashdb> <media image>\n"
+  << "scan_media [-s <step size>] [-j e|o|c|a] [-x <r>] [-f <fraction>]\n"
+  << "           <hashdb> <media image>\n"
   << "  Scan hash database <hashdb> for hashes in <media image> and print out\n"
   << "  matches.\n"
   << "\n"
@@ -376,6 +445,11 @@ void scan_media() {
   << "  -x, --disable_processing\n"
   << "    Disable further processing:\n"
   << "      r disables recursively processing embedded data.\n"
+  << "  -f, --sample_fraction\n"
+  << "    Scan a sample of about this fraction of the media for triage, for\n"
+  << "    example 0.01.  One 64KiB sample is taken at random from each stretch\n"
+  << "    of the media, neighbors of samples with matches are also scanned,\n"
+  << "    and the number of matching blocks in the media is estimated.\n"
   << "\n"
   << "  Parameters:\n"
   << "  <hashdb>          the file path to the hash database to use as the\n"
@@ -594,6 +668,8 @@ static void all() {
   import_tab();
   import();
   export_json();
+  import_binary();
+  export_binary();
 
   // Database Manipulation
   std::cout << "\nDatabase Manipulation:\n";
@@ -606,6 +682,8 @@ static void all() {
   subtract();
   subtract_hash();
   subtract_repository();
+  index_sources();
+  upgrade();
 
   // Scan
   std::cout << "\nScan:\n";
@@ -645,6 +723,8 @@ void usage(const std::string& command) {
   else if (command == "import_tab") import_tab();
   else if (command == "import") import();
   else if (command == "export") export_json();
+  else if (command == "import_binary") import_binary();
+  else if (command == "export_binary") export_binary();
 
   // Database Manipulation
   else if (command == "add") add();
@@ -656,6 +736,8 @@ void usage(const std::string& command) {
   else if (command == "subtract") subtract();
   else if (command == "subtract_hash") subtract_hash();
   else if (command == "subtract_repository") subtract_repository();
+  else if (command == "index_sources") index_sources();
+  else if (command == "upgrade") upgrade();
 
   // Scan
   else if (command == "scan_list") scan_list();
@@ -0,0 +1,281 @@
+// Author:  Bruce Allen
+// Created: 2/25/2013
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on February 25, 2013 by Bruce Allen.
+
+/**
+ * \file
+ * Provide a threadsafe bounded cache of find_hash_json results keyed by
+ * scan mode and block hash.
+ *
+ * Entries are spread across locked shards.  Each shard holds at most
+ * its share of max_bytes of keys and values and evicts entries using
+ * the CLOCK policy.  A max_bytes value of zero disables caching.
+ */
+
+#ifndef HASH_RESULT_CACHE_HPP
+#define HASH_RESULT_CACHE_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <stdint.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#include "mutex_lock.hpp"
+
+namespace hashdb {
+
+class hash_result_cache_t {
+
+  public:
+  static const size_t num_modes = 4;          // one per scan_mode_t
+
+  private:
+  static const size_t num_shards = 64;        // power of 2
+  static const size_t entry_overhead = 96;    // approximate bytes/entry
+
+  struct entry_t {
+    std::string key;                          // mode byte + block_hash
+    std::string value;
+    bool referenced;
+    entry_t() : key(), value(), referenced(false) {
+    }
+  };
+
+  typedef std::map<std::string, size_t> index_t;
+
+  struct shard_t {
+#ifdef HAVE_PTHREAD
+    pthread_mutex_t M;                        // mutext
+#else
+    int M;                                    // placeholder
+#endif
+    std::vector<entry_t> entries;             // CLOCK ring
+    std::vector<size_t> free_entries;
+    index_t index;
+    size_t hand;
+    size_t bytes;
+    uint64_t hits[num_modes];
+    uint64_t misses[num_modes];
+    uint64_t evictions;
+    shard_t() : M(), entries(), free_entries(), index(), hand(0), bytes(0),
+                hits(), misses(), evictions(0) {
+    }
+  };
+
+  const size_t max_bytes;
+  const size_t max_shard_bytes;
+  shard_t* shards;
+
+  // do not allow copy or assignment
+  hash_result_cache_t(const hash_result_cache_t&);
+  hash_result_cache_t& operator=(const hash_result_cache_t&);
+
+  static std::string make_key(const size_t mode,
+                              const std::string& block_hash) {
+    std::string key(1, static_cast<char>(mode));
+    key += block_hash;
+    return key;
+  }
+
+  shard_t& shard_for(const std::string& block_hash) const {
+    uint32_t h = 2166136261u;
+    for (size_t i=0; i<block_hash.size(); ++i) {
+      h ^= static_cast<uint8_t>(block_hash[i]);
+      h *= 16777619u;
+    }
+    return shards[h & (num_shards - 1)];
+  }
+
+  static size_t entry_bytes(const entry_t& entry) {
+    return entry.key.size() + entry.value.size() + entry_overhead;
+  }
+
+  // evict one entry using the CLOCK policy, shard must not be empty
+  static void evict(shard_t& shard) {
+    while (true) {
+      if (shard.hand >= shard.entries.size()) {
+        shard.hand = 0;
+      }
+      entry_t& entry = shard.entries[shard.hand];
+      if (entry.key.size() != 0) {
+        if (entry.referenced) {
+          // second chance
+          entry.referenced = false;
+        } else {
+          shard.bytes -= entry_bytes(entry);
+          shard.index.erase(entry.key);
+          entry.key.clear();
+          entry.value.clear();
+          shard.free_entries.push_back(shard.hand);
+          ++shard.evictions;
+          ++shard.hand;
+          return;
+        }
+      }
+      ++shard.hand;
+    }
+  }
+
+  public:
+  hash_result_cache_t(const size_t p_max_bytes) :
+                max_bytes(p_max_bytes),
+                max_shard_bytes(p_max_bytes / num_shards),
+                shards(new shard_t[num_shards]) {
+    for (size_t i=0; i<num_shards; ++i) {
+      MUTEX_INIT(&shards[i].M);
+    }
+  }
+
+  ~hash_result_cache_t() {
+    for (size_t i=0; i<num_shards; ++i) {
+      MUTEX_DESTROY(&shards[i].M);
+    }
+    delete[] shards;
+  }
+
+  // true if caching is enabled
+  bool enabled() const {
+    return max_bytes != 0;
+  }
+
+  // find cached result, false if not cached
+  bool find(const size_t mode, const std::string& block_hash,
+            std::string& value) const {
+    if (max_bytes == 0) {
+      return false;
+    }
+    const std::string key = make_key(mode, block_hash);
+    shard_t& shard = shard_for(block_hash);
+    MUTEX_LOCK(&shard.M);
+    index_t::const_iterator it = shard.index.find(key);
+    const bool found = (it != shard.index.end());
+    if (found) {
+      entry_t& entry = shard.entries[it->second];
+      entry.referenced = true;
+      value = entry.value;
+      ++shard.hits[mode];
+    } else {
+      ++shard.misses[mode];
+    }
+    MUTEX_UNLOCK(&shard.M);
+    return found;
+  }
+
+  // cache result, replacing any existing result
+  void insert(const size_t mode, const std::string& block_hash,
+              const std::string& value) {
+    if (max_bytes == 0) {
+      return;
+    }
+    const std::string key = make_key(mode, block_hash);
+    const size_t new_bytes = key.size() + value.size() + entry_overhead;
+    if (new_bytes > max_shard_bytes) {
+      // too large to cache
+      return;
+    }
+
+    shard_t& shard = shard_for(block_hash);
+    MUTEX_LOCK(&shard.M);
+
+    // skip if already there, another thread got here first
+    if (shard.index.find(key) != shard.index.end()) {
+      MUTEX_UNLOCK(&shard.M);
+      return;
+    }
+
+    // make room
+    while (shard.bytes + new_bytes > max_shard_bytes) {
+      evict(shard);
+    }
+
+    // place the new entry
+    size_t i;
+    if (shard.free_entries.size() != 0) {
+      i = shard.free_entries.back();
+      shard.free_entries.pop_back();
+    } else {
+      i = shard.entries.size();
+      shard.entries.push_back(entry_t());
+    }
+    entry_t& entry = shard.entries[i];
+    entry.key = key;
+    entry.value = value;
+    entry.referenced = false;
+    shard.index[key] = i;
+    shard.bytes += new_bytes;
+    MUTEX_UNLOCK(&shard.M);
+  }
+
+  // configured maximum number of bytes
+  size_t capacity() const {
+    return max_bytes;
+  }
+
+  // number of cached results
+  size_t size() const {
+    size_t total = 0;
+    for (size_t i=0; i<num_shards; ++i) {
+      MUTEX_LOCK(&shards[i].M);
+      total += shards[i].index.size();
+      MUTEX_UNLOCK(&shards[i].M);
+    }
+    return total;
+  }
+
+  // approximate number of bytes used by cached results
+  size_t bytes() const {
+    size_t total = 0;
+    for (size_t i=0; i<num_shards; ++i) {
+      MUTEX_LOCK(&shards[i].M);
+      total += shards[i].bytes;
+      MUTEX_UNLOCK(&shards[i].M);
+    }
+    return total;
+  }
+
+  // lookup statistics for a scan mode
+  void stats(const size_t mode, uint64_t& hits, uint64_t& misses) const {
+    hits = 0;
+    misses = 0;
+    for (size_t i=0; i<num_shards; ++i) {
+      MUTEX_LOCK(&shards[i].M);
+      hits += shards[i].hits[mode];
+      misses += shards[i].misses[mode];
+      MUTEX_UNLOCK(&shards[i].M);
+    }
+  }
+
+  // number of evicted results
+  uint64_t evictions() const {
+    uint64_t total = 0;
+    for (size_t i=0; i<num_shards; ++i) {
+      MUTEX_LOCK(&shards[i].M);
+      total += shards[i].evictions;
+      MUTEX_UNLOCK(&shards[i].M);
+    }
+    return total;
+  }
+};
+
+} // end namespace hashdb
+
+#endif
+
@@ -32,6 +32,8 @@
 
 #include <string>
 #include <set>
+#include <vector>
+#include <cstring>
 #include <stdint.h>
 #include <sys/time.h>   // timeval* for timestamp_t
 #include <pthread.h>    // pthread_t* for scan_stream_t
@@ -54,9 +56,16 @@ namespace hashdb {
   class lmdb_source_data_manager_t;
   class lmdb_source_id_manager_t;
   class lmdb_source_name_manager_t;
+  class lmdb_source_hash_manager_t;
+  class lmdb_repository_manager_t;
   class lmdb_changes_t;
   class logger_t;
   class locked_member_t;
+  class source_data_cache_t;
+  class hash_result_cache_t;
+  class lmdb_hash_data_cursor_t;
+  class lmdb_source_id_cursor_t;
+  class json_record_reader_t;
 
   // ************************************************************
   // version of the hashdb library
@@ -85,6 +94,187 @@ namespace hashdb {
   };
   typedef std::set<source_sub_count_t> source_sub_counts_t;
 
+#ifndef SWIG
+  /**
+   * A block hash to insert for a source using
+   * import_manager_t::insert_hashes.
+   */
+  struct hash_insert_t {
+    std::string block_hash;
+    uint64_t k_entropy;
+    std::string block_label;
+    std::string file_hash;
+    hash_insert_t(const std::string& p_block_hash,
+                  const uint64_t p_k_entropy,
+                  const std::string& p_block_label,
+                  const std::string& p_file_hash);
+  };
+
+  /**
+   * A block hash to merge with its sources using
+   * import_manager_t::merge_hashes.
+   */
+  struct hash_merge_t {
+    std::string block_hash;
+    uint64_t k_entropy;
+    std::string block_label;
+    std::vector<std::pair<std::string, uint64_t> > file_hash_sub_counts;
+    hash_merge_t();
+  };
+#endif
+
+  /**
+   * Reusable result for scan_manager_t::find_hash.  Storage grows as
+   * needed and is kept between lookups so that repeated lookups into
+   * the same hash_result_t do not allocate.  Sources are ordered by
+   * file hash.
+   */
+  class hash_result_t {
+    private:
+    friend class scan_manager_t;
+    friend class hash_cursor_t;
+    struct source_t {
+      std::string file_hash;
+      uint64_t sub_count;
+      source_t() : file_hash(), sub_count(0) {
+      }
+      bool operator<(const source_t& that) const {
+        return file_hash < that.file_hash;
+      }
+    };
+    std::vector<source_t> sources;
+    size_t num_sources;
+    std::vector<std::pair<uint64_t, uint64_t> > source_id_sub_counts;
+
+    public:
+    uint64_t k_entropy;
+    std::string block_label;
+    uint64_t count;
+
+    hash_result_t() : sources(), num_sources(0), source_id_sub_counts(),
+                      k_entropy(0), block_label(), count(0) {
+    }
+
+    /**
+     * Clear the result, keeping storage.
+     */
+    void clear() {
+      num_sources = 0;
+      source_id_sub_counts.clear();
+      k_entropy = 0;
+      block_label.clear();
+      count = 0;
+    }
+
+    /**
+     * The number of sources associated with the hash.
+     */
+    size_t size() const {
+      return num_sources;
+    }
+
+    /**
+     * The file hash of source i.
+     */
+    const std::string& file_hash(const size_t i) const {
+      return sources[i].file_hash;
+    }
+
+    /**
+     * The sub_count of source i.
+     */
+    uint64_t sub_count(const size_t i) const {
+      return sources[i].sub_count;
+    }
+  };
+
+  /**
+   * A block or file hash of up to max_size bytes, stored inline.
+   * Unlike std::string, hash_key_t does not allocate, and it compares
+   * and hashes without indirection.  Keys are ordered the same as the
+   * equivalent std::string values.  Hashes longer than max_size are a
+   * usage error.
+   */
+  class hash_key_t {
+    public:
+    static constexpr size_t max_size = 64;  // sized for up to SHA-512
+
+    private:
+    uint8_t key_size;
+    char key[max_size];                     // zero past key_size
+    [[noreturn]] static void size_error(const size_t size);
+
+    public:
+    constexpr hash_key_t() : key_size(0), key() {
+    }
+
+    hash_key_t(const char* const p, const size_t size) :
+                                          key_size(0), key() {
+      assign(p, size);
+    }
+
+    explicit hash_key_t(const std::string& hash) : key_size(0), key() {
+      assign(hash.data(), hash.size());
+    }
+
+    void assign(const char* const p, const size_t size) {
+      if (size > max_size) {
+        size_error(size);
+      }
+      if (size < key_size) {
+        std::memset(key + size, 0, key_size - size);
+      }
+      std::memcpy(key, p, size);
+      key_size = static_cast<uint8_t>(size);
+    }
+
+    constexpr size_t size() const {
+      return key_size;
+    }
+
+    constexpr bool empty() const {
+      return key_size == 0;
+    }
+
+    const char* data() const {
+      return key;
+    }
+
+    std::string to_string() const {
+      return std::string(key, key_size);
+    }
+
+    /**
+     * Hash of the key, for use in hash tables.
+     */
+    size_t hash() const {
+      uint64_t h = 0x9E3779B97F4A7C15ULL ^ key_size;
+      for (size_t i=0; i<key_size; i+=8) {
+        uint64_t word;
+        std::memcpy(&word, key + i, sizeof(word));
+        h = (h ^ word) * 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 32;
+      }
+      return static_cast<size_t>(h);
+    }
+
+    bool operator==(const hash_key_t& that) const {
+      return key_size == that.key_size &&
+             std::memcmp(key, that.key, key_size) == 0;
+    }
+
+    bool operator!=(const hash_key_t& that) const {
+      return !(*this == that);
+    }
+
+    bool operator<(const hash_key_t& that) const {
+      const size_t min_size =
+                 (key_size < that.key_size) ? key_size : that.key_size;
+      const int result = std::memcmp(key, that.key, min_size);
+      return (result != 0) ? (result < 0) : (key_size < that.key_size);
+    }
+  };
+
   // pair(repository_name, filename)
   typedef std::pair<std::string, std::string> source_name_t;
   typedef std::set<source_name_t>             source_names_t;
@@ -99,13 +289,19 @@ namespace hashdb {
    * Attributes:
    *   settings_version - The version of the settings record
    *   block_size - Size, in bytes, of data blocks.
+   *   source_index - True when the source indexes are complete.  Set
+   *     it to create a new hashdb with the source indexes.
    */
   struct settings_t {
 #ifndef SWIG
-    static const uint32_t CURRENT_SETTINGS_VERSION = 4;
+    static const uint32_t CURRENT_SETTINGS_VERSION = 5;
+
+    // the earlier settings version that upgrade_hashdb can upgrade
+    static const uint32_t UPGRADABLE_SETTINGS_VERSION = 4;
 #endif
     uint32_t settings_version;
     uint32_t block_size;
+    bool source_index;
     settings_t();
     std::string settings_string() const;
   };
@@ -143,6 +339,40 @@ namespace hashdb {
                             const hashdb::settings_t& settings,
                             const std::string& command_string);
 
+  /**
+   * Build the source indexes of a hashdb: the reverse index from each
+   * source to its block hashes and the index from each repository name
+   * to its sources.  Databases have these indexes only if they are
+   * created with the source_index setting or built here, and imports
+   * keep them up to date once they are complete.  Building adds any
+   * missing entries, so it may also be run on a database that already
+   * has the indexes.  The indexes are marked complete in the settings
+   * when the build is done, and they are not used until then, so an
+   * interrupted build may be run again.
+   *
+   * Parameters:
+   *   hashdb_dir - Path to the database to index.
+   *
+   * Returns:
+   *   "" if successful else reason if not.
+   */
+  std::string create_source_index(const std::string& hashdb_dir);
+
+  /**
+   * Upgrade a hashdb created by the previous version of hashdb to the
+   * current version.  The hash data store is rewritten so that the
+   * sources of hashes with many sources are sorted and found by seeking.
+   * An interrupted upgrade may be run again.  A hashdb that is already
+   * current is left unchanged.
+   *
+   * Parameters:
+   *   hashdb_dir - Path to the database to upgrade.
+   *
+   * Returns:
+   *   "" if successful else reason if not.
+   */
+  std::string upgrade_hashdb(const std::string& hashdb_dir);
+
   /**
    * Return hashdb settings else reason for failure.
    * The current implementation may abort if something worse than a simple
@@ -169,6 +399,20 @@ namespace hashdb {
    */
   std::string hex_to_bin(const std::string& hex_string);
 
+#ifndef SWIG
+  /**
+   * Decode hex text into binary without reporting errors, for bulk
+   * input.  The text need not be a std::string and bin keeps its
+   * storage between calls.
+   *
+   * Returns:
+   *   True if the text has even length and only hex digits, false and
+   *   empty bin if not.
+   */
+  bool hex_to_bin(const char* const hex, const size_t size,
+                  std::string& bin);
+#endif
+
   /**
    * Return hexadecimal representation of the binary string.
    */
@@ -179,6 +423,11 @@ namespace hashdb {
    * path.  Files with EWF extensions (.E01 files) will be ingested as
    * media images.
    *
+   * File buffers of up to 17MiB are read for up to two jobs queued per
+   * CPU, one job running per CPU, and one job being read or packed per
+   * reader.  Jobs waiting for the source names of earlier files are also
+   * held, for up to 256MiB of buffers.
+   *
    * Parameters:
    *   hashdb_dir - Path to the hashdb data store to import into.
    *   ingest_path - Path to a source file or directory to recursively
@@ -192,6 +441,12 @@ namespace hashdb {
    *   disable_recursive_processing - Disable processing embedded data.
    *   disable_calculate_entropy - Disable calculating block entropy values.
    *   disable_calculate_labels - Disable calculating block entropy labels.
+   *   use_file_hash_cache - Keep the file hash of each file in the hashdb
+   *     and skip reading files that are unchanged since they were
+   *     ingested into this repository.
+   *   num_readers - The number of threads reading files, or 0 for one
+   *     per CPU.  Source names are inserted in the same order for any
+   *     number of readers.
    *   command_string - String to put into the new hashdb log.
    *
    * Returns:
@@ -205,6 +460,8 @@ namespace hashdb {
                      const bool disable_recursive_processing,
                      const bool disable_calculate_entropy,
                      const bool disable_calculate_labels,
+                     const bool use_file_hash_cache,
+                     const size_t num_readers,
                      const std::string& command_string);
 
   /**
@@ -221,6 +478,11 @@ namespace hashdb {
    *   disable_recursive_processing - Disable processing embedded data.
    *   scan_mode - The mode to use for performing the scan.  Controls
    *     scan optimization and returned JSON content.
+   *   sample_fraction - The fraction of the media to sample for triage,
+   *     or 0 to scan all of it.  Samples are 64KiB, one chosen at random
+   *     from each stratum, and the neighbors of samples with matches are
+   *     also scanned.  The number of matching blocks in the media is
+   *     estimated.
    *
    * Returns:
    *   "" if successful else reason if not.
@@ -229,7 +491,8 @@ namespace hashdb {
                      const std::string& media_image_file,
                      const size_t step_size,
                      const bool disable_recursive_processing,
-                     const hashdb::scan_mode_t scan_mode);
+                     const hashdb::scan_mode_t scan_mode,
+                     const double sample_fraction);
 
   /**
    * Read raw bytes at the media offset in the media image file.  Files
@@ -306,6 +569,27 @@ namespace hashdb {
   // ************************************************************
   // import
   // ************************************************************
+#ifndef SWIG
+  /**
+   * Reusable parser state for import_manager_t::import_json.  Keep one
+   * per thread and pass it to each import so records do not each set up
+   * a new parser.
+   */
+  class json_reader_t {
+    private:
+    friend class import_manager_t;
+    json_record_reader_t* reader;
+
+    public:
+    // do not allow copy or assignment
+    json_reader_t(const json_reader_t&) = delete;
+    json_reader_t& operator=(const json_reader_t&) = delete;
+
+    json_reader_t();
+    ~json_reader_t();
+  };
+#endif
+
   /**
    * Manage all LMDB updates.  All interfaces are locked and threadsafe.
    * A logger is opened for logging the command and for logging
@@ -320,6 +604,8 @@ namespace hashdb {
     lmdb_source_data_manager_t* lmdb_source_data_manager;
     lmdb_source_id_manager_t* lmdb_source_id_manager;
     lmdb_source_name_manager_t* lmdb_source_name_manager;
+    lmdb_source_hash_manager_t* lmdb_source_hash_manager; // NULL if none
+    lmdb_repository_manager_t* lmdb_repository_manager;   // NULL if none
 
     logger_t* logger;
     hashdb::lmdb_changes_t* changes;
@@ -360,6 +646,22 @@ namespace hashdb {
                             const std::string& filename);
 
 
+#ifndef SWIG
+    /**
+     * Insert the repository_name, filename pair associated with each of
+     * several sources, writing each store once per group of sources
+     * instead of once per source.
+     *
+     * Parameters:
+     *   repository_name - A repository name to attribute the sources to.
+     *   file_hash_filenames - The file hash of each source file in binary
+     *     form and the name of the source file.
+     */
+    void insert_source_names(const std::string& repository_name,
+                  const std::vector<std::pair<std::string, std::string> >&
+                                                   file_hash_filenames);
+#endif
+
     /**
      * Insert or change source data.
      *
@@ -396,6 +698,31 @@ namespace hashdb {
                      const std::string& block_label,
                      const std::string& file_hash);
 
+#ifndef SWIG
+    /**
+     * Insert the hash data of several block hashes as insert_hash does,
+     * writing each store once per group of hashes instead of once per
+     * hash.
+     *
+     * Parameters:
+     *   hash_inserts - The block hash, entropy, block label, and file
+     *     hash of each hash to insert.
+     */
+    void insert_hashes(const std::vector<hash_insert_t>& hash_inserts);
+#endif
+
+    /**
+     * Write hash inserts that are held in memory.  Inserts into hashes
+     * with many sources are held in memory and written in batches,
+     * which saves rewriting the hash for every source, and so are
+     * inserts into the source indexes, but a crash loses the inserts not
+     * yet written.  They are written when the batch is full, when the
+     * manager is closed, and when this is called, so call this where the
+     * inserts so far must be kept, for example before marking a source
+     * complete.
+     */
+    void flush();
+
 #ifndef SWIG
     /**
      * Insert or change the hash data associated with the block_hash.
@@ -415,6 +742,36 @@ namespace hashdb {
                     const std::string& block_label,
                     const std::string& file_hash,
                     const uint64_t sub_count);
+
+    /**
+     * Merge the hash data associated with the block_hash for several
+     * sources, writing the hash data once instead of once per source.
+     *
+     * Parameters:
+     *   block_hash - The block hash in binary form.
+     *   k_entropy - An entropy value for the associated block, scaled
+     *     up by 1,000 for three decimal place precision.
+     *   block_label - Text indicating the type of the block or "" for
+     *     no label.
+     *   file_hash_sub_counts - The file hash of each source file in
+     *     binary form and the number of file offsets to add for it.
+     */
+    void merge_hashes(const std::string& block_hash,
+                      const uint64_t k_entropy,
+                      const std::string& block_label,
+                      const std::vector<std::pair<std::string, uint64_t> >&
+                                                  file_hash_sub_counts);
+
+    /**
+     * Merge the hash data of several block hashes as merge_hashes does
+     * for one, writing each store once per group of hashes instead of
+     * once per hash.
+     *
+     * Parameters:
+     *   hash_merges - The block hash, entropy, block label, and file
+     *     hash and sub_count of each source of each hash to merge.
+     */
+    void merge_hashes(const std::vector<hash_merge_t>& hash_merges);
 #endif
 
     /**
@@ -446,6 +803,34 @@ namespace hashdb {
      */
     std::string import_json(const std::string& json_string);
 
+#ifndef SWIG
+    /**
+     * Import hash or source information from a JSON record, parsing it
+     * in place.  The record text is modified.
+     *
+     * Parameters:
+     *   json_string - NULL-terminated hash or source text in JSON format.
+     *
+     * Returns:
+     *   "" else error message if JSON is invalid.
+     */
+    std::string import_json(char* const json_string);
+
+    /**
+     * Import hash or source information from a JSON record, parsing it
+     * in place with the given reader.  The record text is modified.
+     *
+     * Parameters:
+     *   json_string - NULL-terminated hash or source text in JSON format.
+     *   json_reader - The parser state of the calling thread.
+     *
+     * Returns:
+     *   "" else error message if JSON is invalid.
+     */
+    std::string import_json(char* const json_string,
+                            json_reader_t& json_reader);
+#endif
+
     /**
      * See if the file hash is in the database.
      *
@@ -453,6 +838,9 @@ namespace hashdb {
      *   true if the file hash is in the database.
      */
     bool has_source(const std::string& file_hash) const;
+#ifndef SWIG
+    bool has_source(const hash_key_t& file_hash) const;
+#endif
 
     /**
      * Return the file_hash of the first source in the database.
@@ -505,17 +893,40 @@ namespace hashdb {
     lmdb_source_data_manager_t* lmdb_source_data_manager;
     lmdb_source_id_manager_t* lmdb_source_id_manager;
     lmdb_source_name_manager_t* lmdb_source_name_manager;
+    lmdb_source_hash_manager_t* lmdb_source_hash_manager; // NULL if none
+    lmdb_repository_manager_t* lmdb_repository_manager;   // NULL if none
 
     // support find_expanded_hash_json when optimizing
     locked_member_t* hashes;
     locked_member_t* sources;
 
+    // decoded source data by source ID and source ID by file hash
+    source_data_cache_t* source_data_cache;
+
+    // find_hash_json results by scan mode and block hash
+    hash_result_cache_t* hash_result_cache;
+
     // low-level find interfaces
     std::string find_expanded_hash_json(const bool optimizing,
                                      const std::string& block_hash);
     std::string find_hash_count_json(const std::string& block_hash) const;
     std::string find_approximate_hash_count_json(
                                      const std::string& block_hash) const;
+#ifndef SWIG
+    // find_hash for std::string or hash_key_t block hashes
+    template <typename K>
+    bool find_hash_result(const K& block_hash,
+                          hash_result_t& hash_result) const;
+
+    // fill in file hashes and sub_counts from source_id_sub_counts
+    void resolve_sources(hash_result_t& hash_result) const;
+
+    // reads hash data and sources in block hash order
+    friend class hash_cursor_t;
+
+    // reads sources in file hash order
+    friend class source_cursor_t;
+#endif
     public:
 #ifndef SWIG
     // do not allow copy or assignment
@@ -528,8 +939,14 @@ namespace hashdb {
      *
      * Parameters:
      *   hashdb_dir - Path to the database to scan against.
+     *   source_cache_size - The maximum number of decoded source
+     *     records to cache, or 0 to disable source caching.
+     *   hash_cache_size - The maximum number of bytes of find_hash_json
+     *     results to cache, or 0 to disable result caching.
      */
-    scan_manager_t(const std::string& hashdb_dir);
+    scan_manager_t(const std::string& hashdb_dir,
+                   const size_t source_cache_size = 100000,
+                   const size_t hash_cache_size = 0);
 
     /**
      * The destructor closes read-only data store resources.
@@ -558,6 +975,23 @@ namespace hashdb {
                    std::string& block_label,
                    uint64_t& count,
                    source_sub_counts_t& source_sub_counts) const;
+
+    /**
+     * Find hash, return hash and source information into a reusable
+     * result.  Reuse the same hash_result_t across calls to avoid heap
+     * allocation.
+     *
+     * Parameters:
+     *   block_hash - The block hash in binary form.
+     *   hash_result - The hash and source information found.
+     *
+     * Returns:
+     *   True if the hash is present, false if not.
+     */
+    bool find_hash(const std::string& block_hash,
+                   hash_result_t& hash_result) const;
+    bool find_hash(const hash_key_t& block_hash,
+                   hash_result_t& hash_result) const;
 #endif
 
     /**
@@ -612,6 +1046,9 @@ namespace hashdb {
      *   The total count of file offsets related to this hash.
      */
     size_t find_hash_count(const std::string& block_hash) const;
+#ifndef SWIG
+    size_t find_hash_count(const hash_key_t& block_hash) const;
+#endif
 
     /**
      * Find the approximate hash count.  Faster than find_hash, but can
@@ -626,6 +1063,9 @@ namespace hashdb {
      *   collisions with truncated hash values.
      */
     size_t find_approximate_hash_count(const std::string& block_hash) const;
+#ifndef SWIG
+    size_t find_approximate_hash_count(const hash_key_t& block_hash) const;
+#endif
 
     /**
      * Find source data for the given source ID, false on no source ID.
@@ -672,6 +1112,53 @@ namespace hashdb {
                            source_names_t& source_names) const;
 #endif
 
+    /**
+     * True if the database has a complete source index, see
+     * create_source_index.
+     */
+    bool has_source_index() const;
+
+#ifndef SWIG
+    /**
+     * Find the block hashes of the source, in block hash order.
+     * Requires the source index.
+     *
+     * Parameters:
+     *   file_hash - The file hash of the source file in binary form.
+     *   block_hashes - The block hashes of the source in binary form.
+     *
+     * Returns:
+     *   True if the source index is present and the file hash has
+     *   block hashes.
+     */
+    bool find_source_hashes(const std::string& file_hash,
+                            std::vector<std::string>& block_hashes) const;
+#endif
+
+    /**
+     * True if the database has a complete repository index, see
+     * create_source_index.
+     */
+    bool has_repository_index() const;
+
+#ifndef SWIG
+    /**
+     * Find the sources that may carry the repository name.  Requires
+     * the repository index.  Very long repository names are indexed by
+     * prefix, so compare source names when the match must be exact.
+     *
+     * Parameters:
+     *   repository_name - The repository name.
+     *   file_hashes - The file hashes of the sources in binary form.
+     *
+     * Returns:
+     *   True if the repository index is present and has the repository
+     *   name.
+     */
+    bool find_repository_sources(const std::string& repository_name,
+                                 std::vector<std::string>& file_hashes) const;
+#endif
+
     /**
      * Find hash, return JSON text else "" if not there.
      *
@@ -772,6 +1259,206 @@ namespace hashdb {
      * Return the number of sources.
      */
     size_t size_sources() const;
+
+    /**
+     * Return cache statistics in JSON format.  Example syntax:
+     *
+     *   {
+     *     "source_cache": {"capacity": 100000, "size": 8,
+     *                      "hits": 1200, "misses": 8},
+     *     "hash_cache": {"capacity": 67108864, "size": 3, "bytes": 2400,
+     *                    "evictions": 0,
+     *                    "expanded": {"hits": 40, "misses": 60},
+     *                    "expanded_optimized": {"hits": 0, "misses": 0},
+     *                    "count": {"hits": 0, "misses": 0},
+     *                    "approximate_count": {"hits": 0, "misses": 0}}
+     *   }
+     */
+    std::string cache_stats() const;
+  };
+
+  // ************************************************************
+  // hash cursor
+  // ************************************************************
+  /**
+   * Walk the hashes of a scan manager in block hash order.  The cursor
+   * holds one read transaction open, so each step is a sequential move
+   * rather than a new lookup.  Use it instead of first_hash and
+   * next_hash when visiting many hashes.  The scan manager must outlive
+   * the cursor.
+   *
+   * In Python, iterating over the cursor yields each block hash.
+   */
+  class hash_cursor_t {
+    private:
+    const scan_manager_t& scan_manager;
+    lmdb_hash_data_cursor_t* cursor;
+
+    public:
+#ifndef SWIG
+    // do not allow copy or assignment
+    hash_cursor_t(const hash_cursor_t&) = delete;
+    hash_cursor_t& operator=(const hash_cursor_t&) = delete;
+#endif
+
+    /**
+     * Open a cursor positioned at the first hash.
+     *
+     * Parameters:
+     *   scan_manager - The open scan manager to walk.
+     */
+    hash_cursor_t(const scan_manager_t& scan_manager);
+
+    ~hash_cursor_t();
+
+    /**
+     * True when the cursor has moved past the last hash.
+     */
+    bool at_end() const;
+
+    /**
+     * The block hash at the cursor in binary form, "" at end.
+     */
+    const std::string& block_hash() const;
+
+    /**
+     * Move to the next hash.
+     */
+    void next();
+
+    /**
+     * Move to the first hash that is not less than the given hash.
+     *
+     * Parameters:
+     *   block_hash - The block hash in binary form.
+     */
+    void seek(const std::string& block_hash);
+
+#ifndef SWIG
+    /**
+     * Read hash and source information for the hash at the cursor, as
+     * scan_manager_t::find_hash does.
+     *
+     * Parameters:
+     *   hash_result - The hash and source information found.
+     *
+     * Returns:
+     *   True if the cursor is at a hash, false at end.
+     */
+    bool read(hash_result_t& hash_result) const;
+
+    /**
+     * Read only the count and the number of sources of the hash at the
+     * cursor.  This reads the hash's header record and not its source
+     * records, so it is much faster than read when sources are not
+     * needed.
+     *
+     * Parameters:
+     *   count - The total count of file offsets related to this hash.
+     *   num_sources - The number of sources associated with this hash.
+     *
+     * Returns:
+     *   True if the cursor is at a hash, false at end.
+     */
+    bool read_count(uint64_t& count, size_t& num_sources) const;
+#endif
+
+    /**
+     * The total count of file offsets related to the hash at the cursor,
+     * read as read_count does, 0 at end.
+     */
+    uint64_t count() const;
+
+    /**
+     * Export the hash at the cursor, as scan_manager_t::export_hash_json
+     * does, without a new lookup.
+     *
+     * Returns:
+     *   JSON hash data or "" at end.
+     */
+    std::string export_hash_json() const;
+
+#ifndef SWIG
+    /**
+     * Export the hash at the cursor and keep the hash data that was
+     * read, so the hash is decoded once.
+     *
+     * Parameters:
+     *   hash_result - The hash and source information found.
+     *
+     * Returns:
+     *   JSON hash data or "" at end.
+     */
+    std::string export_hash_json(hash_result_t& hash_result) const;
+#endif
+  };
+
+  // ************************************************************
+  // source cursor
+  // ************************************************************
+  /**
+   * Walk the sources of a scan manager in file hash order.  The cursor
+   * holds one read transaction open, so each step is a sequential move
+   * rather than a new lookup.  Use it instead of first_source and
+   * next_source when visiting many sources.  The scan manager must
+   * outlive the cursor.
+   *
+   * In Python, iterating over the cursor yields each file hash.
+   */
+  class source_cursor_t {
+    private:
+    const scan_manager_t& scan_manager;
+    lmdb_source_id_cursor_t* cursor;
+
+    public:
+#ifndef SWIG
+    // do not allow copy or assignment
+    source_cursor_t(const source_cursor_t&) = delete;
+    source_cursor_t& operator=(const source_cursor_t&) = delete;
+#endif
+
+    /**
+     * Open a cursor positioned at the first source.
+     *
+     * Parameters:
+     *   scan_manager - The open scan manager to walk.
+     */
+    source_cursor_t(const scan_manager_t& scan_manager);
+
+    ~source_cursor_t();
+
+    /**
+     * True when the cursor has moved past the last source.
+     */
+    bool at_end() const;
+
+    /**
+     * The file hash at the cursor in binary form, "" at end.
+     */
+    const std::string& file_hash() const;
+
+    /**
+     * Move to the next source.
+     */
+    void next();
+
+    /**
+     * Move to the first source whose file hash is not less than the
+     * given file hash.
+     *
+     * Parameters:
+     *   file_hash - The file hash in binary form.
+     */
+    void seek(const std::string& file_hash);
+
+    /**
+     * Export the source at the cursor, as
+     * scan_manager_t::export_source_json does.
+     *
+     * Returns:
+     *   JSON source data or "" at end.
+     */
+    std::string export_source_json() const;
   };
 
   // ************************************************************
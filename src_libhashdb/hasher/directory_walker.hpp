@@ -0,0 +1,519 @@
+// Author:  Bruce Allen
+// Created: 2/25/2013
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on February 25, 2013 by Bruce Allen.
+
+/**
+ * \file
+ * Walks a directory tree with a pool of threads and provides the files
+ * it finds, with their sizes from stat, while it is still walking.
+ *
+ * Threads read directories in parallel, each directory once by its
+ * (device, inode), ahead of the files taken by pop.  pop provides the
+ * files in walk order: entries of a directory sorted by name, with the
+ * files of a subdirectory in place of the subdirectory.  The order does
+ * not depend on thread timing.
+ *
+ * On pop: wait until the next file in walk order is found.  Returns
+ * false when the walk is done and all files are popped.
+ *
+ * Files are skipped as in filename_list: special files, files and
+ * directories seen before by (device, inode), and E01 and split raw
+ * segments after the first.  Of paths to the same (device, inode), the
+ * first in walk order is used.  A directory that cannot be read is
+ * reported and skipped.
+ *
+ * Only stat is used, so an E01 file's size is the size of its first
+ * segment rather than of its media.
+ *
+ * The Windows implementation reads the file list with filename_list
+ * on one thread and does not provide sizes.
+ */
+
+#ifndef DIRECTORY_WALKER_HPP
+#define DIRECTORY_WALKER_HPP
+
+#include <cstring>
+#include <cerrno>
+#include <stdint.h>
+#include <assert.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <queue>
+#include <map>
+#include <set>
+#include <utility>
+#include <algorithm>
+#include <unistd.h>
+#include <pthread.h>
+#ifndef WIN32
+#include <dirent.h>
+#endif
+#include "filename_t.hpp"
+#include "filename_list.hpp"
+#include "file_reader_helper.hpp"
+#include "tprint.hpp"
+
+namespace hasher {
+
+/**
+ * A file found by the walk and its size from stat.
+ */
+struct found_file_t {
+  filename_t filename;
+  uint64_t filesize;
+  found_file_t() : filename(), filesize(0) {
+  }
+  found_file_t(const filename_t& p_filename, const uint64_t p_filesize) :
+                     filename(p_filename), filesize(p_filesize) {
+  }
+};
+
+class directory_walker_t {
+
+  private:
+  // bound the files read but not yet popped
+  static const size_t max_held_files = 65536;
+
+  typedef std::pair<uint64_t, uint64_t> dev_inode_t;
+
+  // a file or subdirectory of a directory
+  struct entry_t {
+    std::string name;
+    bool is_directory;
+    dev_inode_t dev_inode;
+    uint64_t filesize;
+    entry_t(const std::string& p_name, const bool p_is_directory,
+            const struct stat& st) :
+               name(p_name), is_directory(p_is_directory),
+               dev_inode(st.st_dev, st.st_ino),
+               filesize(p_is_directory ? 0 : st.st_size) {
+    }
+    bool operator<(const entry_t& other) const {
+      return name < other.name;
+    }
+  };
+
+  // a directory, read by one thread and then walked by pop
+  struct directory_t {
+    const std::string path;              // the path it is read by
+    const dev_inode_t dev_inode;
+    const std::vector<size_t> order;     // entry indexes from the root
+    bool is_read;
+    std::vector<entry_t> entries;        // sorted by name
+    std::string walk_path;               // the path it is walked by
+    size_t next_entry;                   // the next entry to walk
+    directory_t(const std::string& p_path, const dev_inode_t& p_dev_inode,
+                const std::vector<size_t>& p_order) :
+               path(p_path), dev_inode(p_dev_inode), order(p_order),
+               is_read(false), entries(), walk_path(), next_entry(0) {
+    }
+  };
+
+  const std::string path;
+  const int num_threads;
+  ::pthread_t* threads;
+
+  // directories by (device, inode), NULL once walked
+  std::map<dev_inode_t, directory_t*> directories;
+
+  // directories not yet read, in walk order
+  std::map<std::vector<size_t>, directory_t*> unread_directories;
+
+  directory_t* needed_directory;        // pop waits for it to be read
+  size_t busy_threads;                  // threads reading a directory
+  size_t held_files;                    // read but not yet walked
+  std::vector<directory_t*> walking;    // directories being walked, root first
+  std::queue<found_file_t> files;       // found other than by the walk
+  std::set<dev_inode_t> seen_dev_inodes;
+  uint64_t total_filesize;
+  bool is_stopping;
+  mutable pthread_mutex_t M;                  // mutext
+  pthread_cond_t C;                     // signals progress
+
+  // do not allow copy or assignment
+  directory_walker_t(const directory_walker_t&);
+  directory_walker_t& operator=(const directory_walker_t&);
+
+  void lock() const {
+    if(pthread_mutex_lock(&M)) {
+      assert(0);
+    }
+  }
+
+  void unlock() const {
+    pthread_mutex_unlock(&M);
+  }
+
+  // wait for a signal, call under lock
+  void wait() {
+    pthread_cond_wait(&C, &M);
+  }
+
+  // wake threads waiting for progress, call under lock
+  void signal() {
+    pthread_cond_broadcast(&C);
+  }
+
+#ifndef WIN32
+  // true if the file is not seen before, call under lock
+  bool is_new(const dev_inode_t& dev_inode) {
+    return seen_dev_inodes.insert(dev_inode).second;
+  }
+
+  // true if filename is a split raw segment after the first and the
+  // segments before it back to the first are there
+  static bool is_later_serial_segment(const std::string& filename) {
+    std::string segment_filename = filename;
+    std::string previous = serial_segment_filename(segment_filename, -1);
+    while (previous.size() > 0 && access(previous.c_str(), F_OK) == 0) {
+      segment_filename = previous;
+      previous = serial_segment_filename(segment_filename, -1);
+    }
+    return segment_filename != filename &&
+           is_first_serial_segment(segment_filename);
+  }
+
+  // true if filename is an E01 segment after the first and the first
+  // segment is there, or is a later split raw segment
+  static bool is_later_segment(const std::string& filename) {
+    if (is_later_serial_segment(filename)) {
+      return true;
+    }
+    const size_t size = filename.size();
+    if (size < 4 || filename[size-4] != '.' ||
+        (filename[size-3] != 'E' && filename[size-3] != 'e') ||
+        filename[size-2] < '0' || filename[size-2] > '9' ||
+        filename[size-1] < '0' || filename[size-1] > '9' ||
+        (filename[size-2] == '0' && filename[size-1] < '2')) {
+      return false;
+    }
+    const std::string first_segment =
+                              filename.substr(0, size - 2) + "01";
+    return access(first_segment.c_str(), F_OK) == 0;
+  }
+
+  // read the files and subdirectories of the directory sorted by name
+  static void read_directory(directory_t& directory) {
+
+    DIR *dir = opendir(directory.path.c_str());
+    if (dir == NULL) {
+      std::stringstream ss;
+      ss << "# Unable to read directory " << directory.path
+         << ", " << strerror(errno) << "\n";
+      hashdb::tprint(std::cout, ss.str());
+      return;
+    }
+
+    while (true) {
+      struct dirent *entry = readdir(dir);
+      if (entry == NULL) {
+        // done with readdir stream
+        break;
+      }
+
+      // skip files "." and ".."
+      if (strcmp(entry->d_name, ".") == 0 ||
+          strcmp(entry->d_name, "..") == 0) {
+        continue;
+      }
+      const std::string filename = directory.path + "/" + entry->d_name;
+
+      // stat the file and maybe skip it
+      struct stat st;
+      if (stat(filename.c_str(), &st)) {
+        // can't stat
+        continue;
+      }
+      if (S_ISDIR(st.st_mode)) {
+        directory.entries.push_back(entry_t(entry->d_name, true, st));
+      } else if (S_ISREG(st.st_mode) && !is_later_segment(filename)) {
+        directory.entries.push_back(entry_t(entry->d_name, false, st));
+      }
+    }
+    closedir(dir);
+    std::sort(directory.entries.begin(), directory.entries.end());
+  }
+
+  // Take the directory to read next, NULL if none may be read now.  Read
+  // the directory pop waits for first, then directories in walk order
+  // while not too many files are held.  Call under lock.
+  directory_t* take_unread_directory() {
+    std::map<std::vector<size_t>, directory_t*>::iterator it;
+    if (needed_directory != NULL) {
+      it = unread_directories.find(needed_directory->order);
+    } else {
+      it = unread_directories.end();
+    }
+    if (it == unread_directories.end()) {
+      if (unread_directories.empty() || held_files >= max_held_files) {
+        return NULL;
+      }
+      it = unread_directories.begin();
+    }
+    directory_t* const directory = it->second;
+    unread_directories.erase(it);
+    return directory;
+  }
+
+  // keep the read directory and add its new subdirectories for reading,
+  // call under lock
+  void add_read_directory(directory_t& directory) {
+    directory.is_read = true;
+    for (size_t i=0; i<directory.entries.size(); ++i) {
+      const entry_t& entry = directory.entries[i];
+      if (!entry.is_directory) {
+        ++held_files;
+        total_filesize += entry.filesize;
+      } else if (directories.find(entry.dev_inode) == directories.end()) {
+        std::vector<size_t> order(directory.order);
+        order.push_back(i);
+        directory_t* const subdirectory = new directory_t(
+                 directory.path + "/" + entry.name, entry.dev_inode, order);
+        directories[entry.dev_inode] = subdirectory;
+        unread_directories[order] = subdirectory;
+      }
+    }
+  }
+
+  void run() {
+    lock();
+    while (!is_stopping) {
+
+      // wait for a directory or for the walk to be done
+      directory_t* const directory = take_unread_directory();
+      if (directory == NULL) {
+        if (unread_directories.empty() && busy_threads == 0) {
+          break;
+        }
+        wait();
+        continue;
+      }
+      ++busy_threads;
+      unlock();
+
+      // read the directory without the lock
+      read_directory(*directory);
+
+      lock();
+      add_read_directory(*directory);
+      --busy_threads;
+      signal();
+    }
+    signal();
+    unlock();
+  }
+
+  // Move the walk to the next file, false when the walk is done.  Call
+  // under lock.
+  bool next_file(found_file_t& found_file) {
+    while (!walking.empty() && !is_stopping) {
+      directory_t* const directory = walking.back();
+
+      // wait for the directory to be read
+      if (!directory->is_read) {
+        needed_directory = directory;
+        signal();
+        wait();
+        continue;
+      }
+      needed_directory = NULL;
+
+      // done with the directory
+      if (directory->next_entry == directory->entries.size()) {
+        directories[directory->dev_inode] = NULL;
+        delete directory;
+        walking.pop_back();
+        continue;
+      }
+
+      // the next entry, skipping paths to what is seen before
+      const entry_t& entry = directory->entries[directory->next_entry++];
+      if (!entry.is_directory && held_files-- == max_held_files) {
+        signal();
+      }
+      if (!is_new(entry.dev_inode)) {
+        total_filesize -= entry.filesize;
+        continue;
+      }
+      const std::string filename = directory->walk_path + "/" + entry.name;
+      if (entry.is_directory) {
+        directory_t* const subdirectory = directories[entry.dev_inode];
+        subdirectory->walk_path = filename;
+        walking.push_back(subdirectory);
+        continue;
+      }
+      found_file = found_file_t(filename, entry.filesize);
+      return true;
+    }
+    return false;
+  }
+#else
+  void run() {
+    filenames_t filenames;
+    const std::string error_message = filename_list(path, &filenames);
+    if (error_message.size() != 0) {
+      hashdb::tprint(std::cout, "# " + error_message + "\n");
+    }
+    lock();
+    for (filenames_t::const_iterator it = filenames.begin();
+                                     it != filenames.end(); ++it) {
+      files.push(found_file_t(*it, 0));
+    }
+    --busy_threads;
+    signal();
+    unlock();
+  }
+
+  // files are found by filename_list, so wait for it
+  bool next_file(found_file_t& found_file) {
+    while (busy_threads != 0) {
+      wait();
+    }
+    if (files.empty()) {
+      return false;
+    }
+    found_file = files.front();
+    files.pop();
+    return true;
+  }
+#endif
+
+  static void* walk(void* const arg) {
+    static_cast<directory_walker_t*>(arg)->run();
+    return 0;
+  }
+
+  public:
+  /**
+   * Start walking the path, which may also be a single file.
+   */
+  directory_walker_t(const std::string& p_path, const int p_num_threads) :
+           path(p_path),
+#ifdef WIN32
+           num_threads(1),
+#else
+           num_threads(p_num_threads),
+#endif
+           threads(new ::pthread_t[num_threads]),
+           directories(), unread_directories(), needed_directory(NULL),
+           busy_threads(0), held_files(0), walking(), files(),
+           seen_dev_inodes(), total_filesize(0), is_stopping(false),
+           M(), C() {
+
+    if(pthread_mutex_init(&M,NULL)) {
+      std::cerr << "Error obtaining mutex.\n";
+      assert(0);
+    }
+    if(pthread_cond_init(&C,NULL)) {
+      std::cerr << "Error obtaining condition variable.\n";
+      assert(0);
+    }
+
+#ifdef WIN32
+    // the one thread is busy until it adds all files
+    busy_threads = 1;
+#else
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+      const dev_inode_t dev_inode(st.st_dev, st.st_ino);
+      is_new(dev_inode);
+      directory_t* const directory =
+                  new directory_t(path, dev_inode, std::vector<size_t>());
+      directories[dev_inode] = directory;
+      unread_directories[directory->order] = directory;
+      directory->walk_path = path;
+      walking.push_back(directory);
+    } else {
+      // not a directory so just use the path, which the reader checks
+      files.push(found_file_t(path, (stat(path.c_str(), &st) == 0) ?
+                                                         st.st_size : 0));
+      total_filesize = files.front().filesize;
+    }
+#endif
+
+    for (int i=0; i<num_threads; i++) {
+      int rc = ::pthread_create(&threads[i], NULL,
+                                directory_walker_t::walk, this);
+      if (rc != 0) {
+        std::cerr << "Unable to start directory walker thread.\n";
+        assert(0);
+      }
+    }
+  }
+
+  ~directory_walker_t() {
+    // stop any walk in progress and join each thread
+    lock();
+    is_stopping = true;
+    signal();
+    unlock();
+    for (int i=0; i<num_threads; i++) {
+      int status = pthread_join(threads[i], NULL);
+      if (status != 0) {
+        std::cerr << "error in directory walker join " << status << "\n";
+      }
+    }
+    delete[] threads;
+
+    // directories not walked
+    for (std::map<dev_inode_t, directory_t*>::const_iterator it =
+              directories.begin(); it != directories.end(); ++it) {
+      delete it->second;
+    }
+    pthread_cond_destroy(&C);
+    pthread_mutex_destroy(&M);
+  }
+
+  /**
+   * Take the next file, false when the walk is done and there are no
+   * more.
+   */
+  bool pop(found_file_t& found_file) {
+    lock();
+    bool has_file;
+    if (!files.empty()) {
+      found_file = files.front();
+      files.pop();
+      has_file = true;
+    } else {
+      has_file = next_file(found_file);
+    }
+    unlock();
+    return has_file;
+  }
+
+  /**
+   * The sum of the sizes of the files found so far.  Files are counted
+   * when their directory is read, and paths to a file seen before are
+   * taken back out as they are walked.
+   */
+  uint64_t bytes_found() const {
+    lock();
+    const uint64_t bytes = total_filesize;
+    unlock();
+    return bytes;
+  }
+};
+
+} // end namespace hasher
+
+#endif
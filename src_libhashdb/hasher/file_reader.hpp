@@ -19,7 +19,8 @@
 
 /**
  * \file
- * Read E01, serial 001, and single files.
+ * Read E01, serial 001, and single files.  Single regular files are
+ * also memory-mapped when asked and possible, see mapped_data.
  *
  * Adapted from bulk_extractor/src/image_process.cpp.
  */
@@ -38,6 +39,7 @@
 #include "file_reader_helper.hpp"
 #include "ewf_file_reader.hpp"
 #include "single_file_reader.hpp"
+#include "serial_file_reader.hpp"
 
 namespace hasher {
 
@@ -48,6 +50,7 @@ class file_reader_t {
   private:
   // state
   ewf_file_reader_t* ewf_file_reader;
+  serial_file_reader_t* serial_file_reader;
   single_file_reader_t* single_file_reader;
 
   public:
@@ -78,13 +81,8 @@ class file_reader_t {
       // E01
       return file_reader_type_t::E01;
     }
-    if (last4 == ".000" || last4 == ".001") {
-      // 001
-      return file_reader_type_t::SERIAL;
-    }
-    if (p_filename.size() >= 8 &&
-        p_filename.substr(p_filename.size() - 8) == "001.vmdk") {
-      // 001.vdmk
+    if (is_first_serial_segment(utf8_to_native(p_filename))) {
+      // 000, 001, or 001.vmdk
       return file_reader_type_t::SERIAL;
     }
     // no special filename extension
@@ -92,7 +90,8 @@ class file_reader_t {
   }
 
   // open the file for reading, return error_message or ""
-  std::string open_reader(const filename_t& native_filename) {
+  std::string open_reader(const filename_t& native_filename,
+                          const bool map) {
     switch(file_reader_type) {
 
       // E01
@@ -101,9 +100,15 @@ class file_reader_t {
         return ewf_file_reader->error_message;
       }
 
+      // SERIAL split raw file
+      case file_reader_type_t::SERIAL: {
+        serial_file_reader = new serial_file_reader_t(native_filename);
+        return serial_file_reader->error_message;
+      }
+
       // SINGLE binary file
       case file_reader_type_t::SINGLE: {
-        single_file_reader = new single_file_reader_t(native_filename);
+        single_file_reader = new single_file_reader_t(native_filename, map);
         return single_file_reader->error_message;
       }
       default: assert(0); std::exit(1);
@@ -118,6 +123,11 @@ class file_reader_t {
         return ewf_file_reader->filesize;
       }
 
+      // SERIAL split raw file
+      case file_reader_type_t::SERIAL: {
+        return serial_file_reader->filesize;
+      }
+
       // SINGLE binary file
       case file_reader_type_t::SINGLE: {
         return single_file_reader->filesize;
@@ -134,13 +144,17 @@ class file_reader_t {
    * Check error_message.
    * To read: read(offset, buffer, buffer_size).
    * Use as desired: filename, filesize, file_reader_type.
+   * Set p_map to map a single regular file into memory, see mapped_data.
+   * Do not map files that may change while in use.
    */
-  file_reader_t(const filename_t& p_native_filename) :
+  file_reader_t(const filename_t& p_native_filename,
+                const bool p_map = false) :
           ewf_file_reader(NULL),
+          serial_file_reader(NULL),
           single_file_reader(NULL),
           filename(native_to_utf8(p_native_filename)),
           file_reader_type(reader_type(filename)),
-          error_message(open_reader(p_native_filename)),
+          error_message(open_reader(p_native_filename, p_map)),
           filesize(get_filesize()),
           last_offset(0),
           last_buffer(NULL),
@@ -159,6 +173,12 @@ class file_reader_t {
         break;
       }
 
+      // SERIAL split raw file
+      case file_reader_type_t::SERIAL: {
+        delete serial_file_reader;
+        break;
+      }
+
       // SINGLE binary file
       case file_reader_type_t::SINGLE: {
         delete single_file_reader;
@@ -169,6 +189,26 @@ class file_reader_t {
     }
   }
 
+  /**
+   * The file in memory if it is a single file that was mapped, else NULL.
+   * The map is valid until this reader is destroyed.
+   */
+  const uint8_t* mapped_data() const {
+    if (file_reader_type == file_reader_type_t::SINGLE) {
+      return single_file_reader->mapped_data();
+    }
+    return NULL;
+  }
+
+  /**
+   * Ask for the mapped bytes at offset to be read ahead.
+   */
+  void will_need(const uint64_t offset, const size_t count) const {
+    if (file_reader_type == file_reader_type_t::SINGLE) {
+      single_file_reader->will_need(offset, count);
+    }
+  }
+
   // read into the provided buffer
   std::string read(uint64_t offset,
                    uint8_t* const buffer,
@@ -198,6 +238,14 @@ class file_reader_t {
         return read_error_message;
       }
 
+      // SERIAL split raw file
+      case file_reader_type_t::SERIAL: {
+        const std::string read_error_message = serial_file_reader->read(
+                               offset, buffer, buffer_size, bytes_read);
+        last_bytes_read = *bytes_read;
+        return read_error_message;
+      }
+
       // SINGLE binary file
       case file_reader_type_t::SINGLE: {
         const std::string read_error_message = single_file_reader->read(
@@ -25,6 +25,9 @@
  *   pread64() for Windows in global namespace
  *   get_drive_geometry() for Windows
  *   get_filesize_by_filename()
+ *   release_mapped()
+ *   is_first_serial_segment()
+ *   serial_segment_filename()
  */
 
 #include <config.h>
@@ -50,6 +53,9 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
 #include "filename_t.hpp"
 #include "file_reader_helper.hpp"
 
@@ -236,5 +242,71 @@ std::string get_filesize_by_filename(const filename_t &fname,
 #endif
 }
 
-} // end namespace hasher
+// release_mapped() drops whole pages only, the pages at the edges may
+// be shared with neighboring regions still in use
+void release_mapped(const uint8_t* const p, const size_t size) {
+#if defined(HAVE_SYS_MMAN_H) && !defined(WIN32)
+    const uintptr_t page_size = sysconf(_SC_PAGESIZE);
+    const uintptr_t start = (reinterpret_cast<uintptr_t>(p) + page_size - 1)
+                            / page_size * page_size;
+    const uintptr_t end = (reinterpret_cast<uintptr_t>(p) + size)
+                          / page_size * page_size;
+    if (start < end) {
+        madvise(reinterpret_cast<void*>(start), end - start, MADV_DONTNEED);
+    }
+#endif
+}
 
+// position of the three-digit segment number in a split raw filename
+// ending in .NNN or NNN.vmdk, or npos if there is none
+static size_t serial_number_position(const filename_t& filename) {
+    const char vmdk[] = ".vmdk";
+    const filename_t vmdk_suffix(vmdk, vmdk + 5);
+    const size_t size = filename.size();
+    size_t pos;
+    if (size >= 8 && filename.compare(size - 5, 5, vmdk_suffix) == 0) {
+        pos = size - 8;
+    } else if (size >= 5 && filename[size - 4] == '.') {
+        pos = size - 3;
+    } else {
+        return filename_t::npos;
+    }
+    for (size_t i=pos; i<pos+3; ++i) {
+        if (filename[i] < '0' || filename[i] > '9') {
+            return filename_t::npos;
+        }
+    }
+    return pos;
+}
+
+bool is_first_serial_segment(const filename_t& filename) {
+    const size_t pos = serial_number_position(filename);
+    if (pos == filename_t::npos ||
+        filename[pos] != '0' || filename[pos + 1] != '0') {
+        return false;
+    }
+    // .000 and .001 but only 001.vmdk
+    return filename[pos + 2] == '1' ||
+           (filename[pos + 2] == '0' && pos + 3 == filename.size());
+}
+
+filename_t serial_segment_filename(const filename_t& filename,
+                                   const int delta) {
+    const size_t pos = serial_number_position(filename);
+    if (pos == filename_t::npos) {
+        return filename_t();
+    }
+    const int number = (filename[pos] - '0') * 100 +
+                       (filename[pos + 1] - '0') * 10 +
+                       (filename[pos + 2] - '0') + delta;
+    if (number < 0 || number > 999) {
+        return filename_t();
+    }
+    filename_t segment_filename(filename);
+    segment_filename[pos] = '0' + number / 100;
+    segment_filename[pos + 1] = '0' + number / 10 % 10;
+    segment_filename[pos + 2] = '0' + number % 10;
+    return segment_filename;
+}
+
+} // end namespace hasher
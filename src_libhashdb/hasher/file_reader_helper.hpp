@@ -25,6 +25,9 @@
  *   pread64() for Windows
  *   get_filesize()
  *   get_filesize_by_filename()
+ *   release_mapped()
+ *   is_first_serial_segment()
+ *   serial_segment_filename()
  */
 
 #ifndef FILE_READER_HELPER_HPP
@@ -32,6 +35,7 @@
 
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <stdint.h>
 #include "filename_t.hpp"
 
 // if pread64 is not defined then define it in the global namespace
@@ -48,6 +52,18 @@ namespace hasher {
 // return error_message or ""
 std::string get_filesize_by_filename(const filename_t &fname, uint64_t* size);
 
+// let go of the whole pages of a processed region of a mapped file
+void release_mapped(const uint8_t* const p, const size_t size);
+
+// true if filename names the first segment of split raw media, *.000,
+// *.001, or *001.vmdk
+bool is_first_serial_segment(const filename_t& filename);
+
+// the filename of the split raw segment numbered delta after filename's,
+// or "" if filename is not numbered or the number is out of range
+filename_t serial_segment_filename(const filename_t& filename,
+                                   const int delta);
+
 } // end namespace hasher
 
 #endif
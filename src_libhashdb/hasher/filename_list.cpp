@@ -55,6 +55,7 @@
 #include <stack>
 #include <set>
 #include "filename_t.hpp"
+#include "file_reader_helper.hpp"
 
 namespace hasher {
 
@@ -118,6 +119,12 @@ static void strip_non_first_multipart_filenames(filenames_t& filenames) {
           break;
         }
       }
+    } else if (is_first_serial_segment(filename)) {
+      // remove split raw segments after first
+      filename_t next_filename = serial_segment_filename(filename, 1);
+      while (next_filename.size() > 0 && filenames.erase(next_filename) == 1) {
+        next_filename = serial_segment_filename(next_filename, 1);
+      }
     }
   }
 }
@@ -247,7 +254,7 @@ std::string filename_list(const std::string& utf8_filename,
     filehandle = INVALID_HANDLE_VALUE;
   }
 
-  // strip out non-first recursive filenames such as *.E02, etc.
+  // strip out non-first recursive filenames such as *.E02, *.002, etc.
   strip_non_first_multipart_filenames(*files);
 
   // done
@@ -362,7 +369,7 @@ std::string filename_list(const std::string& filename, filenames_t* files) {
     closedir(dir);
   }
 
-  // strip out non-first recursive filenames such as *.E02, etc.
+  // strip out non-first recursive filenames such as *.E02, *.002, etc.
   strip_non_first_multipart_filenames(*files);
 
   // done
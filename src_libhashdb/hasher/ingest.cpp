@@ -37,54 +37,63 @@
 #endif
 
 #include <string>
+#include <vector>
 #include <cassert>
 #include <iostream>
 #include <unistd.h> // for F_OK
 #include <sstream>
+#include <ctime>
+#include <sys/types.h>
+#include <sys/stat.h>
 #include "num_cpus.hpp"
 #include "hashdb.hpp"
 #include "filename_t.hpp"
 #include "file_reader.hpp"
 #include "hash_calculator.hpp"
-#include "filename_list.hpp"
+#include "directory_walker.hpp"
 #include "threadpool.hpp"
 #include "job.hpp"
 #include "job_queue.hpp"
+#include "small_file_packer.hpp"
+#include "source_name_sequencer.hpp"
 #include "ingest_tracker.hpp"
+#include "lmdb_file_hash_cache_manager.hpp"
 #include "tprint.hpp"
 
 static const size_t BUFFER_DATA_SIZE = 16777216;   // 2^24=16MiB
 static const size_t BUFFER_SIZE = 17825792;        // 2^24+2^20=17MiB
 static const size_t MAX_RECURSION_DEPTH = 7;
 
+// buffer bytes of jobs held for source name order, for any number of CPUs
+static const size_t MAX_HELD_BYTES = 268435456;     // 2^28=256MiB
+
 namespace hashdb {
   // ************************************************************
   // helpers
   // ************************************************************
-  static uint64_t calculate_total_bytes(const hasher::filenames_t filenames) {
-
-    // iterate over files
-    uint64_t total_bytes = 0;
-    int i = 0;
-    for (hasher::filenames_t::const_iterator it=filenames.begin();
-                                           it != filenames.end(); ++it) {
-
-      // maybe print status
-      if (++i % 1000 == 0) {
-        std::cout << "# Reading size of file " << i
-                  << " of " << filenames.size() << " ...\n";
-      }
-
-      // append size to total
-      const hasher::file_reader_t file_reader(*it);
-      total_bytes += file_reader.filesize;
+  // Read the file hash of an unchanged file from the file hash cache and
+  // record the source name instead of reading the file if its source is
+  // already in the DB.  Return true if the file was skipped.
+  static bool skip_cached_file(
+        const hasher::file_reader_t& file_reader,
+        hasher::ingest_tracker_t& ingest_tracker,
+        const hashdb::lmdb_file_hash_cache_manager_t& file_hash_cache_manager,
+        hasher::source_name_sequencer_t& source_name_sequencer,
+        const size_t sequence,
+        const hashdb::file_stat_t& file_stat,
+        const std::string& repository_name) {
+
+    std::string file_hash;
+    if (!file_hash_cache_manager.find(file_reader.filename, file_stat,
+                                      repository_name, file_hash) ||
+        !ingest_tracker.is_preexisting_source(file_hash)) {
+      return false;
     }
 
-    if (i > 1000) {
-        std::cout << "# Done reading file sizes, total size is " << total_bytes << "\n";
-      }
-
-    return total_bytes;
+    // store the source repository name and filename
+    source_name_sequencer.put(sequence, file_hash, file_reader.filename);
+    ingest_tracker.track_bytes(file_reader.filesize);
+    return true;
   }
 
   std::string ingest_file(
@@ -98,7 +107,9 @@ namespace hashdb {
         const bool disable_recursive_processing,
         const bool disable_calculate_entropy,
         const bool disable_calculate_labels,
-        hasher::job_queue_t* const job_queue) {
+        hasher::source_name_sequencer_t& source_name_sequencer,
+        const size_t sequence,
+        std::string& file_hash) {
 
     // identify the maximum recursion depth
     size_t max_recursion_depth = 
@@ -172,11 +183,11 @@ namespace hashdb {
     }
 
     // get the source file hash
-    const std::string file_hash = hash_calculator.final();
+    file_hash = hash_calculator.final();
 
-    // store the source repository name and filename
-    import_manager.insert_source_name(file_hash, repository_name,
-                                      file_reader.filename);
+    // store the source repository name and filename, its jobs wait for
+    // it to be stored so that source IDs are in order
+    source_name_sequencer.put(sequence, file_hash, file_reader.filename);
 
     // define the file type, currently not defined
     const std::string file_type = "";
@@ -197,7 +208,7 @@ namespace hashdb {
     // push buffer b onto the job queue
     size_t b_data_size = (b_size > BUFFER_DATA_SIZE)
                          ? BUFFER_DATA_SIZE : b_size;
-    job_queue->push(hasher::job_t::new_ingest_job(
+    source_name_sequencer.push(sequence, hasher::job_t::new_ingest_job(
                  &import_manager,
                  &ingest_tracker,
                  whitelist_scan_manager,
@@ -244,7 +255,7 @@ namespace hashdb {
       // push this buffer b2 onto the job queue
       size_t b2_data_size = (b2_bytes_read > BUFFER_DATA_SIZE)
                                         ? BUFFER_DATA_SIZE : b2_bytes_read;
-      job_queue->push(hasher::job_t::new_ingest_job(
+      source_name_sequencer.push(sequence, hasher::job_t::new_ingest_job(
                  &import_manager,
                  &ingest_tracker,
                  whitelist_scan_manager,
@@ -269,6 +280,170 @@ namespace hashdb {
     return "";
   }
 
+  // ************************************************************
+  // reader threads
+  // ************************************************************
+  // what the reader threads share
+  class ingest_readers_t {
+    private:
+    // do not allow copy or assignment
+    ingest_readers_t(const ingest_readers_t&);
+    ingest_readers_t& operator=(const ingest_readers_t&);
+
+    public:
+    hashdb::import_manager_t& import_manager;
+    hasher::ingest_tracker_t& ingest_tracker;
+    const hashdb::scan_manager_t* const whitelist_scan_manager;
+    hashdb::lmdb_file_hash_cache_manager_t* const file_hash_cache_manager;
+    hasher::directory_walker_t& directory_walker;
+    hasher::source_name_sequencer_t& source_name_sequencer;
+    const std::string repository_name;
+    const size_t step_size;
+    const size_t block_size;
+    const bool disable_recursive_processing;
+    const bool disable_calculate_entropy;
+    const bool disable_calculate_labels;
+
+    ingest_readers_t(
+        hashdb::import_manager_t& p_import_manager,
+        hasher::ingest_tracker_t& p_ingest_tracker,
+        const hashdb::scan_manager_t* const p_whitelist_scan_manager,
+        hashdb::lmdb_file_hash_cache_manager_t* const
+                                             p_file_hash_cache_manager,
+        hasher::directory_walker_t& p_directory_walker,
+        hasher::source_name_sequencer_t& p_source_name_sequencer,
+        const std::string& p_repository_name,
+        const size_t p_step_size,
+        const size_t p_block_size,
+        const bool p_disable_recursive_processing,
+        const bool p_disable_calculate_entropy,
+        const bool p_disable_calculate_labels) :
+                 import_manager(p_import_manager),
+                 ingest_tracker(p_ingest_tracker),
+                 whitelist_scan_manager(p_whitelist_scan_manager),
+                 file_hash_cache_manager(p_file_hash_cache_manager),
+                 directory_walker(p_directory_walker),
+                 source_name_sequencer(p_source_name_sequencer),
+                 repository_name(p_repository_name),
+                 step_size(p_step_size),
+                 block_size(p_block_size),
+                 disable_recursive_processing(p_disable_recursive_processing),
+                 disable_calculate_entropy(p_disable_calculate_entropy),
+                 disable_calculate_labels(p_disable_calculate_labels) {
+    }
+  };
+
+  // take files from the walk, read them, and push their jobs until the
+  // walk is done
+  static void* read_files(void* const arg) {
+    ingest_readers_t& r = *static_cast<ingest_readers_t*>(arg);
+
+    // pack small files into shared jobs
+    hasher::small_file_packer_t small_file_packer(
+                 &r.import_manager, &r.ingest_tracker,
+                 r.whitelist_scan_manager,
+                 r.repository_name, r.step_size, r.block_size,
+                 r.disable_recursive_processing,
+                 r.disable_calculate_entropy,
+                 r.disable_calculate_labels,
+                 (r.disable_recursive_processing) ? MAX_RECURSION_DEPTH : 0,
+                 &r.source_name_sequencer);
+
+    // iterate over files
+    hasher::found_file_t found_file;
+    size_t sequence;
+    while (r.source_name_sequencer.take(r.directory_walker, found_file,
+                                        sequence)) {
+      const hasher::file_reader_t file_reader(found_file.filename);
+
+      // update the total with the reader's size
+      r.ingest_tracker.correct_bytes_total(found_file.filesize,
+                    (file_reader.error_message.size() == 0) ?
+                                          file_reader.filesize : 0);
+      r.ingest_tracker.set_bytes_found(r.directory_walker.bytes_found(),
+                                       false);
+
+      // the source name if the file has one
+      std::string file_hash;
+
+      if (file_reader.error_message.size() == 0) {
+
+        // only process when file size > 0
+        if (file_reader.filesize > 0) {
+
+          // a file modified at or after this time may change unnoticed
+          // within the same second, so it is not cached
+          const time_t start_time = time(NULL);
+
+          // the file hash cache only knows single files
+          struct stat st;
+          const bool has_stat = r.file_hash_cache_manager != NULL &&
+                 file_reader.file_reader_type == hasher::SINGLE &&
+                 stat(file_reader.filename.c_str(), &st) == 0;
+
+          // skip an unchanged file with a known source
+          if (has_stat && skip_cached_file(file_reader, r.ingest_tracker,
+                        *r.file_hash_cache_manager, r.source_name_sequencer,
+                        sequence,
+                        hashdb::file_stat_t(st.st_dev, st.st_ino, st.st_size,
+                                            st.st_mtime),
+                        r.repository_name)) {
+            continue;
+          }
+
+          std::string success;
+          if (file_reader.filesize <=
+                          hasher::small_file_packer_t::max_file_size) {
+            success = small_file_packer.add(file_reader, sequence,
+                                            file_hash);
+          } else {
+            success = ingest_file(
+                 file_reader, r.import_manager, r.ingest_tracker,
+                 r.whitelist_scan_manager,
+                 r.repository_name, r.step_size, r.block_size,
+                 r.disable_recursive_processing,
+                 r.disable_calculate_entropy,
+                 r.disable_calculate_labels,
+                 r.source_name_sequencer, sequence, file_hash);
+          }
+          if (success.size() > 0) {
+            std::stringstream ss;
+            ss << "# Error while importing file " << file_reader.filename
+               << ", " << file_reader.error_message << "\n";
+            hashdb::tprint(std::cout, ss.str());
+
+          } else if (has_stat && st.st_mtime < start_time) {
+            // remember the file hash for the next ingest
+            r.file_hash_cache_manager->insert(file_reader.filename,
+                     hashdb::file_stat_t(st.st_dev, st.st_ino, st.st_size,
+                                         st.st_mtime),
+                     file_hash, r.repository_name);
+          }
+
+        } else {
+          std::stringstream ss;
+          ss << "# Skipping file " << file_reader.filename
+             << " size " << file_reader.filesize << "\n";
+          hashdb::tprint(std::cout, ss.str());
+        }
+      } else {
+        // this file could not be opened
+        std::stringstream ss;
+        ss << "# Unable to import file: " << file_reader.error_message << "\n";
+        hashdb::tprint(std::cout, ss.str());
+      }
+
+      // a file whose file hash was not found has no source name
+      if (file_hash.size() == 0) {
+        r.source_name_sequencer.put(sequence, "", "");
+      }
+    }
+
+    // push the last small files
+    small_file_packer.push();
+    return NULL;
+  }
+
   // ************************************************************
   // ingest
   // ************************************************************
@@ -280,6 +455,8 @@ namespace hashdb {
                      const bool disable_recursive_processing,
                      const bool disable_calculate_entropy,
                      const bool disable_calculate_labels,
+                     const bool use_file_hash_cache,
+                     const size_t p_num_readers,
                      const std::string& cmd) {
 
     bool has_whitelist = false;
@@ -314,18 +491,17 @@ namespace hashdb {
     // open import manager
     hashdb::import_manager_t import_manager(hashdb_dir, cmd);
 
-    // get the list of filenames to be processed
-    hasher::filenames_t filenames;
-    error_message = hasher::filename_list(ingest_path, &filenames);
-    if (error_message.size() != 0) {
-      return error_message;
+    // maybe open the file hash cache
+    hashdb::lmdb_file_hash_cache_manager_t* file_hash_cache_manager = NULL;
+    if (use_file_hash_cache) {
+      file_hash_cache_manager = new hashdb::lmdb_file_hash_cache_manager_t(
+               hashdb_dir,
+               hashdb::lmdb_file_hash_cache_manager_t::is_present(hashdb_dir) ?
+                                              hashdb::RW_MODIFY : hashdb::RW_NEW);
     }
 
-    // calculate the total number of bytes that will be processed
-    uint64_t total_bytes = calculate_total_bytes(filenames);
-
-    // create the ingest_tracker
-    hasher::ingest_tracker_t ingest_tracker(&import_manager, total_bytes);
+    // create the ingest_tracker, the total bytes is found as files are
+    hasher::ingest_tracker_t ingest_tracker(&import_manager, 0);
 
     // maybe open whitelist DB
     if (has_whitelist) {
@@ -335,6 +511,9 @@ namespace hashdb {
     // get the number of CPUs
     const size_t num_cpus = hashdb::numCPU();
 
+    // read files on one thread per CPU unless set
+    const size_t num_readers = (p_num_readers == 0) ? num_cpus : p_num_readers;
+
     // create the job queue to hold 2X more jobs than threads
     // Note: 2X is arbitrary.  The idea is to always have work available
     // but not to unnecessarily fill up RAM with buffers.
@@ -344,44 +523,44 @@ namespace hashdb {
     hasher::threadpool_t* const threadpool =
                                new hasher::threadpool_t(num_cpus, job_queue);
 
-    // iterate over files
-    for (hasher::filenames_t::const_iterator it=filenames.begin();
-                                           it != filenames.end(); it++) {
-      const hasher::file_reader_t file_reader(*it);
-
-      if (file_reader.error_message.size() == 0) {
-
-        // only process when file size > 0
-        if (file_reader.filesize > 0) {
-          std::string success = ingest_file(
-                 file_reader, import_manager, ingest_tracker,
-                 whitelist_scan_manager,
+    // find files while ingesting them.  Walking waits on the filesystem
+    // more than on the CPU, so use more threads than CPUs.
+    hasher::directory_walker_t directory_walker(ingest_path, num_cpus * 4);
+
+    // source names are inserted in the order files are taken from the
+    // walk, holding jobs of later files for as many jobs as are queued
+    // but no more than MAX_HELD_BYTES of buffers
+    hasher::source_name_sequencer_t source_name_sequencer(&import_manager,
+                                 repository_name, job_queue, num_cpus * 2,
+                                 MAX_HELD_BYTES);
+
+    // read files on reader threads until the walk is done
+    ingest_readers_t ingest_readers(import_manager, ingest_tracker,
+                 whitelist_scan_manager, file_hash_cache_manager,
+                 directory_walker, source_name_sequencer,
                  repository_name, step_size, settings.block_size,
                  disable_recursive_processing,
                  disable_calculate_entropy,
-                 disable_calculate_labels,
-                 job_queue);
-          if (success.size() > 0) {
-            std::stringstream ss;
-            ss << "# Error while importing file " << file_reader.filename
-               << ", " << file_reader.error_message << "\n";
-            hashdb::tprint(std::cout, ss.str());
-          }
-
-        } else {
-          std::stringstream ss;
-          ss << "# Skipping file " << file_reader.filename
-             << " size " << file_reader.filesize << "\n";
-          hashdb::tprint(std::cout, ss.str());
-        }
-      } else {
-        // this file could not be opened
-        std::stringstream ss;
-        ss << "# Unable to import file: " << file_reader.error_message << "\n";
-        hashdb::tprint(std::cout, ss.str());
+                 disable_calculate_labels);
+    std::vector<pthread_t> readers(num_readers);
+    for (size_t i=0; i<num_readers; i++) {
+      int rc = ::pthread_create(&readers[i], NULL, read_files,
+                                &ingest_readers);
+      if (rc != 0) {
+        std::cerr << "Unable to start ingest reader thread.\n";
+        assert(0);
+      }
+    }
+    for (size_t i=0; i<num_readers; i++) {
+      int status = pthread_join(readers[i], NULL);
+      if (status != 0) {
+        std::cerr << "error in ingest reader join " << status << "\n";
       }
     }
 
+    // all files are found
+    ingest_tracker.set_bytes_found(directory_walker.bytes_found(), true);
+
     // done
     job_queue->done_adding();
     delete threadpool;
@@ -389,10 +568,10 @@ namespace hashdb {
     if (has_whitelist) {
       delete whitelist_scan_manager;
     }
+    delete file_hash_cache_manager;
 
     // success
     return "";
   }
 
 } // end namespace hashdb
-
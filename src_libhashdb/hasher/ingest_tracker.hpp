@@ -24,6 +24,8 @@
  *   2) to track zero_count and nonprobative_count and store them
  *      when the total is ready.
  * Also tracks total bytes processed in order to provide progress feedback.
+ * The total grows while files are still being found, and is shown with
+ * a "+" until it is final.
  */
 
 #ifndef INGEST_TRACKER_HPP
@@ -41,6 +43,8 @@
 #include <unistd.h>
 #include <pthread.h>
 #include <map>
+#include <vector>
+#include <algorithm>
 #include "tprint.hpp"
 
 namespace hasher {
@@ -67,9 +71,13 @@ class ingest_tracker_t {
   };
     
   hashdb::import_manager_t* const import_manager;
-  std::map<std::string, source_data_t> source_data_map;
-  std::set<std::string> preexisting_sources;
-  const uint64_t bytes_total;
+  typedef std::map<hashdb::hash_key_t, source_data_t> source_data_map_t;
+  source_data_map_t source_data_map;
+  std::vector<hashdb::hash_key_t> preexisting_sources;  // sorted
+  uint64_t bytes_total;
+  uint64_t bytes_found;
+  uint64_t bytes_total_correction;
+  bool is_bytes_total_final;
   uint64_t bytes_done;
   uint64_t bytes_reported_done;
   mutable pthread_mutex_t M;
@@ -92,9 +100,21 @@ class ingest_tracker_t {
   void identify_preexisting_sources() {
     std::string file_hash = import_manager->first_source();
     while (file_hash != "") {
-      preexisting_sources.insert(file_hash);
+      preexisting_sources.push_back(hashdb::hash_key_t(file_hash));
       file_hash = import_manager->next_source(file_hash);
     }
+    std::sort(preexisting_sources.begin(), preexisting_sources.end());
+  }
+
+  // print %done, call under lock
+  void report_bytes() {
+    std::stringstream ss;
+    ss << "# " << bytes_done
+       << " of " << bytes_total << (is_bytes_total_final ? "" : "+")
+       << " bytes completed ("
+       << ((bytes_total == 0) ? 0 : bytes_done * 100 / bytes_total)
+       << "%)\n";
+    hashdb::tprint(std::cout, ss.str());
   }
 
   public:
@@ -104,6 +124,9 @@ class ingest_tracker_t {
                source_data_map(),
                preexisting_sources(),
                bytes_total(p_bytes_total),
+               bytes_found(p_bytes_total),
+               bytes_total_correction(0),
+               is_bytes_total_final(false),
                bytes_done(0),
                bytes_reported_done(0),
                M() {
@@ -121,16 +144,18 @@ class ingest_tracker_t {
   // true so record if added, else false if already there
   bool add_source(const std::string& file_hash, const uint64_t filesize,
                   const std::string& file_type, const size_t parts_total) {
+    const hashdb::hash_key_t key(file_hash);
     lock();
-    if (preexisting_sources.find(file_hash) != preexisting_sources.end() ||
-        source_data_map.find(file_hash) != source_data_map.end()) {
+    if (std::binary_search(preexisting_sources.begin(),
+                           preexisting_sources.end(), key) ||
+        source_data_map.find(key) != source_data_map.end()) {
       // already added
       unlock();
       return false;
     } else {
       // add this new source
-      source_data_map.insert(std::pair<std::string, source_data_t>(
-             file_hash, source_data_t(filesize, file_type, parts_total)));
+      source_data_map.insert(std::pair<hashdb::hash_key_t, source_data_t>(
+             key, source_data_t(filesize, file_type, parts_total)));
       unlock();
       return true;
     }
@@ -139,11 +164,11 @@ class ingest_tracker_t {
   void track_source(const std::string& file_hash,
                     const uint64_t zero_count,
                     const uint64_t nonprobative_count) {
+    const hashdb::hash_key_t key(file_hash);
     lock();
 
     // update count values in source_data
-    std::map<std::string, source_data_t>::const_iterator it =
-                                            source_data_map.find(file_hash);
+    source_data_map_t::const_iterator it = source_data_map.find(key);
     if (it == source_data_map.end()) {
       // program error
       assert(0);
@@ -158,13 +183,15 @@ class ingest_tracker_t {
     source_data.zero_count += zero_count;
     source_data.nonprobative_count += nonprobative_count;
     ++source_data.parts_done;
-    source_data_map.insert(std::pair<std::string, source_data_t>(
-                                                   file_hash, source_data));
+    source_data_map.insert(std::pair<hashdb::hash_key_t, source_data_t>(
+                                                   key, source_data));
 
     unlock();
 
-    // if this is the final update for this source, add this source data to DB
+    // if this is the final update for this source, add this source data to
+    // DB, after its hashes since source data marks the source as present
     if (source_data.parts_done == parts_total) {
+      import_manager->flush();
       import_manager->insert_source_data(file_hash,
                                          source_data.filesize,
                                          source_data.file_type,
@@ -173,21 +200,40 @@ class ingest_tracker_t {
     }
   }
 
+  // set the total size of the files found, which is final when all files
+  // are found
+  void set_bytes_found(const uint64_t p_bytes_found, const bool is_final) {
+    lock();
+    bytes_found = p_bytes_found;
+    bytes_total = bytes_found + bytes_total_correction;
+    is_bytes_total_final = is_final;
+    if (is_final && bytes_done == bytes_total && bytes_done != 0) {
+      // the last bytes were done before the total was final
+      report_bytes();
+    }
+    unlock();
+  }
+
+  // Count a file as its size when read instead of its size when found,
+  // for example for E01 media or for files that cannot be read.  The
+  // correction is modulo 2^64 while it is negative.
+  void correct_bytes_total(const uint64_t found_size,
+                           const uint64_t read_size) {
+    lock();
+    bytes_total_correction += read_size - found_size;
+    bytes_total = bytes_found + bytes_total_correction;
+    unlock();
+  }
+
   void track_bytes(const uint64_t count) {
     static const size_t INCREMENT = 134217728; // = 2^27 = 100 MiB
     lock();
     bytes_done += count;
-    if (bytes_done == bytes_total ||
+    if ((is_bytes_total_final && bytes_done == bytes_total) ||
         bytes_done > bytes_reported_done + INCREMENT) {
 
       // print %done
-      std::stringstream ss;
-      ss << "# " << bytes_done
-         << " of " << bytes_total
-         << " bytes completed (" << bytes_done * 100 / bytes_total
-         << "%)\n";
-      hashdb::tprint(std::cout, ss.str());
-
+      report_bytes();
 
       // next milestone
       bytes_reported_done += INCREMENT;
@@ -195,9 +241,17 @@ class ingest_tracker_t {
     unlock();
   }
 
+  // true if the source was in the DB before this ingest
+  bool is_preexisting_source(const std::string& file_hash) const {
+    return std::binary_search(preexisting_sources.begin(),
+                              preexisting_sources.end(),
+                              hashdb::hash_key_t(file_hash));
+  }
+
   bool seen_source(const std::string& file_hash) {
+    const hashdb::hash_key_t key(file_hash);
     lock();
-    bool has_hash = source_data_map.find(file_hash) != source_data_map.end();
+    bool has_hash = source_data_map.find(key) != source_data_map.end();
     unlock();
     return has_hash;
   }
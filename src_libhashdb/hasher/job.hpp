@@ -20,7 +20,10 @@
 /**
  * \file
  * job data is used by threads for ingesting or scanning data.
- * There are two job types, see job_type_t.
+ * There are three job types, see job_type_t.  An INGEST_SMALL_FILES job
+ * holds many small files back to back in one buffer, see small_file_t.
+ * A SCAN job's buffer may be a slice of a memory-mapped file, see
+ * buffer_is_mapped, in which case the job does not own it.
  */
 
 #ifndef JOB_HPP
@@ -30,6 +33,7 @@
 #include <sstream>
 #include <cstdlib>
 #include <stdint.h>
+#include <vector>
 //#include <unistd.h>
 #include "hashdb.hpp"
 #include "hash_calculator.hpp"
@@ -38,7 +42,29 @@
 
 namespace hasher {
 
-enum job_type_t {INGEST, SCAN};
+enum job_type_t {INGEST, SCAN, INGEST_SMALL_FILES};
+
+/**
+ * A file in the buffer of an INGEST_SMALL_FILES job.
+ */
+struct small_file_t {
+  std::string file_hash;
+  std::string filename;
+  uint64_t filesize;
+  size_t buffer_offset;
+  bool disable_ingest_hashes;
+  small_file_t(const std::string& p_file_hash,
+               const std::string& p_filename,
+               const uint64_t p_filesize,
+               const size_t p_buffer_offset,
+               const bool p_disable_ingest_hashes) :
+                   file_hash(p_file_hash),
+                   filename(p_filename),
+                   filesize(p_filesize),
+                   buffer_offset(p_buffer_offset),
+                   disable_ingest_hashes(p_disable_ingest_hashes) {
+  }
+};
 
 class job_t {
 
@@ -66,7 +92,9 @@ class job_t {
         const size_t p_buffer_data_size,
         const size_t p_max_recursion_depth,
         const size_t p_recursion_depth,
-        const std::string p_recursion_path) :
+        const std::string p_recursion_path,
+        const std::vector<small_file_t>* const p_small_files,
+        const bool p_buffer_is_mapped) :
                    job_type(p_job_type),
                    import_manager(p_import_manager),
                    ingest_tracker(p_ingest_tracker),
@@ -91,6 +119,8 @@ class job_t {
                    max_recursion_depth(p_max_recursion_depth),
                    recursion_depth(p_recursion_depth),
                    recursion_path(p_recursion_path),
+                   small_files(p_small_files),
+                   buffer_is_mapped(p_buffer_is_mapped),
                    error_message("") {
   }
 
@@ -123,6 +153,8 @@ class job_t {
   const size_t max_recursion_depth;
   const size_t recursion_depth;
   const std::string recursion_path;
+  const std::vector<small_file_t>* const small_files;
+  const bool buffer_is_mapped;
   std::string error_message;
 
   // ingest
@@ -172,10 +204,58 @@ class job_t {
                      p_buffer_data_size,
                      p_max_recursion_depth,
                      p_recursion_depth,
-                     p_recursion_path);
+                     p_recursion_path,
+                     NULL,  // small_files
+                     false); // buffer_is_mapped
+  }
+
+  // ingest small files packed into one buffer, taking small_files
+  static job_t* new_ingest_small_files_job(
+        hashdb::import_manager_t* const p_import_manager,
+        hasher::ingest_tracker_t* const p_ingest_tracker,
+        const hashdb::scan_manager_t* const p_whitelist_scan_manager,
+        const std::string p_repository_name,
+        const size_t p_step_size,
+        const size_t p_block_size,
+        const bool p_disable_recursive_processing,
+        const bool p_disable_calculate_entropy,
+        const bool p_disable_calculate_labels,
+        const std::vector<small_file_t>* const p_small_files,
+        const uint8_t* const p_buffer,
+        const size_t p_buffer_size,
+        const size_t p_buffer_data_size,
+        const size_t p_max_recursion_depth) {
+
+    return new job_t(
+                     job_type_t::INGEST_SMALL_FILES,
+                     p_import_manager,
+                     p_ingest_tracker,
+                     p_whitelist_scan_manager,
+                     p_repository_name,
+                     NULL, // scan_manager
+                     NULL, // scan_tracker
+                     p_step_size,
+                     p_block_size,
+                     "",   // file hash, see small_files
+                     "",   // filename, see small_files
+                     p_buffer_data_size, // filesize is all the files
+                     0,    // file_offset
+                     p_disable_recursive_processing,
+                     p_disable_calculate_entropy,
+                     p_disable_calculate_labels,
+                     false, // disable_ingest_hashes, see small_files
+                     hashdb::scan_mode_t::EXPANDED, // scan_mode not used
+                     p_buffer,
+                     p_buffer_size,
+                     p_buffer_data_size,
+                     p_max_recursion_depth,
+                     0,    // recursion_depth
+                     "",   // recursion_path
+                     p_small_files,
+                     false); // buffer_is_mapped
   }
 
-  // scan
+  // scan, a mapped buffer is a slice of a memory-mapped file
   static job_t* new_scan_job(
         hashdb::scan_manager_t* const p_scan_manager,
         hasher::scan_tracker_t* const p_scan_tracker,
@@ -187,6 +267,7 @@ class job_t {
         const bool p_disable_recursive_processing,
         const hashdb::scan_mode_t p_scan_mode,
         const uint8_t* const p_buffer,
+        const bool p_buffer_is_mapped,
         const size_t p_buffer_size,
         const size_t p_buffer_data_size,
         const size_t p_max_recursion_depth,
@@ -217,7 +298,9 @@ class job_t {
                      p_buffer_data_size,
                      p_max_recursion_depth,
                      p_recursion_depth,
-                     p_recursion_path);
+                     p_recursion_path,
+                     NULL,  // small_files
+                     p_buffer_is_mapped);
   }
 };
 
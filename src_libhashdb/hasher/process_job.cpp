@@ -46,6 +46,7 @@
 #include <sys/stat.h>
 #include <iostream>
 #include <unistd.h>
+#include <vector>
 #include "hashdb.hpp"
 #include "job.hpp"
 #include "tprint.hpp"
@@ -54,6 +55,7 @@
 #include "hash_calculator.hpp"
 #include "entropy_calculator.hpp"
 #include "calculate_block_label.hpp"
+#include "file_reader_helper.hpp"
 
 namespace hasher {
 
@@ -86,6 +88,15 @@ namespace hasher {
         ss << "# Scanning ";
         break;
       }
+      case hasher::job_type_t::INGEST_SMALL_FILES: {
+        // print the file count, first file, and size of all the files
+        ss << "# Ingesting " << job.small_files->size() << " small files "
+           << job.small_files->front().filename << "..."
+           << " size " << job.filesize
+           << "\n";
+        hashdb::tprint(std::cout, ss.str());
+        return;
+      }
       default:
         assert(0);
     }
@@ -107,19 +118,15 @@ namespace hasher {
   }
 
 
-  // process INGEST job
-  static void process_ingest_job(const hasher::job_t& job) {
-
-    // print status
-    print_status(job);
+  // add the block hashes of the job's buffer to the DB and recursively
+  // process it, reusing the calculators.  If hash_inserts is given, the
+  // block hashes are added to it for the caller to insert instead.
+  static void ingest_buffer(const hasher::job_t& job,
+                            hasher::hash_calculator_t& hash_calculator,
+                      const hasher::entropy_calculator_t& entropy_calculator,
+                std::vector<hashdb::hash_insert_t>* const hash_inserts = NULL) {
 
     if (!job.disable_ingest_hashes) {
-      // get hash calculator object
-      hasher::hash_calculator_t hash_calculator;
-
-      // get entropy calculator object
-      hasher::entropy_calculator_t entropy_calculator(job.block_size);
-
       // iterate over buffer to add block hashes and metadata
       size_t zero_count = 0;
       size_t nonprobative_count = 0;
@@ -153,8 +160,13 @@ namespace hasher {
         }
 
         // add block hash to DB
-        job.import_manager->insert_hash(block_hash, k_entropy, block_label,
-                                        job.file_hash);
+        if (hash_inserts != NULL) {
+          hash_inserts->push_back(hashdb::hash_insert_t(
+                          block_hash, k_entropy, block_label, job.file_hash));
+        } else {
+          job.import_manager->insert_hash(block_hash, k_entropy, block_label,
+                                          job.file_hash);
+        }
       }
 
       // submit tracked source counts to the ingest tracker for final reporting
@@ -162,18 +174,90 @@ namespace hasher {
                                job.file_hash, zero_count, nonprobative_count);
     }
 
+    // recursively find and process any uncompressible data in order to
+    // record their source names
+    if (!job.disable_recursive_processing) {
+      process_recursive(job);
+    }
+  }
+
+  // process INGEST job
+  static void process_ingest_job(const hasher::job_t& job) {
+
+    // print status
+    print_status(job);
+
+    // get hash calculator object
+    hasher::hash_calculator_t hash_calculator;
+
+    // get entropy calculator object
+    hasher::entropy_calculator_t entropy_calculator(job.block_size);
+
+    // add block hashes and recurse
+    ingest_buffer(job, hash_calculator, entropy_calculator);
+
     // submit bytes processed to the ingest tracker for final reporting
     if (job.recursion_depth == 0) {
       job.ingest_tracker->track_bytes(job.buffer_data_size);
     }
 
-    // recursively find and process any uncompressible data in order to
-    // record their source names
-    if (!job.disable_recursive_processing) {
-      process_recursive(job);
+    // we are now done with this job.  Delete it.
+    delete[] job.buffer;
+    delete &job;
+  }
+
+  // process INGEST_SMALL_FILES job
+  static void process_ingest_small_files_job(const hasher::job_t& job) {
+
+    // print status
+    print_status(job);
+
+    // get calculators once for all the files
+    hasher::hash_calculator_t hash_calculator;
+    hasher::entropy_calculator_t entropy_calculator(job.block_size);
+
+    // block hashes of the files, inserted together
+    std::vector<hashdb::hash_insert_t> hash_inserts;
+
+    // ingest each file as an INGEST job over its part of the buffer
+    for (std::vector<small_file_t>::const_iterator it =
+            job.small_files->begin(); it != job.small_files->end(); ++it) {
+      job_t* file_job = job_t::new_ingest_job(
+                   job.import_manager,
+                   job.ingest_tracker,
+                   job.whitelist_scan_manager,
+                   job.repository_name,
+                   job.step_size,
+                   job.block_size,
+                   it->file_hash,
+                   it->filename,
+                   it->filesize,
+                   0,      // file_offset
+                   job.disable_recursive_processing,
+                   job.disable_calculate_entropy,
+                   job.disable_calculate_labels,
+                   it->disable_ingest_hashes,
+                   job.buffer + it->buffer_offset, // buffer
+                   it->filesize, // buffer_size
+                   it->filesize, // buffer_data_size
+                   job.max_recursion_depth,
+                   0,      // recursion_depth
+                   "");    // recursion path
+      ingest_buffer(*file_job, hash_calculator, entropy_calculator,
+                    &hash_inserts);
+
+      // the buffer belongs to this job
+      delete file_job;
     }
 
+    // add the block hashes of all the files to DB
+    job.import_manager->insert_hashes(hash_inserts);
+
+    // submit bytes processed to the ingest tracker for final reporting
+    job.ingest_tracker->track_bytes(job.buffer_data_size);
+
     // we are now done with this job.  Delete it.
+    delete job.small_files;
     delete[] job.buffer;
     delete &job;
   }
@@ -185,6 +269,7 @@ namespace hasher {
     print_status(job);
 
     size_t zero_count = 0;
+    size_t match_count = 0;
 
     // get hash calculator object
     hasher::hash_calculator_t hash_calculator;
@@ -207,6 +292,8 @@ namespace hasher {
               job.scan_manager->find_hash_json(job.scan_mode, block_hash);
 
       if (json_string.size() > 0) {
+        ++match_count;
+
         // match so print offset <tab> file <tab> json
         std::stringstream ss;
         if (job.recursion_path != "") {
@@ -234,6 +321,8 @@ namespace hasher {
     // submit tracked bytes processed to the scan tracker for final reporting
     if (job.recursion_depth == 0) {
       job.scan_tracker->track_bytes(job.buffer_data_size);
+      job.scan_tracker->track_matches(job.file_offset, job.buffer_data_size,
+                                      match_count);
     }
 
     // recursively find and process any uncompressible data
@@ -242,7 +331,12 @@ namespace hasher {
     }
 
     // we are now done with this job.  Delete it.
-    delete[] job.buffer;
+    if (job.buffer_is_mapped) {
+      // the buffer is part of a file's map, let its pages go
+      hasher::release_mapped(job.buffer, job.buffer_data_size);
+    } else {
+      delete[] job.buffer;
+    }
     delete &job;
   }
 
@@ -259,6 +353,11 @@ namespace hasher {
         break;
       }
 
+      case hasher::job_type_t::INGEST_SMALL_FILES: {
+        process_ingest_small_files_job(job);
+        break;
+      }
+
       default:
         assert(0);
     }
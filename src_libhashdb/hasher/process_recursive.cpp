@@ -189,6 +189,7 @@ namespace hasher {
                    parent_job.disable_recursive_processing,
                    parent_job.scan_mode,
                    uncompressed_buffer,
+                   false,             // buffer_is_mapped
                    uncompressed_size, // buffer_size
                    uncompressed_size, // buffer_data_size
                    parent_job.max_recursion_depth,
@@ -199,6 +200,10 @@ namespace hasher {
         process_job(*recursed_scan_media_job);
         break;
       }
+
+      // small files are recursed as INGEST jobs of each file
+      default:
+        assert(0);
     }
   }
 
@@ -0,0 +1,294 @@
+// Author:  Bruce Allen
+// Created: 2/25/2013
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on February 25, 2013 by Bruce Allen.
+
+/**
+ * \file
+ * Tracks the samples of a sampling scan.  The media is divided into
+ * samples of sample_size bytes.  The producer pushes one primary sample
+ * chosen at random from each stratum of consecutive samples, and
+ * threads track the matches found in each sample.  A sample with
+ * matches queues its neighbors to be scanned so that regions with
+ * matches are scanned densely.  Threadsafe.
+ *
+ * The number of matching blocks in the media is estimated from the
+ * primary samples only, as a simple random sample of the samples, with
+ * a 95% confidence interval.  A sample drawn as primary after it was
+ * scanned as a neighbor is not scanned again but is counted as primary,
+ * so that every stratum has its primary sample.
+ */
+
+#ifndef SAMPLE_TRACKER_HPP
+#define SAMPLE_TRACKER_HPP
+
+#include <cmath>
+#include <stdint.h>
+#include <assert.h>
+#include <iostream>
+#include <sstream>
+#include <map>
+#include <queue>
+#include <pthread.h>
+
+namespace hasher {
+
+class sample_tracker_t {
+
+  public:
+  const uint64_t filesize;
+  const uint64_t sample_size;
+  const uint64_t num_samples;            // samples in the media
+
+  private:
+  // a sample that is pushed
+  struct sample_t {
+    bool is_primary;
+    bool is_tracked;
+    size_t match_count;
+    sample_t(const bool p_is_primary) :
+              is_primary(p_is_primary), is_tracked(false), match_count(0) {
+    }
+  };
+
+  std::map<uint64_t, sample_t> pushed;   // by sample index
+  std::queue<uint64_t> neighbors;        // samples to scan densely
+  size_t in_flight;                      // pushed and not yet tracked
+
+  // the primary samples and their matches
+  uint64_t primary_count;
+  uint64_t primary_matches;
+  double primary_matches_squared;
+
+  // all samples
+  uint64_t bytes_sampled;
+  uint64_t matches;
+  mutable pthread_mutex_t M;             // mutext
+  pthread_cond_t C;                      // signals tracked samples
+
+  // do not allow copy or assignment
+  sample_tracker_t(const sample_tracker_t&);
+  sample_tracker_t& operator=(const sample_tracker_t&);
+
+  void lock() const {
+    if(pthread_mutex_lock(&M)) {
+      assert(0);
+    }
+  }
+
+  void unlock() const {
+    pthread_mutex_unlock(&M);
+  }
+
+  // count the matches of a primary sample, call under lock
+  void track_primary(const size_t match_count) {
+    ++primary_count;
+    primary_matches += match_count;
+    primary_matches_squared += static_cast<double>(match_count) *
+                               match_count;
+  }
+
+  // queue a neighbor to scan unless it is pushed, call under lock
+  void add_neighbor(const uint64_t index) {
+    if (index < num_samples && pushed.find(index) == pushed.end()) {
+      neighbors.push(index);
+    }
+  }
+
+  // take a queued neighbor that is not pushed, call under lock
+  bool pop_neighbor(uint64_t& index) {
+    while (!neighbors.empty()) {
+      index = neighbors.front();
+      neighbors.pop();
+      if (pushed.find(index) == pushed.end()) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  public:
+  sample_tracker_t(const uint64_t p_filesize,
+                   const uint64_t p_sample_size) :
+                     filesize(p_filesize),
+                     sample_size(p_sample_size),
+                     num_samples((p_filesize + p_sample_size - 1) /
+                                 p_sample_size),
+                     pushed(), neighbors(), in_flight(0),
+                     primary_count(0), primary_matches(0),
+                     primary_matches_squared(0),
+                     bytes_sampled(0), matches(0), M(), C() {
+    if(pthread_mutex_init(&M,NULL)) {
+      std::cerr << "Error obtaining mutex.\n";
+      assert(0);
+    }
+    if(pthread_cond_init(&C,NULL)) {
+      std::cerr << "Error obtaining condition variable.\n";
+      assert(0);
+    }
+  }
+
+  ~sample_tracker_t() {
+    pthread_cond_destroy(&C);
+    pthread_mutex_destroy(&M);
+  }
+
+  /**
+   * Mark the sample at index as pushed.  False if it is already pushed,
+   * in which case do not push it again.  A primary sample that is
+   * already pushed as a neighbor becomes primary, and its matches are
+   * counted as primary once they are tracked.
+   */
+  bool push(const uint64_t index, const bool is_primary) {
+    lock();
+    const std::pair<std::map<uint64_t, sample_t>::iterator, bool> result =
+               pushed.insert(std::pair<uint64_t, sample_t>(
+                                               index, sample_t(is_primary)));
+    sample_t& sample = result.first->second;
+    if (result.second) {
+      ++in_flight;
+    } else if (is_primary && !sample.is_primary) {
+      sample.is_primary = true;
+      if (sample.is_tracked) {
+        track_primary(sample.match_count);
+      }
+    }
+    unlock();
+    return result.second;
+  }
+
+  /**
+   * Track the number of matches found in the sample at file_offset.
+   */
+  void track_matches(const uint64_t file_offset,
+                     const uint64_t bytes_scanned,
+                     const size_t match_count) {
+    const uint64_t index = file_offset / sample_size;
+    lock();
+    std::map<uint64_t, sample_t>::iterator it = pushed.find(index);
+    assert(it != pushed.end());
+    it->second.is_tracked = true;
+    it->second.match_count = match_count;
+    if (it->second.is_primary) {
+      track_primary(match_count);
+    }
+    bytes_sampled += bytes_scanned;
+    matches += match_count;
+    if (match_count > 0) {
+      if (index > 0) {
+        add_neighbor(index - 1);
+      }
+      add_neighbor(index + 1);
+    }
+    --in_flight;
+    pthread_cond_broadcast(&C);
+    unlock();
+  }
+
+  /**
+   * Take the index of a neighbor sample to scan, false if there is none
+   * now.
+   */
+  bool take_neighbor(uint64_t& index) {
+    lock();
+    const bool has_neighbor = pop_neighbor(index);
+    unlock();
+    return has_neighbor;
+  }
+
+  /**
+   * Take the index of a neighbor sample to scan, waiting while pushed
+   * samples are not tracked.  False when no sample is in flight and no
+   * neighbor is queued, so scanning is done.
+   */
+  bool wait_for_neighbor(uint64_t& index) {
+    lock();
+    bool has_neighbor = pop_neighbor(index);
+    while (!has_neighbor && in_flight > 0) {
+      pthread_cond_wait(&C, &M);
+      has_neighbor = pop_neighbor(index);
+    }
+    unlock();
+    return has_neighbor;
+  }
+
+  /**
+   * True while pushed samples are not tracked or neighbors are queued.
+   */
+  bool is_busy() const {
+    lock();
+    const bool busy = in_flight > 0 || !neighbors.empty();
+    unlock();
+    return busy;
+  }
+
+  /**
+   * Print the samples scanned and the estimated number of matching
+   * blocks, call after threads are done.
+   */
+  void report(std::ostream& os) const {
+    lock();
+    std::stringstream ss;
+    ss << "# Sampled " << bytes_sampled << " of " << filesize << " bytes ("
+       << ((filesize == 0) ? 0 : bytes_sampled * 100 / filesize)
+       << "%) in " << pushed.size() << " samples, "
+       << primary_count << " primary\n"
+       << "# Matching blocks found in samples: " << matches << "\n";
+
+    if (primary_count > 0) {
+      // estimate total matches with the expansion estimator of a simple
+      // random sample, with finite population correction
+      const double n = static_cast<double>(primary_count);
+      const double big_n = static_cast<double>(num_samples);
+      const double mean = primary_matches / n;
+      double estimate = big_n * mean;
+      double lower = estimate;
+      double upper = estimate;
+      if (primary_count > 1) {
+        double variance = (primary_matches_squared - n * mean * mean) /
+                          (n - 1);
+        if (variance < 0) {
+          variance = 0;
+        }
+        const double standard_error =
+               big_n * std::sqrt((1 - n / big_n) * variance / n);
+        lower = estimate - 1.96 * standard_error;
+        upper = estimate + 1.96 * standard_error;
+      }
+
+      // there are at least as many as were found
+      if (estimate < matches) {
+        estimate = matches;
+      }
+      if (lower < matches) {
+        lower = matches;
+      }
+      ss << "# Estimated matching blocks in media: "
+         << static_cast<uint64_t>(estimate + 0.5)
+         << ", 95% confidence interval "
+         << static_cast<uint64_t>(lower + 0.5) << " to "
+         << static_cast<uint64_t>((upper > estimate ? upper : estimate) + 0.5)
+         << "\n";
+    }
+    unlock();
+    os << ss.str();
+  }
+};
+
+} // end namespace hasher
+
+#endif
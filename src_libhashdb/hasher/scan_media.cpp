@@ -37,7 +37,10 @@
 #endif
 
 #include <string>
+#include <vector>
+#include <random>
 #include <cassert>
+#include <pthread.h>
 #include <iostream>
 #include <unistd.h> // for F_OK
 #include <sstream>
@@ -49,11 +52,13 @@
 #include "job.hpp"
 #include "job_queue.hpp"
 #include "scan_tracker.hpp"
+#include "sample_tracker.hpp"
 #include "tprint.hpp"
 
 static const size_t BUFFER_DATA_SIZE = 16777216;   // 2^24=16MiB
 static const size_t BUFFER_SIZE = 17825792;        // 2^24+2^20=17MiB
 static const size_t MAX_RECURSION_DEPTH = 7;
+static const size_t SAMPLE_SIZE = 65536;           // 2^16=64KiB
 
 namespace hashdb {
   // ************************************************************
@@ -73,6 +78,43 @@ namespace hashdb {
     size_t max_recursion_depth = 
                         (process_embedded_data) ? MAX_RECURSION_DEPTH : 0;
 
+    // push slices of the file's map when it is mapped, the jobs do not
+    // own them
+    const uint8_t* const map = file_reader.mapped_data();
+    if (map != NULL) {
+      for (uint64_t offset = 0;
+           offset < file_reader.filesize;
+           offset += BUFFER_DATA_SIZE) {
+
+        const size_t b_size = (file_reader.filesize - offset <= BUFFER_SIZE)
+                              ? file_reader.filesize - offset : BUFFER_SIZE;
+        const size_t b_data_size = (b_size > BUFFER_DATA_SIZE)
+                                   ? BUFFER_DATA_SIZE : b_size;
+
+        // read ahead while waiting to push
+        file_reader.will_need(offset, b_size);
+
+        job_queue->push(hasher::job_t::new_scan_job(
+                 &scan_manager,
+                 &scan_tracker,
+                 step_size,
+                 block_size,
+                 file_reader.filename,
+                 file_reader.filesize,
+                 offset, // file_offset
+                 process_embedded_data,
+                 scan_mode,
+                 map + offset, // buffer
+                 true,   // buffer_is_mapped
+                 b_size, // buffer_size
+                 b_data_size, // buffer_data_size
+                 max_recursion_depth,
+                 0,      // recursion_depth
+                 ""));   // recursion path
+      }
+      return "";
+    }
+
     // create buffer b to read into
     size_t b_size = (file_reader.filesize <= BUFFER_SIZE) ?
                           file_reader.filesize : BUFFER_SIZE;
@@ -107,6 +149,7 @@ namespace hashdb {
                  process_embedded_data,
                  scan_mode,
                  b,      // buffer
+                 false,  // buffer_is_mapped
                  b_size, // buffer_size
                  b_data_size, // buffer_data_size,
                  max_recursion_depth,
@@ -149,6 +192,7 @@ namespace hashdb {
                  process_embedded_data,
                  scan_mode,
                  b2,      // buffer
+                 false,   // buffer_is_mapped
                  b2_bytes_read, // buffer_size
                  b2_data_size,  // buffer_data_size
                  max_recursion_depth,
@@ -158,6 +202,315 @@ namespace hashdb {
     return "";
   }
 
+  // ************************************************************
+  // scan_ewf_file
+  // ************************************************************
+  // E01 media is read on several threads, each with its own libewf
+  // handle, so that chunk decompression is not serialized.  Readers take
+  // buffer offsets in order.  The bounded job queue bounds the
+  // decompressed buffers waiting to be scanned.
+  class ewf_readers_t {
+    private:
+    uint64_t next_offset;
+    mutable pthread_mutex_t M;                  // mutext
+
+    // do not allow copy or assignment
+    ewf_readers_t(const ewf_readers_t&);
+    ewf_readers_t& operator=(const ewf_readers_t&);
+
+    void lock() const {
+      if(pthread_mutex_lock(&M)) {
+        assert(0);
+      }
+    }
+
+    void unlock() const {
+      pthread_mutex_unlock(&M);
+    }
+
+    public:
+    const hasher::filename_t native_filename;
+    const uint64_t filesize;
+    hashdb::scan_manager_t& scan_manager;
+    hasher::scan_tracker_t& scan_tracker;
+    const size_t step_size;
+    const size_t block_size;
+    const bool process_embedded_data;
+    const hashdb::scan_mode_t scan_mode;
+    hasher::job_queue_t* const job_queue;
+    std::string error_message;
+
+    ewf_readers_t(const hasher::filename_t& p_native_filename,
+                  const uint64_t p_filesize,
+                  hashdb::scan_manager_t& p_scan_manager,
+                  hasher::scan_tracker_t& p_scan_tracker,
+                  const size_t p_step_size,
+                  const size_t p_block_size,
+                  const bool p_process_embedded_data,
+                  const hashdb::scan_mode_t p_scan_mode,
+                  hasher::job_queue_t* const p_job_queue) :
+                 next_offset(0),
+                 M(),
+                 native_filename(p_native_filename),
+                 filesize(p_filesize),
+                 scan_manager(p_scan_manager),
+                 scan_tracker(p_scan_tracker),
+                 step_size(p_step_size),
+                 block_size(p_block_size),
+                 process_embedded_data(p_process_embedded_data),
+                 scan_mode(p_scan_mode),
+                 job_queue(p_job_queue),
+                 error_message("") {
+      if(pthread_mutex_init(&M,NULL)) {
+        std::cerr << "Error obtaining mutex.\n";
+        assert(0);
+      }
+    }
+
+    ~ewf_readers_t() {
+      pthread_mutex_destroy(&M);
+    }
+
+    // take the offset of the next buffer to read, false when done
+    bool take(uint64_t& offset) {
+      lock();
+      const bool has_offset = next_offset < filesize &&
+                              error_message.size() == 0;
+      if (has_offset) {
+        offset = next_offset;
+        next_offset += BUFFER_DATA_SIZE;
+      }
+      unlock();
+      return has_offset;
+    }
+
+    // keep the first error and stop taking buffers
+    void set_error(const std::string& p_error_message) {
+      lock();
+      if (error_message.size() == 0) {
+        error_message = p_error_message;
+      }
+      unlock();
+    }
+  };
+
+  // open a libewf handle and read and push buffers until done
+  static void* read_ewf_buffers(void* const arg) {
+    ewf_readers_t& r = *static_cast<ewf_readers_t*>(arg);
+
+    // identify the maximum recursion depth
+    const size_t max_recursion_depth =
+                      (r.process_embedded_data) ? MAX_RECURSION_DEPTH : 0;
+
+    const hasher::file_reader_t file_reader(r.native_filename);
+    if (file_reader.error_message.size() > 0) {
+      r.set_error(file_reader.error_message);
+      return NULL;
+    }
+
+    uint64_t offset;
+    while (r.take(offset)) {
+
+      // create b to read into
+      const size_t b_size = (r.filesize - offset <= BUFFER_SIZE)
+                            ? r.filesize - offset : BUFFER_SIZE;
+      uint8_t* b = new (std::nothrow) uint8_t[b_size]();
+      if (b == NULL) {
+        r.set_error("bad memory allocation");
+        return NULL;
+      }
+
+      // read into b
+      size_t b_bytes_read = 0;
+      const std::string error_message =
+                         file_reader.read(offset, b, b_size, &b_bytes_read);
+      if (error_message.size() > 0) {
+        delete[] b;
+        r.set_error(error_message);
+        return NULL;
+      }
+
+      // push buffer b onto the job queue
+      const size_t b_data_size = (b_bytes_read > BUFFER_DATA_SIZE)
+                                 ? BUFFER_DATA_SIZE : b_bytes_read;
+      r.job_queue->push(hasher::job_t::new_scan_job(
+                 &r.scan_manager,
+                 &r.scan_tracker,
+                 r.step_size,
+                 r.block_size,
+                 file_reader.filename,
+                 r.filesize,
+                 offset, // file_offset
+                 r.process_embedded_data,
+                 r.scan_mode,
+                 b,      // buffer
+                 false,  // buffer_is_mapped
+                 b_bytes_read, // buffer_size
+                 b_data_size,  // buffer_data_size
+                 max_recursion_depth,
+                 0,      // recursion_depth
+                 ""));   // recursion path
+    }
+    return NULL;
+  }
+
+  std::string scan_ewf_file(
+        const hasher::filename_t& native_filename,
+        const uint64_t filesize,
+        hashdb::scan_manager_t& scan_manager,
+        hasher::scan_tracker_t& scan_tracker,
+        const size_t step_size,
+        const size_t block_size,
+        const bool process_embedded_data,
+        const hashdb::scan_mode_t scan_mode,
+        hasher::job_queue_t* const job_queue,
+        const size_t num_readers) {
+
+    ewf_readers_t ewf_readers(native_filename, filesize, scan_manager,
+                              scan_tracker, step_size, block_size,
+                              process_embedded_data, scan_mode, job_queue);
+    std::vector<pthread_t> readers(num_readers);
+    for (size_t i=0; i<num_readers; i++) {
+      int rc = ::pthread_create(&readers[i], NULL, read_ewf_buffers,
+                                &ewf_readers);
+      if (rc != 0) {
+        std::cerr << "Unable to start E01 reader thread.\n";
+        assert(0);
+      }
+    }
+    for (size_t i=0; i<num_readers; i++) {
+      int status = pthread_join(readers[i], NULL);
+      if (status != 0) {
+        std::cerr << "error in E01 reader join " << status << "\n";
+      }
+    }
+    return ewf_readers.error_message;
+  }
+
+  // ************************************************************
+  // scan_file_samples
+  // ************************************************************
+  // read the sample at index and push it onto the job queue unless it is
+  // already pushed
+  static std::string push_sample(
+        const hasher::file_reader_t& file_reader,
+        hashdb::scan_manager_t& scan_manager,
+        hasher::scan_tracker_t& scan_tracker,
+        hasher::sample_tracker_t& sample_tracker,
+        const size_t step_size,
+        const size_t block_size,
+        const bool process_embedded_data,
+        const hashdb::scan_mode_t scan_mode,
+        hasher::job_queue_t* const job_queue,
+        const uint64_t index,
+        const bool is_primary) {
+
+    if (!sample_tracker.push(index, is_primary)) {
+      // already pushed
+      return "";
+    }
+
+    // create b to read the sample and the bytes of its last block into
+    const uint64_t offset = index * SAMPLE_SIZE;
+    const uint64_t remaining = file_reader.filesize - offset;
+    const size_t b_size = (remaining < SAMPLE_SIZE + block_size)
+                          ? remaining : SAMPLE_SIZE + block_size;
+    uint8_t* b = new (std::nothrow) uint8_t[b_size]();
+    if (b == NULL) {
+      return "bad memory allocation";
+    }
+
+    // read into b
+    size_t b_bytes_read = 0;
+    const std::string error_message =
+                       file_reader.read(offset, b, b_size, &b_bytes_read);
+    if (error_message.size() > 0) {
+      delete[] b;
+      return error_message;
+    }
+
+    // push buffer b onto the job queue
+    const size_t b_data_size = (b_size > SAMPLE_SIZE) ? SAMPLE_SIZE : b_size;
+    job_queue->push(hasher::job_t::new_scan_job(
+                 &scan_manager,
+                 &scan_tracker,
+                 step_size,
+                 block_size,
+                 file_reader.filename,
+                 file_reader.filesize,
+                 offset, // file_offset
+                 process_embedded_data,
+                 scan_mode,
+                 b,      // buffer
+                 false,  // buffer_is_mapped
+                 b_size, // buffer_size
+                 b_data_size, // buffer_data_size
+                 (process_embedded_data) ? MAX_RECURSION_DEPTH : 0,
+                 0,      // recursion_depth
+                 ""));   // recursion path
+    return "";
+  }
+
+  // scan one sample chosen at random from each stratum of
+  // samples_per_stratum samples, and the neighbors of samples with
+  // matches.  The same samples are chosen each time.
+  std::string scan_file_samples(
+        const hasher::file_reader_t& file_reader,
+        hashdb::scan_manager_t& scan_manager,
+        hasher::scan_tracker_t& scan_tracker,
+        hasher::sample_tracker_t& sample_tracker,
+        const size_t step_size,
+        const size_t block_size,
+        const bool process_embedded_data,
+        const hashdb::scan_mode_t scan_mode,
+        hasher::job_queue_t* const job_queue,
+        const uint64_t samples_per_stratum) {
+
+    std::mt19937_64 random_generator(0);
+    std::string error_message;
+    uint64_t index;
+    for (uint64_t stratum = 0;
+         stratum < sample_tracker.num_samples;
+         stratum += samples_per_stratum) {
+
+      // the primary sample of this stratum
+      const uint64_t stratum_size =
+               (sample_tracker.num_samples - stratum < samples_per_stratum)
+               ? sample_tracker.num_samples - stratum : samples_per_stratum;
+      error_message = push_sample(file_reader, scan_manager, scan_tracker,
+                     sample_tracker, step_size, block_size,
+                     process_embedded_data, scan_mode, job_queue,
+                     stratum + random_generator() % stratum_size, true);
+      if (error_message.size() > 0) {
+        return error_message;
+      }
+
+      // neighbors of samples with matches
+      while (sample_tracker.take_neighbor(index)) {
+        error_message = push_sample(file_reader, scan_manager, scan_tracker,
+                     sample_tracker, step_size, block_size,
+                     process_embedded_data, scan_mode, job_queue,
+                     index, false);
+        if (error_message.size() > 0) {
+          return error_message;
+        }
+      }
+    }
+
+    // scan neighbors until the matching regions are scanned, waiting for
+    // samples in flight to be tracked
+    while (sample_tracker.wait_for_neighbor(index)) {
+      error_message = push_sample(file_reader, scan_manager, scan_tracker,
+                     sample_tracker, step_size, block_size,
+                     process_embedded_data, scan_mode, job_queue,
+                     index, false);
+      if (error_message.size() > 0) {
+        return error_message;
+      }
+    }
+    return "";
+  }
+
   // ************************************************************
   // scan_media
   // ************************************************************
@@ -165,7 +518,8 @@ namespace hashdb {
                          const std::string& media_filename,
                          const size_t step_size,
                          const bool process_embedded_data,
-                         const hashdb::scan_mode_t scan_mode) {
+                         const hashdb::scan_mode_t scan_mode,
+                         const double sample_fraction) {
 
     // make sure hashdb_dir is there
     std::string error_message;
@@ -175,19 +529,28 @@ namespace hashdb {
       return error_message;
     }
 
-    // open scan manager
-    hashdb::scan_manager_t scan_manager(hashdb_dir);
+    // open scan manager, caching up to 64MiB of results for repeated hashes
+    hashdb::scan_manager_t scan_manager(hashdb_dir, 100000, 67108864);
 
-    // open the file reader
+    // open the file reader, mapping a single file so that scan jobs can
+    // use slices of the map
     const hasher::file_reader_t file_reader(hasher::utf8_to_native(
-                                                           media_filename));
+                                                   media_filename), true);
     if (file_reader.error_message.size() > 0) {
       // the file failed to open
       return file_reader.error_message;
     }
 
+    // sample one in samples_per_stratum samples unless scanning it all
+    const bool is_sampling = sample_fraction > 0 && sample_fraction < 1;
+    const uint64_t samples_per_stratum = (is_sampling)
+                   ? static_cast<uint64_t>(1 / sample_fraction + 0.5) : 1;
+    hasher::sample_tracker_t sample_tracker(file_reader.filesize,
+                                            SAMPLE_SIZE);
+
     // create the scan_tracker
-    hasher::scan_tracker_t scan_tracker(file_reader.filesize);
+    hasher::scan_tracker_t scan_tracker(file_reader.filesize,
+                                  (is_sampling) ? &sample_tracker : NULL);
 
     // get the number of CPUs
     const size_t num_cpus = hashdb::numCPU();
@@ -199,15 +562,31 @@ namespace hashdb {
     hasher::threadpool_t* const threadpool =
                                new hasher::threadpool_t(num_cpus, job_queue);
 
-    // scan the file
-    std::string success = scan_file(file_reader, scan_manager, scan_tracker,
-                                    step_size, settings.block_size,
-                                    process_embedded_data, scan_mode,
-                                    job_queue);
+    // scan the file, reading E01 media on one thread per CPU
+    std::string success;
+    if (is_sampling) {
+      success = scan_file_samples(file_reader, scan_manager, scan_tracker,
+                                  sample_tracker, step_size,
+                                  settings.block_size,
+                                  process_embedded_data, scan_mode,
+                                  job_queue, samples_per_stratum);
+    } else if (file_reader.file_reader_type ==
+                                      hasher::file_reader_type_t::E01) {
+      success = scan_ewf_file(hasher::utf8_to_native(media_filename),
+                              file_reader.filesize, scan_manager,
+                              scan_tracker, step_size, settings.block_size,
+                              process_embedded_data, scan_mode,
+                              job_queue, num_cpus);
+    } else {
+      success = scan_file(file_reader, scan_manager, scan_tracker,
+                          step_size, settings.block_size,
+                          process_embedded_data, scan_mode,
+                          job_queue);
+    }
     if (success.size() > 0) {
       std::stringstream ss;
       ss << "# Error while scanning file " << file_reader.filename
-         << ", " << file_reader.error_message << "\n";
+         << ", " << success << "\n";
       hashdb::tprint(std::cout, ss.str());
     }
 
@@ -218,6 +597,9 @@ namespace hashdb {
 
     std::cout << "# Total zero-byte blocks found: " << scan_tracker.zero_count
               << "\n";
+    if (is_sampling) {
+      sample_tracker.report(std::cout);
+    }
 
     // success
     return "";
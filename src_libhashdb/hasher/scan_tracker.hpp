@@ -21,6 +21,7 @@
  * \file
  * Tracks zero_count during threaded ingest to know how many zero blocks
  *   are skipped.  Read zero_count after all threads have closed.
+ * Forwards matches to the sample tracker when scanning samples.
  */
 
 #ifndef SCAN_TRACKER_HPP
@@ -38,6 +39,7 @@
 #include <pthread.h>
 #include <map>
 #include "tprint.hpp"
+#include "sample_tracker.hpp"
 
 namespace hasher {
 
@@ -53,6 +55,7 @@ class scan_tracker_t {
   const uint64_t bytes_total;
   uint64_t bytes_done;
   uint64_t bytes_reported_done;
+  sample_tracker_t* const sample_tracker;
   mutable pthread_mutex_t M;
   
   // do not allow copy or assignment
@@ -70,9 +73,12 @@ class scan_tracker_t {
   }
 
   public:
-  scan_tracker_t(const uint64_t p_bytes_total) :
+  // sample_tracker is NULL unless scanning samples
+  scan_tracker_t(const uint64_t p_bytes_total,
+                 sample_tracker_t* const p_sample_tracker) :
                      zero_count(0), bytes_total(p_bytes_total),
-                     bytes_done(0), bytes_reported_done(0), M() {
+                     bytes_done(0), bytes_reported_done(0),
+                     sample_tracker(p_sample_tracker), M() {
     if(pthread_mutex_init(&M,NULL)) {
       std::cerr << "Error obtaining mutex.\n";
       assert(0);
@@ -109,6 +115,14 @@ class scan_tracker_t {
     }
     unlock();
   }
+
+  void track_matches(const uint64_t file_offset,
+                     const uint64_t bytes_scanned,
+                     const size_t match_count) {
+    if (sample_tracker != NULL) {
+      sample_tracker->track_matches(file_offset, bytes_scanned, match_count);
+    }
+  }
 };
 
 } // end namespace hasher
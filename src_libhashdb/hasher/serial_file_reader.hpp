@@ -0,0 +1,354 @@
+// Author:  Bruce Allen
+// Created: 2/25/2013
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on February 25, 2013 by Bruce Allen.
+
+/**
+ * \file
+ * Read chunks from split raw media, *.000, *.001, or *001.vmdk and the
+ * consecutively numbered segments after it, as one file.
+ *
+ * Segments are found and sized when opened and are opened for reading
+ * as reads reach them.  As a read nears the end of a segment, the next
+ * segment is opened and read ahead.  A segment is closed once a read
+ * reaches its end, so media of many segments read front to back keeps
+ * at most two open.  Not threadsafe.
+ *
+ * Adapted from bulk_extractor/src/image_process.cpp.
+ */
+
+#ifndef SERIAL_FILE_READER_HPP
+#define SERIAL_FILE_READER_HPP
+
+#include <unistd.h>
+#include <sstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cassert>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include "filename_t.hpp"
+#include "file_reader_helper.hpp"
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+namespace hasher {
+
+class serial_file_reader_t {
+
+  private:
+  // read the next segment ahead when a read ends this close to the end
+  static const uint64_t read_ahead_size = 16777216;  // 2^24=16MiB
+
+  // a segment and its place in the media, opened on first read
+  struct segment_t {
+    filename_t native_filename;
+    uint64_t offset;
+    uint64_t filesize;
+#ifdef WIN32
+    HANDLE file_handle;
+#else
+    int fd;
+#endif
+    segment_t(const filename_t& p_native_filename,
+              const uint64_t p_offset,
+              const uint64_t p_filesize) :
+                  native_filename(p_native_filename),
+                  offset(p_offset),
+                  filesize(p_filesize),
+#ifdef WIN32
+                  file_handle(INVALID_HANDLE_VALUE) {
+#else
+                  fd(-1) {
+#endif
+    }
+  };
+
+  // SERIAL file data
+  mutable std::vector<segment_t> segments;
+  mutable size_t first_open;    // segments before this are closed
+
+  public:
+  const filename_t native_filename;
+  private:
+  std::string temp_error_message;
+  public:
+  const uint64_t filesize;
+  const std::string error_message;
+
+  private:
+
+  // do not allow copy or assignment
+  serial_file_reader_t(const serial_file_reader_t&);
+  serial_file_reader_t& operator=(const serial_file_reader_t&);
+
+  // true if the segment is there
+  static bool is_present(const filename_t& segment_filename) {
+#ifdef WIN32
+    return GetFileAttributesW(segment_filename.c_str()) !=
+                                             INVALID_FILE_ATTRIBUTES;
+#else
+    struct stat st;
+    return stat(segment_filename.c_str(), &st) == 0;
+#endif
+  }
+
+  // find the segments and their sizes, return error_message else ""
+  std::string open_reader() {
+    uint64_t offset = 0;
+    filename_t segment_filename = native_filename;
+    while (segment_filename.size() > 0 && is_present(segment_filename)) {
+      uint64_t segment_filesize;
+      const std::string size_error_message = get_filesize_by_filename(
+                                   segment_filename, &segment_filesize);
+      if (size_error_message.size() > 0) {
+        return size_error_message;
+      }
+      segments.push_back(segment_t(segment_filename, offset,
+                                   segment_filesize));
+      offset += segment_filesize;
+      segment_filename = serial_segment_filename(segment_filename, 1);
+    }
+
+    if (segments.size() == 0) {
+      std::stringstream ss;
+      ss << "hashdb file reader cannot open file "
+         << native_to_utf8(native_filename);
+      return ss.str();
+    }
+    return "";
+  }
+
+  uint64_t get_filesize() const {
+    if (segments.size() == 0) {
+      return 0;
+    }
+    return segments.back().offset + segments.back().filesize;
+  }
+
+  // open the segment for reading if it is not open, return error_message
+  // else ""
+  std::string open_segment(segment_t& segment) const {
+#ifdef WIN32
+    if (segment.file_handle != INVALID_HANDLE_VALUE) {
+      return "";
+    }
+    segment.file_handle = CreateFileW(segment.native_filename.c_str(),
+                                    FILE_READ_DATA,
+                                    FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                                    OPEN_EXISTING, 0, NULL);
+    if (segment.file_handle == INVALID_HANDLE_VALUE) {
+#else
+    if (segment.fd >= 0) {
+      return "";
+    }
+    segment.fd = ::open(segment.native_filename.c_str(), O_RDONLY|O_BINARY);
+    if (segment.fd < 0) {
+#endif
+      std::stringstream ss;
+      ss << "hashdb file reader cannot open file "
+         << native_to_utf8(segment.native_filename);
+      return ss.str();
+    }
+    return "";
+  }
+
+  // close the segment if it is open
+  static void close_segment(segment_t& segment) {
+#ifdef WIN32
+    if (segment.file_handle != INVALID_HANDLE_VALUE) {
+      ::CloseHandle(segment.file_handle);
+      segment.file_handle = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (segment.fd >= 0) {
+      close(segment.fd);
+      segment.fd = -1;
+    }
+#endif
+  }
+
+  // close the segments before segment i, which reads have moved past
+  void close_before(const size_t i) const {
+    for (; first_open < i; ++first_open) {
+      close_segment(segments[first_open]);
+    }
+  }
+
+  // the last segment starting at or before offset
+  size_t find_segment(const uint64_t offset) const {
+    size_t i = 0;
+    size_t lo = 0;
+    size_t hi = segments.size();
+    while (lo < hi) {
+      const size_t mid = (lo + hi) / 2;
+      if (segments[mid].offset <= offset) {
+        i = mid;
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    return i;
+  }
+
+  // open the segment after segment i and start reading it ahead
+  void read_ahead(const size_t i) const {
+    if (i + 1 >= segments.size() ||
+        open_segment(segments[i + 1]).size() > 0) {
+      return;
+    }
+#if defined(POSIX_FADV_WILLNEED) && !defined(WIN32)
+    posix_fadvise(segments[i + 1].fd, 0, read_ahead_size,
+                  POSIX_FADV_WILLNEED);
+#endif
+  }
+
+  // read from one segment, return error_message else ""
+  std::string read_segment(segment_t& segment,
+                           const uint64_t offset,
+                           uint8_t* const buffer,
+                           const size_t buffer_size,
+                           size_t* const bytes_read) const {
+
+    *bytes_read = 0;
+    const std::string open_error_message = open_segment(segment);
+    if (open_error_message.size() > 0) {
+      return open_error_message;
+    }
+
+#ifdef WIN32
+    int count = ::pread64(segment.file_handle,
+                          reinterpret_cast<char*>(buffer),
+                          buffer_size, offset);
+#else
+  #if defined(HAVE_PREAD64)
+    /* If we have pread64, make sure it is defined */
+    extern size_t pread64(int fd,char *buffer,size_t nbyte,off_t offset);
+  #endif
+
+  #if !defined(HAVE_PREAD64) && defined(HAVE_PREAD)
+    /* if we are not using pread64, make sure that off_t is 8 bytes in size */
+  #define pread64(d,buffer,nbyte,offset) pread(d,buffer,nbyte,offset)
+  #endif
+
+    ssize_t count = ::pread64(segment.fd,buffer,buffer_size,offset);
+#endif
+    if (count < 0) {
+      return "read failed";
+    }
+    *bytes_read = static_cast<size_t>(count);
+    return "";
+  }
+
+  public:
+  /**
+   * Opens a split raw file reader given the first segment.
+   */
+  serial_file_reader_t(const filename_t& p_native_filename) :
+          segments(),
+          first_open(0),
+          native_filename(p_native_filename),
+          temp_error_message(open_reader()),
+          filesize(get_filesize()),
+          error_message(temp_error_message) {
+  }
+
+  // close any open resources
+  ~serial_file_reader_t() {
+    for (std::vector<segment_t>::iterator it = segments.begin();
+                                          it != segments.end(); ++it) {
+      close_segment(*it);
+    }
+  }
+
+  std::string read(const uint64_t offset,
+                   uint8_t* const buffer,
+                   const size_t buffer_size,
+                   size_t* const bytes_read) const {
+
+    *bytes_read = 0;
+
+    // make sure reader is working
+    if (error_message.size() > 0) {
+      // error so leave alone
+      std::stringstream ss;
+      ss << "Unable to read: " << error_message << "\n";
+      return ss.str();
+    }
+
+    // start in the last segment starting at or before offset
+    size_t i = find_segment(offset);
+
+    // close segments the reads have moved past, or close from here on if
+    // this read goes back to segments that were closed
+    if (first_open > i) {
+      first_open = i;
+    }
+    close_before(i);
+
+    // read across segments until the buffer is full or the media ends
+    uint64_t media_offset = offset;
+    while (*bytes_read < buffer_size && i < segments.size()) {
+      segment_t& segment = segments[i];
+      const uint64_t segment_offset = media_offset - segment.offset;
+      if (segment_offset >= segment.filesize) {
+        // past this segment, which may be empty and read ahead
+        close_before(i + 1);
+        ++i;
+        continue;
+      }
+      const uint64_t segment_remaining = segment.filesize - segment_offset;
+      const size_t count = (buffer_size - *bytes_read > segment_remaining)
+                    ? segment_remaining : buffer_size - *bytes_read;
+
+      size_t segment_bytes_read;
+      const std::string read_error_message = read_segment(segment,
+                                 segment_offset, buffer + *bytes_read,
+                                 count, &segment_bytes_read);
+      if (read_error_message.size() > 0) {
+        return read_error_message;
+      }
+      *bytes_read += segment_bytes_read;
+      media_offset += segment_bytes_read;
+      if (segment_bytes_read < count) {
+        // the segment is shorter than when it was opened
+        break;
+      }
+
+      // read the next segment ahead when nearing the end of this one
+      if (segment_remaining - count <= read_ahead_size) {
+        read_ahead(i);
+      }
+
+      // close this segment once read to its end
+      if (count == segment_remaining) {
+        close_before(i + 1);
+      }
+      ++i;
+    }
+    return "";
+  }
+};
+
+} // end namespace hasher
+
+#endif
@@ -21,6 +21,13 @@
  * \file
  * Read chunks from a single file
  *
+ * A regular file is also memory-mapped when asked and possible so that
+ * scan jobs can reference slices of the map instead of reading into
+ * buffers of their own, see mapped_data.  Devices and files that cannot
+ * be mapped are only read.  Reading a map of a file that is truncated
+ * while it is in use raises SIGBUS, so map only media that is not
+ * expected to change, as scan_media does, and not files being ingested.
+ *
  * Adapted heavily from bulk_extractor/src/image_process.cpp.
  */
 
@@ -36,6 +43,10 @@
 #include <set>
 #include <cassert>
 #include <libewf.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 #include "filename_t.hpp"
 #include "file_reader_helper.hpp"
 
@@ -64,6 +75,8 @@ class single_file_reader_t {
   const std::string error_message;
 
   private:
+  // the file mapped into memory, NULL when not mapped
+  uint8_t* map;
 
   // do not allow copy or assignment
   single_file_reader_t(const single_file_reader_t&);
@@ -107,14 +120,35 @@ class single_file_reader_t {
     }
   }
 
-
-
+  // map a regular file, return NULL if not mapped
+  uint8_t* map_file() const {
+#if defined(HAVE_SYS_MMAN_H) && !defined(WIN32)
+    struct stat st;
+    if (error_message.size() > 0 || filesize == 0 ||
+        filesize != static_cast<uint64_t>(static_cast<size_t>(filesize)) ||
+        fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+      return NULL;
+    }
+    void* p = mmap(NULL, filesize, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+      // read instead
+      return NULL;
+    }
+    // the file is read front to back
+    madvise(p, filesize, MADV_SEQUENTIAL);
+    return static_cast<uint8_t*>(p);
+#else
+    return NULL;
+#endif
+  }
 
   public:
   /**
-   * Opens a single file reader.
+   * Opens a single file reader, mapping a regular file into memory if
+   * p_map is true.
    */
-  single_file_reader_t(const filename_t& p_native_filename) :
+  single_file_reader_t(const filename_t& p_native_filename,
+                       const bool p_map = false) :
 #ifdef WIN32
           file_handle(INVALID_HANDLE_VALUE),
 #else
@@ -123,11 +157,18 @@ class single_file_reader_t {
           native_filename(p_native_filename),
           temp_error_message(open_reader()),
           filesize(get_filesize()),
-          error_message(temp_error_message) {
+          error_message(temp_error_message),
+          map((p_map) ? map_file() : NULL) {
   }
 
   // close any open resources
   ~single_file_reader_t() {
+#if defined(HAVE_SYS_MMAN_H) && !defined(WIN32)
+    if (map != NULL) {
+      munmap(map, filesize);
+    }
+#endif
+
     // SINGLE binary file
 #ifdef WIN32
     if(file_handle!=INVALID_HANDLE_VALUE) ::CloseHandle(file_handle);
@@ -136,6 +177,30 @@ class single_file_reader_t {
 #endif
   }
 
+  /**
+   * The file in memory, or NULL if it was not asked to be or could not
+   * be mapped.  The map is valid
+   * until this reader is destroyed.
+   */
+  const uint8_t* mapped_data() const {
+    return map;
+  }
+
+  /**
+   * Ask for the mapped bytes at offset to be read ahead.
+   */
+  void will_need(const uint64_t offset, const size_t count) const {
+#if defined(HAVE_SYS_MMAN_H) && !defined(WIN32)
+    if (map != NULL && offset < filesize) {
+      // madvise takes a page-aligned address
+      const uint64_t start = offset - offset % sysconf(_SC_PAGESIZE);
+      const uint64_t end = (count > filesize - offset) ?
+                                         filesize : offset + count;
+      madvise(map + start, end - start, MADV_WILLNEED);
+    }
+#endif
+  }
+
   std::string read(const uint64_t offset,
                    uint8_t* const buffer,
                    const size_t buffer_size,
@@ -0,0 +1,218 @@
+// Author:  Bruce Allen
+// Created: 2/25/2013
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on February 25, 2013 by Bruce Allen.
+
+/**
+ * \file
+ * Packs small files back to back into one buffer and pushes them
+ * through the source name sequencer as one INGEST_SMALL_FILES job, so that a file of a few
+ * blocks does not cost a job, a buffer allocation, and a status line of
+ * its own.  The file hash is calculated as each file is added, and its
+ * source name is put to the source name sequencer.
+ *
+ * Call push after the last file is added.  Not threadsafe, each ingest
+ * reader thread has its own.
+ */
+
+#ifndef SMALL_FILE_PACKER_HPP
+#define SMALL_FILE_PACKER_HPP
+
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "hashdb.hpp"
+#include "file_reader.hpp"
+#include "hash_calculator.hpp"
+#include "job.hpp"
+#include "ingest_tracker.hpp"
+#include "source_name_sequencer.hpp"
+
+namespace hasher {
+
+class small_file_packer_t {
+
+  public:
+  // files up to this size are packed
+  static const size_t max_file_size = 65536;   // 2^16=64KiB
+
+  private:
+  // buffer size and maximum file count of one job
+  static const size_t buffer_size = 16777216;  // 2^24=16MiB
+  static const size_t max_files = 4096;
+
+  hashdb::import_manager_t* const import_manager;
+  hasher::ingest_tracker_t* const ingest_tracker;
+  const hashdb::scan_manager_t* const whitelist_scan_manager;
+  const std::string repository_name;
+  const size_t step_size;
+  const size_t block_size;
+  const bool disable_recursive_processing;
+  const bool disable_calculate_entropy;
+  const bool disable_calculate_labels;
+  const size_t max_recursion_depth;
+  hasher::source_name_sequencer_t* const source_name_sequencer;
+  hasher::hash_calculator_t hash_calculator;
+
+  // the files of the job being packed, NULL when none
+  uint8_t* buffer;
+  size_t buffer_used;
+  std::vector<small_file_t>* small_files;
+  size_t last_sequence;
+
+  // do not allow copy or assignment
+  small_file_packer_t(const small_file_packer_t&);
+  small_file_packer_t& operator=(const small_file_packer_t&);
+
+  public:
+  small_file_packer_t(
+        hashdb::import_manager_t* const p_import_manager,
+        hasher::ingest_tracker_t* const p_ingest_tracker,
+        const hashdb::scan_manager_t* const p_whitelist_scan_manager,
+        const std::string& p_repository_name,
+        const size_t p_step_size,
+        const size_t p_block_size,
+        const bool p_disable_recursive_processing,
+        const bool p_disable_calculate_entropy,
+        const bool p_disable_calculate_labels,
+        const size_t p_max_recursion_depth,
+        hasher::source_name_sequencer_t* const p_source_name_sequencer) :
+                   import_manager(p_import_manager),
+                   ingest_tracker(p_ingest_tracker),
+                   whitelist_scan_manager(p_whitelist_scan_manager),
+                   repository_name(p_repository_name),
+                   step_size(p_step_size),
+                   block_size(p_block_size),
+                   disable_recursive_processing(p_disable_recursive_processing),
+                   disable_calculate_entropy(p_disable_calculate_entropy),
+                   disable_calculate_labels(p_disable_calculate_labels),
+                   max_recursion_depth(p_max_recursion_depth),
+                   source_name_sequencer(p_source_name_sequencer),
+                   hash_calculator(),
+                   buffer(NULL),
+                   buffer_used(0),
+                   small_files(NULL),
+                   last_sequence(0) {
+  }
+
+  ~small_file_packer_t() {
+    // files not pushed are not ingested
+    delete small_files;
+    delete[] buffer;
+  }
+
+  /**
+   * Read the file into the buffer, calculate its file hash, and put its
+   * source name.  The file's filesize must be no more than max_file_size.
+   * Return "" or error, in which case the source name is not put.
+   */
+  std::string add(const hasher::file_reader_t& file_reader,
+                  const size_t sequence,
+                  std::string& file_hash) {
+
+    const size_t filesize = file_reader.filesize;
+
+    // push the files packed so far if this file does not fit
+    if (small_files != NULL && (buffer_used + filesize > buffer_size ||
+                                small_files->size() == max_files)) {
+      push();
+    }
+
+    // start a new job, its buffer is filled as files are added
+    if (small_files == NULL) {
+      buffer = new (std::nothrow) uint8_t[buffer_size];
+      if (buffer == NULL) {
+        return "bad memory allocation";
+      }
+      buffer_used = 0;
+      small_files = new std::vector<small_file_t>;
+    }
+
+    // read the file into the buffer, zero-filling any unread part
+    uint8_t* const b = buffer + buffer_used;
+    size_t bytes_read = 0;
+    const std::string error_message =
+                          file_reader.read(0, b, filesize, &bytes_read);
+    if (error_message.size() > 0) {
+      return error_message;
+    }
+    if (bytes_read < filesize) {
+      std::memset(b + bytes_read, 0, filesize - bytes_read);
+    }
+
+    // get the source file hash
+    file_hash = hash_calculator.calculate(b, filesize, 0, filesize);
+
+    // store the source repository name and filename
+    source_name_sequencer->put(sequence, file_hash, file_reader.filename);
+    last_sequence = sequence;
+
+    // add source file information to ingest_tracker, file type is not
+    // defined, and do not re-ingest hashes from duplicate sources
+    const bool source_added = ingest_tracker->add_source(file_hash,
+                                                  filesize, "", 1);
+
+    small_files->push_back(small_file_t(file_hash, file_reader.filename,
+                                  filesize, buffer_used, !source_added));
+    buffer_used += filesize;
+    return "";
+  }
+
+  /**
+   * Push the files packed so far through the source name sequencer, which
+   * queues the job once their source names are inserted.  A buffer that
+   * is mostly unused is copied to one of its used size first so that held
+   * and queued jobs do not keep the whole buffer.
+   */
+  void push() {
+    if (small_files == NULL || small_files->size() == 0) {
+      return;
+    }
+    if (buffer_used < buffer_size / 2) {
+      uint8_t* const used_buffer = new (std::nothrow) uint8_t[buffer_used];
+      if (used_buffer != NULL) {
+        std::memcpy(used_buffer, buffer, buffer_used);
+        delete[] buffer;
+        buffer = used_buffer;
+      }
+    }
+    source_name_sequencer->push(last_sequence,
+                 hasher::job_t::new_ingest_small_files_job(
+                 import_manager,
+                 ingest_tracker,
+                 whitelist_scan_manager,
+                 repository_name,
+                 step_size,
+                 block_size,
+                 disable_recursive_processing,
+                 disable_calculate_entropy,
+                 disable_calculate_labels,
+                 small_files,
+                 buffer,
+                 buffer_used, // buffer_size
+                 buffer_used, // buffer_data_size
+                 max_recursion_depth));
+    buffer = NULL;
+    buffer_used = 0;
+    small_files = NULL;
+  }
+};
+
+} // end namespace hasher
+
+#endif
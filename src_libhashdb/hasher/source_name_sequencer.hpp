@@ -0,0 +1,215 @@
+// Author:  Bruce Allen
+// Created: 2/25/2013
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on February 25, 2013 by Bruce Allen.
+
+/**
+ * \file
+ * Numbers files as ingest reader threads take them from the directory
+ * walk, and inserts their source names in that order as readers finish
+ * calculating file hashes out of order.  New sources are given source
+ * IDs in that order, no matter how many readers there are.  Threadsafe.
+ *
+ * Every file taken must be put exactly once, with file hash "" if it
+ * has no source name, or later files are never inserted.  Push the jobs
+ * that insert a file's block hashes through the sequencer.  A job is
+ * pushed onto the job queue when the source names through its file are
+ * inserted, and is held until then so that the reader can go on to the
+ * next file.  When too many jobs or too many buffer bytes are held,
+ * pushing waits unless the job's source names are already inserted, so
+ * the reader of the file that holds up the others never waits.  One job
+ * is always held, even if its buffer is larger than the byte bound.
+ */
+
+#ifndef SOURCE_NAME_SEQUENCER_HPP
+#define SOURCE_NAME_SEQUENCER_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+#include <iostream>
+#include <assert.h>
+#include <pthread.h>
+#include "hashdb.hpp"
+#include "directory_walker.hpp"
+#include "job.hpp"
+#include "job_queue.hpp"
+
+namespace hasher {
+
+class source_name_sequencer_t {
+
+  private:
+  typedef std::pair<std::string, std::string> file_hash_filename_t;
+
+  hashdb::import_manager_t* const import_manager;
+  const std::string repository_name;
+  hasher::job_queue_t* const job_queue;
+  const size_t max_held_jobs;
+  const size_t max_held_bytes;
+  size_t next_take;
+  size_t next_insert;
+  std::map<size_t, file_hash_filename_t> pending;
+  std::vector<file_hash_filename_t> ready;
+  std::multimap<size_t, const hasher::job_t*> held_jobs;
+  size_t held_bytes;
+  mutable pthread_mutex_t take_M;             // orders take
+  mutable pthread_mutex_t M;                  // mutext
+  pthread_cond_t C;                           // signals inserts
+
+  // do not allow copy or assignment
+  source_name_sequencer_t(const source_name_sequencer_t&);
+  source_name_sequencer_t& operator=(const source_name_sequencer_t&);
+
+  void lock(pthread_mutex_t& mutex) const {
+    if(pthread_mutex_lock(&mutex)) {
+      assert(0);
+    }
+  }
+
+  void unlock(pthread_mutex_t& mutex) const {
+    pthread_mutex_unlock(&mutex);
+  }
+
+  public:
+  source_name_sequencer_t(hashdb::import_manager_t* const p_import_manager,
+                          const std::string& p_repository_name,
+                          hasher::job_queue_t* const p_job_queue,
+                          const size_t p_max_held_jobs,
+                          const size_t p_max_held_bytes) :
+               import_manager(p_import_manager),
+               repository_name(p_repository_name),
+               job_queue(p_job_queue),
+               max_held_jobs(p_max_held_jobs),
+               max_held_bytes(p_max_held_bytes),
+               next_take(0),
+               next_insert(0),
+               pending(),
+               ready(),
+               held_jobs(),
+               held_bytes(0),
+               take_M(),
+               M(),
+               C() {
+    if(pthread_mutex_init(&take_M,NULL) || pthread_mutex_init(&M,NULL)) {
+      std::cerr << "Error obtaining mutex.\n";
+      assert(0);
+    }
+    if(pthread_cond_init(&C,NULL)) {
+      std::cerr << "Error obtaining condition variable.\n";
+      assert(0);
+    }
+  }
+
+  ~source_name_sequencer_t() {
+    if (held_jobs.size() != 0) {
+      // program error if a file was not put
+      std::cerr << "Processing error: ingest jobs are held.\n";
+    }
+    pthread_cond_destroy(&C);
+    pthread_mutex_destroy(&take_M);
+    pthread_mutex_destroy(&M);
+  }
+
+  /**
+   * Take the next file from the walk and its sequence number, false
+   * when the walk is done.
+   */
+  bool take(directory_walker_t& directory_walker, found_file_t& found_file,
+            size_t& sequence) {
+    lock(take_M);
+    const bool has_file = directory_walker.pop(found_file);
+    if (has_file) {
+      sequence = next_take++;
+    }
+    unlock(take_M);
+    return has_file;
+  }
+
+  /**
+   * Put the source name of the file with this sequence number, or "" for
+   * file_hash if it has none, insert the source names that are now in
+   * order, and push the jobs held for them.
+   */
+  void put(const size_t sequence, const std::string& file_hash,
+           const std::string& filename) {
+    std::vector<const hasher::job_t*> released_jobs;
+    lock(M);
+    pending.insert(std::pair<size_t, file_hash_filename_t>(
+                     sequence, file_hash_filename_t(file_hash, filename)));
+
+    // insert in order, under lock so that inserts do not pass each other
+    ready.clear();
+    std::map<size_t, file_hash_filename_t>::iterator it = pending.begin();
+    while (it != pending.end() && it->first == next_insert) {
+      if (it->second.first.size() != 0) {
+        ready.push_back(it->second);
+      }
+      pending.erase(it++);
+      ++next_insert;
+    }
+    if (ready.size() != 0) {
+      import_manager->insert_source_names(repository_name, ready);
+    }
+
+    // release the jobs of the inserted files
+    const std::multimap<size_t, const hasher::job_t*>::iterator end =
+                                        held_jobs.lower_bound(next_insert);
+    for (std::multimap<size_t, const hasher::job_t*>::iterator job_it =
+                          held_jobs.begin(); job_it != end; ++job_it) {
+      released_jobs.push_back(job_it->second);
+      held_bytes -= job_it->second->buffer_size;
+    }
+    held_jobs.erase(held_jobs.begin(), end);
+    pthread_cond_broadcast(&C);
+    unlock(M);
+
+    // the job queue may wait for room, so push without the lock
+    for (std::vector<const hasher::job_t*>::const_iterator job_it =
+              released_jobs.begin(); job_it != released_jobs.end(); ++job_it) {
+      job_queue->push(*job_it);
+    }
+  }
+
+  /**
+   * Push the job that inserts block hashes of the file with this
+   * sequence number once the source names through the file are
+   * inserted.
+   */
+  void push(const size_t sequence, const hasher::job_t* const job) {
+    lock(M);
+    while (sequence >= next_insert && held_jobs.size() != 0 &&
+           (held_jobs.size() >= max_held_jobs ||
+            held_bytes + job->buffer_size > max_held_bytes)) {
+      pthread_cond_wait(&C, &M);
+    }
+    if (sequence >= next_insert) {
+      held_jobs.insert(std::pair<size_t, const hasher::job_t*>(
+                                                           sequence, job));
+      held_bytes += job->buffer_size;
+      unlock(M);
+      return;
+    }
+    unlock(M);
+    job_queue->push(job);
+  }
+};
+
+} // end namespace hasher
+
+#endif
@@ -32,50 +32,75 @@
 namespace hashdb {
 
 
+// hex digit values by character, 0xff for characters that are not hex
+// digits
+class hex_table_t {
+  public:
+  uint8_t values[256];
+  hex_table_t() {
+    for (size_t i=0; i<256; ++i) {
+      values[i] = 0xff;
+    }
+    for (uint8_t c='0'; c<='9'; ++c) {
+      values[c] = c - '0';
+    }
+    for (uint8_t c='a'; c<='f'; ++c) {
+      values[c] = c - 'a' + 10;
+      values[c - 'a' + 'A'] = c - 'a' + 10;
+    }
+  }
+};
+
+// the table, ready even for callers that run during static initialization
+static const hex_table_t& hex_table() {
+  static const hex_table_t table;
+  return table;
+}
+
+bool hex_to_bin(const char* const hex, const size_t size,
+                std::string& bin) {
+
+  bin.clear();
+
+  // size must be even
+  if (size%2 != 0) {
+    return false;
+  }
+
+  bin.resize(size / 2);
+  const uint8_t* const values = hex_table().values;
+  const uint8_t* const p = reinterpret_cast<const uint8_t*>(hex);
+  for (size_t i=0, j=0; i<size; i+=2, ++j) {
+    const uint8_t d0 = values[p[i]];
+    const uint8_t d1 = values[p[i+1]];
+    if (d0 > 0x0f || d1 > 0x0f) {
+      bin.clear();
+      return false;
+    }
+    bin[j] = static_cast<char>(d0 << 4 | d1);
+  }
+  return true;
+}
+
 /**
  * Return binary string or empty if hexdigest length is not even
  * or has any invalid digits.
  */
 std::string hex_to_bin(const std::string& hex_string) {
 
-  size_t size = hex_string.size();
   // size must be even
-  if (size%2 != 0) {
+  if (hex_string.size()%2 != 0) {
     std::cerr << "hex_to_bin: hex input not aligned on even boundary in '"
               << hex_string << "'\n";
     return "";
   }
 
-  size_t i = 0;
-  size_t j = 0;
-  uint8_t bin[size];
-  for (; i<size; i+=2) {
-    uint8_t c0 = hex_string[i];
-    uint8_t c1 = hex_string[i+1];
-    uint8_t d0;
-    uint8_t d1;
-
-    if(c0>='0' && c0<='9') d0 = c0-'0';
-    else if(c0>='a' && c0<='f') d0 = c0-'a'+10;
-    else if(c0>='A' && c0<='F') d0 = c0-'A'+10;
-    else {
-      std::cerr << "hex_to_bin: unexpected hex character in '"
-                << hex_string << "'\n";
-      return "";
-    }
-
-    if(c1>='0' && c1<='9') d1 = c1-'0';
-    else if(c1>='a' && c1<='f') d1 = c1-'a'+10;
-    else if(c1>='A' && c1<='F') d1 = c1-'A'+10;
-    else {
-      std::cerr << "hex_to_bin: unexpected hex character in '"
-                << hex_string << "'\n";
-      return "";
-    }
-
-    bin[j++] = d0 << 4 | d1;
+  std::string bin;
+  if (!hex_to_bin(hex_string.data(), hex_string.size(), bin)) {
+    std::cerr << "hex_to_bin: unexpected hex character in '"
+              << hex_string << "'\n";
   }
-  return std::string(reinterpret_cast<char*>(bin), j);
+  return bin;
 }
 
 inline uint8_t tohex(uint8_t c) {
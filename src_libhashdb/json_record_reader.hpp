@@ -0,0 +1,272 @@
+// Author:  Bruce Allen
+// Created: 2/25/2013
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on February 25, 2013 by Bruce Allen.
+
+/**
+ * \file
+ * Read the fields of one JSON hash or source record using the rapidjson
+ * SAX reader instead of building a DOM document.  Only the fields that
+ * import uses are kept.  Their types are checked after parsing, so a
+ * record with invalid syntax is reported as invalid syntax no matter
+ * what its fields hold.
+ *
+ * As with the DOM, the first of duplicate members is used, and members
+ * that import does not use, including nested ones, are skipped.
+ */
+
+#ifndef JSON_RECORD_READER_HPP
+#define JSON_RECORD_READER_HPP
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <stdint.h>
+#include "rapidjson.h"
+#include "reader.h"
+
+namespace hashdb {
+
+class json_record_reader_t {
+
+  public:
+  // the fields import uses
+  enum field_t {BLOCK_HASH,
+                K_ENTROPY,
+                BLOCK_LABEL,
+                SOURCE_SUB_COUNTS,
+                FILE_HASH,
+                FILESIZE,
+                FILE_TYPE,
+                ZERO_COUNT,
+                NONPROBATIVE_COUNT,
+                NAME_PAIRS,
+                NUM_FIELDS,
+                NO_FIELD = NUM_FIELDS};
+
+  // the type of a field or array element, ABSENT if not in the record
+  enum value_type_t {ABSENT, STRING, UINT64, ARRAY, OTHER};
+
+  struct value_t {
+    value_type_t type;
+    std::string string_value;
+    uint64_t uint64_value;
+    value_t() : type(ABSENT), string_value(), uint64_value(0) {
+    }
+  };
+
+  private:
+  value_t fields[NUM_FIELDS];
+
+  // elements of array fields, kept between records so their storage
+  // is reused
+  std::vector<value_t> elements[NUM_FIELDS];
+  size_t num_elements[NUM_FIELDS];
+
+  // parser, kept between records so its stack is reused
+  rapidjson::Reader sax_reader;
+
+  // parser state
+  size_t depth;
+  field_t field;
+
+  // do not allow copy or assignment
+  json_record_reader_t(const json_record_reader_t&);
+  json_record_reader_t& operator=(const json_record_reader_t&);
+
+  static field_t to_field(const char* const str, const size_t length) {
+    static const char* const names[NUM_FIELDS] = {"block_hash",
+                                                  "k_entropy",
+                                                  "block_label",
+                                                  "source_sub_counts",
+                                                  "file_hash",
+                                                  "filesize",
+                                                  "file_type",
+                                                  "zero_count",
+                                                  "nonprobative_count",
+                                                  "name_pairs"};
+    for (size_t i=0; i<NUM_FIELDS; ++i) {
+      if (strlen(names[i]) == length && memcmp(names[i], str, length) == 0) {
+        return static_cast<field_t>(i);
+      }
+    }
+    return NO_FIELD;
+  }
+
+  // the value to set for a scalar or container at the current depth
+  value_t* current_value() {
+    if (field == NO_FIELD) {
+      return NULL;
+    }
+    if (depth == 1) {
+      return &fields[field];
+    }
+    if (depth == 2 && fields[field].type == ARRAY) {
+      if (num_elements[field] == elements[field].size()) {
+        elements[field].push_back(value_t());
+      }
+      value_t* const element = &elements[field][num_elements[field]++];
+      element->type = ABSENT;
+      return element;
+    }
+    return NULL;
+  }
+
+  bool set_string(const char* const str, const size_t length) {
+    if (depth == 0) {
+      return false;
+    }
+    value_t* const value = current_value();
+    if (value != NULL) {
+      value->type = STRING;
+      value->string_value.assign(str, length);
+    }
+    return true;
+  }
+
+  bool set_uint64(const uint64_t n) {
+    if (depth == 0) {
+      return false;
+    }
+    value_t* const value = current_value();
+    if (value != NULL) {
+      value->type = UINT64;
+      value->uint64_value = n;
+    }
+    return true;
+  }
+
+  bool set_other() {
+    if (depth == 0) {
+      return false;
+    }
+    value_t* const value = current_value();
+    if (value != NULL) {
+      value->type = OTHER;
+    }
+    return true;
+  }
+
+  public:
+  json_record_reader_t() : fields(), elements(), num_elements(),
+                           sax_reader(), depth(0), field(NO_FIELD) {
+  }
+
+  /**
+   * Parse the record in place, modifying json_string.  Return false on
+   * invalid syntax or if the record is not a JSON object.
+   */
+  bool parse(char* const json_string) {
+    for (size_t i=0; i<NUM_FIELDS; ++i) {
+      fields[i].type = ABSENT;
+      num_elements[i] = 0;
+    }
+    depth = 0;
+    field = NO_FIELD;
+
+    rapidjson::InsituStringStream stream(json_string);
+    return !sax_reader.Parse<rapidjson::kParseInsituFlag>(stream, *this)
+                                                              .IsError();
+  }
+
+  /**
+   * The field, valid after parse.
+   */
+  const value_t& get(const field_t p_field) const {
+    return fields[p_field];
+  }
+
+  /**
+   * The elements of an array field, valid after parse.
+   */
+  size_t size(const field_t p_field) const {
+    return num_elements[p_field];
+  }
+  const value_t& element(const field_t p_field, const size_t i) const {
+    return elements[p_field][i];
+  }
+
+  // rapidjson SAX handler interface
+  typedef char Ch;
+  bool Null() {
+    return set_other();
+  }
+  bool Bool(bool) {
+    return set_other();
+  }
+  bool Int(int i) {
+    return (i < 0) ? set_other() : set_uint64(static_cast<uint64_t>(i));
+  }
+  bool Uint(unsigned i) {
+    return set_uint64(i);
+  }
+  bool Int64(int64_t i) {
+    return (i < 0) ? set_other() : set_uint64(static_cast<uint64_t>(i));
+  }
+  bool Uint64(uint64_t i) {
+    return set_uint64(i);
+  }
+  bool Double(double) {
+    return set_other();
+  }
+  bool String(const Ch* str, rapidjson::SizeType length, bool) {
+    return set_string(str, length);
+  }
+  bool StartObject() {
+    if (depth != 0 && !set_other()) {
+      return false;
+    }
+    ++depth;
+    return true;
+  }
+  bool Key(const Ch* str, rapidjson::SizeType length, bool) {
+    if (depth == 1) {
+      field = to_field(str, length);
+
+      // use the first of duplicate members
+      if (field != NO_FIELD && fields[field].type != ABSENT) {
+        field = NO_FIELD;
+      }
+    }
+    return true;
+  }
+  bool EndObject(rapidjson::SizeType) {
+    --depth;
+    return true;
+  }
+  bool StartArray() {
+    if (depth == 0) {
+      // the record must be an object
+      return false;
+    }
+    value_t* const value = current_value();
+    if (value != NULL) {
+      value->type = (depth == 1) ? ARRAY : OTHER;
+    }
+    ++depth;
+    return true;
+  }
+  bool EndArray(rapidjson::SizeType) {
+    --depth;
+    return true;
+  }
+};
+
+} // end namespace hashdb
+
+#endif
+
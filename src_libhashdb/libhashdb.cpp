@@ -41,6 +41,8 @@
 #include <string>
 #include <sstream>
 #include <vector>
+#include <map>
+#include <algorithm>    // for std::sort
 #include <stdint.h>
 #include <climits>
 #ifndef HAVE_CXX11
@@ -55,13 +57,20 @@
 #include "file_modes.h"
 #include "settings_manager.hpp"
 #include "lmdb_hash_data_manager.hpp"
+#include "lmdb_hash_data_cursor.hpp"
+#include "lmdb_source_id_cursor.hpp"
 #include "lmdb_hash_manager.hpp"
 #include "lmdb_source_data_manager.hpp"
 #include "lmdb_source_id_manager.hpp"
 #include "lmdb_source_name_manager.hpp"
+#include "lmdb_source_hash_manager.hpp"
+#include "lmdb_repository_manager.hpp"
 #include "logger.hpp"
 #include "locked_member.hpp"
+#include "source_data_cache.hpp"
+#include "hash_result_cache.hpp"
 #include "lmdb_changes.hpp"
+#include "json_record_reader.hpp"
 #include "rapidjson.h"
 #include "writer.h"
 #include "document.h"
@@ -138,20 +147,94 @@ namespace hashdb {
     delete source_names;
   }
 
-  static uint32_t calculate_crc(
-                       const hashdb::source_sub_counts_t& source_sub_counts) {
+  // helper for reading source data through the source data cache
+  static bool find_cached_source_data(
+                  const hashdb::lmdb_source_data_manager_t& manager,
+                  hashdb::source_data_cache_t& cache,
+                  const uint64_t source_id,
+                  hashdb::source_data_cache_t::source_data_t& source_data) {
+
+    if (cache.find(source_id, source_data)) {
+      return true;
+    }
+    bool source_data_found = manager.find(source_id,
+                  source_data.file_hash, source_data.filesize,
+                  source_data.file_type, source_data.zero_count,
+                  source_data.nonprobative_count);
+    if (source_data_found) {
+      cache.insert(source_id, source_data);
+    }
+    return source_data_found;
+  }
+
+  // helper for reading the file hash of a source through the source
+  // data cache.  file_hash keeps its storage.
+  static bool find_cached_file_hash(
+                  const hashdb::lmdb_source_data_manager_t& manager,
+                  hashdb::source_data_cache_t& cache,
+                  const uint64_t source_id,
+                  std::string& file_hash) {
+
+    if (cache.find_file_hash(source_id, file_hash)) {
+      return true;
+    }
+    hashdb::source_data_cache_t::source_data_t source_data;
+    bool source_data_found = manager.find(source_id,
+                  source_data.file_hash, source_data.filesize,
+                  source_data.file_type, source_data.zero_count,
+                  source_data.nonprobative_count);
+    if (source_data_found) {
+      cache.insert(source_id, source_data);
+    }
+    file_hash.assign(source_data.file_hash);
+    return source_data_found;
+  }
+
+  // helper for reading a source ID through the source data cache
+  static bool find_cached_source_id(
+                  const hashdb::lmdb_source_id_manager_t& manager,
+                  hashdb::source_data_cache_t& cache,
+                  const std::string& file_hash,
+                  uint64_t& source_id) {
+
+    if (cache.find_source_id(file_hash, source_id)) {
+      return true;
+    }
+    bool has_id = manager.find(file_hash, source_id);
+    if (has_id) {
+      cache.insert_source_id(file_hash, source_id);
+    }
+    return has_id;
+  }
+
+  static uint32_t calculate_crc(const hashdb::hash_result_t& hash_result) {
 
     // calculate the CRC for the sources
     uint32_t crc = 0;
-    for (hashdb::source_sub_counts_t::const_iterator it =
-         source_sub_counts.begin(); it != source_sub_counts.end(); ++it) {
+    for (size_t i=0; i<hash_result.size(); ++i) {
+      const std::string& file_hash = hash_result.file_hash(i);
       crc = hashdb::crc32(crc, static_cast<uint8_t*>(static_cast<void*>(
-                          const_cast<char*>((*it).file_hash.c_str()))),
-                          it->file_hash.size());
+                          const_cast<char*>(file_hash.c_str()))),
+                          file_hash.size());
     }
     return crc;
   }
 
+  // per-thread reusable find_hash result
+  static hashdb::hash_result_t& thread_hash_result() {
+    static thread_local hashdb::hash_result_t hash_result;
+    return hash_result;
+  }
+
+  // true if the source indexes are there and marked complete
+  static bool has_complete_source_index(const std::string& hashdb_dir) {
+    hashdb::settings_t settings;
+    return hashdb::read_settings(hashdb_dir, settings).size() == 0 &&
+           settings.source_index &&
+           lmdb_source_hash_manager_t::is_present(hashdb_dir) &&
+           lmdb_repository_manager_t::is_present(hashdb_dir);
+  }
+
   // ************************************************************
   // version of the hashdb library
   // ************************************************************
@@ -193,7 +276,8 @@ namespace hashdb {
     }
 
     // create the settings file
-    std::string error_message = hashdb::write_settings(hashdb_dir, settings);
+    std::string error_message = hashdb::write_settings(hashdb_dir,
+                                                       settings);
     if (error_message.size() != 0) {
       return error_message;
     }
@@ -205,12 +289,124 @@ namespace hashdb {
     lmdb_source_id_manager_t(hashdb_dir, RW_NEW);
     lmdb_source_name_manager_t(hashdb_dir, RW_NEW);
 
+    // create the source indexes if requested, the new indexes are complete
+    if (settings.source_index) {
+      lmdb_source_hash_manager_t(hashdb_dir, RW_NEW);
+      lmdb_repository_manager_t(hashdb_dir, RW_NEW);
+    }
+
     // create the log
     logger_t(hashdb_dir, command_string);
 
     return "";
   }
 
+  /**
+   * Return "" if the source indexes are built else reason if not.
+   */
+  std::string create_source_index(const std::string& hashdb_dir) {
+
+    // the hashdb must be there
+    hashdb::settings_t settings;
+    std::string error_message = hashdb::read_settings(hashdb_dir, settings);
+    if (error_message.size() != 0) {
+      return error_message;
+    }
+
+    // open the hash data store and the new or partial source hash store
+    lmdb_hash_data_manager_t hash_data_manager(hashdb_dir, READ_ONLY);
+    lmdb_source_hash_manager_t source_hash_manager(hashdb_dir,
+                  lmdb_source_hash_manager_t::is_present(hashdb_dir) ?
+                                                       RW_MODIFY : RW_NEW);
+
+    // index the sources of every hash in batches, one transaction per
+    // batch
+    static const size_t max_batch_size = 1<<16;
+    lmdb_source_hash_manager_t::source_hashes_t source_hashes;
+    uint64_t k_entropy;
+    std::string block_label;
+    uint64_t count;
+    source_id_sub_counts_t source_id_sub_counts;
+    for (lmdb_hash_data_cursor_t cursor(hash_data_manager); !cursor.at_end();
+                                                           cursor.next()) {
+      cursor.read(k_entropy, block_label, count, source_id_sub_counts);
+      for (source_id_sub_counts_t::const_iterator it =
+                   source_id_sub_counts.begin();
+                   it != source_id_sub_counts.end(); ++it) {
+        source_hashes.push_back(lmdb_source_hash_manager_t::source_hashes_t::
+                             value_type(it->source_id, cursor.hash()));
+      }
+      if (source_hashes.size() >= max_batch_size) {
+        source_hash_manager.insert(source_hashes);
+        source_hashes.clear();
+      }
+    }
+    source_hash_manager.insert(source_hashes);
+
+    // open the source stores and the new or partial repository store
+    lmdb_source_id_manager_t source_id_manager(hashdb_dir, READ_ONLY);
+    lmdb_source_name_manager_t source_name_manager(hashdb_dir, READ_ONLY);
+    lmdb_repository_manager_t repository_manager(hashdb_dir,
+                  lmdb_repository_manager_t::is_present(hashdb_dir) ?
+                                                       RW_MODIFY : RW_NEW);
+
+    // index the repository names of every source in batches
+    std::vector<std::pair<std::string, uint64_t> > repository_source_ids;
+    source_names_t source_names;
+    for (lmdb_source_id_cursor_t cursor(source_id_manager); !cursor.at_end();
+                                                           cursor.next()) {
+      source_name_manager.find(cursor.source_id(), source_names);
+      for (source_names_t::const_iterator it = source_names.begin();
+                                     it != source_names.end(); ++it) {
+        repository_source_ids.push_back(std::pair<std::string, uint64_t>(
+                                          it->first, cursor.source_id()));
+      }
+      if (repository_source_ids.size() >= max_batch_size) {
+        repository_manager.insert(repository_source_ids);
+        repository_source_ids.clear();
+      }
+    }
+    repository_manager.insert(repository_source_ids);
+
+    // mark the source indexes complete
+    settings.source_index = true;
+    return hashdb::write_settings(hashdb_dir, settings);
+  }
+
+  /**
+   * Return "" if the hashdb is upgraded or current else reason if not.
+   */
+  std::string upgrade_hashdb(const std::string& hashdb_dir) {
+
+    // the hashdb must be there
+    hashdb::settings_t settings;
+    std::string error_message = hashdb::read_any_settings(hashdb_dir,
+                                                          settings);
+    if (error_message.size() != 0) {
+      return error_message;
+    }
+
+    // the hashdb must be current or upgradable
+    if (settings.settings_version ==
+                                 settings_t::CURRENT_SETTINGS_VERSION) {
+      return "";
+    }
+    if (settings.settings_version !=
+                                 settings_t::UPGRADABLE_SETTINGS_VERSION) {
+      return "The hashdb at path '" + hashdb_dir + "' is not compatible.";
+    }
+
+    // rewrite Type 3 records
+    {
+      lmdb_hash_data_manager_t hash_data_manager(hashdb_dir, RW_MODIFY);
+      hash_data_manager.upgrade();
+    }
+
+    // mark the hashdb current
+    settings.settings_version = settings_t::CURRENT_SETTINGS_VERSION;
+    return hashdb::write_settings(hashdb_dir, settings);
+  }
+
   // ************************************************************
   // source sub_counts
   // ************************************************************
@@ -223,22 +419,66 @@ namespace hashdb {
     return (file_hash < that.file_hash);
   }
 
+  // ************************************************************
+  // hash insert
+  // ************************************************************
+  hash_insert_t::hash_insert_t(const std::string& p_block_hash,
+                               const uint64_t p_k_entropy,
+                               const std::string& p_block_label,
+                               const std::string& p_file_hash) :
+          block_hash(p_block_hash),
+          k_entropy(p_k_entropy),
+          block_label(p_block_label),
+          file_hash(p_file_hash) {
+    }
+
+  hash_merge_t::hash_merge_t() :
+          block_hash(),
+          k_entropy(0),
+          block_label(),
+          file_hash_sub_counts() {
+    }
+
+  // ************************************************************
+  // hash key
+  // ************************************************************
+  constexpr size_t hash_key_t::max_size;
+
+  void hash_key_t::size_error(const size_t size) {
+    std::cerr << "Usage error: a hash value of " << size
+              << " bytes exceeds the maximum of " << max_size << " bytes.\n";
+    assert(0);
+    std::exit(1);
+  }
+
   // ************************************************************
   // settings
   // ************************************************************
   settings_t::settings_t() :
          settings_version(settings_t::CURRENT_SETTINGS_VERSION),
-         block_size(512) {
+         block_size(512),
+         source_index(false) {
   }
 
   std::string settings_t::settings_string() const {
     std::stringstream ss;
     ss << "{\"settings_version\":" << settings_version
        << ", \"block_size\":" << block_size
+       << ", \"source_index\":" << (source_index ? "true" : "false")
        << "}";
     return ss.str();
   }
 
+  // ************************************************************
+  // JSON reader
+  // ************************************************************
+  json_reader_t::json_reader_t() : reader(new json_record_reader_t) {
+  }
+
+  json_reader_t::~json_reader_t() {
+    delete reader;
+  }
+
   // ************************************************************
   // import
   // ************************************************************
@@ -250,6 +490,8 @@ namespace hashdb {
           lmdb_source_data_manager(0),
           lmdb_source_id_manager(0),
           lmdb_source_name_manager(0),
+          lmdb_source_hash_manager(0),
+          lmdb_repository_manager(0),
 
           // log
           logger(new logger_t(hashdb_dir, command_string)),
@@ -265,6 +507,14 @@ namespace hashdb {
                                                               RW_MODIFY);
     lmdb_source_name_manager = new lmdb_source_name_manager_t(hashdb_dir,
                                                               RW_MODIFY);
+
+    // maintain the source indexes if they are complete
+    if (has_complete_source_index(hashdb_dir)) {
+      lmdb_source_hash_manager = new lmdb_source_hash_manager_t(hashdb_dir,
+                                                              RW_MODIFY);
+      lmdb_repository_manager = new lmdb_repository_manager_t(hashdb_dir,
+                                                              RW_MODIFY);
+    }
   }
 
   import_manager_t::~import_manager_t() {
@@ -279,6 +529,8 @@ namespace hashdb {
     delete lmdb_source_data_manager;
     delete lmdb_source_id_manager;
     delete lmdb_source_name_manager;
+    delete lmdb_source_hash_manager;
+    delete lmdb_repository_manager;
     delete logger;
     delete changes;
   }
@@ -296,6 +548,9 @@ namespace hashdb {
                                                     source_id);
     lmdb_source_name_manager->insert(source_id, repository_name, filename,
                                      *changes);
+    if (lmdb_repository_manager != 0) {
+      lmdb_repository_manager->insert(repository_name, source_id);
+    }
 
     // If the source ID is new then add a blank source data record just to keep
     // from breaking the reverse look-up done in scan_manager_t.
@@ -305,6 +560,58 @@ namespace hashdb {
     }
   }
 
+  // insert source names in groups, one transaction per store per group
+  void import_manager_t::insert_source_names(
+                  const std::string& repository_name,
+                  const std::vector<std::pair<std::string, std::string> >&
+                                                   file_hash_filenames) {
+
+    // bound the size of each transaction
+    static const size_t max_group_size = 256;
+
+    std::vector<std::string> file_hashes;
+    std::vector<std::string> filenames;
+    std::vector<uint64_t> source_ids;
+    std::vector<bool> is_new_ids;
+    std::vector<std::pair<std::string, std::string> >::const_iterator it =
+                                                file_hash_filenames.begin();
+    while (it != file_hash_filenames.end()) {
+
+      // get a group
+      file_hashes.clear();
+      filenames.clear();
+      for (; it != file_hash_filenames.end() &&
+             file_hashes.size() < max_group_size; ++it) {
+        if (it->first.size() == 0) {
+          std::cerr << "Error: insert_source_names called with empty file_hash\n";
+          continue;
+        }
+        file_hashes.push_back(it->first);
+        filenames.push_back(it->second);
+      }
+      if (file_hashes.size() == 0) {
+        continue;
+      }
+
+      lmdb_source_id_manager->insert(file_hashes, *changes, source_ids,
+                                     is_new_ids);
+      lmdb_source_name_manager->insert(source_ids, repository_name,
+                                       filenames, *changes);
+      if (lmdb_repository_manager != 0) {
+        lmdb_repository_manager->insert(repository_name, source_ids);
+      }
+
+      // If a source ID is new then add a blank source data record just to
+      // keep from breaking the reverse look-up done in scan_manager_t.
+      for (size_t i=0; i<source_ids.size(); ++i) {
+        if (is_new_ids[i] == true) {
+          lmdb_source_data_manager->insert(source_ids[i], file_hashes[i],
+                                           0, "", 0, 0, *changes);
+        }
+      }
+    }
+  }
+
   void import_manager_t::insert_source_data(
                           const std::string& file_hash,
                           const uint64_t filesize,
@@ -345,6 +652,9 @@ namespace hashdb {
                  block_hash, k_entropy, block_label,
                  source_id, *changes);
     lmdb_hash_manager->insert(block_hash, count, *changes);
+    if (lmdb_source_hash_manager != 0) {
+      lmdb_source_hash_manager->insert(source_id, block_hash);
+    }
 
     // If the source ID is new then add a blank source data record just to keep
     // from breaking the reverse look-up done in scan_manager_t.
@@ -354,6 +664,91 @@ namespace hashdb {
     }
   }
 
+  // insert hashes in groups, one transaction per store per group
+  void import_manager_t::insert_hashes(
+                  const std::vector<hash_insert_t>& hash_inserts) {
+
+    // bound the size of each transaction
+    static const size_t max_group_size = 4096;
+
+    std::vector<std::string> file_hashes;
+    std::vector<uint64_t> source_ids;
+    std::vector<bool> is_new_ids;
+    std::map<std::string, uint64_t> group_source_ids;
+    std::vector<std::string> block_hashes;
+    std::vector<uint64_t> k_entropies;
+    std::vector<std::string> block_labels;
+    std::vector<std::string> hash_file_hashes;
+    std::vector<uint64_t> hash_source_ids;
+    std::vector<size_t> counts;
+    std::vector<hash_insert_t>::const_iterator it = hash_inserts.begin();
+    while (it != hash_inserts.end()) {
+
+      // get a group
+      block_hashes.clear();
+      k_entropies.clear();
+      block_labels.clear();
+      file_hashes.clear();
+      hash_file_hashes.clear();
+      group_source_ids.clear();
+      for (; it != hash_inserts.end() &&
+             block_hashes.size() < max_group_size; ++it) {
+        if (it->block_hash.size() == 0) {
+          std::cerr << "Error: insert_hashes called with empty block_hash\n";
+          continue;
+        }
+        if (it->file_hash.size() == 0) {
+          std::cerr << "Error: insert_hashes called with empty file_hash\n";
+          continue;
+        }
+        block_hashes.push_back(it->block_hash);
+        k_entropies.push_back(it->k_entropy);
+        block_labels.push_back(it->block_label);
+        hash_file_hashes.push_back(it->file_hash);
+        if (group_source_ids.insert(std::pair<std::string, uint64_t>(
+                                         it->file_hash, 0)).second) {
+          file_hashes.push_back(it->file_hash);
+        }
+      }
+      if (block_hashes.size() == 0) {
+        continue;
+      }
+
+      // get source IDs
+      lmdb_source_id_manager->insert(file_hashes, *changes, source_ids,
+                                     is_new_ids);
+      for (size_t i=0; i<file_hashes.size(); ++i) {
+        group_source_ids[file_hashes[i]] = source_ids[i];
+      }
+      hash_source_ids.clear();
+      for (std::vector<std::string>::const_iterator hash_it =
+                    hash_file_hashes.begin();
+                    hash_it != hash_file_hashes.end(); ++hash_it) {
+        hash_source_ids.push_back(group_source_ids[*hash_it]);
+      }
+
+      // insert hashes into hash data manager and hash manager
+      lmdb_hash_data_manager->insert(block_hashes, k_entropies, block_labels,
+                                     hash_source_ids, *changes, counts);
+      lmdb_hash_manager->insert(block_hashes, counts, *changes);
+      if (lmdb_source_hash_manager != 0) {
+        for (size_t i=0; i<block_hashes.size(); ++i) {
+          lmdb_source_hash_manager->insert(hash_source_ids[i],
+                                           block_hashes[i]);
+        }
+      }
+
+      // If a source ID is new then add a blank source data record just to
+      // keep from breaking the reverse look-up done in scan_manager_t.
+      for (size_t i=0; i<source_ids.size(); ++i) {
+        if (is_new_ids[i] == true) {
+          lmdb_source_data_manager->insert(source_ids[i], file_hashes[i],
+                                           0, "", 0, 0, *changes);
+        }
+      }
+    }
+  }
+
   // add only if file hash is not present, use during merge
   void import_manager_t::merge_hash(const std::string& block_hash,
                                     const uint64_t k_entropy,
@@ -361,32 +756,180 @@ namespace hashdb {
                                     const std::string& file_hash,
                                     const uint64_t sub_count) {
 
+    std::vector<std::pair<std::string, uint64_t> > file_hash_sub_counts;
+    file_hash_sub_counts.push_back(std::pair<std::string, uint64_t>(
+                                                  file_hash, sub_count));
+    merge_hashes(block_hash, k_entropy, block_label, file_hash_sub_counts);
+  }
+
+  // merge all sources of a hash, writing the hash data once
+  void import_manager_t::merge_hashes(const std::string& block_hash,
+                                      const uint64_t k_entropy,
+                                      const std::string& block_label,
+                  const std::vector<std::pair<std::string, uint64_t> >&
+                                                  file_hash_sub_counts) {
+
+    if (file_hash_sub_counts.size() == 0) {
+      return;
+    }
     if (block_hash.size() == 0) {
       std::cerr << "Error: insert_hash called with empty block_hash\n";
       return;
     }
-    if (file_hash.size() == 0) {
-      std::cerr << "Error: insert_hash called with empty file_hash\n";
+
+    // get source IDs
+    std::vector<std::pair<uint64_t, uint64_t> > source_id_sub_counts;
+    std::vector<std::pair<uint64_t, std::string> > new_ids;
+    for (std::vector<std::pair<std::string, uint64_t> >::const_iterator it =
+                    file_hash_sub_counts.begin();
+                    it != file_hash_sub_counts.end(); ++it) {
+      if (it->first.size() == 0) {
+        std::cerr << "Error: insert_hash called with empty file_hash\n";
+        continue;
+      }
+      uint64_t source_id;
+      bool is_new_id = lmdb_source_id_manager->insert(it->first, *changes,
+                                                      source_id);
+      source_id_sub_counts.push_back(std::pair<uint64_t, uint64_t>(
+                                                  source_id, it->second));
+      if (is_new_id == true) {
+        new_ids.push_back(std::pair<uint64_t, std::string>(
+                                                  source_id, it->first));
+      }
+    }
+    if (source_id_sub_counts.size() == 0) {
       return;
     }
 
-    uint64_t source_id;
-    bool is_new_id = lmdb_source_id_manager->insert(file_hash, *changes,
-                                                    source_id);
-
     // merge hash into hash data manager
     const size_t count = lmdb_hash_data_manager->merge(
                  block_hash, k_entropy, block_label,
-                 source_id, sub_count, *changes);
+                 source_id_sub_counts, *changes);
 
     // insert hash into hash manager
     lmdb_hash_manager->insert(block_hash, count, *changes);
+    if (lmdb_source_hash_manager != 0) {
+      for (std::vector<std::pair<uint64_t, uint64_t> >::const_iterator it =
+                    source_id_sub_counts.begin();
+                    it != source_id_sub_counts.end(); ++it) {
+        lmdb_source_hash_manager->insert(it->first, block_hash);
+      }
+    }
 
-    // If the source ID is new then add a blank source data record just to keep
-    // from breaking the reverse look-up done in scan_manager_t.
-    if (is_new_id == true) {
-      lmdb_source_data_manager->insert(source_id, file_hash, 0, "", 0, 0,
-                                       *changes);
+    // If a source ID is new then add a blank source data record just to keep
+    // from breaking the reverse look-up done in scan_manager_t.  Keep any
+    // source data that a concurrent import of the source record inserted.
+    for (std::vector<std::pair<uint64_t, std::string> >::const_iterator it =
+                    new_ids.begin(); it != new_ids.end(); ++it) {
+      lmdb_source_data_manager->insert(it->first, it->second, 0, "", 0, 0,
+                                       *changes, true);
+    }
+  }
+
+  // merge hashes in groups, one transaction per store per group
+  void import_manager_t::merge_hashes(
+                  const std::vector<hash_merge_t>& hash_merges) {
+
+    // bound the size of each transaction
+    static const size_t max_group_size = 4096;
+
+    std::vector<std::string> file_hashes;
+    std::vector<uint64_t> source_ids;
+    std::vector<bool> is_new_ids;
+    std::map<std::string, uint64_t> group_source_ids;
+    std::vector<std::string> block_hashes;
+    std::vector<uint64_t> k_entropies;
+    std::vector<std::string> block_labels;
+    std::vector<std::vector<std::pair<uint64_t, uint64_t> > >
+                                                  source_id_sub_counts;
+    std::vector<size_t> counts;
+    std::vector<hash_merge_t>::const_iterator it = hash_merges.begin();
+    while (it != hash_merges.end()) {
+
+      // get a group, with the sources of each hash indexed into
+      // file_hashes until their source IDs are known
+      block_hashes.clear();
+      k_entropies.clear();
+      block_labels.clear();
+      file_hashes.clear();
+      group_source_ids.clear();
+      for (; it != hash_merges.end() &&
+             block_hashes.size() < max_group_size; ++it) {
+        if (it->block_hash.size() == 0) {
+          std::cerr << "Error: merge_hashes called with empty block_hash\n";
+          continue;
+        }
+        if (source_id_sub_counts.size() == block_hashes.size()) {
+          source_id_sub_counts.resize(block_hashes.size() + 1);
+        }
+        std::vector<std::pair<uint64_t, uint64_t> >& sub_counts =
+                                 source_id_sub_counts[block_hashes.size()];
+        sub_counts.clear();
+        for (std::vector<std::pair<std::string, uint64_t> >::const_iterator
+                    source_it = it->file_hash_sub_counts.begin();
+                    source_it != it->file_hash_sub_counts.end();
+                    ++source_it) {
+          if (source_it->first.size() == 0) {
+            std::cerr << "Error: merge_hashes called with empty file_hash\n";
+            continue;
+          }
+          const std::pair<std::map<std::string, uint64_t>::iterator, bool>
+                   source = group_source_ids.insert(
+                   std::pair<std::string, uint64_t>(source_it->first,
+                                                    file_hashes.size()));
+          if (source.second) {
+            file_hashes.push_back(source_it->first);
+          }
+          sub_counts.push_back(std::pair<uint64_t, uint64_t>(
+                                 source.first->second, source_it->second));
+        }
+        if (sub_counts.size() == 0) {
+          continue;
+        }
+        block_hashes.push_back(it->block_hash);
+        k_entropies.push_back(it->k_entropy);
+        block_labels.push_back(it->block_label);
+      }
+      if (block_hashes.size() == 0) {
+        continue;
+      }
+
+      // get source IDs
+      lmdb_source_id_manager->insert(file_hashes, *changes, source_ids,
+                                     is_new_ids);
+      for (size_t i=0; i<block_hashes.size(); ++i) {
+        for (std::vector<std::pair<uint64_t, uint64_t> >::iterator
+                    source_it = source_id_sub_counts[i].begin();
+                    source_it != source_id_sub_counts[i].end(); ++source_it) {
+          source_it->first = source_ids[source_it->first];
+        }
+      }
+
+      // merge hashes into hash data manager and hash manager
+      lmdb_hash_data_manager->merge(block_hashes, k_entropies, block_labels,
+                                    source_id_sub_counts, *changes, counts);
+      lmdb_hash_manager->insert(block_hashes, counts, *changes);
+      if (lmdb_source_hash_manager != 0) {
+        for (size_t j=0; j<block_hashes.size(); ++j) {
+          for (std::vector<std::pair<uint64_t, uint64_t> >::const_iterator
+                    source_it = source_id_sub_counts[j].begin();
+                    source_it != source_id_sub_counts[j].end(); ++source_it) {
+            lmdb_source_hash_manager->insert(source_it->first,
+                                             block_hashes[j]);
+          }
+        }
+      }
+
+      // If a source ID is new then add a blank source data record just to
+      // keep from breaking the reverse look-up done in scan_manager_t.
+      // Keep any source data that a concurrent import of the source record
+      // inserted.
+      for (size_t j=0; j<source_ids.size(); ++j) {
+        if (is_new_ids[j] == true) {
+          lmdb_source_data_manager->insert(source_ids[j], file_hashes[j],
+                                           0, "", 0, 0, *changes, true);
+        }
+      }
     }
   }
 
@@ -394,28 +937,46 @@ namespace hashdb {
   std::string import_manager_t::import_json(
                           const std::string& json_string) {
 
-    // open input as a JSON DOM document
-    rapidjson::Document document;
-    if (document.Parse(json_string.c_str()).HasParseError() ||
-        !document.IsObject()) {
+    // parse a copy since parsing is in place
+    std::vector<char> json_copy(json_string.c_str(),
+                                json_string.c_str() + json_string.size() + 1);
+    return import_json(&json_copy[0]);
+  }
+
+  // import JSON hash or source parsed in place, return "" or error
+  std::string import_manager_t::import_json(char* const json_string) {
+    json_reader_t json_reader;
+    return import_json(json_string, json_reader);
+  }
+
+  // import JSON hash or source parsed in place with the reader of the
+  // calling thread, return "" or error
+  std::string import_manager_t::import_json(char* const json_string,
+                                            json_reader_t& json_reader) {
+
+    typedef hashdb::json_record_reader_t reader_t;
+    reader_t& reader = *json_reader.reader;
+    if (!reader.parse(json_string)) {
       return "Invalid JSON syntax";
     }
 
     // block_hash or file_hash
-    if (document.HasMember("block_hash")) {
+    if (reader.get(reader_t::BLOCK_HASH).type != reader_t::ABSENT) {
 
       // block_hash
-      if (!document["block_hash"].IsString()) {
+      if (reader.get(reader_t::BLOCK_HASH).type != reader_t::STRING) {
         return "Invalid block_hash field";
       }
       const std::string block_hash = hashdb::hex_to_bin(
-                                         document["block_hash"].GetString());
+                             reader.get(reader_t::BLOCK_HASH).string_value);
 
       // entropy (optional)
       uint64_t k_entropy = 0;
-      if (document.HasMember("k_entropy")) {
-        if (document["k_entropy"].IsUint64()) {
-          k_entropy = document["k_entropy"].GetUint64();
+      const reader_t::value_t& json_k_entropy = reader.get(
+                                                     reader_t::K_ENTROPY);
+      if (json_k_entropy.type != reader_t::ABSENT) {
+        if (json_k_entropy.type == reader_t::UINT64) {
+          k_entropy = json_k_entropy.uint64_value;
         } else {
           return "Invalid k_entropy field";
         }
@@ -423,70 +984,73 @@ namespace hashdb {
 
       // block_label (optional)
       std::string block_label = "";
-      if (document.HasMember("block_label")) {
-        if (document["block_label"].IsString()) {
-          block_label = document["block_label"].GetString();
+      const reader_t::value_t& json_block_label = reader.get(
+                                                     reader_t::BLOCK_LABEL);
+      if (json_block_label.type != reader_t::ABSENT) {
+        if (json_block_label.type == reader_t::STRING) {
+          block_label = json_block_label.string_value;
         } else {
           return "Invalid block_label field";
         }
       }
 
       // source_sub_counts:[]
-      if (!document.HasMember("source_sub_counts") ||
-                    !document["source_sub_counts"].IsArray()) {
+      if (reader.get(reader_t::SOURCE_SUB_COUNTS).type != reader_t::ARRAY) {
         return "Invalid source_sub_counts field";
       }
-      const rapidjson::Value& json_source_sub_counts =
-                                        document["source_sub_counts"];
-      hashdb::source_sub_counts_t* source_sub_counts =
-                                        new hashdb::source_sub_counts_t;
-      for (rapidjson::SizeType i = 0;
-           i+1 < json_source_sub_counts.Size(); i+=2) {
+      std::vector<std::pair<std::string, uint64_t> > file_hash_sub_counts;
+      std::string error_message = "";
+      const size_t size = reader.size(reader_t::SOURCE_SUB_COUNTS);
+      for (size_t i = 0; i+1 < size; i+=2) {
 
         // source hash
-        if (!json_source_sub_counts[i+0].IsString()) {
-          delete source_sub_counts;
-          return "Invalid source hash in source_sub_counts";
+        const reader_t::value_t& json_file_hash = reader.element(
+                                           reader_t::SOURCE_SUB_COUNTS, i);
+        if (json_file_hash.type != reader_t::STRING) {
+          error_message = "Invalid source hash in source_sub_counts";
+          break;
         }
-        const std::string file_hash = hashdb::hex_to_bin(
-                                        json_source_sub_counts[i].GetString());
 
         // sub_count
-        if (!json_source_sub_counts[i+1].IsUint64()) {
-          delete source_sub_counts;
-          return "Invalid sub_count in source_sub_counts";
+        const reader_t::value_t& json_sub_count = reader.element(
+                                           reader_t::SOURCE_SUB_COUNTS, i+1);
+        if (json_sub_count.type != reader_t::UINT64) {
+          error_message = "Invalid sub_count in source_sub_counts";
+          break;
         }
-        const uint64_t sub_count = json_source_sub_counts[i+1].GetUint64();
 
-        // add hash data for this source and source sub_count
-        merge_hash(block_hash, k_entropy, block_label, file_hash, sub_count);
+        file_hash_sub_counts.push_back(std::pair<std::string, uint64_t>(
+                            hashdb::hex_to_bin(json_file_hash.string_value),
+                            json_sub_count.uint64_value));
       }
 
-      delete source_sub_counts;
-      return "";
+      // add hash data for the sources and source sub_counts read before
+      // any error
+      merge_hashes(block_hash, k_entropy, block_label, file_hash_sub_counts);
+      return error_message;
 
-    } else if (document.HasMember("file_hash")) {
+    } else if (reader.get(reader_t::FILE_HASH).type != reader_t::ABSENT) {
 
       // parse file_hash
-      if (!document.HasMember("file_hash") ||
-                    !document["file_hash"].IsString()) {
+      if (reader.get(reader_t::FILE_HASH).type != reader_t::STRING) {
         return "Invalid file_hash field";
       }
       const std::string file_hash = hashdb::hex_to_bin(
-                                       document["file_hash"].GetString());
+                              reader.get(reader_t::FILE_HASH).string_value);
 
       // parse filesize
-      if (!document.HasMember("filesize") ||
-                    !document["filesize"].IsUint64()) {
+      if (reader.get(reader_t::FILESIZE).type != reader_t::UINT64) {
         return "Invalid filesize field";
       }
-      const uint64_t filesize = document["filesize"].GetUint64();
+      const uint64_t filesize = reader.get(reader_t::FILESIZE).uint64_value;
 
       // parse file_type (optional)
       std::string file_type = "";
-      if (document.HasMember("file_type")) {
-        if (document["file_type"].IsString()) {
-          file_type = document["file_type"].GetString();
+      const reader_t::value_t& json_file_type = reader.get(
+                                                     reader_t::FILE_TYPE);
+      if (json_file_type.type != reader_t::ABSENT) {
+        if (json_file_type.type == reader_t::STRING) {
+          file_type = json_file_type.string_value;
         } else {
           return "Invalid file_type field";
         }
@@ -494,9 +1058,11 @@ namespace hashdb {
 
       // zero_count (optional)
       uint64_t zero_count = 0;
-      if (document.HasMember("zero_count")) {
-        if (document["zero_count"].IsUint64()) {
-          zero_count = document["zero_count"].GetUint64();
+      const reader_t::value_t& json_zero_count = reader.get(
+                                                     reader_t::ZERO_COUNT);
+      if (json_zero_count.type != reader_t::ABSENT) {
+        if (json_zero_count.type == reader_t::UINT64) {
+          zero_count = json_zero_count.uint64_value;
         } else {
           return "Invalid zero_count field";
         }
@@ -504,50 +1070,50 @@ namespace hashdb {
 
       // nonprobative_count (optional)
       uint64_t nonprobative_count = 0;
-      if (document.HasMember("nonprobative_count")) {
-        if (document["nonprobative_count"].IsUint64()) {
-          nonprobative_count = document["nonprobative_count"].GetUint64();
+      const reader_t::value_t& json_nonprobative_count = reader.get(
+                                             reader_t::NONPROBATIVE_COUNT);
+      if (json_nonprobative_count.type != reader_t::ABSENT) {
+        if (json_nonprobative_count.type == reader_t::UINT64) {
+          nonprobative_count = json_nonprobative_count.uint64_value;
         } else {
           return "Invalid nonprobative_count field";
         }
       }
 
       // parse name_pairs:[]
-      if (!document.HasMember("name_pairs") ||
-                    !document["name_pairs"].IsArray()) {
+      if (reader.get(reader_t::NAME_PAIRS).type != reader_t::ARRAY) {
         return "Invalid name_pairs field";
       }
-      const rapidjson::Value& json_names = document["name_pairs"];
-      hashdb::source_names_t* names = new hashdb::source_names_t;
-      for (rapidjson::SizeType i = 0; i< json_names.Size(); i+=2) {
+      hashdb::source_names_t names;
+      const size_t size = reader.size(reader_t::NAME_PAIRS);
+      for (size_t i = 0; i < size; i+=2) {
 
         // parse repository name
-        if (!json_names[i].IsString()) {
-          delete names;
+        const reader_t::value_t& json_repository_name = reader.element(
+                                                  reader_t::NAME_PAIRS, i);
+        if (json_repository_name.type != reader_t::STRING) {
           return "Invalid repository name in name_pairs field";
         }
-        const std::string repository_name = json_names[i].GetString();
 
         // parse filename
-        if (!json_names[i+1].IsString()) {
-          delete names;
+        if (i+1 == size || reader.element(reader_t::NAME_PAIRS, i+1).type
+                                                     != reader_t::STRING) {
           return "Invalid filename in name_pairs field";
         }
-        const std::string filename = json_names[i+1].GetString();
 
         // add repository name, filename pair
-        names->insert(hashdb::source_name_t(repository_name, filename));
+        names.insert(hashdb::source_name_t(
+                   json_repository_name.string_value,
+                   reader.element(reader_t::NAME_PAIRS, i+1).string_value));
       }
 
       // everything worked so insert the source data and source names
       insert_source_data(file_hash,
                          filesize, file_type, zero_count, nonprobative_count);
-      for (hashdb::source_names_t::const_iterator it = names->begin();
-           it != names->end(); ++it) {
+      for (hashdb::source_names_t::const_iterator it = names.begin();
+           it != names.end(); ++it) {
         insert_source_name(file_hash, it->first, it->second);
       }
-
-      delete names;
       return "";
 
     } else {
@@ -560,6 +1126,11 @@ namespace hashdb {
     return lmdb_source_id_manager->find(file_hash, source_id);
   }
 
+  bool import_manager_t::has_source(const hash_key_t& file_hash) const {
+    uint64_t source_id;
+    return lmdb_source_id_manager->find(file_hash, source_id);
+  }
+
   std::string import_manager_t::first_source() const {
     return lmdb_source_id_manager->first_source();
   }
@@ -587,20 +1158,37 @@ namespace hashdb {
     return lmdb_source_id_manager->size();
   }
 
+  void import_manager_t::flush() {
+    lmdb_hash_data_manager->flush();
+    if (lmdb_source_hash_manager != 0) {
+      lmdb_source_hash_manager->flush();
+    }
+  }
+
   // ************************************************************
   // scan
   // ************************************************************
-  scan_manager_t::scan_manager_t(const std::string& hashdb_dir) :
+  scan_manager_t::scan_manager_t(const std::string& hashdb_dir,
+                                 const size_t source_cache_size,
+                                 const size_t hash_cache_size) :
           // LMDB managers
           lmdb_hash_data_manager(0),
           lmdb_hash_manager(0),
           lmdb_source_data_manager(0),
           lmdb_source_id_manager(0),
           lmdb_source_name_manager(0),
+          lmdb_source_hash_manager(0),
+          lmdb_repository_manager(0),
 
           // for find_expanded_hash_json
           hashes(new locked_member_t),
-          sources(new locked_member_t) {
+          sources(new locked_member_t),
+
+          // for source lookups
+          source_data_cache(new source_data_cache_t(source_cache_size)),
+
+          // for find_hash_json
+          hash_result_cache(new hash_result_cache_t(hash_cache_size)) {
 
     // open managers
     lmdb_hash_data_manager = new lmdb_hash_data_manager_t(hashdb_dir,
@@ -612,6 +1200,14 @@ namespace hashdb {
                                                               READ_ONLY);
     lmdb_source_name_manager = new lmdb_source_name_manager_t(hashdb_dir,
                                                               READ_ONLY);
+
+    // use the source indexes only if they are complete
+    if (has_complete_source_index(hashdb_dir)) {
+      lmdb_source_hash_manager = new lmdb_source_hash_manager_t(hashdb_dir,
+                                                              READ_ONLY);
+      lmdb_repository_manager = new lmdb_repository_manager_t(hashdb_dir,
+                                                              READ_ONLY);
+    }
   }
 
   scan_manager_t::~scan_manager_t() {
@@ -620,37 +1216,71 @@ namespace hashdb {
     delete lmdb_source_data_manager;
     delete lmdb_source_id_manager;
     delete lmdb_source_name_manager;
+    delete lmdb_source_hash_manager;
+    delete lmdb_repository_manager;
 
     // for find_expanded_hash_json
     delete hashes;
     delete sources;
+
+    // for source lookups
+    delete source_data_cache;
+
+    // for find_hash_json
+    delete hash_result_cache;
   }
 
   std::string scan_manager_t::find_hash_json(
                    const hashdb::scan_mode_t scan_mode,
                    const std::string& block_hash) {
 
+    // use the cached result if available.  An EXPANDED_OPTIMIZED
+    // result is reusable only while the hash is still marked as reported.
+    const size_t mode = static_cast<size_t>(scan_mode);
+    std::string json_text;
+    if (hash_result_cache->find(mode, block_hash, json_text) &&
+                 (scan_mode != hashdb::scan_mode_t::EXPANDED_OPTIMIZED ||
+                  hashes->locked_contains(block_hash))) {
+      return json_text;
+    }
+
     // delegate to low-level handler
     switch(scan_mode) {
 
       // EXPANDED
       case hashdb::scan_mode_t::EXPANDED:
-        return find_expanded_hash_json(false, block_hash);
+        json_text = find_expanded_hash_json(false, block_hash);
+        break;
 
       // EXPANDED_OPTIMIZED
       case hashdb::scan_mode_t::EXPANDED_OPTIMIZED:
-        return find_expanded_hash_json(true, block_hash);
+        json_text = find_expanded_hash_json(true, block_hash);
+        break;
 
       // COUNT
       case hashdb::scan_mode_t::COUNT:
-        return find_hash_count_json(block_hash);
+        json_text = find_hash_count_json(block_hash);
+        break;
 
       // APPROXIMATE_COUNT
       case hashdb::scan_mode_t::APPROXIMATE_COUNT:
-        return find_approximate_hash_count_json(block_hash);
+        json_text = find_approximate_hash_count_json(block_hash);
+        break;
 
       default: assert(0); std::exit(1);
     }
+
+    // cache matches
+    if (json_text.size() != 0 && hash_result_cache->enabled()) {
+      if (scan_mode == hashdb::scan_mode_t::EXPANDED_OPTIMIZED) {
+        // later optimized results for this hash are suppressed
+        hash_result_cache->insert(mode, block_hash, "{\"block_hash\":\"" +
+                                  hashdb::bin_to_hex(block_hash) + "\"}");
+      } else {
+        hash_result_cache->insert(mode, block_hash, json_text);
+      }
+    }
+    return json_text;
   }
 
   // Find expanded hash, optimized with caching, return JSON.
@@ -658,20 +1288,14 @@ namespace hashdb {
   std::string scan_manager_t::find_expanded_hash_json(
                     const bool optimizing, const std::string& block_hash) {
 
-    // fields to hold the scan
-    uint64_t k_entropy;
-    std::string block_label;
-    uint64_t count;
-    hashdb::source_sub_counts_t* source_sub_counts =
-                                           new hashdb::source_sub_counts_t;
+    // fields to hold the scan, reused by this thread
+    hashdb::hash_result_t& hash_result = thread_hash_result();
 
     // scan
-    bool matched = scan_manager_t::find_hash(block_hash,
-                           k_entropy, block_label, count, *source_sub_counts);
+    bool matched = scan_manager_t::find_hash(block_hash, hash_result);
 
     // done if no match
     if (matched == false) {
-      delete source_sub_counts;
       return "";
     }
 
@@ -688,31 +1312,32 @@ namespace hashdb {
     if (!optimizing || hashes->locked_insert(block_hash)) {
 
       // add entropy
-      json_doc.AddMember("k_entropy", k_entropy, allocator);
+      json_doc.AddMember("k_entropy", hash_result.k_entropy, allocator);
 
       // add block_label
-      json_doc.AddMember("block_label", v(block_label, allocator), allocator);
+      json_doc.AddMember("block_label", v(hash_result.block_label, allocator),
+                         allocator);
 
       // add count
-      json_doc.AddMember("count", count, allocator);
+      json_doc.AddMember("count", hash_result.count, allocator);
 
       // add source_list_id
-      uint32_t crc = calculate_crc(*source_sub_counts);
+      uint32_t crc = calculate_crc(hash_result);
       json_doc.AddMember("source_list_id", crc, allocator);
 
       // the sources array
       rapidjson::Value json_sources(rapidjson::kArrayType);
 
       // add each source object
-      for (hashdb::source_sub_counts_t::const_iterator it =
-           source_sub_counts->begin(); it != source_sub_counts->end(); ++it) {
-        if (!optimizing || sources->locked_insert(it->file_hash)) {
+      for (size_t i=0; i<hash_result.size(); ++i) {
+        const std::string& file_hash = hash_result.file_hash(i);
+        if (!optimizing || sources->locked_insert(file_hash)) {
 
           // create a json_source object for the json_sources array
           rapidjson::Value json_source(rapidjson::kObjectType);
 
           // provide the complete source information for this source
-          provide_source_information(*this, it->file_hash, allocator,
+          provide_source_information(*this, file_hash, allocator,
                                      json_source);
           json_sources.PushBack(json_source, allocator);
         }
@@ -722,23 +1347,21 @@ namespace hashdb {
       // add source_sub_counts as pairs of file hash, sub_count
       rapidjson::Value json_source_sub_counts(rapidjson::kArrayType);
 
-      for (hashdb::source_sub_counts_t::const_iterator it =
-           source_sub_counts->begin(); it != source_sub_counts->end(); ++it) {
+      for (size_t i=0; i<hash_result.size(); ++i) {
 
         // file hash
         json_source_sub_counts.PushBack(
-                   v(hashdb::bin_to_hex(it->file_hash), allocator), allocator);
+                   v(hashdb::bin_to_hex(hash_result.file_hash(i)), allocator),
+                   allocator);
 
         // sub_count
-        json_source_sub_counts.PushBack(it->sub_count, allocator);
+        json_source_sub_counts.PushBack(hash_result.sub_count(i), allocator);
 
       }
       json_doc.AddMember("source_sub_counts", json_source_sub_counts,
                          allocator);
     }
 
-    delete source_sub_counts;
-
     // return JSON text
     rapidjson::StringBuffer strbuf;
     rapidjson::Writer<rapidjson::StringBuffer> writer(strbuf);
@@ -754,11 +1377,40 @@ namespace hashdb {
                uint64_t& count,
                source_sub_counts_t& source_sub_counts) const {
 
-    // clear fields
-    k_entropy = 0;
-    block_label = "";
-    count = 0;
+    // find into a reusable result
+    hashdb::hash_result_t& hash_result = thread_hash_result();
+    bool has_hash = find_hash(block_hash, hash_result);
+
+    // copy out fields
+    k_entropy = hash_result.k_entropy;
+    block_label = hash_result.block_label;
+    count = hash_result.count;
     source_sub_counts.clear();
+    for (size_t i=0; i<hash_result.size(); ++i) {
+      source_sub_counts.insert(hashdb::source_sub_count_t(
+                     hash_result.file_hash(i), hash_result.sub_count(i)));
+    }
+    return has_hash;
+  }
+
+  // find hash into a reusable result without allocating once the
+  // result has grown to size
+  bool scan_manager_t::find_hash(const std::string& block_hash,
+                                 hash_result_t& hash_result) const {
+    return find_hash_result(block_hash, hash_result);
+  }
+
+  bool scan_manager_t::find_hash(const hash_key_t& block_hash,
+                                 hash_result_t& hash_result) const {
+    return find_hash_result(block_hash, hash_result);
+  }
+
+  template <typename K>
+  bool scan_manager_t::find_hash_result(const K& block_hash,
+                                        hash_result_t& hash_result) const {
+
+    // clear fields
+    hash_result.clear();
 
     if (block_hash.size() == 0) {
       std::cerr << "Error: find_hash called with empty block_hash\n";
@@ -772,107 +1424,111 @@ namespace hashdb {
     }
 
     // hash may be present so read hash using hash data manager
-    hashdb::source_id_sub_counts_t* source_id_sub_counts =
-                new hashdb::source_id_sub_counts_t;
-    bool has_hash = lmdb_hash_data_manager->find(block_hash, k_entropy,
-                                  block_label, count, *source_id_sub_counts);
-    if (has_hash) {
-      // build source_sub_count from source_id_sub_count
-      for (hashdb::source_id_sub_counts_t::const_iterator it =
-           source_id_sub_counts->begin(); it != source_id_sub_counts->end();
-           ++it) {
-
-        // space for unused returned source variables
-        std::string file_hash;
-        uint64_t filesize;
-        std::string file_type;
-        uint64_t zero_count;
-        uint64_t nonprobative_count;
-
-        // get file_hash from source_id
-        bool source_data_found = lmdb_source_data_manager->find(
-                                it->source_id, file_hash,
-                                filesize, file_type,
-                                zero_count, nonprobative_count);
-
-        // source_data must have a source_id to match the source_id in hash_data
-        if (source_data_found == false) {
-          assert(0);
-        }
+    bool has_hash = lmdb_hash_data_manager->find(block_hash,
+                                  hash_result.k_entropy,
+                                  hash_result.block_label,
+                                  hash_result.count,
+                                  hash_result.source_id_sub_counts);
+    if (has_hash == false) {
+      // no action, lmdb_hash_data_manager.find clears out fields
+      return false;
+    }
+
+    resolve_sources(hash_result);
+    return true;
+  }
+
+  // build sources from source_id_sub_counts ordered by file hash
+  void scan_manager_t::resolve_sources(hash_result_t& hash_result) const {
 
-        // add the source sub_counts
-        source_sub_counts.insert(hashdb::source_sub_count_t(file_hash,
-                                                            it->sub_count));
+    // grow source storage as needed, never shrink it
+    const size_t num_sources = hash_result.source_id_sub_counts.size();
+    if (hash_result.sources.size() < num_sources) {
+      hash_result.sources.resize(num_sources);
+    }
+
+    // build sources from source_id_sub_counts
+    for (size_t i=0; i<num_sources; ++i) {
+
+      // get file_hash from source_id
+      bool source_data_found = find_cached_file_hash(
+                                *lmdb_source_data_manager,
+                                *source_data_cache,
+                                hash_result.source_id_sub_counts[i].first,
+                                hash_result.sources[i].file_hash);
+
+      // source_data must have a source_id to match the source_id in hash_data
+      if (source_data_found == false) {
+        assert(0);
       }
-      delete source_id_sub_counts;
-      return true;
 
-    } else {
-      // no action, lmdb_hash_data_manager.find clears out fields
-      delete source_id_sub_counts;
-      return false;
+      // add the source sub_count
+      hash_result.sources[i].sub_count =
+                                hash_result.source_id_sub_counts[i].second;
     }
+    hash_result.num_sources = num_sources;
+
+    // order sources by file hash
+    std::sort(hash_result.sources.begin(),
+              hash_result.sources.begin() + num_sources);
   }
 
-  // export hash, return result as JSON string
-  std::string scan_manager_t::export_hash_json(
-               const std::string& block_hash) const {
+  // hash data as exported JSON
+  static std::string export_hash_result_json(const std::string& block_hash,
+                                     const hashdb::hash_result_t& hash_result) {
 
-    // hash fields
-    uint64_t k_entropy;
-    std::string block_label;
-    uint64_t unused_count;
-    hashdb::source_sub_counts_t* source_sub_counts =
-                                new hashdb::source_sub_counts_t;
+    // prepare JSON
+    rapidjson::Document json_doc;
+    rapidjson::Document::AllocatorType& allocator = json_doc.GetAllocator();
+    json_doc.SetObject();
 
-    // scan
-    bool found_hash = find_hash(block_hash, k_entropy, block_label,
-                                unused_count, *source_sub_counts);
+    // put in hash data
+    std::string hex_block_hash = hashdb::bin_to_hex(block_hash);
+    json_doc.AddMember("block_hash", v(hex_block_hash, allocator), allocator);
+    json_doc.AddMember("k_entropy", hash_result.k_entropy, allocator);
+    json_doc.AddMember("block_label", v(hash_result.block_label, allocator),
+                       allocator);
 
-    std::string json_hash_string;
-    if (found_hash) {
+    // put in source_sub_counts as pairs of file hash, sub_count
+    rapidjson::Value json_source_sub_counts(rapidjson::kArrayType);
 
-      // prepare JSON
-      rapidjson::Document json_doc;
-      rapidjson::Document::AllocatorType& allocator = json_doc.GetAllocator();
-      json_doc.SetObject();
+    for (size_t i=0; i<hash_result.size(); ++i) {
 
-      // put in hash data
-      std::string hex_block_hash = hashdb::bin_to_hex(block_hash);
-      json_doc.AddMember("block_hash", v(hex_block_hash, allocator), allocator);
-      json_doc.AddMember("k_entropy", k_entropy, allocator);
-      json_doc.AddMember("block_label", v(block_label, allocator), allocator);
+      // file hash
+      json_source_sub_counts.PushBack(
+                 v(hashdb::bin_to_hex(hash_result.file_hash(i)), allocator),
+                 allocator);
 
-      // put in source_sub_counts as pairs of file hash, sub_count
-      rapidjson::Value json_source_sub_counts(rapidjson::kArrayType);
+      // sub_count
+      json_source_sub_counts.PushBack(hash_result.sub_count(i), allocator);
 
-      for (hashdb::source_sub_counts_t::const_iterator it =
-           source_sub_counts->begin(); it != source_sub_counts->end(); ++it) {
+    }
+    json_doc.AddMember("source_sub_counts", json_source_sub_counts,
+                       allocator);
 
-        // file hash
-        json_source_sub_counts.PushBack(
-                   v(hashdb::bin_to_hex(it->file_hash), allocator), allocator);
+    // write JSON text
+    rapidjson::StringBuffer strbuf;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(strbuf);
+    json_doc.Accept(writer);
+    return strbuf.GetString();
+  }
 
-        // sub_count
-        json_source_sub_counts.PushBack(it->sub_count, allocator);
+  // export hash, return result as JSON string
+  std::string scan_manager_t::export_hash_json(
+               const std::string& block_hash) const {
 
-      }
-      json_doc.AddMember("source_sub_counts", json_source_sub_counts,
-                         allocator);
+    // hash fields, reused by this thread
+    hashdb::hash_result_t& hash_result = thread_hash_result();
 
-      // write JSON text
-      rapidjson::StringBuffer strbuf;
-      rapidjson::Writer<rapidjson::StringBuffer> writer(strbuf);
-      json_doc.Accept(writer);
-      json_hash_string = strbuf.GetString();
+    // scan
+    bool found_hash = find_hash(block_hash, hash_result);
 
+    if (found_hash) {
+      return export_hash_result_json(block_hash, hash_result);
     } else {
       // not found
-      json_hash_string = "";
+      return "";
     }
-
-    delete source_sub_counts;
-    return json_hash_string;
   }
 
   // find hash count
@@ -887,6 +1543,16 @@ namespace hashdb {
     return lmdb_hash_data_manager->find_count(block_hash);
   }
 
+  size_t scan_manager_t::find_hash_count(const hash_key_t& block_hash) const {
+
+    if (block_hash.empty()) {
+      std::cerr << "Error: find_hash_count called with empty block_hash\n";
+      return 0;
+    }
+
+    return lmdb_hash_data_manager->find_count(block_hash);
+  }
+
   // find hash count JSON
   std::string scan_manager_t::find_hash_count_json(
                                     const std::string& block_hash) const {
@@ -929,6 +1595,16 @@ namespace hashdb {
     return lmdb_hash_manager->find(block_hash);
   }
 
+  size_t scan_manager_t::find_approximate_hash_count(
+                                    const hash_key_t& block_hash) const {
+    if (block_hash.empty()) {
+      std::cerr << "Error: find_approximate_hash_count called with empty block_hash\n";
+      return 0;
+    }
+
+    return lmdb_hash_manager->find(block_hash);
+  }
+
   // find approximate hash count JSON
   std::string scan_manager_t::find_approximate_hash_count_json(
                                     const std::string& block_hash) const {
@@ -977,7 +1653,8 @@ namespace hashdb {
 
     // read source_id
     uint64_t source_id;
-    bool has_id = lmdb_source_id_manager->find(file_hash, source_id);
+    bool has_id = find_cached_source_id(*lmdb_source_id_manager,
+                                    *source_data_cache, file_hash, source_id);
     if (has_id == false) {
       // no source ID for this file_hash
       filesize = 0;
@@ -988,14 +1665,18 @@ namespace hashdb {
     } else {
 
       // read source data associated with this source ID
-      std::string returned_file_hash;
-      bool source_data_found = lmdb_source_data_manager->find(source_id,
-                             returned_file_hash, filesize, file_type,
-                             zero_count, nonprobative_count);
+      hashdb::source_data_cache_t::source_data_t source_data;
+      bool source_data_found = find_cached_source_data(
+                             *lmdb_source_data_manager, *source_data_cache,
+                             source_id, source_data);
+      filesize = source_data.filesize;
+      file_type = source_data.file_type;
+      zero_count = source_data.zero_count;
+      nonprobative_count = source_data.nonprobative_count;
 
       // if source data is found, make sure the file binary hash is right
       if (source_data_found == true &&
-                         file_hash != returned_file_hash) {
+                         file_hash != source_data.file_hash) {
         assert(0);
       }
     }
@@ -1012,7 +1693,8 @@ namespace hashdb {
 
     // read source_id
     uint64_t source_id;
-    bool has_id = lmdb_source_id_manager->find(file_hash, source_id);
+    bool has_id = find_cached_source_id(*lmdb_source_id_manager,
+                                    *source_data_cache, file_hash, source_id);
     if (has_id == false) {
       // no source ID for this file_hash
       source_names.clear();
@@ -1023,6 +1705,70 @@ namespace hashdb {
     }
   }
 
+  bool scan_manager_t::has_source_index() const {
+    return lmdb_source_hash_manager != 0;
+  }
+
+  bool scan_manager_t::find_source_hashes(const std::string& file_hash,
+                         std::vector<std::string>& block_hashes) const {
+
+    block_hashes.clear();
+    if (file_hash.size() == 0) {
+      std::cerr << "Error: find_source_hashes called with empty file_hash\n";
+      return false;
+    }
+    if (lmdb_source_hash_manager == 0) {
+      // no source index
+      return false;
+    }
+
+    // read source_id
+    uint64_t source_id;
+    bool has_id = find_cached_source_id(*lmdb_source_id_manager,
+                                    *source_data_cache, file_hash, source_id);
+    if (has_id == false) {
+      // no source ID for this file_hash
+      return false;
+    } else {
+      // block hashes
+      return lmdb_source_hash_manager->find(source_id, block_hashes);
+    }
+  }
+
+  bool scan_manager_t::has_repository_index() const {
+    return lmdb_repository_manager != 0;
+  }
+
+  bool scan_manager_t::find_repository_sources(
+                         const std::string& repository_name,
+                         std::vector<std::string>& file_hashes) const {
+
+    file_hashes.clear();
+    if (lmdb_repository_manager == 0) {
+      // no repository index
+      return false;
+    }
+
+    // read source IDs
+    std::vector<uint64_t> source_ids;
+    bool has_repository_name = lmdb_repository_manager->find(
+                                           repository_name, source_ids);
+
+    // file hashes
+    std::string file_hash;
+    for (std::vector<uint64_t>::const_iterator it = source_ids.begin();
+                                     it != source_ids.end(); ++it) {
+      if (find_cached_file_hash(*lmdb_source_data_manager,
+                                *source_data_cache, *it, file_hash)) {
+        file_hashes.push_back(file_hash);
+      } else {
+        // program error
+        assert(0);
+      }
+    }
+    return has_repository_name;
+  }
+
   // export source, return result as JSON string
   std::string scan_manager_t::export_source_json(
                                const std::string& file_hash) const {
@@ -1125,6 +1871,139 @@ namespace hashdb {
     return lmdb_source_id_manager->size();
   }
 
+  std::string scan_manager_t::cache_stats() const {
+    uint64_t source_hits;
+    uint64_t source_misses;
+    source_data_cache->stats(source_hits, source_misses);
+    std::stringstream ss;
+    ss << "{\"source_cache\":{\"capacity\":"
+       << source_data_cache->capacity()
+       << ", \"size\":" << source_data_cache->size()
+       << ", \"hits\":" << source_hits
+       << ", \"misses\":" << source_misses
+       << "}, \"hash_cache\":{\"capacity\":"
+       << hash_result_cache->capacity()
+       << ", \"size\":" << hash_result_cache->size()
+       << ", \"bytes\":" << hash_result_cache->bytes()
+       << ", \"evictions\":" << hash_result_cache->evictions();
+
+    // per scan mode
+    const char* const mode_names[] = {"expanded", "expanded_optimized",
+                                      "count", "approximate_count"};
+    for (size_t mode=0; mode<hash_result_cache_t::num_modes; ++mode) {
+      uint64_t hits;
+      uint64_t misses;
+      hash_result_cache->stats(mode, hits, misses);
+      ss << ", \"" << mode_names[mode] << "\":{\"hits\":" << hits
+         << ", \"misses\":" << misses << "}";
+    }
+    ss << "}}";
+    return ss.str();
+  }
+
+  // ************************************************************
+  // hash cursor
+  // ************************************************************
+  hash_cursor_t::hash_cursor_t(const scan_manager_t& p_scan_manager) :
+          scan_manager(p_scan_manager),
+          cursor(new lmdb_hash_data_cursor_t(
+                                *p_scan_manager.lmdb_hash_data_manager)) {
+  }
+
+  hash_cursor_t::~hash_cursor_t() {
+    delete cursor;
+  }
+
+  bool hash_cursor_t::at_end() const {
+    return cursor->at_end();
+  }
+
+  const std::string& hash_cursor_t::block_hash() const {
+    return cursor->hash();
+  }
+
+  void hash_cursor_t::next() {
+    cursor->next();
+  }
+
+  void hash_cursor_t::seek(const std::string& p_block_hash) {
+    cursor->seek(p_block_hash);
+  }
+
+  bool hash_cursor_t::read(hash_result_t& hash_result) const {
+    hash_result.clear();
+    if (!cursor->read(hash_result.k_entropy, hash_result.block_label,
+                      hash_result.count, hash_result.source_id_sub_counts)) {
+      return false;
+    }
+    scan_manager.resolve_sources(hash_result);
+    return true;
+  }
+
+  bool hash_cursor_t::read_count(uint64_t& count,
+                                 size_t& num_sources) const {
+    return cursor->read_count(count, num_sources);
+  }
+
+  uint64_t hash_cursor_t::count() const {
+    uint64_t count;
+    size_t num_sources;
+    cursor->read_count(count, num_sources);
+    return count;
+  }
+
+  std::string hash_cursor_t::export_hash_json() const {
+
+    // hash fields, reused by this thread
+    return export_hash_json(thread_hash_result());
+  }
+
+  std::string hash_cursor_t::export_hash_json(
+                                     hash_result_t& hash_result) const {
+    if (read(hash_result)) {
+      return export_hash_result_json(cursor->hash(), hash_result);
+    } else {
+      // at end
+      return "";
+    }
+  }
+
+  // ************************************************************
+  // source cursor
+  // ************************************************************
+  source_cursor_t::source_cursor_t(const scan_manager_t& p_scan_manager) :
+          scan_manager(p_scan_manager),
+          cursor(new lmdb_source_id_cursor_t(
+                                *p_scan_manager.lmdb_source_id_manager)) {
+  }
+
+  source_cursor_t::~source_cursor_t() {
+    delete cursor;
+  }
+
+  bool source_cursor_t::at_end() const {
+    return cursor->at_end();
+  }
+
+  const std::string& source_cursor_t::file_hash() const {
+    return cursor->hash();
+  }
+
+  void source_cursor_t::next() {
+    cursor->next();
+  }
+
+  void source_cursor_t::seek(const std::string& p_file_hash) {
+    cursor->seek(p_file_hash);
+  }
+
+  std::string source_cursor_t::export_source_json() const {
+    if (cursor->at_end()) {
+      return "";
+    }
+    return scan_manager.export_source_json(cursor->hash());
+  }
+
   // ************************************************************
   // timestamp
   // ************************************************************
@@ -0,0 +1,253 @@
+// Author:  Bruce Allen
+// Created: 2/25/2013
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on February 25, 2013 by Bruce Allen.
+
+/**
+ * \file
+ * Manage the LMDB file hash cache store, which remembers the file hash
+ * of each file that ingest has read so that ingest can skip reading an
+ * unchanged file again.  Threadsafe.
+ *
+ * key=path, data=(device, inode, filesize, mtime, file_hash,
+ * repository_name).  A file is unchanged when its path and all of
+ * device, inode, filesize, and mtime match, and it was ingested under
+ * the same repository name.  There is one record per path, replaced
+ * when the file changes.
+ *
+ * Paths longer than the LMDB key limit are not cached.
+ *
+ * This store is optional.  It is created by the first ingest that uses
+ * it.
+ */
+
+#ifndef LMDB_FILE_HASH_CACHE_MANAGER_HPP
+#define LMDB_FILE_HASH_CACHE_MANAGER_HPP
+
+#include "file_modes.h"
+#include "lmdb.h"
+#include "lmdb_helper.h"
+#include "lmdb_context.hpp"
+#include <unistd.h>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <cassert>
+#include <stdint.h>
+
+// no concurrent writes
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#include "mutex_lock.hpp"
+
+namespace hashdb {
+
+/**
+ * The file attributes that must match for a cached file hash to be used.
+ */
+struct file_stat_t {
+  uint64_t device;
+  uint64_t inode;
+  uint64_t filesize;
+  uint64_t mtime;
+  file_stat_t(const uint64_t p_device, const uint64_t p_inode,
+              const uint64_t p_filesize, const uint64_t p_mtime) :
+          device(p_device), inode(p_inode),
+          filesize(p_filesize), mtime(p_mtime) {
+  }
+  bool operator==(const file_stat_t& that) const {
+    return device == that.device && inode == that.inode &&
+           filesize == that.filesize && mtime == that.mtime;
+  }
+};
+
+class lmdb_file_hash_cache_manager_t {
+
+  private:
+  const std::string hashdb_dir;
+  const hashdb::file_mode_type_t file_mode;
+  MDB_env* env;
+  const size_t max_key_size;
+#ifdef HAVE_PTHREAD
+  mutable pthread_mutex_t M;                  // mutext
+#else
+  mutable int M;                              // placeholder
+#endif
+
+  // do not allow copy or assignment
+  lmdb_file_hash_cache_manager_t(const lmdb_file_hash_cache_manager_t&);
+  lmdb_file_hash_cache_manager_t& operator=(
+                                  const lmdb_file_hash_cache_manager_t&);
+
+  public:
+  lmdb_file_hash_cache_manager_t(const std::string& p_hashdb_dir,
+                      const hashdb::file_mode_type_t p_file_mode) :
+       hashdb_dir(p_hashdb_dir),
+       file_mode(p_file_mode),
+       env(lmdb_helper::open_env(hashdb_dir + "/lmdb_file_hash_cache_store",
+                                                                file_mode)),
+       max_key_size(mdb_env_get_maxkeysize(env)),
+       M() {
+
+    MUTEX_INIT(&M);
+  }
+
+  ~lmdb_file_hash_cache_manager_t() {
+    // close the lmdb_file_hash_cache_store DB environment
+    mdb_env_close(env);
+
+    MUTEX_DESTROY(&M);
+  }
+
+  /**
+   * True if the hashdb has a file hash cache store.
+   */
+  static bool is_present(const std::string& hashdb_dir) {
+    return access((hashdb_dir + "/lmdb_file_hash_cache_store").c_str(),
+                  F_OK) == 0;
+  }
+
+  /**
+   * Record the file hash of the file at path.
+   */
+  void insert(const std::string& path,
+              const file_stat_t& file_stat,
+              const std::string& file_hash,
+              const std::string& repository_name) {
+
+    if (path.size() == 0 || path.size() > max_key_size) {
+      return;
+    }
+
+    // data=device, inode, filesize, mtime, file_hash, repository_name
+    std::string data(50 + file_hash.size() + repository_name.size(), 0);
+    uint8_t* const data_start = reinterpret_cast<uint8_t*>(&data[0]);
+    uint8_t* data_p = data_start;
+    data_p = lmdb_helper::encode_uint64_t(file_stat.device, data_p);
+    data_p = lmdb_helper::encode_uint64_t(file_stat.inode, data_p);
+    data_p = lmdb_helper::encode_uint64_t(file_stat.filesize, data_p);
+    data_p = lmdb_helper::encode_uint64_t(file_stat.mtime, data_p);
+    data_p = lmdb_helper::encode_uint64_t(file_hash.size(), data_p);
+    std::memcpy(data_p, file_hash.c_str(), file_hash.size());
+    data_p += file_hash.size();
+    std::memcpy(data_p, repository_name.c_str(), repository_name.size());
+    data_p += repository_name.size();
+
+    MUTEX_LOCK(&M);
+
+    // maybe grow the DB
+    lmdb_helper::maybe_grow(env);
+
+    // get context
+    hashdb::lmdb_context_t context(env, true, false);
+    context.open();
+
+    // set key=path
+    context.key.mv_size = path.size();
+    context.key.mv_data = static_cast<void*>(const_cast<char*>(path.data()));
+    context.data.mv_size = data_p - data_start;
+    context.data.mv_data = data_start;
+
+    // add or replace the record
+    int rc = mdb_put(context.txn, context.dbi,
+                     &context.key, &context.data, 0);
+    if (rc != 0) {
+      std::cerr << "LMDB error: " << mdb_strerror(rc) << "\n";
+      assert(0);
+    }
+
+    context.close();
+    MUTEX_UNLOCK(&M);
+  }
+
+  /**
+   * Find the file hash of the file at path if the file is unchanged
+   * since it was ingested under repository_name, else false.
+   */
+  bool find(const std::string& path,
+            const file_stat_t& file_stat,
+            const std::string& repository_name,
+            std::string& file_hash) const {
+
+    file_hash = "";
+    if (path.size() == 0 || path.size() > max_key_size) {
+      return false;
+    }
+
+    // get context
+    hashdb::lmdb_context_t context(env, false, false);
+    context.open();
+
+    // set key=path
+    context.key.mv_size = path.size();
+    context.key.mv_data = static_cast<void*>(const_cast<char*>(path.data()));
+
+    int rc = mdb_get(context.txn, context.dbi, &context.key, &context.data);
+    if (rc == MDB_NOTFOUND) {
+      context.close();
+      return false;
+    }
+    if (rc != 0) {
+      std::cerr << "LMDB error: " << mdb_strerror(rc) << "\n";
+      assert(0);
+    }
+
+    // read data
+    const uint8_t* p = static_cast<uint8_t*>(context.data.mv_data);
+    const uint8_t* const p_end = p + context.data.mv_size;
+    uint64_t device;
+    uint64_t inode;
+    uint64_t filesize;
+    uint64_t mtime;
+    uint64_t file_hash_size;
+    p = lmdb_helper::decode_uint64_t(p, device);
+    p = lmdb_helper::decode_uint64_t(p, inode);
+    p = lmdb_helper::decode_uint64_t(p, filesize);
+    p = lmdb_helper::decode_uint64_t(p, mtime);
+    p = lmdb_helper::decode_uint64_t(p, file_hash_size);
+
+    // validate that the decoding was properly consumed
+    if (p > p_end || file_hash_size > static_cast<uint64_t>(p_end - p)) {
+      std::cerr << "data decode error in LMDB file hash cache store\n";
+      assert(0);
+    }
+
+    // the file must be unchanged and ingested under the same repository
+    const bool is_unchanged =
+          file_stat == file_stat_t(device, inode, filesize, mtime) &&
+          repository_name.size() ==
+                    static_cast<size_t>(p_end - p - file_hash_size) &&
+          std::memcmp(p + file_hash_size, repository_name.c_str(),
+                      repository_name.size()) == 0;
+    if (is_unchanged) {
+      file_hash.assign(reinterpret_cast<const char*>(p), file_hash_size);
+    }
+
+    context.close();
+    return is_unchanged;
+  }
+
+  // call this from a lock to prevent getting an unstable answer.
+  size_t size() const {
+    return lmdb_helper::size(env);
+  }
+};
+
+} // end namespace hashdb
+
+#endif
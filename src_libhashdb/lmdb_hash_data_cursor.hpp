@@ -0,0 +1,255 @@
+// Author:  Bruce Allen
+// Created: 2/25/2013
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on February 25, 2013 by Bruce Allen.
+
+/**
+ * \file
+ * Provides a read cursor for walking lmdb_hash_data_store in block hash
+ * order.  The cursor holds one read transaction open for its lifetime,
+ * so moving to the next hash is a sequential step instead of a new
+ * transaction and seek.  See lmdb_hash_data_manager for the Type 1,
+ * Type 2, Type 3, and Type 4 record layout.  The cursor reads stored
+ * records only, so it does not see inserts into hot hashes that a
+ * writer holds in memory until they are flushed.
+ */
+
+#ifndef LMDB_HASH_DATA_CURSOR_HPP
+#define LMDB_HASH_DATA_CURSOR_HPP
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <cassert>
+#include <stdint.h>
+#include "lmdb.h"
+#include "lmdb_context.hpp"
+#include "lmdb_hash_data_support.hpp"
+#include "lmdb_hash_data_manager.hpp"
+
+namespace hashdb {
+
+class lmdb_hash_data_cursor_t {
+
+  private:
+  lmdb_context_t context;
+  bool valid;                    // positioned on a hash
+  std::string block_hash;        // the current hash
+  std::string scratch_block_label; // scratch space for read_count
+  std::vector<std::pair<uint64_t, uint64_t> > type4_sub_counts; // scratch
+
+  // do not allow copy or assignment
+  lmdb_hash_data_cursor_t(const lmdb_hash_data_cursor_t&);
+  lmdb_hash_data_cursor_t& operator=(const lmdb_hash_data_cursor_t&);
+
+  // track the cursor position after a move
+  void set_position(const int rc) {
+    if (rc == 0) {
+      valid = true;
+      block_hash.assign(static_cast<char*>(context.key.mv_data),
+                        context.key.mv_size);
+    } else if (rc == MDB_NOTFOUND) {
+      valid = false;
+      block_hash.clear();
+    } else {
+      std::cerr << "LMDB error: " << mdb_strerror(rc) << "\n";
+      assert(0);
+    }
+  }
+
+  public:
+  /**
+   * Open a read cursor on the hash data store and move it to the
+   * first hash.
+   */
+  lmdb_hash_data_cursor_t(const lmdb_hash_data_manager_t& manager) :
+                 context(manager.env, false, true), valid(false),
+                 block_hash(), scratch_block_label(), type4_sub_counts() {
+    context.open();
+    set_position(mdb_cursor_get(context.cursor, &context.key,
+                                &context.data, MDB_FIRST));
+  }
+
+  ~lmdb_hash_data_cursor_t() {
+    context.close();
+  }
+
+  /**
+   * True when the cursor has moved past the last hash.
+   */
+  bool at_end() const {
+    return !valid;
+  }
+
+  /**
+   * The current hash, "" at end.
+   */
+  const std::string& hash() const {
+    return block_hash;
+  }
+
+  /**
+   * Move to the next hash, skipping any remaining Type 3 records of
+   * the current hash.
+   */
+  void next() {
+    if (!valid) {
+      return;
+    }
+    set_position(mdb_cursor_get(context.cursor, &context.key,
+                                &context.data, MDB_NEXT_NODUP));
+  }
+
+  /**
+   * Move to the first hash that is not less than the given hash.
+   * The given hash is a std::string or hash_key_t.
+   */
+  template <typename K>
+  void seek(const K& p_block_hash) {
+    if (p_block_hash.size() == 0) {
+      std::cerr << "Usage error: the block_hash value provided to seek is empty.\n";
+      return;
+    }
+    context.key.mv_size = p_block_hash.size();
+    context.key.mv_data =
+                static_cast<void*>(const_cast<char*>(p_block_hash.data()));
+    set_position(mdb_cursor_get(context.cursor, &context.key,
+                                &context.data, MDB_SET_RANGE));
+  }
+
+  /**
+   * Read the count of the current hash from its Type 1 or Type 2 record
+   * only.  The number of sources is the number of records of the hash,
+   * so Type 3 records are not decoded, but Type 4 records hold many
+   * sources each and are.  Return false and zeros at end.
+   */
+  bool read_count(uint64_t& count, size_t& num_sources) {
+    count = 0;
+    num_sources = 0;
+
+    if (!valid) {
+      return false;
+    }
+
+    // start at the Type 1 or Type 2 record of this hash
+    cursor_to_first_current(context);
+    if (context.data.mv_size == 0) {
+      std::cerr << "program error in data size\n";
+      assert(0);
+    }
+
+    uint64_t k_entropy;
+    if (static_cast<uint8_t*>(context.data.mv_data)[0] != 0) {
+      // Type 1
+      uint64_t source_id;
+      decode_type1(context, k_entropy, scratch_block_label, source_id, count);
+      num_sources = 1;
+      return true;
+    }
+
+    // Type 2, count the Type 3 records that follow it
+    decode_type2(context, k_entropy, scratch_block_label, count);
+    if (has_type4(context)) {
+      // count the sources in the Type 4 records that follow it
+      type4_sub_counts.clear();
+      while (true) {
+        int rc = mdb_cursor_get(context.cursor, &context.key, &context.data,
+                                MDB_NEXT_DUP);
+        if (rc == MDB_NOTFOUND) {
+          break;
+        }
+        if (rc != 0) {
+          std::cerr << "LMDB error: " << mdb_strerror(rc) << "\n";
+          assert(0);
+        }
+        decode_type4(context, type4_sub_counts);
+      }
+      num_sources = type4_sub_counts.size();
+      return true;
+    }
+    size_t num_records;
+    int rc = mdb_cursor_count(context.cursor, &num_records);
+    if (rc != 0) {
+      std::cerr << "LMDB error: " << mdb_strerror(rc) << "\n";
+      assert(0);
+    }
+    num_sources = num_records - 1;
+    return true;
+  }
+
+  /**
+   * Read data for the current hash, see lmdb_hash_data_manager_t::find.
+   * Return false and empty fields at end.
+   */
+  template <typename T>
+  bool read(uint64_t& k_entropy,
+            std::string& block_label,
+            uint64_t& count,
+            T& source_id_sub_counts) {
+
+    // clear any previous values
+    k_entropy = 0;
+    block_label = "";
+    count = 0;
+    source_id_sub_counts.clear();
+
+    if (!valid) {
+      return false;
+    }
+
+    // start at the Type 1 or Type 2 record of this hash
+    cursor_to_first_current(context);
+    if (context.data.mv_size == 0) {
+      std::cerr << "program error in data size\n";
+      assert(0);
+    }
+
+    if (static_cast<uint8_t*>(context.data.mv_data)[0] != 0) {
+      // Type 1
+      uint64_t source_id;
+      uint64_t sub_count;
+      decode_type1(context, k_entropy, block_label, source_id, sub_count);
+      add_source_id_sub_count(source_id_sub_counts, source_id, sub_count);
+      count = sub_count;
+      return true;
+    }
+
+    // Type 2 followed by Type 3 or Type 4 records for this hash
+    decode_type2(context, k_entropy, block_label, count);
+    while (true) {
+      int rc = mdb_cursor_get(context.cursor, &context.key, &context.data,
+                              MDB_NEXT_DUP);
+      if (rc == MDB_NOTFOUND) {
+        // no more Type 3 or Type 4 records for this hash
+        break;
+      }
+      if (rc != 0) {
+        std::cerr << "LMDB error: " << mdb_strerror(rc) << "\n";
+        assert(0);
+      }
+
+      // read Type 3 or Type 4
+      add_type3_or_type4(context, source_id_sub_counts);
+    }
+    return true;
+  }
+};
+
+} // end namespace hashdb
+
+#endif
+
@@ -32,13 +32,29 @@
  *         NULL, entropy, block_label, 4-byte count, clip, do not wrap.
  *
  * Type 3: remaining lines of multi-entry hash:
- *         source_id, 2-byte sub_count up to 65535, clip, do not wrap.
+ *         0x01, 8-byte big-endian source_id, 2-byte sub_count up to 65535,
+ *         clip, do not wrap.
+ *
+ * Type 4: remaining lines of a hot hash, a multi-entry hash with more
+ *         than hot_hash_threshold sources, in place of Type 3:
+ *         0x02, 8-byte big-endian first source_id, then for each of up
+ *         to about 30 sources in source_id order, the source_id as the
+ *         delta from the one before it and the sub_count.
  *
  * NOTES:
  *   * Source ID must be > 0 because this field also distinguishes between
  *     type 1 and Type 2 data.
  *   * LMDB sorts Type 2 before Type 3 records because of the NULL byte
  *     in type 2.
+ *   * LMDB sorts Type 3 records by source_id, so the Type 3 record of a
+ *     source is found by seeking rather than by walking every source of
+ *     the hash.  Databases before settings version 5 encoded source_id
+ *     first, as a varint, and are upgraded by upgrade_type3.
+ *   * A hash becomes hot when its Type 3 records pass hot_hash_threshold
+ *     and they are moved into Type 4 records.  Inserts into hot hashes
+ *     that this manager has seen are held in memory and written in
+ *     batches, and on flush and close.  find and find_count include them
+ *     but lmdb_hash_data_cursor_t does not.
  *   * Some entropy precision is lost because entropy values are stored as
  *     integers, see entropy_scale.
  *   * Count and sub_count fields clip at 0xffffffff and 0xffff, respectively.
@@ -63,6 +79,7 @@
 #include <iostream>
 #include <string>
 #include <set>
+#include <map>
 #include <cassert>
 #ifdef DEBUG_LMDB_HASH_DATA_MANAGER_HPP
 #include "lmdb_print_val.hpp"
@@ -98,6 +115,74 @@ inline uint64_t add4(const uint64_t a, const uint64_t b) {
   return (a+b>0xffffffff) ? 0xffffffff : a+b;
 }
 
+// add source ID and sub_count to a set or to a flat vector of pairs
+inline void add_source_id_sub_count(
+                     source_id_sub_counts_t& source_id_sub_counts,
+                     const uint64_t source_id, const uint64_t sub_count) {
+  source_id_sub_counts.insert(source_id_sub_count_t(source_id, sub_count));
+}
+inline void add_source_id_sub_count(
+       std::vector<std::pair<uint64_t, uint64_t> >& source_id_sub_counts,
+       const uint64_t source_id, const uint64_t sub_count) {
+  source_id_sub_counts.push_back(std::pair<uint64_t, uint64_t>(
+                                                  source_id, sub_count));
+}
+
+// add the sources of the Type 3 or Type 4 record at cursor
+template <typename T>
+inline void add_type3_or_type4(hashdb::lmdb_context_t& context,
+                               T& source_id_sub_counts) {
+  if (is_type4(context)) {
+    std::vector<std::pair<uint64_t, uint64_t> > type4_sub_counts;
+    decode_type4(context, type4_sub_counts);
+    for (std::vector<std::pair<uint64_t, uint64_t> >::const_iterator it =
+                    type4_sub_counts.begin();
+                    it != type4_sub_counts.end(); ++it) {
+      add_source_id_sub_count(source_id_sub_counts, it->first, it->second);
+    }
+  } else {
+    uint64_t source_id;
+    uint64_t sub_count;
+    decode_type3(context, source_id, sub_count);
+    add_source_id_sub_count(source_id_sub_counts, source_id, sub_count);
+  }
+}
+
+// add sub_counts not yet written to sources, which are in source_id order
+inline void add_pending_sub_counts(
+                     const std::map<uint64_t, uint64_t>& pending_sub_counts,
+                     std::map<uint64_t, uint64_t>& sub_counts) {
+  for (std::map<uint64_t, uint64_t>::const_iterator it =
+                    pending_sub_counts.begin();
+                    it != pending_sub_counts.end(); ++it) {
+    sub_counts[it->first] = add2(sub_counts[it->first], it->second);
+  }
+}
+inline void add_pending_sub_counts(
+                     const std::map<uint64_t, uint64_t>& pending_sub_counts,
+                     source_id_sub_counts_t& source_id_sub_counts) {
+  std::map<uint64_t, uint64_t> sub_counts;
+  for (source_id_sub_counts_t::const_iterator it =
+                    source_id_sub_counts.begin();
+                    it != source_id_sub_counts.end(); ++it) {
+    sub_counts[it->source_id] = it->sub_count;
+  }
+  add_pending_sub_counts(pending_sub_counts, sub_counts);
+  source_id_sub_counts.clear();
+  for (std::map<uint64_t, uint64_t>::const_iterator it = sub_counts.begin();
+                    it != sub_counts.end(); ++it) {
+    add_source_id_sub_count(source_id_sub_counts, it->first, it->second);
+  }
+}
+inline void add_pending_sub_counts(
+       const std::map<uint64_t, uint64_t>& pending_sub_counts,
+       std::vector<std::pair<uint64_t, uint64_t> >& source_id_sub_counts) {
+  std::map<uint64_t, uint64_t> sub_counts(source_id_sub_counts.begin(),
+                                          source_id_sub_counts.end());
+  add_pending_sub_counts(pending_sub_counts, sub_counts);
+  source_id_sub_counts.assign(sub_counts.begin(), sub_counts.end());
+}
+
 // maybe truncate block_label
 static std::string truncate_block_label(std::string block_label) {
   if (block_label.size() > hashdb::max_block_label_size) {
@@ -119,6 +204,30 @@ class lmdb_hash_data_manager_t {
   const hashdb::file_mode_type_t file_mode;
   MDB_env* env;
 
+  // hashes with more sources than this keep them in Type 4 records
+  static const size_t hot_hash_threshold = 1024;
+
+  // inserts into hot hashes held in memory before they are written
+  static const size_t max_pending_inserts = 1<<16;
+
+  // a hot hash and the inserts into it not yet written
+  struct hot_hash_t {
+    uint64_t k_entropy;
+    std::string block_label;
+    uint64_t count;                     // including pending inserts
+    std::map<uint64_t, uint64_t> pending_sub_counts;
+    size_t pending_inserts;
+    hot_hash_t(const uint64_t p_k_entropy, const std::string& p_block_label,
+               const uint64_t p_count) :
+                 k_entropy(p_k_entropy), block_label(p_block_label),
+                 count(p_count), pending_sub_counts(), pending_inserts(0) {
+    }
+  };
+
+  // hot hashes seen by insert, guarded by M
+  std::map<std::string, hot_hash_t> hot_hashes;
+  size_t pending_inserts;
+
 #ifdef HAVE_PTHREAD
   mutable pthread_mutex_t M;                  // mutext
 #else
@@ -129,77 +238,104 @@ class lmdb_hash_data_manager_t {
   lmdb_hash_data_manager_t(const lmdb_hash_data_manager_t&);
   lmdb_hash_data_manager_t& operator=(const lmdb_hash_data_manager_t&);
 
-  public:
-  lmdb_hash_data_manager_t(const std::string& p_hashdb_dir,
-                           const hashdb::file_mode_type_t p_file_mode) :
-       hashdb_dir(p_hashdb_dir),
-       file_mode(p_file_mode),
-       env(lmdb_helper::open_env(hashdb_dir + "/lmdb_hash_data_store",
-                                                                file_mode)),
-       M() {
+  // walks the store in block hash order
+  friend class lmdb_hash_data_cursor_t;
 
-    MUTEX_INIT(&M);
+  // keep the hot hash in memory so inserts into it are batched
+  void add_hot_hash(const std::string& block_hash,
+                    const uint64_t k_entropy,
+                    const std::string& block_label,
+                    const uint64_t count) {
+    hot_hashes.insert(std::pair<std::string, hot_hash_t>(block_hash,
+                             hot_hash_t(k_entropy, block_label, count)));
   }
 
-  ~lmdb_hash_data_manager_t() {
-    // close the lmdb_hash_store DB environment
-    mdb_env_close(env);
-
-    MUTEX_DESTROY(&M);
+  // Move the Type 3 records of the hash at cursor into Type 4 records if
+  // there are too many.  Return true if moved.
+  bool maybe_make_hot(hashdb::lmdb_context_t& context,
+                      const std::string& block_hash) {
+    size_t num_records;
+    int rc = mdb_cursor_count(context.cursor, &num_records);
+    if (rc != 0) {
+      std::cerr << "LMDB error: " << mdb_strerror(rc) << "\n";
+      assert(0);
+    }
+    if (num_records <= hot_hash_threshold + 1) {
+      return false;
+    }
+    cursor_to_first_current(context);
+    type3_to_type4(context, block_hash);
+    return true;
   }
 
-  // ************************************************************
-  // insert
-  // ************************************************************
+  // write the pending inserts of the hot hash in an open writable context
+  void flush_hot_hash(hashdb::lmdb_context_t& context,
+                      const std::string& block_hash,
+                      hot_hash_t& hot_hash) {
 
-  /**
-   * Insert hash with accompanying data.  Warn if data present but different.
-   * Return updated source count.
-   *
-   * Use when counting source occurrences for this hash.
-   */
-  size_t insert(const std::string& block_hash,
-                const uint64_t k_entropy,
-                const std::string& p_block_label,
-                const uint64_t source_id,
-                hashdb::lmdb_changes_t& changes) {
+    if (hot_hash.pending_inserts == 0) {
+      return;
+    }
 
-    // program error if source ID is 0 since NULL distinguishes between
-    // type 1 and type 2 data.
-    if (source_id == 0) {
-      std::cerr << "program error in source_id\n";
+    // set the cursor to the Type 2 record of this hash
+    context.key.mv_size = block_hash.size();
+    context.key.mv_data = static_cast<void*>(const_cast<char*>(
+                                                       block_hash.data()));
+    int rc = mdb_cursor_get(context.cursor, &context.key, &context.data,
+                            MDB_SET_KEY);
+    if (rc != 0) {
+      std::cerr << "LMDB error: " << mdb_strerror(rc) << "\n";
       assert(0);
     }
 
-    // get key size
-    const size_t key_size = block_hash.size();
-    uint8_t* const key_start = static_cast<uint8_t*>(
-                 static_cast<void*>(const_cast<char*>(block_hash.c_str())));
+    // write the count and sub_counts
+    replace_type2(context, block_hash, hot_hash.k_entropy,
+                  hot_hash.block_label, hot_hash.count);
+    add_type4(context, block_hash, hot_hash.pending_sub_counts);
 
-    // require valid block_hash
-    if (key_size == 0) {
-      std::cerr << "Usage error: the block_hash value provided to insert is empty.\n";
-      return 0;
-    }
+    pending_inserts -= hot_hash.pending_inserts;
+    hot_hash.pending_sub_counts.clear();
+    hot_hash.pending_inserts = 0;
+  }
 
-    // maybe truncate block_label
-    const std::string block_label = truncate_block_label(p_block_label);
+  // write the pending inserts of all hot hashes, each in its own
+  // transaction
+  void flush_hot_hashes() {
+    if (pending_inserts == 0) {
+      return;
+    }
+    for (std::map<std::string, hot_hash_t>::iterator it =
+                 hot_hashes.begin(); it != hot_hashes.end(); ++it) {
+      if (it->second.pending_inserts == 0) {
+        continue;
+      }
 
-    MUTEX_LOCK(&M);
+      // maybe grow the DB
+      lmdb_helper::maybe_grow(env);
 
-    // maybe grow the DB
-    lmdb_helper::maybe_grow(env);
+      // get context
+      hashdb::lmdb_context_t context(env, true, true);
+      context.open();
+      flush_hot_hash(context, it->first, it->second);
+      context.close();
+    }
+  }
 
-    // get context
-    hashdb::lmdb_context_t context(env, true, true);
-    context.open();
+  // insert in an open writable context, return the updated source count
+  uint64_t insert_in_context(hashdb::lmdb_context_t& context,
+                             const std::string& block_hash,
+                             const uint64_t k_entropy,
+                             const std::string& block_label,
+                             const uint64_t source_id,
+                             hashdb::lmdb_changes_t& changes) {
 #ifdef DEBUG_LMDB_HASH_DATA_MANAGER_HPP
 print_whole_mdb("hash_data_manager insert begin", context.cursor);
 #endif
 
     // set key
-    context.key.mv_size = key_size;
-    context.key.mv_data = key_start;
+    context.key.mv_size = block_hash.size();
+    context.key.mv_data = static_cast<void*>(const_cast<char*>(
+                                                       block_hash.data()));
 
     // return new count when done
     uint64_t count;
@@ -286,13 +422,24 @@ print_mdb_val("hash_data_manager insert found data", context.data);
 
         // look for existing type 3
         uint64_t existing_sub_count;
-        if (cursor_to_type3(context, source_id, existing_sub_count)) {
+        if (has_type4(context)) {
+          // add to type 4 and keep the hot hash in memory
+          std::map<uint64_t, uint64_t> sub_counts;
+          sub_counts[source_id] = 1;
+          add_type4(context, block_hash, sub_counts);
+          add_hot_hash(block_hash, existing_k_entropy, existing_block_label,
+                       count);
+        } else if (cursor_to_type3(context, source_id, existing_sub_count)) {
           // increment sub_count at type 3
           replace_type3(context, block_hash, source_id,
                         add2(existing_sub_count,1));
         } else {
           // new type 3
           new_type3(context, block_hash, source_id, 1);
+          if (maybe_make_hot(context, block_hash)) {
+            add_hot_hash(block_hash, existing_k_entropy, existing_block_label,
+                         count);
+          }
         }
       }
 
@@ -308,25 +455,72 @@ print_whole_mdb("hash_data_manager insert end", context.cursor);
 
     // insert is always accepted
     ++changes.hash_data_inserted;
-
-    context.close();
-    MUTEX_UNLOCK(&M);
     return count;
   }
 
+  // add to a hot hash in memory, return the updated source count
+  uint64_t insert_hot(hot_hash_t& hot_hash,
+                      const uint64_t k_entropy,
+                      const std::string& block_label,
+                      const uint64_t source_id,
+                      hashdb::lmdb_changes_t& changes) {
+
+    // check for mismatched data
+    if (mismatched_data(k_entropy, hot_hash.k_entropy,
+                        block_label, hot_hash.block_label)) {
+      ++changes.hash_data_mismatched_data_detected;
+    }
+
+    // increment count and sub_count
+    hot_hash.count = add4(hot_hash.count, 1);
+    ++hot_hash.pending_sub_counts[source_id];
+    ++hot_hash.pending_inserts;
+    ++pending_inserts;
+
+    // insert is always accepted
+    ++changes.hash_data_inserted;
+    return hot_hash.count;
+  }
+
+  public:
+  lmdb_hash_data_manager_t(const std::string& p_hashdb_dir,
+                           const hashdb::file_mode_type_t p_file_mode) :
+       hashdb_dir(p_hashdb_dir),
+       file_mode(p_file_mode),
+       env(lmdb_helper::open_env(hashdb_dir + "/lmdb_hash_data_store",
+                                                                file_mode)),
+       hot_hashes(),
+       pending_inserts(0),
+       M() {
+
+    MUTEX_INIT(&M);
+  }
+
+  ~lmdb_hash_data_manager_t() {
+    // write inserts held in memory
+    flush_hot_hashes();
+
+    // close the lmdb_hash_store DB environment
+    mdb_env_close(env);
+
+    MUTEX_DESTROY(&M);
+  }
+
   // ************************************************************
-  // merge
+  // insert
   // ************************************************************
+
   /**
-   * Merge hash with accompanying data.  Warn if data present but different.
+   * Insert hash with accompanying data.  Warn if data present but different.
    * Return updated source count.
+   *
+   * Use when counting source occurrences for this hash.
    */
-  size_t merge(const std::string& block_hash,
-               const uint64_t k_entropy,
-               const std::string& p_block_label,
-               const uint64_t source_id,
-               const uint64_t sub_count,
-               hashdb::lmdb_changes_t& changes) {
+  size_t insert(const std::string& block_hash,
+                const uint64_t k_entropy,
+                const std::string& p_block_label,
+                const uint64_t source_id,
+                hashdb::lmdb_changes_t& changes) {
 
     // program error if source ID is 0 since NULL distinguishes between
     // type 1 and type 2 data.
@@ -335,14 +529,9 @@ print_whole_mdb("hash_data_manager insert end", context.cursor);
       assert(0);
     }
 
-    // get key size
-    const size_t key_size = block_hash.size();
-    uint8_t* const key_start = static_cast<uint8_t*>(
-                 static_cast<void*>(const_cast<char*>(block_hash.c_str())));
-
     // require valid block_hash
-    if (key_size == 0) {
-      std::cerr << "Usage error: the block_hash value provided to mergeis empty.\n";
+    if (block_hash.size() == 0) {
+      std::cerr << "Usage error: the block_hash value provided to insert is empty.\n";
       return 0;
     }
 
@@ -351,15 +540,138 @@ print_whole_mdb("hash_data_manager insert end", context.cursor);
 
     MUTEX_LOCK(&M);
 
+    // add to a hot hash in memory
+    std::map<std::string, hot_hash_t>::iterator hot_it =
+                                                 hot_hashes.find(block_hash);
+    if (hot_it != hot_hashes.end()) {
+      const uint64_t count = insert_hot(hot_it->second, k_entropy,
+                                        block_label, source_id, changes);
+
+      // write inserts held in memory when there are many
+      if (pending_inserts >= max_pending_inserts) {
+        flush_hot_hashes();
+      }
+
+      MUTEX_UNLOCK(&M);
+      return count;
+    }
+
     // maybe grow the DB
     lmdb_helper::maybe_grow(env);
 
     // get context
     hashdb::lmdb_context_t context(env, true, true);
     context.open();
-#ifdef DEBUG_LMDB_HASH_DATA_MANAGER_HPP
-print_whole_mdb("hash_data_manager merge begin", context.cursor);
-#endif
+
+    const uint64_t count = insert_in_context(context, block_hash, k_entropy,
+                                             block_label, source_id, changes);
+
+    context.close();
+    MUTEX_UNLOCK(&M);
+    return count;
+  }
+
+  /**
+   * Insert each hash with accompanying data in one transaction, as
+   * insert does one hash.  Set counts to the updated source count of
+   * each hash.
+   */
+  void insert(const std::vector<std::string>& block_hashes,
+              const std::vector<uint64_t>& k_entropies,
+              const std::vector<std::string>& block_labels,
+              const std::vector<uint64_t>& source_ids,
+              hashdb::lmdb_changes_t& changes,
+              std::vector<size_t>& counts) {
+
+    counts.assign(block_hashes.size(), 0);
+
+    // program error if source ID is 0 since NULL distinguishes between
+    // type 1 and type 2 data.
+    size_t bytes = 0;
+    for (size_t i=0; i<block_hashes.size(); ++i) {
+      if (source_ids[i] == 0) {
+        std::cerr << "program error in source_id\n";
+        assert(0);
+      }
+      bytes += block_hashes[i].size() + block_labels[i].size() + 30;
+    }
+
+    MUTEX_LOCK(&M);
+
+    // maybe grow the DB for all the records, an insert may split a
+    // Type 1 record into three records
+    lmdb_helper::maybe_grow(env, block_hashes.size() * 3, bytes * 3);
+
+    // get context
+    hashdb::lmdb_context_t context(env, true, true);
+    context.open();
+
+    for (size_t i=0; i<block_hashes.size(); ++i) {
+
+      // require valid block_hash
+      if (block_hashes[i].size() == 0) {
+        std::cerr << "Usage error: the block_hash value provided to insert is empty.\n";
+        continue;
+      }
+
+      // maybe truncate block_label
+      const std::string block_label = truncate_block_label(block_labels[i]);
+
+      // add to a hot hash in memory or to the store
+      std::map<std::string, hot_hash_t>::iterator hot_it =
+                                           hot_hashes.find(block_hashes[i]);
+      if (hot_it != hot_hashes.end()) {
+        counts[i] = insert_hot(hot_it->second, k_entropies[i],
+                               block_label, source_ids[i], changes);
+      } else {
+        counts[i] = insert_in_context(context, block_hashes[i],
+                                      k_entropies[i], block_label,
+                                      source_ids[i], changes);
+      }
+    }
+
+    context.close();
+
+    // write inserts held in memory when there are many
+    if (pending_inserts >= max_pending_inserts) {
+      flush_hot_hashes();
+    }
+
+    MUTEX_UNLOCK(&M);
+  }
+
+  // ************************************************************
+  // merge
+  // ************************************************************
+  private:
+  // merge one source into the hash in an open writable context, return
+  // updated source count
+  uint64_t merge_in_context(hashdb::lmdb_context_t& context,
+                            const std::string& block_hash,
+                            const uint64_t k_entropy,
+                            const std::string& block_label,
+                            const uint64_t source_id,
+                            const uint64_t sub_count,
+                            hashdb::lmdb_changes_t& changes) {
+
+    // program error if source ID is 0 since NULL distinguishes between
+    // type 1 and type 2 data.
+    if (source_id == 0) {
+      std::cerr << "program error in source_id\n";
+      assert(0);
+    }
+
+    // get key
+    const size_t key_size = block_hash.size();
+    uint8_t* const key_start = static_cast<uint8_t*>(
+                 static_cast<void*>(const_cast<char*>(block_hash.c_str())));
+
+    // write inserts held in memory for this hash first
+    std::map<std::string, hot_hash_t>::iterator hot_it =
+                                                 hot_hashes.find(block_hash);
+    if (hot_it != hot_hashes.end()) {
+      flush_hot_hash(context, block_hash, hot_it->second);
+    }
 
     // set key
     context.key.mv_size = key_size;
@@ -453,9 +765,12 @@ print_mdb_val("hash_data_manager merge found data", context.data);
           ++changes.hash_data_mismatched_data_detected;
         }
 
-        // look for existing type 3
+        // look for existing type 3 or source in type 4
         uint64_t existing_sub_count;
-        if (cursor_to_type3(context, source_id, existing_sub_count)) {
+        const bool is_hot = has_type4(context);
+        if (is_hot ? find_type4(context, block_hash, source_id,
+                                existing_sub_count)
+                   : cursor_to_type3(context, source_id, existing_sub_count)) {
 
           // existing type 3 was merged before, no change
 
@@ -475,8 +790,16 @@ print_mdb_val("hash_data_manager merge found data", context.data);
           replace_type2(context, block_hash, existing_k_entropy,
                         existing_block_label, count);
 
-          // new type 3 for new souce_id
-          new_type3(context, block_hash, source_id, sub_count);
+          if (is_hot) {
+            // add new souce_id to type 4
+            std::map<uint64_t, uint64_t> sub_counts;
+            sub_counts[source_id] = sub_count;
+            add_type4(context, block_hash, sub_counts);
+          } else {
+            // new type 3 for new souce_id
+            new_type3(context, block_hash, source_id, sub_count);
+            maybe_make_hot(context, block_hash);
+          }
 
           ++changes.hash_data_merged;
         }
@@ -488,6 +811,72 @@ print_mdb_val("hash_data_manager merge found data", context.data);
       assert(0);
       return 0; // for mingw
     }
+
+    // keep the count of a hot hash in memory current
+    if (hot_it != hot_hashes.end()) {
+      hot_it->second.count = count;
+    }
+    return count;
+  }
+
+  public:
+  /**
+   * Merge hash with accompanying data.  Warn if data present but different.
+   * Return updated source count.
+   */
+  size_t merge(const std::string& block_hash,
+               const uint64_t k_entropy,
+               const std::string& block_label,
+               const uint64_t source_id,
+               const uint64_t sub_count,
+               hashdb::lmdb_changes_t& changes) {
+    std::vector<std::pair<uint64_t, uint64_t> > source_id_sub_counts;
+    source_id_sub_counts.push_back(std::pair<uint64_t, uint64_t>(
+                                                   source_id, sub_count));
+    return merge(block_hash, k_entropy, block_label, source_id_sub_counts,
+                 changes);
+  }
+
+  /**
+   * Merge hash with accompanying data for each source ID, sub_count pair
+   * in one write transaction.  Warn if data present but different.
+   * Return updated source count.
+   */
+  size_t merge(const std::string& block_hash,
+               const uint64_t k_entropy,
+               const std::string& p_block_label,
+               const std::vector<std::pair<uint64_t, uint64_t> >&
+                                                  source_id_sub_counts,
+               hashdb::lmdb_changes_t& changes) {
+
+    // require valid block_hash
+    if (block_hash.size() == 0) {
+      std::cerr << "Usage error: the block_hash value provided to mergeis empty.\n";
+      return 0;
+    }
+
+    // maybe truncate block_label
+    const std::string block_label = truncate_block_label(p_block_label);
+
+    MUTEX_LOCK(&M);
+
+    // maybe grow the DB
+    lmdb_helper::maybe_grow(env);
+
+    // get context
+    hashdb::lmdb_context_t context(env, true, true);
+    context.open();
+#ifdef DEBUG_LMDB_HASH_DATA_MANAGER_HPP
+print_whole_mdb("hash_data_manager merge begin", context.cursor);
+#endif
+
+    uint64_t count = 0;
+    for (std::vector<std::pair<uint64_t, uint64_t> >::const_iterator it =
+                    source_id_sub_counts.begin();
+                    it != source_id_sub_counts.end(); ++it) {
+      count = merge_in_context(context, block_hash, k_entropy, block_label,
+                               it->first, it->second, changes);
+    }
 #ifdef DEBUG_LMDB_HASH_DATA_MANAGER_HPP
 print_whole_mdb("hash_data_manager merge end", context.cursor);
 #endif
@@ -497,18 +886,110 @@ print_whole_mdb("hash_data_manager merge end", context.cursor);
     return count;
   }
 
+  /**
+   * Merge the sources of each hash in one transaction, as merge does
+   * for one hash.  Set counts to the updated source count of each hash.
+   */
+  void merge(const std::vector<std::string>& block_hashes,
+             const std::vector<uint64_t>& k_entropies,
+             const std::vector<std::string>& block_labels,
+             const std::vector<std::vector<std::pair<uint64_t, uint64_t> > >&
+                                                  source_id_sub_counts,
+             hashdb::lmdb_changes_t& changes,
+             std::vector<size_t>& counts) {
+
+    counts.assign(block_hashes.size(), 0);
+
+    size_t records = 0;
+    size_t bytes = 0;
+    for (size_t i=0; i<block_hashes.size(); ++i) {
+      records += source_id_sub_counts[i].size() + 1;
+      bytes += (block_hashes[i].size() + 20) *
+                       (source_id_sub_counts[i].size() + 1) +
+               block_labels[i].size();
+    }
+
+    MUTEX_LOCK(&M);
+
+    // maybe grow the DB for all the records
+    lmdb_helper::maybe_grow(env, records, bytes);
+
+    // get context
+    hashdb::lmdb_context_t context(env, true, true);
+    context.open();
+
+    for (size_t i=0; i<block_hashes.size(); ++i) {
+
+      // require valid block_hash
+      if (block_hashes[i].size() == 0) {
+        std::cerr << "Usage error: the block_hash value provided to mergeis empty.\n";
+        continue;
+      }
+
+      // maybe truncate block_label
+      const std::string block_label = truncate_block_label(block_labels[i]);
+
+      for (std::vector<std::pair<uint64_t, uint64_t> >::const_iterator it =
+                      source_id_sub_counts[i].begin();
+                      it != source_id_sub_counts[i].end(); ++it) {
+        counts[i] = merge_in_context(context, block_hashes[i],
+                                     k_entropies[i], block_label,
+                                     it->first, it->second, changes);
+      }
+    }
+
+    context.close();
+    MUTEX_UNLOCK(&M);
+  }
+
   // ************************************************************
   // find
   // ************************************************************
   /**
    * Read data for the hash.  If the hash does not exist return false
-   * and empty fields.
+   * and empty fields.  source_id_sub_counts is either a
+   * source_id_sub_counts_t or a vector of source ID, sub_count pairs,
+   * which does not release its storage when cleared.  block_hash is a
+   * std::string or hash_key_t.
    */
-  bool find(const std::string& block_hash,
+  template <typename K, typename T>
+  bool find(const K& block_hash,
             uint64_t& k_entropy,
             std::string& block_label,
             uint64_t& count,
-            source_id_sub_counts_t& source_id_sub_counts) const {
+            T& source_id_sub_counts) const {
+
+    // only writers hold inserts in memory
+    if (file_mode == READ_ONLY) {
+      return find_stored(block_hash, k_entropy, block_label, count,
+                         source_id_sub_counts);
+    }
+
+    MUTEX_LOCK(&M);
+    const bool is_found = find_stored(block_hash, k_entropy, block_label,
+                                      count, source_id_sub_counts);
+
+    // add inserts held in memory
+    std::map<std::string, hot_hash_t>::const_iterator hot_it =
+          hot_hashes.find(std::string(block_hash.data(), block_hash.size()));
+    if (is_found && hot_it != hot_hashes.end() &&
+                                     hot_it->second.pending_inserts != 0) {
+      count = hot_it->second.count;
+      add_pending_sub_counts(hot_it->second.pending_sub_counts,
+                             source_id_sub_counts);
+    }
+    MUTEX_UNLOCK(&M);
+    return is_found;
+  }
+
+  private:
+  // find without inserts held in memory
+  template <typename K, typename T>
+  bool find_stored(const K& block_hash,
+                   uint64_t& k_entropy,
+                   std::string& block_label,
+                   uint64_t& count,
+                   T& source_id_sub_counts) const {
 
     // clear any previous values
     k_entropy = 0;
@@ -532,7 +1013,7 @@ print_whole_mdb("hash_data_manager find", context.cursor);
     // set key
     const size_t key_size = block_hash.size();
     uint8_t* const key_start = static_cast<uint8_t*>(
-                 static_cast<void*>(const_cast<char*>(block_hash.c_str())));
+                 static_cast<void*>(const_cast<char*>(block_hash.data())));
     context.key.mv_size = key_size;
     context.key.mv_data = key_start;
 
@@ -571,8 +1052,7 @@ print_mdb_val("hash_data_manager find Type 1 data", context.data);
         uint64_t source_id;
         uint64_t sub_count;
         decode_type1(context, k_entropy, block_label, source_id, sub_count);
-        source_id_sub_counts.insert(source_id_sub_count_t(source_id,
-                                                          sub_count));
+        add_source_id_sub_count(source_id_sub_counts, source_id, sub_count);
         count = sub_count;
         context.close();
         return true;
@@ -586,7 +1066,8 @@ print_mdb_val("hash_data_manager find Type 2 data", context.data);
         // read the existing Type 2 entry into returned fields
         decode_type2(context, k_entropy, block_label, count);
 
-        // read Type 3 entries while data available and key matches
+        // read Type 3 or Type 4 entries while data available and key
+        // matches
         while (true) {
           rc = mdb_cursor_get(context.cursor, &context.key, &context.data,
                               MDB_NEXT);
@@ -608,14 +1089,8 @@ print_mdb_val("hash_data_manager find Type 3 data", context.data);
             assert(0);
           }
 
-          // read Type 3
-          uint64_t source_id;
-          uint64_t sub_count;
-          decode_type3(context, source_id, sub_count);
-
           // add the LMDB hash data
-          source_id_sub_counts.insert(source_id_sub_count_t(source_id,
-                                                            sub_count));
+          add_type3_or_type4(context, source_id_sub_counts);
         }
 
         context.close();
@@ -633,13 +1108,29 @@ print_mdb_val("hash_data_manager find Type 3 data", context.data);
     return false; // for mingw
   }
 
+  public:
   // ************************************************************
   // find_count
   // ************************************************************
   /**
-   * Return source count for this hash.
+   * Return source count for this hash.  block_hash is a std::string or
+   * hash_key_t.
    */
-  size_t find_count(const std::string& block_hash) const {
+  template <typename K>
+  size_t find_count(const K& block_hash) const {
+
+    // only writers hold inserts in memory
+    if (file_mode != READ_ONLY) {
+      MUTEX_LOCK(&M);
+      std::map<std::string, hot_hash_t>::const_iterator hot_it =
+          hot_hashes.find(std::string(block_hash.data(), block_hash.size()));
+      if (hot_it != hot_hashes.end()) {
+        const uint64_t count = hot_it->second.count;
+        MUTEX_UNLOCK(&M);
+        return count;
+      }
+      MUTEX_UNLOCK(&M);
+    }
 
     // require valid block_hash
     if (block_hash.size() == 0) {
@@ -654,7 +1145,7 @@ print_mdb_val("hash_data_manager find Type 3 data", context.data);
     // set key
     context.key.mv_size = block_hash.size();
     context.key.mv_data =
-                 static_cast<void*>(const_cast<char*>(block_hash.c_str()));
+                 static_cast<void*>(const_cast<char*>(block_hash.data()));
 
     // set the cursor to this key
     int rc = mdb_cursor_get(context.cursor, &context.key, &context.data,
@@ -814,6 +1305,125 @@ print_mdb_val("hash_data_manager find_next data", context.data);
     }
   }
 
+  // ************************************************************
+  // flush
+  // ************************************************************
+  /**
+   * Write inserts into hot hashes that are held in memory.
+   */
+  void flush() {
+    MUTEX_LOCK(&M);
+    flush_hot_hashes();
+    MUTEX_UNLOCK(&M);
+  }
+
+  // ************************************************************
+  // upgrade
+  // ************************************************************
+  /**
+   * Rewrite Type 3 records written before settings version 5 into the
+   * current encoding.  Hashes are rewritten in batches in block hash
+   * order, each batch in its own transaction, and hashes already
+   * rewritten are skipped, so an interrupted upgrade may be run again.
+   * Return the number of hashes rewritten.
+   */
+  size_t upgrade() {
+
+    // bound the size of each batch
+    static const size_t max_batch_hashes = 4096;
+    static const size_t max_batch_records = 1<<16;
+
+    size_t rewritten = 0;
+    std::vector<std::string> block_hashes;
+    size_t records = 0;
+    std::string last_block_hash = "";
+    while (true) {
+
+      // find the next batch of hashes with Type 2 records, starting
+      // after the last hash of the previous batch
+      block_hashes.clear();
+      records = 0;
+      {
+        hashdb::lmdb_context_t context(env, false, true);
+        context.open();
+        int rc;
+        if (last_block_hash.size() == 0) {
+          rc = mdb_cursor_get(context.cursor, &context.key, &context.data,
+                              MDB_FIRST);
+        } else {
+          context.key.mv_size = last_block_hash.size();
+          context.key.mv_data = static_cast<void*>(const_cast<char*>(
+                                                 last_block_hash.data()));
+          rc = mdb_cursor_get(context.cursor, &context.key, &context.data,
+                              MDB_SET_KEY);
+          if (rc == 0) {
+            rc = mdb_cursor_get(context.cursor, &context.key,
+                                &context.data, MDB_NEXT_NODUP);
+          }
+        }
+        while (rc == 0 && block_hashes.size() < max_batch_hashes &&
+                          records < max_batch_records) {
+          if (static_cast<uint8_t*>(context.data.mv_data)[0] == 0) {
+            block_hashes.push_back(std::string(
+                 static_cast<char*>(context.key.mv_data),
+                 context.key.mv_size));
+            size_t num_records;
+            rc = mdb_cursor_count(context.cursor, &num_records);
+            if (rc != 0) {
+              break;
+            }
+            records += num_records;
+          }
+          rc = mdb_cursor_get(context.cursor, &context.key, &context.data,
+                              MDB_NEXT_NODUP);
+        }
+        if (rc != 0 && rc != MDB_NOTFOUND) {
+          std::cerr << "LMDB error: " << mdb_strerror(rc) << "\n";
+          assert(0);
+        }
+        context.close();
+      }
+      if (block_hashes.size() == 0) {
+        break;
+      }
+      last_block_hash = block_hashes.back();
+
+      // rewrite the batch
+      MUTEX_LOCK(&M);
+
+      // maybe grow the DB for all the records
+      lmdb_helper::maybe_grow(env, records,
+                              records * (last_block_hash.size() + 20));
+
+      // get context
+      hashdb::lmdb_context_t context(env, true, true);
+      context.open();
+
+      for (std::vector<std::string>::const_iterator it =
+                   block_hashes.begin(); it != block_hashes.end(); ++it) {
+
+        // set the cursor to this key
+        context.key.mv_size = it->size();
+        context.key.mv_data = static_cast<void*>(const_cast<char*>(
+                                                               it->data()));
+        int rc = mdb_cursor_get(context.cursor, &context.key, &context.data,
+                                MDB_SET_KEY);
+        if (rc != 0) {
+          std::cerr << "LMDB error: " << mdb_strerror(rc) << "\n";
+          assert(0);
+        }
+
+        if (upgrade_type3(context, *it)) {
+          ++rewritten;
+        }
+      }
+
+      context.close();
+      MUTEX_UNLOCK(&M);
+    }
+    return rewritten;
+  }
+
   // call this from a lock to prevent getting an unstable answer.
   size_t size() const {
     return lmdb_helper::size(env);
@@ -51,6 +51,9 @@
 #include <sstream>
 #include <iostream>
 #include <string>
+#include <vector>
+#include <map>
+#include <cstring>
 #include <cassert>
 
 #ifdef DEBUG_LMDB_HASH_DATA_SUPPORT_HPP
@@ -62,7 +65,30 @@ namespace hashdb {
 const size_t max_block_label_size = 10;
 static const size_t type1_max_size = 10+1+max_block_label_size+10+2;
 // not used: static const size_t type2_max_size = 10+1+max_block_label_size+4;
-static const size_t type3_max_size = 10+2;
+static const size_t type3_size = 1+8+2;
+
+// Type 3 starts with this identifier, sorting it after Type 2
+static const uint8_t type3_identifier = 0x01;
+
+// the Type 3 prefix that LMDB sorts by, identifier and source_id
+static const size_t type3_prefix_size = 1+8;
+
+// Type 4 starts with this identifier, sorting it after Type 3
+static const uint8_t type4_identifier = 0x02;
+
+// the Type 4 prefix that LMDB sorts by, identifier and first source_id
+static const size_t type4_prefix_size = 1+8;
+
+// Type 4 records stay below the LMDB limit of 511 bytes for duplicates
+static const size_t type4_max_size = 400;
+
+// space for one source in a Type 4 record, delta and sub_count
+static const size_t type4_max_source_size = 10+3;
+
+// add sub_counts, clip, do not wrap
+inline uint64_t add_sub_count(const uint64_t a, const uint64_t b) {
+  return (a+b>0xffff) ? 0xffff : a+b;
+}
 
 // put and get fixed-width numbers
 inline uint8_t* put1(uint8_t* p, uint64_t n) {
@@ -106,6 +132,22 @@ inline const uint8_t* get4(const uint8_t* const p, uint64_t &n) {
   return p+4;
 }
 
+// big-endian so that LMDB orders records by number
+inline uint8_t* put8_be(uint8_t* p, uint64_t n) {
+  for (int i=7; i>=0; --i) {
+    p[i] = static_cast<uint8_t>(n & 0xff);
+    n >>= 8;
+  }
+  return p+8;
+}
+inline const uint8_t* get8_be(const uint8_t* const p, uint64_t &n) {
+  n = 0;
+  for (int i=0; i<8; ++i) {
+    n = (n << 8) | p[i];
+  }
+  return p+8;
+}
+
 // encode Type 1 record
 static size_t encode_type1(const uint64_t k_entropy,
                            const std::string& block_label,
@@ -192,6 +234,22 @@ static size_t encode_type2(const uint64_t k_entropy,
   return p - p_buf;
 }
 
+// encode the Type 3 prefix
+static size_t encode_type3_prefix(uint64_t source_id, uint8_t* const p_buf) {
+
+  uint8_t* p = p_buf;
+
+  // add type3 identifier
+  *p = type3_identifier;
+  p++;
+
+  // add source_id
+  p = put8_be(p, source_id);
+
+  // size
+  return p - p_buf;
+}
+
 // encode Type 3 record
 static size_t encode_type3(uint64_t source_id,
                            uint64_t sub_count,
@@ -199,14 +257,14 @@ static size_t encode_type3(uint64_t source_id,
 
   uint8_t* p = p_buf;
 
-  // add source_id
-  p = lmdb_helper::encode_uint64_t(source_id, p);
+  // add identifier and source_id
+  p += encode_type3_prefix(source_id, p);
 
   // add sub_count
   p = put2(p, sub_count);
 
   // check bounds
-  if (p > p_buf + type3_max_size) {
+  if (p > p_buf + type3_size) {
     assert(0);
   }
 
@@ -214,6 +272,50 @@ static size_t encode_type3(uint64_t source_id,
   return p - p_buf;
 }
 
+// encode the Type 4 prefix
+static size_t encode_type4_prefix(uint64_t source_id, uint8_t* const p_buf) {
+
+  uint8_t* p = p_buf;
+
+  // add type4 identifier
+  *p = type4_identifier;
+  p++;
+
+  // add first source_id
+  p = put8_be(p, source_id);
+
+  // size
+  return p - p_buf;
+}
+
+// encode Type 4 record from sources starting at begin, return size and
+// advance begin past the sources encoded
+static size_t encode_type4(
+       std::vector<std::pair<uint64_t, uint64_t> >::const_iterator& begin,
+       const std::vector<std::pair<uint64_t, uint64_t> >::const_iterator end,
+       uint8_t* const p_buf) {
+
+  uint8_t* p = p_buf;
+
+  // add identifier and first source_id
+  p += encode_type4_prefix(begin->first, p);
+
+  // add sources while there is room, each source_id as the delta from
+  // the one before it
+  uint64_t previous_source_id = begin->first;
+  while (begin != end &&
+         static_cast<size_t>(p - p_buf) + type4_max_source_size <=
+                                                           type4_max_size) {
+    p = lmdb_helper::encode_uint64_t(begin->first - previous_source_id, p);
+    p = lmdb_helper::encode_uint64_t(begin->second, p);
+    previous_source_id = begin->first;
+    ++begin;
+  }
+
+  // size
+  return p - p_buf;
+}
+
 // write the record given key and data.
 static void write_record(hashdb::lmdb_context_t& context,
                          const std::string& key,
@@ -292,37 +394,260 @@ print_mdb_val("hash_data_support replace_record data", context.data);
     }
   }
 
-  // Move cursor forward from Type 2 to correct Type 3 else false and rewind.
+  // Move cursor from Type 2 to correct Type 3 else false and rewind.
   // Return sub_count.
   bool cursor_to_type3(hashdb::lmdb_context_t& context,
                        const uint64_t source_id,
                        uint64_t& sub_count) {
 
-    while (true) {
-      // get next Type 3 record
+    // LMDB sorts Type 3 records by source_id, so seek to the first record
+    // at or above the prefix for source_id
+    const MDB_val key = context.key;
+    uint8_t p_buf[type3_prefix_size];
+    context.data.mv_size = encode_type3_prefix(source_id, p_buf);
+    context.data.mv_data = p_buf;
+    int rc = mdb_cursor_get(context.cursor, &context.key, &context.data,
+                            MDB_GET_BOTH_RANGE);
+
+    if (rc == 0) {
+      if (context.data.mv_size == type3_size &&
+          std::memcmp(context.data.mv_data, p_buf, type3_prefix_size) == 0) {
+        uint64_t existing_source_id;
+        decode_type3(context, existing_source_id, sub_count);
+        return true;
+      }
+    } else if (rc != MDB_NOTFOUND) {
+      // invalid rc
+      std::cerr << "LMDB error: " << mdb_strerror(rc) << "\n";
+      assert(0);
+    }
+
+    // back up cursor to Type 2
+    context.key = key;
+    rc = mdb_cursor_get(context.cursor, &context.key, &context.data,
+                        MDB_SET_KEY);
+    if (rc != 0) {
+      std::cerr << "LMDB error: " << mdb_strerror(rc) << "\n";
+      assert(0);
+    }
+    sub_count = 0;
+    return false;
+  }
+
+  // True if the record at cursor is Type 4
+  bool is_type4(const hashdb::lmdb_context_t& context) {
+    return context.data.mv_size != 0 &&
+         static_cast<uint8_t*>(context.data.mv_data)[0] == type4_identifier;
+  }
+
+  // True if the hash at cursor, at its Type 2 record, keeps its sources
+  // in Type 4 records.  The cursor stays at Type 2.
+  bool has_type4(hashdb::lmdb_context_t& context) {
+    int rc = mdb_cursor_get(context.cursor, &context.key, &context.data,
+                            MDB_LAST_DUP);
+    if (rc != 0) {
+      std::cerr << "LMDB error: " << mdb_strerror(rc) << "\n";
+      assert(0);
+    }
+    const bool has_type4 = is_type4(context);
+    cursor_to_first_current(context);
+    return has_type4;
+  }
+
+  // Move cursor from Type 2 to the Type 4 record whose range of source IDs
+  // holds source_id.  A record's range runs from its first source_id up
+  // to the first source_id of the next record, and the first record also
+  // holds source IDs below its first source_id.
+  static void cursor_to_type4(hashdb::lmdb_context_t& context,
+                              const std::string& key,
+                              const uint64_t source_id) {
+
+    // seek to the first record at or above the prefix for source_id
+    uint8_t p_buf[type4_prefix_size];
+    context.key.mv_size = key.size();
+    context.key.mv_data = static_cast<void*>(const_cast<char*>(key.data()));
+    context.data.mv_size = encode_type4_prefix(source_id, p_buf);
+    context.data.mv_data = p_buf;
+    int rc = mdb_cursor_get(context.cursor, &context.key, &context.data,
+                            MDB_GET_BOTH_RANGE);
+
+    if (rc == 0 && context.data.mv_size >= type4_prefix_size &&
+        std::memcmp(context.data.mv_data, p_buf, type4_prefix_size) == 0) {
+      // the record starts at source_id
+      return;
+    }
+
+    // otherwise the record before it holds source_id
+    if (rc == 0) {
+      rc = mdb_cursor_get(context.cursor, &context.key, &context.data,
+                          MDB_PREV_DUP);
+    } else if (rc == MDB_NOTFOUND) {
+      context.key.mv_size = key.size();
+      context.key.mv_data = static_cast<void*>(const_cast<char*>(
+                                                              key.data()));
+      rc = mdb_cursor_get(context.cursor, &context.key, &context.data,
+                          MDB_SET_KEY);
+      if (rc == 0) {
+        rc = mdb_cursor_get(context.cursor, &context.key, &context.data,
+                            MDB_LAST_DUP);
+      }
+    }
+    if (rc != 0) {
+      std::cerr << "LMDB error: " << mdb_strerror(rc) << "\n";
+      assert(0);
+    }
+
+    // source_id is below the first Type 4 record so use the first
+    if (static_cast<uint8_t*>(context.data.mv_data)[0] != type4_identifier) {
+      rc = mdb_cursor_get(context.cursor, &context.key, &context.data,
+                          MDB_NEXT_DUP);
+      if (rc != 0) {
+        std::cerr << "LMDB error: " << mdb_strerror(rc) << "\n";
+        assert(0);
+      }
+    }
+  }
+
+  // Find source_id in the Type 4 records of the hash at cursor, at its
+  // Type 2 record, else false.  The cursor returns to Type 2.
+  bool find_type4(hashdb::lmdb_context_t& context,
+                  const std::string& key,
+                  const uint64_t source_id,
+                  uint64_t& sub_count) {
+
+    cursor_to_type4(context, key, source_id);
+    std::vector<std::pair<uint64_t, uint64_t> > source_id_sub_counts;
+    decode_type4(context, source_id_sub_counts);
+    cursor_to_first_current(context);
+
+    for (std::vector<std::pair<uint64_t, uint64_t> >::const_iterator it =
+                    source_id_sub_counts.begin();
+                    it != source_id_sub_counts.end(); ++it) {
+      if (it->first == source_id) {
+        sub_count = it->second;
+        return true;
+      }
+    }
+    sub_count = 0;
+    return false;
+  }
+
+  // Add sub_counts to the sources in the Type 4 records of the hash at
+  // cursor, at its Type 2 record, adding sources that are not there.
+  // Sub_counts clip at 0xffff.  The cursor is left unpositioned.
+  void add_type4(hashdb::lmdb_context_t& context,
+                 const std::string& key,
+                 const std::map<uint64_t, uint64_t>& sub_counts) {
+
+    std::vector<std::pair<uint64_t, uint64_t> > existing;
+    std::vector<std::pair<uint64_t, uint64_t> > merged;
+    std::map<uint64_t, uint64_t>::const_iterator it = sub_counts.begin();
+    while (it != sub_counts.end()) {
+
+      // read the record holding the next source
+      cursor_to_type4(context, key, it->first);
+      existing.clear();
+      decode_type4(context, existing);
+      const std::string record(static_cast<char*>(context.data.mv_data),
+                               context.data.mv_size);
+
+      // the record holds sources up to the first of the next record
+      bool has_limit = false;
+      uint64_t limit = 0;
       int rc = mdb_cursor_get(context.cursor, &context.key, &context.data,
                               MDB_NEXT_DUP);
-
       if (rc == 0) {
-        uint64_t existing_source_id;
-        uint64_t existing_sub_count;
-        decode_type3(context, existing_source_id, existing_sub_count);
-        if (existing_source_id == source_id) {
-          sub_count = existing_sub_count;
-          return true;
+        has_limit = true;
+        get8_be(static_cast<uint8_t*>(context.data.mv_data) + 1, limit);
+      } else if (rc != MDB_NOTFOUND) {
+        std::cerr << "LMDB error: " << mdb_strerror(rc) << "\n";
+        assert(0);
+      }
+
+      // merge the sources in range into the record's sources
+      merged.clear();
+      std::vector<std::pair<uint64_t, uint64_t> >::const_iterator
+                                                     e_it = existing.begin();
+      while (it != sub_counts.end() && (!has_limit || it->first < limit)) {
+        while (e_it != existing.end() && e_it->first < it->first) {
+          merged.push_back(*e_it);
+          ++e_it;
         }
-      } else if (rc == MDB_NOTFOUND) {
-        // back up cursor to Type 2
-        rc = mdb_cursor_get(context.cursor, &context.key, &context.data,
-                            MDB_FIRST_DUP);
-        sub_count = 0;
-        return false;
-      } else {
-        // invalid rc
+        if (e_it != existing.end() && e_it->first == it->first) {
+          merged.push_back(std::pair<uint64_t, uint64_t>(it->first,
+                               add_sub_count(e_it->second, it->second)));
+          ++e_it;
+        } else {
+          merged.push_back(std::pair<uint64_t, uint64_t>(it->first,
+                               add_sub_count(0, it->second)));
+        }
+        ++it;
+      }
+      while (e_it != existing.end()) {
+        merged.push_back(*e_it);
+        ++e_it;
+      }
+
+      // replace the record with records for the merged sources
+      context.key.mv_size = key.size();
+      context.key.mv_data = static_cast<void*>(const_cast<char*>(
+                                                              key.data()));
+      context.data.mv_size = record.size();
+      context.data.mv_data = static_cast<void*>(const_cast<char*>(
+                                                           record.data()));
+      rc = mdb_cursor_get(context.cursor, &context.key, &context.data,
+                          MDB_GET_BOTH);
+      if (rc == 0) {
+        rc = mdb_cursor_del(context.cursor, 0);
+      }
+      if (rc != 0) {
+        std::cerr << "LMDB error: " << mdb_strerror(rc) << "\n";
+        assert(0);
+      }
+      new_type4(context, key, merged);
+    }
+  }
+
+  // Move the Type 3 records of the hash at cursor, at its Type 2 record,
+  // into Type 4 records.  The cursor is left unpositioned.
+  void type3_to_type4(hashdb::lmdb_context_t& context,
+                      const std::string& key) {
+
+    // copy Type 2
+    const std::string type2(static_cast<char*>(context.data.mv_data),
+                            context.data.mv_size);
+
+    // read the Type 3 records, which are in source_id order
+    std::vector<std::pair<uint64_t, uint64_t> > source_id_sub_counts;
+    while (true) {
+      int rc = mdb_cursor_get(context.cursor, &context.key, &context.data,
+                              MDB_NEXT_DUP);
+      if (rc == MDB_NOTFOUND) {
+        break;
+      } else if (rc != 0) {
         std::cerr << "LMDB error: " << mdb_strerror(rc) << "\n";
         assert(0);
       }
+      uint64_t source_id;
+      uint64_t sub_count;
+      decode_type3(context, source_id, sub_count);
+      source_id_sub_counts.push_back(std::pair<uint64_t, uint64_t>(
+                                                   source_id, sub_count));
+    }
+
+    // remove all records of the hash
+    context.key.mv_size = key.size();
+    context.key.mv_data = static_cast<void*>(const_cast<char*>(key.data()));
+    int rc = mdb_del(context.txn, context.dbi, &context.key, NULL);
+    if (rc != 0) {
+      std::cerr << "LMDB error: " << mdb_strerror(rc) << "\n";
+      assert(0);
     }
+
+    // write Type 2 as it was, then the Type 4 records
+    write_record(context, key, reinterpret_cast<const uint8_t*>(
+                                       type2.data()), type2.size());
+    new_type4(context, key, source_id_sub_counts);
   }
 
   // parse Type 1 context.data into these parameters
@@ -436,23 +761,137 @@ print_mdb_val("hash_data_support decode_type3 key", context.key);
 print_mdb_val("hash_data_support decode_type3 data", context.data);
 #endif
 
-    // prepare to read Type 1 entry:
+    // prepare to read Type 3 entry:
     const uint8_t* const p_start = static_cast<uint8_t*>(context.data.mv_data);
     const uint8_t* p = p_start;
 
+    // expect type3 identifier and size
+    if (context.data.mv_size != type3_size || *p != type3_identifier) {
+      std::cerr << "data decode identifier error in LMDB hash data store\n";
+      assert(0);
+    }
+    p++;
+
     // read source ID
-    p = lmdb_helper::decode_uint64_t(p, source_id);
+    p = get8_be(p, source_id);
 
     // read sub_count
     p = get2(p, sub_count);
+  }
+
+  // parse Type 4 context.data, appending its sources
+  void decode_type4(hashdb::lmdb_context_t& context,
+                    std::vector<std::pair<uint64_t, uint64_t> >&
+                                                    source_id_sub_counts) {
+
+#ifdef DEBUG_LMDB_HASH_DATA_SUPPORT_HPP
+print_mdb_val("hash_data_support decode_type4 key", context.key);
+print_mdb_val("hash_data_support decode_type4 data", context.data);
+#endif
+
+    // prepare to read Type 4 entry:
+    const uint8_t* const p_start = static_cast<uint8_t*>(context.data.mv_data);
+    const uint8_t* const p_end = p_start + context.data.mv_size;
+    const uint8_t* p = p_start;
+
+    // expect type4 identifier
+    if (context.data.mv_size <= type4_prefix_size ||
+        *p != type4_identifier) {
+      std::cerr << "data decode identifier error in LMDB hash data store\n";
+      assert(0);
+    }
+    p++;
+
+    // read first source ID
+    uint64_t source_id;
+    p = get8_be(p, source_id);
+
+    // read sources
+    while (p < p_end) {
+      uint64_t delta;
+      uint64_t sub_count;
+      p = lmdb_helper::decode_uint64_t(p, delta);
+      p = lmdb_helper::decode_uint64_t(p, sub_count);
+      source_id += delta;
+      source_id_sub_counts.push_back(std::pair<uint64_t, uint64_t>(
+                                                   source_id, sub_count));
+    }
 
     // read must align to data record
-    if (p != p_start + context.data.mv_size) {
+    if (p != p_end) {
       std::cerr << "data decode error in LMDB hash data store\n";
       assert(0);
     }
   }
 
+  // Rewrite the Type 3 records of the hash at cursor from the encoding
+  // used before settings version 5, which began with the source_id.
+  // Return false if they are already in the current encoding.
+  bool upgrade_type3(hashdb::lmdb_context_t& context,
+                     const std::string& key) {
+
+    // copy Type 2
+    cursor_to_first_current(context);
+    const std::string type2(static_cast<char*>(context.data.mv_data),
+                            context.data.mv_size);
+    if (type2[0] != 0) {
+      std::cerr << "program error: upgrade_type3 requires Type 2\n";
+      assert(0);
+    }
+
+    // read the old Type 3 records
+    std::vector<std::pair<uint64_t, uint64_t> > source_id_sub_counts;
+    while (true) {
+      int rc = mdb_cursor_get(context.cursor, &context.key, &context.data,
+                              MDB_NEXT_DUP);
+      if (rc == MDB_NOTFOUND) {
+        break;
+      } else if (rc != 0) {
+        std::cerr << "LMDB error: " << mdb_strerror(rc) << "\n";
+        assert(0);
+      }
+
+      // the hash is rewritten in one transaction so a current record
+      // means all are current.  Old records this size are not possible.
+      if (context.data.mv_size == type3_size) {
+        return false;
+      }
+
+      const uint8_t* const p_start =
+                              static_cast<uint8_t*>(context.data.mv_data);
+      const uint8_t* p = p_start;
+      uint64_t source_id;
+      uint64_t sub_count;
+      p = lmdb_helper::decode_uint64_t(p, source_id);
+      p = get2(p, sub_count);
+      if (p != p_start + context.data.mv_size) {
+        std::cerr << "data decode error in LMDB hash data store\n";
+        assert(0);
+      }
+      source_id_sub_counts.push_back(std::pair<uint64_t, uint64_t>(
+                                                   source_id, sub_count));
+    }
+
+    // remove all records of the hash
+    context.key.mv_size = key.size();
+    context.key.mv_data = static_cast<void*>(const_cast<char*>(key.data()));
+    int rc = mdb_del(context.txn, context.dbi, &context.key, NULL);
+    if (rc != 0) {
+      std::cerr << "LMDB error: " << mdb_strerror(rc) << "\n";
+      assert(0);
+    }
+
+    // write Type 2 as it was, then the Type 3 records
+    write_record(context, key, reinterpret_cast<const uint8_t*>(
+                                       type2.data()), type2.size());
+    for (std::vector<std::pair<uint64_t, uint64_t> >::const_iterator it =
+                    source_id_sub_counts.begin();
+                    it != source_id_sub_counts.end(); ++it) {
+      new_type3(context, key, it->first, it->second);
+    }
+    return true;
+  }
+
   // write new Type 1 record, key must be valid
   void new_type1(hashdb::lmdb_context_t& context,
                  const std::string& key,
@@ -479,7 +918,7 @@ print_mdb_val("hash_data_support decode_type3 data", context.data);
                  const uint64_t sub_count) {
 
     // space for encoding
-    uint8_t p_buf[type3_max_size];
+    uint8_t p_buf[type3_size];
 
     // encode type3
     const size_t size = encode_type3(source_id, sub_count, p_buf);
@@ -488,6 +927,28 @@ print_mdb_val("hash_data_support decode_type3 data", context.data);
     write_record(context, key, p_buf, size);
   }
 
+  // write new Type 4 records for the sources, which must be in source_id
+  // order, key must be valid
+  void new_type4(hashdb::lmdb_context_t& context,
+                 const std::string& key,
+                 const std::vector<std::pair<uint64_t, uint64_t> >&
+                                                    source_id_sub_counts) {
+
+    // space for encoding
+    uint8_t p_buf[type4_max_size];
+
+    std::vector<std::pair<uint64_t, uint64_t> >::const_iterator it =
+                                               source_id_sub_counts.begin();
+    while (it != source_id_sub_counts.end()) {
+
+      // encode type4
+      const size_t size = encode_type4(it, source_id_sub_counts.end(), p_buf);
+
+      // write
+      write_record(context, key, p_buf, size);
+    }
+  }
+
   // replace Type 1 record at cursor
   void replace_type1(hashdb::lmdb_context_t& context,
                      const std::string& key,
@@ -531,7 +992,7 @@ print_mdb_val("hash_data_support decode_type3 data", context.data);
                      const uint64_t& sub_count) {
 
     // space for encoding
-    uint8_t p_buf[type3_max_size];
+    uint8_t p_buf[type3_size];
 
     // encode type3
     const size_t size = encode_type3(source_id, sub_count, p_buf);
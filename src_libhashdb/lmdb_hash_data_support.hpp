@@ -20,7 +20,7 @@
 /**
  * \file
  * Provides low-level support for moving the cursor and for reading and
- * writing Type1, Type2, and Type3 records in lmdb_hash_data_store.
+ * writing Type1, Type2, Type3, and Type 4 records in lmdb_hash_data_store.
  * See lmdb_hash_data_manager.
  */
 
@@ -29,6 +29,8 @@
 
 #include <unistd.h>
 #include <string>
+#include <vector>
+#include <map>
 #include "lmdb_context.hpp"
 
 namespace hashdb {
@@ -39,12 +41,43 @@ namespace hashdb {
   // move cursor to first entry of current key
   void cursor_to_first_current(hashdb::lmdb_context_t& context);
 
-  // Move cursor forward from Type 2 to correct Type 3 else false and rewind.
+  // Move cursor from Type 2 to correct Type 3 else false and rewind.
   // Return sub_count.
   bool cursor_to_type3(hashdb::lmdb_context_t& context,
                        const uint64_t source_id,
                        uint64_t& sub_count);
 
+  // True if the record at cursor is Type 4
+  bool is_type4(const hashdb::lmdb_context_t& context);
+
+  // True if the hash at cursor, at its Type 2 record, keeps its sources
+  // in Type 4 records.  The cursor stays at Type 2.
+  bool has_type4(hashdb::lmdb_context_t& context);
+
+  // Find source_id in the Type 4 records of the hash at cursor, at its
+  // Type 2 record, else false.  The cursor returns to Type 2.
+  bool find_type4(hashdb::lmdb_context_t& context,
+                  const std::string& key,
+                  const uint64_t source_id,
+                  uint64_t& sub_count);
+
+  // Add sub_counts to the sources in the Type 4 records of the hash at
+  // cursor, at its Type 2 record, adding sources that are not there.
+  // The cursor is left unpositioned.
+  void add_type4(hashdb::lmdb_context_t& context,
+                 const std::string& key,
+                 const std::map<uint64_t, uint64_t>& sub_counts);
+
+  // Move the Type 3 records of the hash at cursor, at its Type 2 record,
+  // into Type 4 records.  The cursor is left unpositioned.
+  void type3_to_type4(hashdb::lmdb_context_t& context,
+                      const std::string& key);
+
+  // Rewrite the Type 3 records of the hash at cursor from the encoding
+  // used before settings version 5.  Return false if already current.
+  bool upgrade_type3(hashdb::lmdb_context_t& context,
+                     const std::string& key);
+
   // parse Type 1 context.data into these parameters
   void decode_type1(hashdb::lmdb_context_t& context,
                     uint64_t& k_entropy,
@@ -63,6 +96,11 @@ namespace hashdb {
                     uint64_t& source_id,
                     uint64_t& sub_count);
 
+  // parse Type 4 context.data, appending its sources
+  void decode_type4(hashdb::lmdb_context_t& context,
+                    std::vector<std::pair<uint64_t, uint64_t> >&
+                                                    source_id_sub_counts);
+
   // write new Type 1 record, key must be valid
   void new_type1(hashdb::lmdb_context_t& context,
                  const std::string& key,
@@ -77,6 +115,13 @@ namespace hashdb {
                  const uint64_t source_id,
                  const uint64_t sub_count);
 
+  // write new Type 4 records for the sources, which must be in source_id
+  // order, key must be valid
+  void new_type4(hashdb::lmdb_context_t& context,
+                 const std::string& key,
+                 const std::vector<std::pair<uint64_t, uint64_t> >&
+                                                    source_id_sub_counts);
+
   // replace Type 1 record at cursor
   void replace_type1(hashdb::lmdb_context_t& context,
                      const std::string& key,
@@ -64,6 +64,7 @@ for i in range(1500):
 #include <sstream>
 #include <iostream>
 #include <string>
+#include <vector>
 #include <set>
 #include <cassert>
 #ifdef DEBUG_LMDB_HASH_MANAGER_HPP
@@ -122,26 +123,10 @@ class lmdb_hash_manager_t {
     return (m + 4) * lookup[x] - 5;
   }
 
-  public:
-  lmdb_hash_manager_t(const std::string& p_hashdb_dir,
-                      const hashdb::file_mode_type_t p_file_mode) :
-          hashdb_dir(p_hashdb_dir),
-          file_mode(p_file_mode),
-          env(lmdb_helper::open_env(
-                           hashdb_dir + "/lmdb_hash_store", file_mode)),
-          M() {
-    MUTEX_INIT(&M);
-  }
-
-  ~lmdb_hash_manager_t() {
-    // close the lmdb_hash_store DB environment
-    mdb_env_close(env);
-
-    MUTEX_DESTROY(&M);
-  }
-
-  void insert(const std::string& binary_hash, const size_t count,
-              hashdb::lmdb_changes_t& changes) {
+  // insert in an open write context
+  void insert_in_context(hashdb::lmdb_context_t& context,
+                         const std::string& binary_hash, const size_t count,
+                         hashdb::lmdb_changes_t& changes) {
 
     // require valid binary_hash
     if (binary_hash.size() == 0) {
@@ -165,18 +150,6 @@ class lmdb_hash_manager_t {
     // set data
     data[0] = count_to_byte(count);
 
-    // ************************************************************
-    // insert
-    // ************************************************************
-    MUTEX_LOCK(&M);
-
-    // maybe grow the DB
-    lmdb_helper::maybe_grow(env);
-
-    // get context
-    hashdb::lmdb_context_t context(env, true, false);
-    context.open();
-
     // see if key is already there
     // set context key
     context.key.mv_size = prefix_size;
@@ -208,9 +181,7 @@ print_mdb_val("hash_manager insert not found data", context.data);
       }
 
       // new hash inserted
-      context.close();
       ++changes.hash_inserted;
-      MUTEX_UNLOCK(&M);
       return;
 
     // handle when key already exists
@@ -247,8 +218,6 @@ print_mdb_val("hash_manager insert update count data", context.data);
       }
 
       // done because suffix matched
-      context.close();
-      MUTEX_UNLOCK(&M);
       return;
     } else {
 
@@ -258,10 +227,74 @@ print_mdb_val("hash_manager insert update count data", context.data);
     }
   }
 
+
+  public:
+  lmdb_hash_manager_t(const std::string& p_hashdb_dir,
+                      const hashdb::file_mode_type_t p_file_mode) :
+          hashdb_dir(p_hashdb_dir),
+          file_mode(p_file_mode),
+          env(lmdb_helper::open_env(
+                           hashdb_dir + "/lmdb_hash_store", file_mode)),
+          M() {
+    MUTEX_INIT(&M);
+  }
+
+  ~lmdb_hash_manager_t() {
+    // close the lmdb_hash_store DB environment
+    mdb_env_close(env);
+
+    MUTEX_DESTROY(&M);
+  }
+
+  void insert(const std::string& binary_hash, const size_t count,
+              hashdb::lmdb_changes_t& changes) {
+
+    MUTEX_LOCK(&M);
+
+    // maybe grow the DB
+    lmdb_helper::maybe_grow(env);
+
+    // get context
+    hashdb::lmdb_context_t context(env, true, false);
+    context.open();
+
+    insert_in_context(context, binary_hash, count, changes);
+
+    context.close();
+    MUTEX_UNLOCK(&M);
+  }
+
+  /**
+   * Insert each hash with its count in one transaction.
+   */
+  void insert(const std::vector<std::string>& binary_hashes,
+              const std::vector<size_t>& counts,
+              hashdb::lmdb_changes_t& changes) {
+
+    MUTEX_LOCK(&M);
+
+    // maybe grow the DB for all the records
+    lmdb_helper::maybe_grow(env, binary_hashes.size(),
+                            binary_hashes.size() * (num_prefix_bytes + 1));
+
+    // get context
+    hashdb::lmdb_context_t context(env, true, false);
+    context.open();
+
+    for (size_t i=0; i<binary_hashes.size(); ++i) {
+      insert_in_context(context, binary_hashes[i], counts[i], changes);
+    }
+
+    context.close();
+    MUTEX_UNLOCK(&M);
+  }
+
   /**
-   * Find if hash is present, return approximate count.
+   * Find if hash is present, return approximate count.  binary_hash is
+   * a std::string or hash_key_t.
    */
-  size_t find(const std::string& binary_hash) const {
+  template <typename K>
+  size_t find(const K& binary_hash) const {
 
     // require valid binary_hash
     if (binary_hash.size() == 0) {
@@ -278,7 +311,7 @@ print_mdb_val("hash_manager insert update count data", context.data);
     // set key
     size_t prefix_size =
               (hash_size > num_prefix_bytes) ? num_prefix_bytes : hash_size;
-    memcpy(key, binary_hash.c_str(), prefix_size);
+    memcpy(key, binary_hash.data(), prefix_size);
 
     // ************************************************************
     // find
@@ -44,6 +44,7 @@
 #include "sys/stat.h"
 #include "lmdb.h"
 #include "file_modes.h"
+#include "num_cpus.hpp"
 #include <stdexcept>
 #include <cassert>
 #include <stdint.h>
@@ -210,7 +211,9 @@ namespace lmdb_helper {
     unsigned int env_flags;
     switch(file_mode) {
       case hashdb::READ_ONLY:
-        env_flags = MDB_RDONLY;
+        // NOTLS allows a thread to hold a long-lived read cursor while
+        // it also does lookups in the same environment.
+        env_flags = MDB_RDONLY | MDB_NOTLS;
         break;
       case hashdb::RW_NEW:
         // store directory must not exist yet
@@ -248,6 +251,18 @@ namespace lmdb_helper {
         return 0; // for mingw compiler
     }
 
+    // Range workers and scan threads each hold read transactions on the
+    // store, one worker per CPU, so size the reader table to the CPUs
+    // rather than use the LMDB default of 126.
+    const int num_cpus = hashdb::numCPU();
+    const unsigned int max_readers = (num_cpus > 7) ? 16 * num_cpus : 126;
+    rc = mdb_env_set_maxreaders(env, max_readers);
+    if (rc != 0) {
+      std::cerr << "Error sizing the reader table of store: " << store_dir
+                << ": " <<  mdb_strerror(rc) << "\nAborting.\n";
+      exit(1);
+    }
+
     // open the MDB environment
     rc = mdb_env_open(env, store_dir.c_str(), env_flags, 0664);
     if (rc != 0) {
@@ -260,7 +275,7 @@ namespace lmdb_helper {
     return env;
   }
 
-  void maybe_grow(MDB_env* env) {
+  void maybe_grow(MDB_env* env, const size_t records, const size_t bytes) {
     // http://comments.gmane.org/gmane.network.openldap.technical/11699
     // also see mdb_env_set_mapsize
 
@@ -288,8 +303,13 @@ namespace lmdb_helper {
       }
     }
 
+    // each record beyond the first may copy a path of pages and split one
+    const size_t pages = ((records > 1) ? (records - 1) * (ms.ms_depth + 1)
+                                        : 0) + bytes / ms.ms_psize;
+
     // maybe grow the DB
-    if (env_info.me_mapsize / ms.ms_psize <= env_info.me_last_pgno + 10) {
+    if (env_info.me_mapsize / ms.ms_psize <=
+                                   env_info.me_last_pgno + 10 + pages) {
 
       // could call mdb_env_sync(env, 1) here but it does not help
       // rc = mdb_env_sync(env, 1);
@@ -299,14 +319,16 @@ namespace lmdb_helper {
       //   exit(1);
       // }
 
-      // grow the DB
+      // grow the DB, more than once for a large transaction
       size_t size = env_info.me_mapsize;
-      if (size > (1<<30)) { // 1<<30 = 1,073,741,824
-        // add 1GiB
-        size += (1<<30);
-      } else {
-        // double
-        size *= 2;
+      while (size / ms.ms_psize <= env_info.me_last_pgno + 10 + pages) {
+        if (size > (1<<30)) { // 1<<30 = 1,073,741,824
+          // add 1GiB
+          size += (1<<30);
+        } else {
+          // double
+          size *= 2;
+        }
       }
 #ifdef DEBUG
       std::cout << "Growing DB " << env << " from " << env_info.me_mapsize
@@ -60,7 +60,10 @@ namespace lmdb_helper {
   MDB_env* open_env(const std::string& store_dir,
                            const hashdb::file_mode_type_t file_mode);
 
-  void maybe_grow(MDB_env* env);
+  // grow the DB if it may not have room for a write transaction of
+  // records records holding about bytes bytes
+  void maybe_grow(MDB_env* env, const size_t records = 1,
+                  const size_t bytes = 0);
 
   // size
   size_t size(MDB_env* env);
@@ -0,0 +1,308 @@
+// Author:  Bruce Allen
+// Created: 2/25/2013
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on February 25, 2013 by Bruce Allen.
+
+/**
+ * \file
+ * Manage the LMDB repository store, the index from repository name to
+ * the source IDs of sources with that repository name.  Threadsafe.
+ *
+ * key=repository_name, data=source_id, with one duplicate record per
+ * source ID.  Each repository name is stored once, as the key, no
+ * matter how many sources carry it.
+ *
+ * LMDB keys are limited in size, so a repository name longer than the
+ * limit is keyed by its prefix.  Names sharing that prefix then share
+ * a key, so find returns candidate source IDs and callers that must be
+ * exact compare the source names.
+ *
+ * This store is optional.  Databases created before it existed do not
+ * have it until it is built from the source name store, and it is used
+ * only once the settings mark it complete.
+ */
+
+#ifndef LMDB_REPOSITORY_MANAGER_HPP
+#define LMDB_REPOSITORY_MANAGER_HPP
+
+#include "file_modes.h"
+#include "lmdb.h"
+#include "lmdb_helper.h"
+#include "lmdb_context.hpp"
+#include <vector>
+#include <unistd.h>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <cassert>
+
+// no concurrent writes
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#include "mutex_lock.hpp"
+
+namespace hashdb {
+
+class lmdb_repository_manager_t {
+
+  private:
+  const std::string hashdb_dir;
+  const hashdb::file_mode_type_t file_mode;
+  MDB_env* env;
+  const size_t max_key_size;
+#ifdef HAVE_PTHREAD
+  mutable pthread_mutex_t M;                  // mutext
+#else
+  mutable int M;                              // placeholder
+#endif
+
+  // do not allow copy or assignment
+  lmdb_repository_manager_t(const lmdb_repository_manager_t&);
+  lmdb_repository_manager_t& operator=(const lmdb_repository_manager_t&);
+
+  // set the key to the repository name or its prefix
+  void set_key(hashdb::lmdb_context_t& context,
+               const std::string& repository_name) const {
+    context.key.mv_size = (repository_name.size() < max_key_size) ?
+                                  repository_name.size() : max_key_size;
+    context.key.mv_data =
+            static_cast<void*>(const_cast<char*>(repository_name.data()));
+  }
+
+  // insert in an open write context, return true if inserted
+  bool insert_in_context(hashdb::lmdb_context_t& context,
+                         const std::string& repository_name,
+                         const uint64_t source_id) {
+
+    // set key=repository_name
+    set_key(context, repository_name);
+
+    // set data=source_id
+    uint8_t data[10];
+    uint8_t* data_p = data;
+    data_p = lmdb_helper::encode_uint64_t(source_id, data_p);
+    context.data.mv_size = data_p - data;
+    context.data.mv_data = data;
+
+    int rc = mdb_put(context.txn, context.dbi,
+                     &context.key, &context.data, MDB_NODUPDATA);
+
+    if (rc == 0 || rc == MDB_KEYEXIST) {
+      return (rc == 0);
+
+    } else {
+      // invalid rc
+      std::cerr << "LMDB error: " << mdb_strerror(rc) << "\n";
+      assert(0);
+      return false; // for mingw
+    }
+  }
+
+  public:
+  lmdb_repository_manager_t(const std::string& p_hashdb_dir,
+                      const hashdb::file_mode_type_t p_file_mode) :
+       hashdb_dir(p_hashdb_dir),
+       file_mode(p_file_mode),
+       env(lmdb_helper::open_env(hashdb_dir + "/lmdb_repository_store",
+                                                                file_mode)),
+       max_key_size(mdb_env_get_maxkeysize(env)),
+       M() {
+
+    MUTEX_INIT(&M);
+  }
+
+  ~lmdb_repository_manager_t() {
+    // close the lmdb_repository_store DB environment
+    mdb_env_close(env);
+
+    MUTEX_DESTROY(&M);
+  }
+
+  /**
+   * True if the hashdb has a repository store.
+   */
+  static bool is_present(const std::string& hashdb_dir) {
+    return access((hashdb_dir + "/lmdb_repository_store").c_str(),
+                  F_OK) == 0;
+  }
+
+  /**
+   * Insert the source ID for the repository name unless it is already
+   * there.  Return true if the source ID was inserted.
+   */
+  bool insert(const std::string& repository_name,
+              const uint64_t source_id) {
+
+    if (repository_name.size() == 0) {
+      // LMDB keys may not be empty, and there is nothing to look up
+      return false;
+    }
+
+    MUTEX_LOCK(&M);
+
+    // maybe grow the DB
+    lmdb_helper::maybe_grow(env);
+
+    // get context
+    hashdb::lmdb_context_t context(env, true, true);
+    context.open();
+
+    const bool is_inserted = insert_in_context(context, repository_name,
+                                               source_id);
+
+    context.close();
+    MUTEX_UNLOCK(&M);
+    return is_inserted;
+  }
+
+  /**
+   * Insert each source ID for the repository name in one transaction
+   * unless it is already there.
+   */
+  void insert(const std::string& repository_name,
+              const std::vector<uint64_t>& source_ids) {
+
+    if (repository_name.size() == 0) {
+      // LMDB keys may not be empty, and there is nothing to look up
+      return;
+    }
+
+    MUTEX_LOCK(&M);
+
+    // maybe grow the DB for all the records
+    lmdb_helper::maybe_grow(env, source_ids.size(), source_ids.size() * 10);
+
+    // get context
+    hashdb::lmdb_context_t context(env, true, true);
+    context.open();
+
+    for (std::vector<uint64_t>::const_iterator it = source_ids.begin();
+                                            it != source_ids.end(); ++it) {
+      insert_in_context(context, repository_name, *it);
+    }
+
+    context.close();
+    MUTEX_UNLOCK(&M);
+  }
+
+  /**
+   * Insert each source ID for its repository name in one transaction
+   * unless it is already there.
+   */
+  void insert(const std::vector<std::pair<std::string, uint64_t> >&
+                                              repository_name_source_ids) {
+
+    MUTEX_LOCK(&M);
+
+    // maybe grow the DB for all the records
+    size_t bytes = 0;
+    for (std::vector<std::pair<std::string, uint64_t> >::const_iterator it =
+                    repository_name_source_ids.begin();
+                    it != repository_name_source_ids.end(); ++it) {
+      bytes += it->first.size() + 10;
+    }
+    lmdb_helper::maybe_grow(env, repository_name_source_ids.size(), bytes);
+
+    // get context
+    hashdb::lmdb_context_t context(env, true, true);
+    context.open();
+
+    for (std::vector<std::pair<std::string, uint64_t> >::const_iterator it =
+                    repository_name_source_ids.begin();
+                    it != repository_name_source_ids.end(); ++it) {
+      // LMDB keys may not be empty, and there is nothing to look up
+      if (it->first.size() != 0) {
+        insert_in_context(context, it->first, it->second);
+      }
+    }
+
+    context.close();
+    MUTEX_UNLOCK(&M);
+  }
+
+  /**
+   * Find the source IDs of the repository name, false on no repository
+   * name.
+   */
+  bool find(const std::string& repository_name,
+            std::vector<uint64_t>& source_ids) const {
+
+    source_ids.clear();
+    if (repository_name.size() == 0) {
+      return false;
+    }
+
+    // get context
+    hashdb::lmdb_context_t context(env, false, true);
+    context.open();
+
+    // set key
+    set_key(context, repository_name);
+    context.data.mv_size = 0;
+    context.data.mv_data = NULL;
+
+    // set the cursor to this key
+    int rc = mdb_cursor_get(context.cursor, &context.key, &context.data,
+                            MDB_SET_KEY);
+
+    // note if repository name was found
+    bool repository_name_found = (rc == 0);
+
+    // read source IDs while data available for this key
+    while (rc == 0) {
+      const uint8_t* const p = static_cast<uint8_t*>(context.data.mv_data);
+      uint64_t source_id;
+      const uint8_t* const p_stop = lmdb_helper::decode_uint64_t(p,
+                                                                 source_id);
+
+      // validate that the decoding was properly consumed
+      if (static_cast<size_t>(p_stop - p) != context.data.mv_size) {
+        std::cerr << "data decode error in LMDB repository store\n";
+        assert(0);
+      }
+      source_ids.push_back(source_id);
+
+      rc = mdb_cursor_get(context.cursor, &context.key, &context.data,
+                          MDB_NEXT_DUP);
+    }
+
+    // make sure rc is valid
+    if (rc == MDB_NOTFOUND) {
+      // good, LMDB worked correctly
+      context.close();
+      return repository_name_found;
+
+    } else {
+      // invalid rc
+      std::cerr << "LMDB error: " << mdb_strerror(rc) << "\n";
+      assert(0);
+      return false; // for mingw
+    }
+  }
+
+  // call this from a lock to prevent getting an unstable answer.
+  size_t size() const {
+    return lmdb_helper::size(env);
+  }
+};
+
+} // end namespace hashdb
+
+#endif
+
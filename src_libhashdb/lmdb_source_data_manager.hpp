@@ -89,7 +89,9 @@ class lmdb_source_data_manager_t {
   }
 
   /**
-   * Insert unless there and same.
+   * Insert unless there and same.  With keep_existing, insert only if
+   * not there, for placeholder data that must not replace data that
+   * another thread just inserted.
    */
   void insert(const uint64_t source_id,
               const std::string& file_binary_hash,
@@ -97,7 +99,8 @@ class lmdb_source_data_manager_t {
               const std::string& file_type,
               const uint64_t zero_count,
               const uint64_t nonprobative_count,
-              hashdb::lmdb_changes_t& changes) {
+              hashdb::lmdb_changes_t& changes,
+              const bool keep_existing = false) {
 
     MUTEX_LOCK(&M);
 
@@ -165,7 +168,9 @@ print_mdb_val("source_data_manager insert change from key", context.key);
 print_mdb_val("source_data_manager insert change from data", context.data);
 #endif
       // already there
-      if (context.data.mv_size == (new_data_size) && (std::memcmp(
+      if (keep_existing) {
+        // leave it
+      } else if (context.data.mv_size == (new_data_size) && (std::memcmp(
                   context.data.mv_data, data, context.data.mv_size) == 0)) {
         // size and data same
         ++changes.source_data_same;
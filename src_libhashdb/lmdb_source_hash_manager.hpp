@@ -0,0 +1,263 @@
+// Author:  Bruce Allen
+// Created: 2/25/2013
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on February 25, 2013 by Bruce Allen.
+
+/**
+ * \file
+ * Manage the LMDB source hash store, the reverse index from source ID
+ * to the block hashes of the source.  Threadsafe.
+ *
+ * key=source_id, data=block_hash, with one duplicate record per block
+ * hash.  Duplicates are sorted so block hashes are found in block hash
+ * order.
+ *
+ * This store is optional.  Databases do not have it until it is built
+ * from the hash data store, and it is used only once the settings mark
+ * it complete.
+ *
+ * Inserts made while importing are held in memory and written in
+ * batches, one transaction per batch, when the batch is full, on flush,
+ * and on close.  find does not include held inserts.
+ */
+
+#ifndef LMDB_SOURCE_HASH_MANAGER_HPP
+#define LMDB_SOURCE_HASH_MANAGER_HPP
+
+#include "file_modes.h"
+#include "lmdb.h"
+#include "lmdb_helper.h"
+#include "lmdb_context.hpp"
+#include <vector>
+#include <unistd.h>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <cassert>
+
+// no concurrent writes
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#include "mutex_lock.hpp"
+
+namespace hashdb {
+
+class lmdb_source_hash_manager_t {
+
+  public:
+  typedef std::vector<std::pair<uint64_t, std::string> > source_hashes_t;
+
+  private:
+  // the number of held inserts that are written in one transaction
+  static const size_t max_pending_inserts = 1<<16;
+
+  const std::string hashdb_dir;
+  const hashdb::file_mode_type_t file_mode;
+  MDB_env* env;
+  source_hashes_t pending_inserts;
+#ifdef HAVE_PTHREAD
+  mutable pthread_mutex_t M;                  // mutext
+#else
+  mutable int M;                              // placeholder
+#endif
+
+  // do not allow copy or assignment
+  lmdb_source_hash_manager_t(const lmdb_source_hash_manager_t&);
+  lmdb_source_hash_manager_t& operator=(const lmdb_source_hash_manager_t&);
+
+  // write the source hashes in one transaction, call from a lock
+  void write(const source_hashes_t& source_hashes) {
+    if (source_hashes.size() == 0) {
+      return;
+    }
+
+    // maybe grow the DB for all the records
+    size_t bytes = 0;
+    for (source_hashes_t::const_iterator it = source_hashes.begin();
+                                      it != source_hashes.end(); ++it) {
+      bytes += 10 + it->second.size();
+    }
+    lmdb_helper::maybe_grow(env, source_hashes.size(), bytes);
+
+    // get context
+    hashdb::lmdb_context_t context(env, true, true);
+    context.open();
+
+    uint8_t key[10];
+    for (source_hashes_t::const_iterator it = source_hashes.begin();
+                                      it != source_hashes.end(); ++it) {
+
+      // set key=source_id
+      uint8_t* key_p = key;
+      key_p = lmdb_helper::encode_uint64_t(it->first, key_p);
+      context.key.mv_size = key_p - key;
+      context.key.mv_data = key;
+
+      // set data=block_hash
+      context.data.mv_size = it->second.size();
+      context.data.mv_data =
+                static_cast<void*>(const_cast<char*>(it->second.data()));
+
+      int rc = mdb_put(context.txn, context.dbi,
+                       &context.key, &context.data, MDB_NODUPDATA);
+
+      if (rc != 0 && rc != MDB_KEYEXIST) {
+        // invalid rc
+        std::cerr << "LMDB error: " << mdb_strerror(rc) << "\n";
+        assert(0);
+      }
+    }
+
+    context.close();
+  }
+
+  public:
+  lmdb_source_hash_manager_t(const std::string& p_hashdb_dir,
+                      const hashdb::file_mode_type_t p_file_mode) :
+       hashdb_dir(p_hashdb_dir),
+       file_mode(p_file_mode),
+       env(lmdb_helper::open_env(hashdb_dir + "/lmdb_source_hash_store",
+                                                                file_mode)),
+       pending_inserts(),
+       M() {
+
+    MUTEX_INIT(&M);
+  }
+
+  ~lmdb_source_hash_manager_t() {
+    // write held inserts
+    flush();
+
+    // close the lmdb_source_hash_store DB environment
+    mdb_env_close(env);
+
+    MUTEX_DESTROY(&M);
+  }
+
+  /**
+   * True if the hashdb has a source hash store.
+   */
+  static bool is_present(const std::string& hashdb_dir) {
+    return access((hashdb_dir + "/lmdb_source_hash_store").c_str(),
+                  F_OK) == 0;
+  }
+
+  /**
+   * Insert the block hash for the source ID unless it is already there.
+   * The insert is held and written with the next batch.
+   */
+  void insert(const uint64_t source_id, const std::string& block_hash) {
+
+    if (block_hash.size() == 0) {
+      std::cerr << "Usage error: the block_hash value provided to insert is empty.\n";
+      return;
+    }
+
+    MUTEX_LOCK(&M);
+    pending_inserts.push_back(source_hashes_t::value_type(source_id,
+                                                          block_hash));
+    if (pending_inserts.size() >= max_pending_inserts) {
+      write(pending_inserts);
+      pending_inserts.clear();
+    }
+    MUTEX_UNLOCK(&M);
+  }
+
+  /**
+   * Insert each block hash for its source ID in one transaction unless
+   * it is already there.
+   */
+  void insert(const source_hashes_t& source_hashes) {
+    MUTEX_LOCK(&M);
+    write(source_hashes);
+    MUTEX_UNLOCK(&M);
+  }
+
+  /**
+   * Write held inserts.
+   */
+  void flush() {
+    MUTEX_LOCK(&M);
+    write(pending_inserts);
+    pending_inserts.clear();
+    MUTEX_UNLOCK(&M);
+  }
+
+  /**
+   * Find the block hashes of the source ID in block hash order, false
+   * on no source ID.
+   */
+  bool find(const uint64_t source_id,
+            std::vector<std::string>& block_hashes) const {
+
+    block_hashes.clear();
+
+    // get context
+    hashdb::lmdb_context_t context(env, false, true);
+    context.open();
+
+    // set key
+    uint8_t key[10];
+    uint8_t* key_p = key;
+    key_p = lmdb_helper::encode_uint64_t(source_id, key_p);
+    context.key.mv_size = key_p - key;
+    context.key.mv_data = key;
+    context.data.mv_size = 0;
+    context.data.mv_data = NULL;
+
+    // set the cursor to this key
+    int rc = mdb_cursor_get(context.cursor, &context.key, &context.data,
+                            MDB_SET_KEY);
+
+    // note if source ID was found
+    bool source_id_found = (rc == 0);
+
+    // read block hashes while data available for this key
+    while (rc == 0) {
+      block_hashes.push_back(std::string(
+                   static_cast<char*>(context.data.mv_data),
+                   context.data.mv_size));
+      rc = mdb_cursor_get(context.cursor, &context.key, &context.data,
+                          MDB_NEXT_DUP);
+    }
+
+    // make sure rc is valid
+    if (rc == MDB_NOTFOUND) {
+      // good, LMDB worked correctly
+      context.close();
+      return source_id_found;
+
+    } else {
+      // invalid rc
+      std::cerr << "LMDB error: " << mdb_strerror(rc) << "\n";
+      assert(0);
+      return false; // for mingw
+    }
+  }
+
+  // call this from a lock to prevent getting an unstable answer.
+  size_t size() const {
+    return lmdb_helper::size(env);
+  }
+};
+
+} // end namespace hashdb
+
+#endif
+
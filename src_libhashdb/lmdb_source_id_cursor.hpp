@@ -0,0 +1,150 @@
+// Author:  Bruce Allen
+// Created: 2/25/2013
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on February 25, 2013 by Bruce Allen.
+
+/**
+ * \file
+ * Provides a read cursor for walking lmdb_source_id_store in file hash
+ * order.  The cursor holds one read transaction open for its lifetime,
+ * so moving to the next source is a sequential step instead of a new
+ * transaction and seek.
+ */
+
+#ifndef LMDB_SOURCE_ID_CURSOR_HPP
+#define LMDB_SOURCE_ID_CURSOR_HPP
+
+#include <string>
+#include <iostream>
+#include <cassert>
+#include <stdint.h>
+#include "lmdb.h"
+#include "lmdb_context.hpp"
+#include "lmdb_helper.h"
+#include "lmdb_source_id_manager.hpp"
+
+namespace hashdb {
+
+class lmdb_source_id_cursor_t {
+
+  private:
+  lmdb_context_t context;
+  bool valid;                   // positioned on a source
+  std::string file_hash;        // the current file hash
+
+  // do not allow copy or assignment
+  lmdb_source_id_cursor_t(const lmdb_source_id_cursor_t&);
+  lmdb_source_id_cursor_t& operator=(const lmdb_source_id_cursor_t&);
+
+  // track the cursor position after a move
+  void set_position(const int rc) {
+    if (rc == 0) {
+      valid = true;
+      file_hash.assign(static_cast<char*>(context.key.mv_data),
+                       context.key.mv_size);
+    } else if (rc == MDB_NOTFOUND) {
+      valid = false;
+      file_hash.clear();
+    } else {
+      std::cerr << "LMDB error: " << mdb_strerror(rc) << "\n";
+      assert(0);
+    }
+  }
+
+  public:
+  /**
+   * Open a read cursor on the source ID store and move it to the
+   * first source.
+   */
+  lmdb_source_id_cursor_t(const lmdb_source_id_manager_t& manager) :
+                 context(manager.env, false, false), valid(false),
+                 file_hash() {
+    context.open();
+    set_position(mdb_cursor_get(context.cursor, &context.key,
+                                &context.data, MDB_FIRST));
+  }
+
+  ~lmdb_source_id_cursor_t() {
+    context.close();
+  }
+
+  /**
+   * True when the cursor has moved past the last source.
+   */
+  bool at_end() const {
+    return !valid;
+  }
+
+  /**
+   * The current file hash, "" at end.
+   */
+  const std::string& hash() const {
+    return file_hash;
+  }
+
+  /**
+   * Move to the next source.
+   */
+  void next() {
+    if (!valid) {
+      return;
+    }
+    set_position(mdb_cursor_get(context.cursor, &context.key,
+                                &context.data, MDB_NEXT));
+  }
+
+  /**
+   * Move to the first source whose file hash is not less than the
+   * given file hash.
+   */
+  void seek(const std::string& p_file_hash) {
+    if (p_file_hash.size() == 0) {
+      std::cerr << "Usage error: the file_binary_hash value provided to seek is empty.\n";
+      return;
+    }
+    context.key.mv_size = p_file_hash.size();
+    context.key.mv_data =
+                static_cast<void*>(const_cast<char*>(p_file_hash.data()));
+    set_position(mdb_cursor_get(context.cursor, &context.key,
+                                &context.data, MDB_SET_RANGE));
+  }
+
+  /**
+   * The source ID of the current source, 0 at end.
+   */
+  uint64_t source_id() const {
+    if (!valid) {
+      return 0;
+    }
+    uint64_t id;
+    const uint8_t* p = static_cast<uint8_t*>(context.data.mv_data);
+    p = lmdb_helper::decode_uint64_t(p, id);
+
+    // read must align to data record
+    if (p != static_cast<uint8_t*>(context.data.mv_data) +
+                                              context.data.mv_size) {
+      std::cerr << "data decode error in LMDB source ID store\n";
+      assert(0);
+    }
+    return id;
+  }
+};
+
+} // end namespace hashdb
+
+#endif
+
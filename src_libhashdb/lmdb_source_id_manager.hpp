@@ -67,45 +67,15 @@ class lmdb_source_id_manager_t {
   lmdb_source_id_manager_t(const lmdb_source_id_manager_t&);
   lmdb_source_id_manager_t& operator=(const lmdb_source_id_manager_t&);
 
-  public:
-  lmdb_source_id_manager_t(const std::string& p_hashdb_dir,
-                           const hashdb::file_mode_type_t p_file_mode) :
-       hashdb_dir(p_hashdb_dir),
-       file_mode(p_file_mode),
-       env(lmdb_helper::open_env(hashdb_dir + "/lmdb_source_id_store",
-                                                            file_mode)),
-       M() {
-    MUTEX_INIT(&M);
-  }
-
-  ~lmdb_source_id_manager_t() {
-    // close the lmdb_hash_store DB environment
-    mdb_env_close(env);
-
-    MUTEX_DESTROY(&M);
-  }
-
-  /**
-   * Insert key=file_binary_hash, value=source_id.  Return bool, source_id.
-   * True if new.
-   */
-  bool insert(const std::string& file_binary_hash,
-              hashdb::lmdb_changes_t& changes, uint64_t& source_id) {
-
-    // require valid file_binary_hash
-    if (file_binary_hash.size() == 0) {
-      std::cerr << "Usage error: the file_binary_hash value provided to insert is empty.\n";
-      return false;
-    }
+  // walks the store in file hash order
+  friend class lmdb_source_id_cursor_t;
 
-    MUTEX_LOCK(&M);
-
-    // maybe grow the DB
-    lmdb_helper::maybe_grow(env);
-
-    // get context
-    hashdb::lmdb_context_t context(env, true, false); // writable, no duplicates
-    context.open();
+  // insert in an open write context, return true and the new source_id
+  // if new else false and the existing source_id
+  bool insert_in_context(hashdb::lmdb_context_t& context,
+                         const std::string& file_binary_hash,
+                         hashdb::lmdb_changes_t& changes,
+                         uint64_t& source_id) {
 
     // set key
     context.key.mv_size = file_binary_hash.size();
@@ -133,13 +103,18 @@ print_mdb_val("source_id_manager insert has data", context.data);
       }
 
       ++changes.source_id_already_present;
-      context.close();
-      MUTEX_UNLOCK(&M);
       return false;
 
     } else if (rc == MDB_NOTFOUND) {
-      // generate new source ID as DB size + 1
-      source_id = size() + 1;
+      // generate new source ID as DB size + 1, counting records added
+      // earlier in this transaction
+      MDB_stat stat;
+      rc = mdb_stat(context.txn, context.dbi, &stat);
+      if (rc != 0) {
+        std::cerr << "LMDB error: " << mdb_strerror(rc) << "\n";
+        assert(0);
+      }
+      source_id = stat.ms_entries + 1;
       uint8_t data[10];
       uint8_t* p = data;
       p = lmdb_helper::encode_uint64_t(source_id, p);
@@ -161,8 +136,6 @@ print_mdb_val("source_id_manager insert new data", context.data);
 
       // source ID created
       ++changes.source_id_inserted;
-      context.close();
-      MUTEX_UNLOCK(&M);
       return true;
 
     } else {
@@ -174,10 +147,101 @@ print_mdb_val("source_id_manager insert new data", context.data);
     }
   }
 
+  public:
+  lmdb_source_id_manager_t(const std::string& p_hashdb_dir,
+                           const hashdb::file_mode_type_t p_file_mode) :
+       hashdb_dir(p_hashdb_dir),
+       file_mode(p_file_mode),
+       env(lmdb_helper::open_env(hashdb_dir + "/lmdb_source_id_store",
+                                                            file_mode)),
+       M() {
+    MUTEX_INIT(&M);
+  }
+
+  ~lmdb_source_id_manager_t() {
+    // close the lmdb_hash_store DB environment
+    mdb_env_close(env);
+
+    MUTEX_DESTROY(&M);
+  }
+
+  /**
+   * Insert key=file_binary_hash, value=source_id.  Return bool, source_id.
+   * True if new.
+   */
+  bool insert(const std::string& file_binary_hash,
+              hashdb::lmdb_changes_t& changes, uint64_t& source_id) {
+
+    // require valid file_binary_hash
+    if (file_binary_hash.size() == 0) {
+      std::cerr << "Usage error: the file_binary_hash value provided to insert is empty.\n";
+      return false;
+    }
+
+    MUTEX_LOCK(&M);
+
+    // maybe grow the DB
+    lmdb_helper::maybe_grow(env);
+
+    // get context
+    hashdb::lmdb_context_t context(env, true, false); // writable, no duplicates
+    context.open();
+
+    const bool is_new = insert_in_context(context, file_binary_hash,
+                                          changes, source_id);
+
+    context.close();
+    MUTEX_UNLOCK(&M);
+    return is_new;
+  }
+
+  /**
+   * Insert each file_binary_hash in one transaction.  Return the source_id
+   * of each and whether it is new.  A file_binary_hash repeated in the list
+   * is new only the first time.
+   */
+  void insert(const std::vector<std::string>& file_binary_hashes,
+              hashdb::lmdb_changes_t& changes,
+              std::vector<uint64_t>& source_ids,
+              std::vector<bool>& is_new_ids) {
+
+    source_ids.assign(file_binary_hashes.size(), 0);
+    is_new_ids.assign(file_binary_hashes.size(), false);
+
+    // require valid file_binary_hash values
+    for (std::vector<std::string>::const_iterator it =
+         file_binary_hashes.begin(); it != file_binary_hashes.end(); ++it) {
+      if (it->size() == 0) {
+        std::cerr << "Usage error: the file_binary_hash value provided to insert is empty.\n";
+        return;
+      }
+    }
+
+    MUTEX_LOCK(&M);
+
+    // maybe grow the DB for all the records
+    lmdb_helper::maybe_grow(env, file_binary_hashes.size(),
+                            file_binary_hashes.size() * 32);
+
+    // get context
+    hashdb::lmdb_context_t context(env, true, false); // writable, no duplicates
+    context.open();
+
+    for (size_t i=0; i<file_binary_hashes.size(); ++i) {
+      is_new_ids[i] = insert_in_context(context, file_binary_hashes[i],
+                                        changes, source_ids[i]);
+    }
+
+    context.close();
+    MUTEX_UNLOCK(&M);
+  }
+
   /**
-   * Find source ID else false and 0.
+   * Find source ID else false and 0.  file_binary_hash is a std::string
+   * or hash_key_t.
    */
-  bool find(const std::string& file_binary_hash, uint64_t& source_id) const {
+  template <typename K>
+  bool find(const K& file_binary_hash, uint64_t& source_id) const {
 
     // require valid file_binary_hash
     if (file_binary_hash.size() == 0) {
@@ -192,7 +256,7 @@ print_mdb_val("source_id_manager insert new data", context.data);
     // set key
     context.key.mv_size = file_binary_hash.size();
     context.key.mv_data =
-            static_cast<void*>(const_cast<char*>(file_binary_hash.c_str()));
+            static_cast<void*>(const_cast<char*>(file_binary_hash.data()));
 
     // set the cursor to this key
     int rc = mdb_cursor_get(context.cursor, &context.key, &context.data,
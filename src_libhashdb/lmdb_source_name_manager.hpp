@@ -69,41 +69,12 @@ class lmdb_source_name_manager_t {
   lmdb_source_name_manager_t(const lmdb_source_name_manager_t&);
   lmdb_source_name_manager_t& operator=(const lmdb_source_name_manager_t&);
 
-  public:
-  lmdb_source_name_manager_t(const std::string& p_hashdb_dir,
-                      const hashdb::file_mode_type_t p_file_mode) :
-       hashdb_dir(p_hashdb_dir),
-       file_mode(p_file_mode),
-       env(lmdb_helper::open_env(hashdb_dir + "/lmdb_source_name_store",
-                                                                file_mode)),
-       M() {
-
-    MUTEX_INIT(&M);
-  }
-
-  ~lmdb_source_name_manager_t() {
-    // close the lmdb_hash_store DB environment
-    mdb_env_close(env);
-
-    MUTEX_DESTROY(&M);
-  }
-
-  /**
-   * Insert repository_name, filename pair unless pair is already there.
-   */
-  void insert(const uint64_t source_id,
-              const std::string& repository_name,
-              const std::string& filename,
-              hashdb::lmdb_changes_t& changes) {
-
-    MUTEX_LOCK(&M);
-
-    // maybe grow the DB
-    lmdb_helper::maybe_grow(env);
-
-    // get context
-    hashdb::lmdb_context_t context(env, true, true);
-    context.open();
+  // insert in an open write context
+  void insert_in_context(hashdb::lmdb_context_t& context,
+                         const uint64_t source_id,
+                         const std::string& repository_name,
+                         const std::string& filename,
+                         hashdb::lmdb_changes_t& changes) {
 
     // set key=source_id
     uint8_t key[10];
@@ -137,16 +108,10 @@ print_mdb_val("source_name_manager insert new data", context.data);
     if (rc == 0) {
       // the new name pair went in
       ++changes.source_name_inserted;
-      context.close();
-      MUTEX_UNLOCK(&M);
-      return;
 
     } else if (rc == MDB_KEYEXIST) {
       // the name pair was already there
       ++changes.source_name_already_present;
-      context.close();
-      MUTEX_UNLOCK(&M);
-      return;
 
     } else {
       // invalid rc
@@ -155,6 +120,86 @@ print_mdb_val("source_name_manager insert new data", context.data);
     }
   }
 
+  public:
+  lmdb_source_name_manager_t(const std::string& p_hashdb_dir,
+                      const hashdb::file_mode_type_t p_file_mode) :
+       hashdb_dir(p_hashdb_dir),
+       file_mode(p_file_mode),
+       env(lmdb_helper::open_env(hashdb_dir + "/lmdb_source_name_store",
+                                                                file_mode)),
+       M() {
+
+    MUTEX_INIT(&M);
+  }
+
+  ~lmdb_source_name_manager_t() {
+    // close the lmdb_hash_store DB environment
+    mdb_env_close(env);
+
+    MUTEX_DESTROY(&M);
+  }
+
+  /**
+   * Insert repository_name, filename pair unless pair is already there.
+   */
+  void insert(const uint64_t source_id,
+              const std::string& repository_name,
+              const std::string& filename,
+              hashdb::lmdb_changes_t& changes) {
+
+    MUTEX_LOCK(&M);
+
+    // maybe grow the DB
+    lmdb_helper::maybe_grow(env);
+
+    // get context
+    hashdb::lmdb_context_t context(env, true, true);
+    context.open();
+
+    insert_in_context(context, source_id, repository_name, filename,
+                      changes);
+
+    context.close();
+    MUTEX_UNLOCK(&M);
+  }
+
+  /**
+   * Insert the repository_name, filename pair of each source ID in one
+   * transaction unless the pair is already there.
+   */
+  void insert(const std::vector<uint64_t>& source_ids,
+              const std::string& repository_name,
+              const std::vector<std::string>& filenames,
+              hashdb::lmdb_changes_t& changes) {
+
+    if (source_ids.size() != filenames.size()) {
+      // program error
+      assert(0);
+    }
+    size_t bytes = 0;
+    for (std::vector<std::string>::const_iterator it = filenames.begin();
+                                             it != filenames.end(); ++it) {
+      bytes += repository_name.size() + it->size() + 20;
+    }
+
+    MUTEX_LOCK(&M);
+
+    // maybe grow the DB for all the records
+    lmdb_helper::maybe_grow(env, source_ids.size(), bytes);
+
+    // get context
+    hashdb::lmdb_context_t context(env, true, true);
+    context.open();
+
+    for (size_t i=0; i<source_ids.size(); ++i) {
+      insert_in_context(context, source_ids[i], repository_name,
+                        filenames[i], changes);
+    }
+
+    context.close();
+    MUTEX_UNLOCK(&M);
+  }
+
   /**
    * Find source names, false on no source ID.
    */
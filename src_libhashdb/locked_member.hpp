@@ -20,6 +20,16 @@
 /**
  * \file
  * Provide a threadsafe interface for checking membership.
+ *
+ * Members are spread across shards by hash so that concurrent scan
+ * threads rarely contend for the same lock.  Each shard is an
+ * open-addressed table of fixed-size binary keys.  Keys longer than
+ * the fixed key size are kept in a small per-shard overflow set.
+ * Members may be given as std::string or hash_key_t values.
+ *
+ * If max_members is nonzero, each shard holds at most its share of
+ * max_members and evicts members using the CLOCK policy.  An evicted
+ * member will be reported as new again if it is inserted again.
  */
 
 #ifndef LOCKED_MEMBER_HPP
@@ -27,47 +37,326 @@
 
 #include <string>
 #include <set>
+#include <vector>
+#include <cstring>
+#include <stdint.h>
 
 // no concurrent writes
 #ifdef HAVE_PTHREAD
 #include <pthread.h>
 #endif
 #include "mutex_lock.hpp"
+#include "hashdb.hpp"
 
 namespace hashdb {
 
 class locked_member_t {
 
   private:
-  typedef std::set<std::string> set_t;
-  set_t member;
+  static const size_t num_shards = 64;       // power of 2
+  static const size_t max_key_size = 32;     // sized for up to SHA-256
+  static const size_t initial_slots = 64;    // power of 2, per shard
 
+  // fixed-size table slot
+  struct slot_t {
+    uint32_t hash;
+    uint8_t occupied;
+    uint8_t referenced;
+    uint8_t key_size;
+    uint8_t key[max_key_size];
+    slot_t() : hash(0), occupied(0), referenced(0), key_size(0), key() {
+    }
+  };
+
+  struct shard_t {
+#ifdef HAVE_PTHREAD
+    pthread_mutex_t M;                        // mutext
+#else
+    int M;                                    // placeholder
+#endif
+    std::vector<slot_t> slots;
+    size_t count;                             // occupied slots
+    size_t hand;                              // CLOCK hand
+    std::set<std::string> overflow;           // keys > max_key_size
+    shard_t() : M(), slots(initial_slots), count(0), hand(0), overflow() {
+    }
+  };
+
+  const size_t max_shard_members;             // 0 means no limit
+  shard_t* shards;
+
+  // statistics
 #ifdef HAVE_PTHREAD
-  mutable pthread_mutex_t M;                  // mutext
+  mutable pthread_mutex_t stats_M;            // mutext
 #else
-  mutable int M;                              // placeholder
+  mutable int stats_M;                        // placeholder
 #endif
+  size_t eviction_count;
 
   // do not allow copy or assignment
   locked_member_t(const locked_member_t&);
   locked_member_t& operator=(const locked_member_t&);
 
+  // FNV-1a
+  static uint32_t calculate_hash(const char* const item,
+                                 const size_t item_size) {
+    uint32_t h = 2166136261u;
+    for (size_t i=0; i<item_size; ++i) {
+      h ^= static_cast<uint8_t>(item[i]);
+      h *= 16777619u;
+    }
+    return h;
+  }
+
+  static bool slot_matches(const slot_t& slot, const uint32_t hash,
+                           const char* const item, const size_t item_size) {
+    return slot.hash == hash &&
+           slot.key_size == item_size &&
+           std::memcmp(slot.key, item, item_size) == 0;
+  }
+
+  // place a slot known not to be present into a table with room
+  static void place(std::vector<slot_t>& slots, const slot_t& slot) {
+    const size_t mask = slots.size() - 1;
+    size_t i = slot.hash & mask;
+    while (slots[i].occupied) {
+      i = (i + 1) & mask;
+    }
+    slots[i] = slot;
+  }
+
+  // double the table size
+  static void grow(shard_t& shard) {
+    std::vector<slot_t> old_slots(shard.slots.size() * 2);
+    old_slots.swap(shard.slots);
+    for (size_t i=0; i<old_slots.size(); ++i) {
+      if (old_slots[i].occupied) {
+        place(shard.slots, old_slots[i]);
+      }
+    }
+    shard.hand = 0;
+  }
+
+  // remove the slot at position i using backward-shift deletion
+  static void erase_at(shard_t& shard, size_t i) {
+    std::vector<slot_t>& slots = shard.slots;
+    const size_t mask = slots.size() - 1;
+    slots[i].occupied = 0;
+    size_t j = i;
+    while (true) {
+      j = (j + 1) & mask;
+      if (!slots[j].occupied) {
+        break;
+      }
+      // move slot j back to i if its home is not cyclically in (i, j]
+      const size_t home = slots[j].hash & mask;
+      const bool in_range = (i <= j) ? (i < home && home <= j)
+                                     : (i < home || home <= j);
+      if (!in_range) {
+        slots[i] = slots[j];
+        slots[j].occupied = 0;
+        i = j;
+      }
+    }
+    --shard.count;
+  }
+
+  // evict one member using the CLOCK policy
+  void evict(shard_t& shard) {
+    const size_t mask = shard.slots.size() - 1;
+    while (true) {
+      slot_t& slot = shard.slots[shard.hand];
+      if (slot.occupied) {
+        if (slot.referenced) {
+          // second chance
+          slot.referenced = 0;
+        } else {
+          erase_at(shard, shard.hand);
+          break;
+        }
+      }
+      shard.hand = (shard.hand + 1) & mask;
+    }
+
+    count_eviction();
+  }
+
+  void count_eviction() {
+    MUTEX_LOCK(&stats_M);
+    ++eviction_count;
+    MUTEX_UNLOCK(&stats_M);
+  }
+
+  // insert into the overflow set of shard, shard must be locked
+  bool insert_overflow(shard_t& shard, const std::string& item) {
+    if (shard.overflow.find(item) != shard.overflow.end()) {
+      // already a member
+      return false;
+    }
+
+    // make room, evicting the first member
+    if (max_shard_members != 0 &&
+                    shard.overflow.size() >= max_shard_members) {
+      shard.overflow.erase(shard.overflow.begin());
+      count_eviction();
+    }
+    shard.overflow.insert(item);
+    return true;
+  }
+
+  // insert into shard, shard must be locked
+  bool insert_slot(shard_t& shard, const uint32_t hash,
+                   const char* const item, const size_t item_size) {
+
+    // find item or its empty slot
+    size_t mask = shard.slots.size() - 1;
+    size_t i = hash & mask;
+    while (shard.slots[i].occupied) {
+      if (slot_matches(shard.slots[i], hash, item, item_size)) {
+        // already a member
+        shard.slots[i].referenced = 1;
+        return false;
+      }
+      i = (i + 1) & mask;
+    }
+
+    // make room
+    if (max_shard_members != 0 && shard.count >= max_shard_members) {
+      evict(shard);
+    }
+    if ((shard.count + 1) * 4 > shard.slots.size() * 3) {
+      grow(shard);
+    }
+
+    // add item
+    slot_t slot;
+    slot.hash = hash;
+    slot.occupied = 1;
+    slot.referenced = 0;
+    slot.key_size = static_cast<uint8_t>(item_size);
+    std::memcpy(slot.key, item, item_size);
+    place(shard.slots, slot);
+    ++shard.count;
+    return true;
+  }
+
+  // return true if new else false
+  bool insert(const char* const item, const size_t item_size) {
+    const uint32_t hash = calculate_hash(item, item_size);
+    shard_t& shard = shards[(hash >> 26) & (num_shards - 1)];
+    MUTEX_LOCK(&shard.M);
+    bool did_insert;
+    if (item_size <= max_key_size) {
+      did_insert = insert_slot(shard, hash, item, item_size);
+    } else {
+      did_insert = insert_overflow(shard, std::string(item, item_size));
+    }
+    MUTEX_UNLOCK(&shard.M);
+    return did_insert;
+  }
+
+  // return true if a member
+  bool contains(const char* const item, const size_t item_size) const {
+    const uint32_t hash = calculate_hash(item, item_size);
+    shard_t& shard = shards[(hash >> 26) & (num_shards - 1)];
+    MUTEX_LOCK(&shard.M);
+    bool found = false;
+    if (item_size <= max_key_size) {
+      const size_t mask = shard.slots.size() - 1;
+      size_t i = hash & mask;
+      while (shard.slots[i].occupied) {
+        if (slot_matches(shard.slots[i], hash, item, item_size)) {
+          shard.slots[i].referenced = 1;
+          found = true;
+          break;
+        }
+        i = (i + 1) & mask;
+      }
+    } else {
+      found = (shard.overflow.find(std::string(item, item_size)) !=
+                                                   shard.overflow.end());
+    }
+    MUTEX_UNLOCK(&shard.M);
+    return found;
+  }
+
   public:
-  locked_member_t() : member(), M() {
-    MUTEX_INIT(&M);
+  /**
+   * Create an empty member set.  If max_members is nonzero, members
+   * are evicted to keep the set within this size.
+   */
+  locked_member_t(const size_t max_members = 0) :
+                max_shard_members((max_members == 0) ? 0 :
+                     (max_members + num_shards - 1) / num_shards),
+                shards(new shard_t[num_shards]),
+                stats_M(),
+                eviction_count(0) {
+    for (size_t i=0; i<num_shards; ++i) {
+      MUTEX_INIT(&shards[i].M);
+    }
+    MUTEX_INIT(&stats_M);
   }
 
   ~locked_member_t() {
-    MUTEX_DESTROY(&M);
+    for (size_t i=0; i<num_shards; ++i) {
+      MUTEX_DESTROY(&shards[i].M);
+    }
+    MUTEX_DESTROY(&stats_M);
+    delete[] shards;
   }
 
   // return true if new else false
   bool locked_insert(const std::string& item) {
-    MUTEX_LOCK(&M);
-    std::pair<set_t::const_iterator, bool> pair = member.insert(item);
-    bool did_insert = pair.second;
-    MUTEX_UNLOCK(&M);
-    return did_insert;
+    return insert(item.data(), item.size());
+  }
+
+  bool locked_insert(const hash_key_t& item) {
+    return insert(item.data(), item.size());
+  }
+
+  // return true if a member
+  bool locked_contains(const std::string& item) const {
+    return contains(item.data(), item.size());
+  }
+
+  bool locked_contains(const hash_key_t& item) const {
+    return contains(item.data(), item.size());
+  }
+
+  // number of members
+  size_t size() const {
+    size_t total = 0;
+    for (size_t i=0; i<num_shards; ++i) {
+      MUTEX_LOCK(&shards[i].M);
+      total += shards[i].count + shards[i].overflow.size();
+      MUTEX_UNLOCK(&shards[i].M);
+    }
+    return total;
+  }
+
+  // number of members evicted to stay within max_members
+  size_t evictions() const {
+    MUTEX_LOCK(&stats_M);
+    const size_t count = eviction_count;
+    MUTEX_UNLOCK(&stats_M);
+    return count;
+  }
+
+  // approximate bytes of memory used, including per-node overhead
+  // estimates for overflow members
+  size_t memory_usage() const {
+    size_t total = sizeof(locked_member_t) + num_shards * sizeof(shard_t);
+    for (size_t i=0; i<num_shards; ++i) {
+      MUTEX_LOCK(&shards[i].M);
+      total += shards[i].slots.capacity() * sizeof(slot_t);
+      for (std::set<std::string>::const_iterator it =
+                     shards[i].overflow.begin();
+                     it != shards[i].overflow.end(); ++it) {
+        total += 64 + it->capacity();
+      }
+      MUTEX_UNLOCK(&shards[i].M);
+    }
+    return total;
   }
 };
 
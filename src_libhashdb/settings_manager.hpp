@@ -40,9 +40,9 @@
 
 namespace hashdb {
 
-  // return error message or ""
-  std::string read_settings(const std::string& hashdb_dir,
-                            hashdb::settings_t& settings) {
+  // return error message or "", accept any settings version
+  std::string read_any_settings(const std::string& hashdb_dir,
+                                hashdb::settings_t& settings) {
 
     // path must exist
     if (access(hashdb_dir.c_str(), F_OK) != 0) {
@@ -95,12 +95,35 @@ namespace hashdb {
       settings.settings_version = document["settings_version"].GetUint64();
       settings.block_size = document["block_size"].GetUint64();
 
+      // the source indexes are complete only if marked so
+      settings.source_index = document.HasMember("source_index")
+                              && document["source_index"].IsBool()
+                              && document["source_index"].GetBool();
+
     } else {
       return "Missing JSON settings in settings file at path '"
              + filename + "'.";
     }
 
+    // accept the read
+    return "";
+  }
+
+  // return error message or ""
+  std::string read_settings(const std::string& hashdb_dir,
+                            hashdb::settings_t& settings) {
+
+    std::string error_message = read_any_settings(hashdb_dir, settings);
+    if (error_message.size() != 0) {
+      return error_message;
+    }
+
     // settings version must be compatible
+    if (settings.settings_version ==
+                       hashdb::settings_t::UPGRADABLE_SETTINGS_VERSION) {
+      return "The hashdb at path '" + hashdb_dir
+             + "' is from an earlier version of hashdb and must be upgraded.";
+    }
     if (settings.settings_version <
                              hashdb::settings_t::CURRENT_SETTINGS_VERSION) {
       return "The hashdb at path '" + hashdb_dir + "' is not compatible.";
@@ -0,0 +1,252 @@
+// Author:  Bruce Allen
+// Created: 2/25/2013
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on February 25, 2013 by Bruce Allen.
+
+/**
+ * \file
+ * Provide a threadsafe cache of decoded source data records keyed by
+ * source ID, and of source IDs keyed by file hash.  Used by the scan
+ * manager, where the underlying data store is read-only.
+ *
+ * Entries are spread across locked shards.  When a shard is full, an
+ * entry next to the newly inserted entry is evicted.  A max_entries
+ * value of zero disables caching.
+ */
+
+#ifndef SOURCE_DATA_CACHE_HPP
+#define SOURCE_DATA_CACHE_HPP
+
+#include <string>
+#include <map>
+#include <stdint.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#include "mutex_lock.hpp"
+
+namespace hashdb {
+
+class source_data_cache_t {
+
+  public:
+  // decoded source data record
+  struct source_data_t {
+    std::string file_hash;
+    uint64_t filesize;
+    std::string file_type;
+    uint64_t zero_count;
+    uint64_t nonprobative_count;
+    source_data_t() : file_hash(), filesize(0), file_type(),
+                      zero_count(0), nonprobative_count(0) {
+    }
+  };
+
+  private:
+  static const size_t num_shards = 64;        // power of 2
+
+  typedef std::map<uint64_t, source_data_t> records_t;
+  typedef std::map<std::string, uint64_t> source_ids_t;
+
+  struct shard_t {
+#ifdef HAVE_PTHREAD
+    pthread_mutex_t M;                        // mutext
+#else
+    int M;                                    // placeholder
+#endif
+    records_t records;
+    source_ids_t source_ids;
+    uint64_t hits;
+    uint64_t misses;
+    shard_t() : M(), records(), source_ids(), hits(0), misses(0) {
+    }
+  };
+
+  const size_t max_entries;
+  const size_t max_shard_entries;
+  shard_t* shards;
+
+  // do not allow copy or assignment
+  source_data_cache_t(const source_data_cache_t&);
+  source_data_cache_t& operator=(const source_data_cache_t&);
+
+  shard_t& shard_for(const uint64_t source_id) const {
+    return shards[(source_id * 0x9E3779B97F4A7C15ULL) >> 58];
+  }
+
+  shard_t& shard_for(const std::string& file_hash) const {
+    uint32_t h = 2166136261u;
+    for (size_t i=0; i<file_hash.size(); ++i) {
+      h ^= static_cast<uint8_t>(file_hash[i]);
+      h *= 16777619u;
+    }
+    return shards[h & (num_shards - 1)];
+  }
+
+  // keep map within max_shard_entries by evicting a neighbor of it
+  template <typename T>
+  static void make_room(T& map, typename T::iterator it,
+                        const size_t max_size) {
+    if (map.size() <= max_size) {
+      return;
+    }
+    typename T::iterator victim = it;
+    ++victim;
+    if (victim == map.end()) {
+      victim = map.begin();
+    }
+    map.erase(victim);
+  }
+
+  public:
+  source_data_cache_t(const size_t p_max_entries) :
+                max_entries(p_max_entries),
+                max_shard_entries((p_max_entries + num_shards - 1) /
+                                  num_shards),
+                shards(new shard_t[num_shards]) {
+    for (size_t i=0; i<num_shards; ++i) {
+      MUTEX_INIT(&shards[i].M);
+    }
+  }
+
+  ~source_data_cache_t() {
+    for (size_t i=0; i<num_shards; ++i) {
+      MUTEX_DESTROY(&shards[i].M);
+    }
+    delete[] shards;
+  }
+
+  // find source data record, false if not cached
+  bool find(const uint64_t source_id, source_data_t& source_data) const {
+    if (max_entries == 0) {
+      return false;
+    }
+    shard_t& shard = shard_for(source_id);
+    MUTEX_LOCK(&shard.M);
+    records_t::const_iterator it = shard.records.find(source_id);
+    const bool found = (it != shard.records.end());
+    if (found) {
+      source_data = it->second;
+      ++shard.hits;
+    } else {
+      ++shard.misses;
+    }
+    MUTEX_UNLOCK(&shard.M);
+    return found;
+  }
+
+  // find only the file hash of a source data record, false if not cached
+  bool find_file_hash(const uint64_t source_id,
+                      std::string& file_hash) const {
+    if (max_entries == 0) {
+      return false;
+    }
+    shard_t& shard = shard_for(source_id);
+    MUTEX_LOCK(&shard.M);
+    records_t::const_iterator it = shard.records.find(source_id);
+    const bool found = (it != shard.records.end());
+    if (found) {
+      file_hash.assign(it->second.file_hash);
+      ++shard.hits;
+    } else {
+      ++shard.misses;
+    }
+    MUTEX_UNLOCK(&shard.M);
+    return found;
+  }
+
+  // cache source data record
+  void insert(const uint64_t source_id, const source_data_t& source_data) {
+    if (max_entries == 0) {
+      return;
+    }
+    shard_t& shard = shard_for(source_id);
+    MUTEX_LOCK(&shard.M);
+    std::pair<records_t::iterator, bool> pair = shard.records.insert(
+                  std::pair<uint64_t, source_data_t>(source_id, source_data));
+    make_room(shard.records, pair.first, max_shard_entries);
+    MUTEX_UNLOCK(&shard.M);
+  }
+
+  // find source ID, false if not cached
+  bool find_source_id(const std::string& file_hash,
+                      uint64_t& source_id) const {
+    if (max_entries == 0) {
+      return false;
+    }
+    shard_t& shard = shard_for(file_hash);
+    MUTEX_LOCK(&shard.M);
+    source_ids_t::const_iterator it = shard.source_ids.find(file_hash);
+    const bool found = (it != shard.source_ids.end());
+    if (found) {
+      source_id = it->second;
+      ++shard.hits;
+    } else {
+      ++shard.misses;
+    }
+    MUTEX_UNLOCK(&shard.M);
+    return found;
+  }
+
+  // cache source ID
+  void insert_source_id(const std::string& file_hash,
+                        const uint64_t source_id) {
+    if (max_entries == 0) {
+      return;
+    }
+    shard_t& shard = shard_for(file_hash);
+    MUTEX_LOCK(&shard.M);
+    std::pair<source_ids_t::iterator, bool> pair = shard.source_ids.insert(
+                  std::pair<std::string, uint64_t>(file_hash, source_id));
+    make_room(shard.source_ids, pair.first, max_shard_entries);
+    MUTEX_UNLOCK(&shard.M);
+  }
+
+  // configured maximum number of entries of each kind
+  size_t capacity() const {
+    return max_entries;
+  }
+
+  // number of cached source data records and source IDs
+  size_t size() const {
+    size_t total = 0;
+    for (size_t i=0; i<num_shards; ++i) {
+      MUTEX_LOCK(&shards[i].M);
+      total += shards[i].records.size() + shards[i].source_ids.size();
+      MUTEX_UNLOCK(&shards[i].M);
+    }
+    return total;
+  }
+
+  // lookup statistics
+  void stats(uint64_t& hits, uint64_t& misses) const {
+    hits = 0;
+    misses = 0;
+    for (size_t i=0; i<num_shards; ++i) {
+      MUTEX_LOCK(&shards[i].M);
+      hits += shards[i].hits;
+      misses += shards[i].misses;
+      MUTEX_UNLOCK(&shards[i].M);
+    }
+  }
+};
+
+} // end namespace hashdb
+
+#endif
+
@@ -61,6 +61,10 @@ void make_dir_if_not_there(const std::string& temp_dir) {
 }
 
 void rm_hashdb_dir(const std::string& hashdb_dir) {
+  remove((hashdb_dir + "/lmdb_file_hash_cache_store/data.mdb").c_str());
+  remove((hashdb_dir + "/lmdb_file_hash_cache_store/lock.mdb").c_str());
+  rmdir((hashdb_dir + "/lmdb_file_hash_cache_store").c_str());
+
   remove((hashdb_dir + "/lmdb_hash_data_store/data.mdb").c_str());
   remove((hashdb_dir + "/lmdb_hash_data_store/lock.mdb").c_str());
   rmdir((hashdb_dir + "/lmdb_hash_data_store").c_str());
@@ -69,10 +73,18 @@ void rm_hashdb_dir(const std::string& hashdb_dir) {
   remove((hashdb_dir + "/lmdb_hash_store/lock.mdb").c_str());
   rmdir((hashdb_dir + "/lmdb_hash_store").c_str());
 
+  remove((hashdb_dir + "/lmdb_repository_store/data.mdb").c_str());
+  remove((hashdb_dir + "/lmdb_repository_store/lock.mdb").c_str());
+  rmdir((hashdb_dir + "/lmdb_repository_store").c_str());
+
   remove((hashdb_dir + "/lmdb_source_data_store/data.mdb").c_str());
   remove((hashdb_dir + "/lmdb_source_data_store/lock.mdb").c_str());
   rmdir((hashdb_dir + "/lmdb_source_data_store").c_str());
 
+  remove((hashdb_dir + "/lmdb_source_hash_store/data.mdb").c_str());
+  remove((hashdb_dir + "/lmdb_source_hash_store/lock.mdb").c_str());
+  rmdir((hashdb_dir + "/lmdb_source_hash_store").c_str());
+
   remove((hashdb_dir + "/lmdb_source_id_store/data.mdb").c_str());
   remove((hashdb_dir + "/lmdb_source_id_store/lock.mdb").c_str());
   rmdir((hashdb_dir + "/lmdb_source_id_store").c_str());
@@ -0,0 +1,157 @@
+// Author:  Bruce Allen
+// Created: 2/25/2013
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on February 25, 2013 by Bruce Allen.
+
+/**
+ * \file
+ * Test that the directory walker provides files in walk order for any
+ * number of threads, using the first path in walk order to a file that
+ * has several.
+ */
+
+#include <config.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <stdint.h>
+#include <ftw.h>
+#include <unistd.h>
+#include "unit_test.h"
+#include "../src_libhashdb/hasher/directory_walker.hpp"
+#include "directory_helper.hpp"
+
+static const std::string temp_dir = "temp_dir_directory_walker_test";
+
+// remove a file or empty directory for nftw
+static int remove_path(const char* filename, const struct stat* st,
+                       int typeflag, struct FTW* ftw) {
+  return remove(filename);
+}
+
+// make a file of the given size
+void make_file(const std::string& filename, const size_t size) {
+  std::ofstream out(filename.c_str(), std::ios::binary);
+  out << std::string(size, 'x');
+}
+
+// Make a tree with nested directories, a wide directory, hard links
+// and a symbolic link to a parent directory.  Return the files in walk
+// order and their total size.
+void make_tree(std::vector<std::string>& expected, uint64_t& total_size) {
+  nftw(temp_dir.c_str(), remove_path, 16, FTW_DEPTH | FTW_PHYS);
+  expected.clear();
+  total_size = 0;
+
+  make_dir_if_not_there(temp_dir);
+  make_dir_if_not_there(temp_dir + "/a");
+  make_dir_if_not_there(temp_dir + "/a/c");
+  make_dir_if_not_there(temp_dir + "/a/c/d");
+  make_dir_if_not_there(temp_dir + "/b");
+  make_dir_if_not_there(temp_dir + "/wide");
+
+  // hard link "0link" sorts first so it is used instead of "b/f2"
+  make_file(temp_dir + "/b/f2", 2);
+  TEST_EQ(link((temp_dir + "/b/f2").c_str(),
+               (temp_dir + "/0link").c_str()), 0);
+  expected.push_back(temp_dir + "/0link");
+  total_size += 2;
+
+  make_file(temp_dir + "/a/c/d/f1", 1);
+  expected.push_back(temp_dir + "/a/c/d/f1");
+  total_size += 1;
+
+  // a loop back to "a" is not walked
+  TEST_EQ(symlink("..", (temp_dir + "/a/c/loop").c_str()), 0);
+
+  make_file(temp_dir + "/a/c/x", 3);
+  expected.push_back(temp_dir + "/a/c/x");
+  total_size += 3;
+
+  make_file(temp_dir + "/a/z", 4);
+  expected.push_back(temp_dir + "/a/z");
+  total_size += 4;
+
+  // "a-b" sorts after directory "a" in its directory
+  make_file(temp_dir + "/a-b", 5);
+  expected.push_back(temp_dir + "/a-b");
+  total_size += 5;
+
+  // "b/link_to_z" is a path to "a/z", which is first
+  TEST_EQ(link((temp_dir + "/a/z").c_str(),
+               (temp_dir + "/b/link_to_z").c_str()), 0);
+
+  // many directories for the threads to read
+  for (size_t i=0; i<100; ++i) {
+    std::stringstream ss;
+    ss << temp_dir << "/wide/" << 100 + i;
+    make_dir_if_not_there(ss.str());
+    for (size_t j=0; j<5; ++j) {
+      std::stringstream ss2;
+      ss2 << ss.str() << "/" << j;
+      make_file(ss2.str(), j);
+      expected.push_back(ss2.str());
+      total_size += j;
+    }
+  }
+}
+
+// walk and compare
+void test_walk(const std::vector<std::string>& expected,
+               const uint64_t total_size, const int num_threads) {
+  hasher::directory_walker_t walker(temp_dir, num_threads);
+  std::vector<std::string> walked;
+  hasher::found_file_t found_file;
+  while (walker.pop(found_file)) {
+    walked.push_back(found_file.filename);
+  }
+  TEST_EQ(walked.size(), expected.size());
+  const bool is_in_order = (walked == expected);
+  TEST_EQ(is_in_order, true);
+  TEST_EQ(walker.bytes_found(), total_size);
+}
+
+// a single file is provided as is
+void test_single_file() {
+  const std::string filename = temp_dir + "/a/z";
+  hasher::directory_walker_t walker(filename, 4);
+  hasher::found_file_t found_file;
+  TEST_EQ(walker.pop(found_file), true);
+  TEST_EQ(found_file.filename, filename);
+  TEST_EQ(found_file.filesize, 4);
+  TEST_EQ(walker.pop(found_file), false);
+}
+
+int main(int argc, char* argv[]) {
+  std::vector<std::string> expected;
+  uint64_t total_size;
+  make_tree(expected, total_size);
+  for (int i=0; i<10; ++i) {
+    test_walk(expected, total_size, 1);
+    test_walk(expected, total_size, 4);
+    test_walk(expected, total_size, 16);
+  }
+  test_single_file();
+  nftw(temp_dir.c_str(), remove_path, 16, FTW_DEPTH | FTW_PHYS);
+
+  // done
+  std::cout << "directory_walker_test Done.\n";
+  return 0;
+}
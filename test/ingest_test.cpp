@@ -0,0 +1,157 @@
+// Author:  Bruce Allen
+// Created: 2/25/2013
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on February 25, 2013 by Bruce Allen.
+
+/**
+ * \file
+ * Test that ingest gives source IDs in walk order of a nested tree for
+ * any number of readers.
+ */
+
+#include <config.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdio>
+#include <stdint.h>
+#include <ftw.h>
+#include "unit_test.h"
+#include "../src_libhashdb/hashdb.hpp"
+#include "lmdb_source_id_manager.hpp"
+#include "directory_helper.hpp"
+
+static const std::string temp_dir = "temp_dir_ingest_test";
+static const std::string hashdb_dir = "temp_dir_ingest_test.hdb";
+static const std::string repository_name = "ingest_test";
+
+// remove a file or empty directory for nftw
+static int remove_path(const char* filename, const struct stat* st,
+                       int typeflag, struct FTW* ftw) {
+  return remove(filename);
+}
+
+// make a file of pseudorandom bytes that differ for each seed
+void make_file(const std::string& filename, const size_t size,
+               const uint64_t seed) {
+  std::string data(size, '\0');
+  uint64_t x = seed;
+  for (size_t i=0; i<size; ++i) {
+    x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+    data[i] = static_cast<char>(x >> 56);
+  }
+  std::ofstream out(filename.c_str(), std::ios::binary);
+  out << data;
+}
+
+// Make nested directories of small files, which are packed, and large
+// files, which are not.  Return the files in walk order.
+void make_tree(const std::string& dir, const size_t depth,
+               std::vector<std::string>& expected) {
+  make_dir_if_not_there(dir);
+  for (size_t i=0; i<8; ++i) {
+    // names sort in the order made, files before and after directories
+    std::stringstream ss;
+    ss << dir << "/" << i;
+    const std::string name = ss.str();
+    if ((i == 1 || i == 5) && depth > 0) {
+      make_tree(name, depth - 1, expected);
+    } else {
+      const uint64_t seed = expected.size() + 1;
+      const size_t size = (seed % 5 == 0) ? 70000 + seed : 100 + seed * 10;
+      make_file(name, size, seed);
+      expected.push_back(name);
+    }
+  }
+}
+
+// ingest with the given number of readers and return the file hashes
+// in source ID order
+void ingest_file_hashes(const size_t num_readers,
+                        std::vector<std::string>& file_hashes) {
+  rm_hashdb_dir(hashdb_dir);
+  hashdb::settings_t settings;
+  std::string error_message = hashdb::create_hashdb(hashdb_dir, settings,
+                                                    "ingest_test");
+  TEST_EQ(error_message, "");
+  error_message = hashdb::ingest(hashdb_dir, temp_dir, 512, repository_name,
+                                 "", false, false, false, false,
+                                 num_readers, "ingest_test");
+  TEST_EQ(error_message, "");
+
+  std::map<uint64_t, std::string> ordered;
+  hashdb::lmdb_source_id_manager_t manager(hashdb_dir, hashdb::READ_ONLY);
+  for (std::string file_hash = manager.first_source(); file_hash != "";
+       file_hash = manager.next_source(file_hash)) {
+    uint64_t source_id;
+    TEST_EQ(manager.find(file_hash, source_id), true);
+    ordered[source_id] = file_hash;
+  }
+  file_hashes.clear();
+  for (std::map<uint64_t, std::string>::const_iterator it = ordered.begin();
+       it != ordered.end(); ++it) {
+    file_hashes.push_back(it->second);
+  }
+}
+
+// the filename of each file hash
+void filenames(const std::vector<std::string>& file_hashes,
+               std::vector<std::string>& names) {
+  hashdb::scan_manager_t manager(hashdb_dir);
+  names.clear();
+  for (std::vector<std::string>::const_iterator it = file_hashes.begin();
+       it != file_hashes.end(); ++it) {
+    hashdb::source_names_t source_names;
+    TEST_EQ(manager.find_source_names(*it, source_names), true);
+    TEST_EQ(source_names.size(), 1);
+    TEST_EQ(source_names.begin()->first, repository_name);
+    names.push_back(source_names.begin()->second);
+  }
+}
+
+void test_reader_counts(const std::vector<std::string>& expected) {
+  std::vector<std::string> first_file_hashes;
+  ingest_file_hashes(1, first_file_hashes);
+  std::vector<std::string> names;
+  filenames(first_file_hashes, names);
+  TEST_EQ(names.size(), expected.size());
+  const bool is_in_walk_order = (names == expected);
+  TEST_EQ(is_in_walk_order, true);
+
+  const size_t reader_counts[] = {2, 4, 16};
+  for (size_t i=0; i<3; ++i) {
+    std::vector<std::string> file_hashes;
+    ingest_file_hashes(reader_counts[i], file_hashes);
+    const bool is_same = (file_hashes == first_file_hashes);
+    TEST_EQ(is_same, true);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  nftw(temp_dir.c_str(), remove_path, 16, FTW_DEPTH | FTW_PHYS);
+  std::vector<std::string> expected;
+  make_tree(temp_dir, 3, expected);
+  test_reader_counts(expected);
+  nftw(temp_dir.c_str(), remove_path, 16, FTW_DEPTH | FTW_PHYS);
+
+  // done
+  std::cout << "ingest_test Done.\n";
+  return 0;
+}
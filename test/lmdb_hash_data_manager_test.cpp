@@ -28,8 +28,10 @@
 #include <cstdio>
 #include "unit_test.h"
 #include "lmdb_hash_data_manager.hpp"
+#include "lmdb_hash_data_cursor.hpp"
 #include "lmdb_helper.h"
 #include "lmdb_changes.hpp"
+#include "lmdb_context.hpp"
 #include "source_id_sub_counts.hpp"
 #include "../src_libhashdb/hashdb.hpp"
 #include "directory_helper.hpp"
@@ -364,6 +366,378 @@ void test_merge() {
   TEST_EQ(it->sub_count, 1000);
 }
 
+// merge several sources in one transaction
+void test_merge_sources() {
+
+// hash_data_inserted
+// hash_data_merged
+// hash_data_merged_same
+// hash_data_mismatched_data_detected
+// hash_data_mismatched_sub_count_detected
+
+  // variables
+  uint64_t k_entropy;
+  std::string block_label;
+  uint64_t count;
+  hashdb::source_id_sub_counts_t source_id_sub_counts;
+  hashdb::lmdb_changes_t changes;
+  std::vector<std::pair<uint64_t, uint64_t> > merge_sub_counts;
+
+  // create new manager
+  make_new_hashdb_dir(hashdb_dir);
+  hashdb::lmdb_hash_data_manager_t manager(hashdb_dir, hashdb::RW_NEW);
+
+  // new Type 1 split into Type 2 and Type 3, repeated source is same
+  merge_sub_counts.push_back(std::pair<uint64_t, uint64_t>(1, 10));
+  merge_sub_counts.push_back(std::pair<uint64_t, uint64_t>(2, 100));
+  merge_sub_counts.push_back(std::pair<uint64_t, uint64_t>(1, 10));
+  TEST_EQ(manager.merge(binary_0, 2000, "l", merge_sub_counts, changes), 110);
+  check_changes(changes,0,2,1,0,0);
+
+  // add to existing Type 2
+  merge_sub_counts.clear();
+  merge_sub_counts.push_back(std::pair<uint64_t, uint64_t>(3, 1000));
+  merge_sub_counts.push_back(std::pair<uint64_t, uint64_t>(2, 100));
+  TEST_EQ(manager.merge(binary_0, 2000, "l", merge_sub_counts, changes), 1110);
+  check_changes(changes,0,3,2,0,0);
+
+  // find
+  TEST_EQ(manager.find(binary_0, k_entropy, block_label, count,
+                       source_id_sub_counts), true);
+  TEST_EQ(k_entropy, 2000);
+  TEST_EQ(block_label, "l");
+  TEST_EQ(count, 1110);
+  TEST_EQ(source_id_sub_counts.size(), 3);
+
+  // nothing to merge
+  merge_sub_counts.clear();
+  TEST_EQ(manager.merge(binary_1, 0, "", merge_sub_counts, changes), 0);
+  TEST_EQ(manager.find(binary_1, k_entropy, block_label, count,
+                       source_id_sub_counts), false);
+}
+
+void test_many_sources() {
+
+  // variables
+  uint64_t k_entropy;
+  std::string block_label;
+  uint64_t count;
+  std::vector<std::pair<uint64_t, uint64_t> > source_id_sub_counts;
+  hashdb::lmdb_changes_t changes;
+
+  // create new manager
+  make_new_hashdb_dir(hashdb_dir);
+  hashdb::lmdb_hash_data_manager_t manager(hashdb_dir, hashdb::RW_NEW);
+
+  // insert sources out of order, including source IDs of varying width
+  const uint64_t source_ids[] = {300, 2, 70000, 1, 0x100000000, 128, 127};
+  for (size_t i=0; i<7; ++i) {
+    manager.insert(binary_0, 0, "", source_ids[i], changes);
+  }
+
+  // insert and merge existing sources
+  TEST_EQ(manager.insert(binary_0, 0, "", 128, changes), 8);
+  TEST_EQ(manager.merge(binary_0, 0, "", 70000, 1, changes), 8);
+  check_changes(changes,8,0,1,0,0);
+
+  // find returns sources in source ID order
+  TEST_EQ(manager.find(binary_0, k_entropy, block_label, count,
+                       source_id_sub_counts), true);
+  TEST_EQ(count, 8);
+  TEST_EQ(source_id_sub_counts.size(), 7);
+  TEST_EQ(source_id_sub_counts[0].first, 1);
+  TEST_EQ(source_id_sub_counts[1].first, 2);
+  TEST_EQ(source_id_sub_counts[2].first, 127);
+  TEST_EQ(source_id_sub_counts[3].first, 128);
+  TEST_EQ(source_id_sub_counts[3].second, 2);
+  TEST_EQ(source_id_sub_counts[4].first, 300);
+  TEST_EQ(source_id_sub_counts[5].first, 70000);
+  TEST_EQ(source_id_sub_counts[5].second, 1);
+  TEST_EQ(source_id_sub_counts[6].first, 0x100000000);
+}
+
+void test_hot_hash() {
+
+  // variables
+  uint64_t k_entropy;
+  std::string block_label;
+  uint64_t count;
+  std::vector<std::pair<uint64_t, uint64_t> > source_id_sub_counts;
+  hashdb::lmdb_changes_t changes;
+
+  // create new manager
+  make_new_hashdb_dir(hashdb_dir);
+  {
+    hashdb::lmdb_hash_data_manager_t manager(hashdb_dir, hashdb::RW_NEW);
+
+    // insert enough sources to make binary_0 hot
+    for (uint64_t i=0; i<2000; ++i) {
+      manager.insert(binary_0, 0, "", i * 3 + 1, changes);
+    }
+
+    // insert into a source held in memory, merge new and existing
+    // sources, and insert a wide source ID
+    TEST_EQ(manager.insert(binary_0, 0, "", 4, changes), 2001);
+    TEST_EQ(manager.merge(binary_0, 0, "", 2, 5, changes), 2006);
+    TEST_EQ(manager.merge(binary_0, 0, "", 7, 1, changes), 2006);
+    TEST_EQ(manager.insert(binary_0, 0, "", 0x100000000, changes), 2007);
+    check_changes(changes,2002,1,1,0,0);
+
+    // find includes inserts held in memory
+    TEST_EQ(manager.find_count(binary_0), 2007);
+    TEST_EQ(manager.find(binary_0, k_entropy, block_label, count,
+                         source_id_sub_counts), true);
+    TEST_EQ(count, 2007);
+    TEST_EQ(source_id_sub_counts.size(), 2002);
+    TEST_EQ(source_id_sub_counts[0].first, 1);
+    TEST_EQ(source_id_sub_counts[1].first, 2);
+    TEST_EQ(source_id_sub_counts[1].second, 5);
+    TEST_EQ(source_id_sub_counts[2].first, 4);
+    TEST_EQ(source_id_sub_counts[2].second, 2);
+    TEST_EQ(source_id_sub_counts[2001].first, 0x100000000);
+
+    // same after flush
+    manager.flush();
+    TEST_EQ(manager.find(binary_0, k_entropy, block_label, count,
+                         source_id_sub_counts), true);
+    TEST_EQ(count, 2007);
+    TEST_EQ(source_id_sub_counts.size(), 2002);
+    TEST_EQ(source_id_sub_counts[2].second, 2);
+    TEST_EQ(source_id_sub_counts[1999].first, 5995);
+    TEST_EQ(source_id_sub_counts[1999].second, 1);
+
+    // held in memory again, then written on close
+    TEST_EQ(manager.insert(binary_0, 0, "", 5995, changes), 2008);
+  }
+
+  // stored sources are in source ID order
+  hashdb::lmdb_hash_data_manager_t manager(hashdb_dir, hashdb::READ_ONLY);
+  TEST_EQ(manager.find_count(binary_0), 2008);
+  TEST_EQ(manager.find(binary_0, k_entropy, block_label, count,
+                       source_id_sub_counts), true);
+  TEST_EQ(count, 2008);
+  TEST_EQ(source_id_sub_counts.size(), 2002);
+  for (size_t i=1; i<source_id_sub_counts.size(); ++i) {
+    TEST_EQ((source_id_sub_counts[i-1].first <
+             source_id_sub_counts[i].first), true);
+  }
+  TEST_EQ(source_id_sub_counts[1999].second, 2);
+
+  // the cursor reads Type 4 records
+  hashdb::lmdb_hash_data_cursor_t cursor(manager);
+  size_t num_sources;
+  TEST_EQ(cursor.read_count(count, num_sources), true);
+  TEST_EQ(count, 2008);
+  TEST_EQ(num_sources, 2002);
+  TEST_EQ(cursor.read(k_entropy, block_label, count, source_id_sub_counts),
+          true);
+  TEST_EQ(source_id_sub_counts.size(), 2002);
+}
+
+void test_insert_batch() {
+
+  // variables
+  uint64_t k_entropy;
+  std::string block_label;
+  uint64_t count;
+  std::vector<std::pair<uint64_t, uint64_t> > source_id_sub_counts;
+  std::vector<size_t> counts;
+  hashdb::lmdb_changes_t changes;
+
+  // create new manager
+  make_new_hashdb_dir(hashdb_dir);
+  hashdb::lmdb_hash_data_manager_t manager(hashdb_dir, hashdb::RW_NEW);
+
+  // a Type 1 hash inserted twice and split, a Type 1 hash with a
+  // mismatched label, and enough sources to make binary_2 hot
+  std::vector<std::string> block_hashes;
+  std::vector<uint64_t> k_entropies;
+  std::vector<std::string> block_labels;
+  std::vector<uint64_t> source_ids;
+  const uint64_t batch_source_ids[] = {1, 1, 2};
+  for (size_t i=0; i<3; ++i) {
+    block_hashes.push_back(binary_0);
+    k_entropies.push_back(1);
+    block_labels.push_back("bl");
+    source_ids.push_back(batch_source_ids[i]);
+  }
+  block_hashes.push_back(binary_1);
+  k_entropies.push_back(0);
+  block_labels.push_back("");
+  source_ids.push_back(1);
+  block_hashes.push_back(binary_1);
+  k_entropies.push_back(0);
+  block_labels.push_back("x");
+  source_ids.push_back(1);
+  for (uint64_t i=0; i<2000; ++i) {
+    block_hashes.push_back(binary_2);
+    k_entropies.push_back(0);
+    block_labels.push_back("");
+    source_ids.push_back(i + 1);
+  }
+  manager.insert(block_hashes, k_entropies, block_labels, source_ids,
+                 changes, counts);
+  check_changes(changes,2005,0,0,1,0);
+
+  // counts are as if inserted one at a time
+  TEST_EQ(counts.size(), 2005);
+  TEST_EQ(counts[0], 1);
+  TEST_EQ(counts[1], 2);
+  TEST_EQ(counts[2], 3);
+  TEST_EQ(counts[4], 2);
+  TEST_EQ(counts[2004], 2000);
+
+  TEST_EQ(manager.find(binary_0, k_entropy, block_label, count,
+                       source_id_sub_counts), true);
+  TEST_EQ(k_entropy, 1);
+  TEST_EQ(block_label, "bl");
+  TEST_EQ(count, 3);
+  TEST_EQ(source_id_sub_counts.size(), 2);
+  TEST_EQ(source_id_sub_counts[0].second, 2);
+  TEST_EQ(manager.find_count(binary_1), 2);
+
+  // a later batch adds to the hot hash in memory
+  block_hashes.assign(1, binary_2);
+  k_entropies.assign(1, 0);
+  block_labels.assign(1, "");
+  source_ids.assign(1, 3);
+  manager.insert(block_hashes, k_entropies, block_labels, source_ids,
+                 changes, counts);
+  TEST_EQ(counts[0], 2001);
+  TEST_EQ(manager.find(binary_2, k_entropy, block_label, count,
+                       source_id_sub_counts), true);
+  TEST_EQ(count, 2001);
+  TEST_EQ(source_id_sub_counts.size(), 2000);
+  TEST_EQ(source_id_sub_counts[2].second, 2);
+}
+
+void test_upgrade() {
+
+  // variables
+  uint64_t k_entropy;
+  std::string block_label;
+  uint64_t count;
+  std::vector<std::pair<uint64_t, uint64_t> > source_id_sub_counts;
+  hashdb::lmdb_changes_t changes;
+
+  // create a store holding binary_0 in the encoding used before
+  // settings version 5, with Type 3 source_id as a varint
+  make_new_hashdb_dir(hashdb_dir);
+  {
+    MDB_env* env = lmdb_helper::open_env(hashdb_dir + "/lmdb_hash_data_store",
+                                         hashdb::RW_NEW);
+    hashdb::lmdb_context_t context(env, true, true);
+    context.open();
+    context.key.mv_size = binary_0.size();
+    context.key.mv_data = static_cast<void*>(const_cast<char*>(
+                                                       binary_0.data()));
+
+    // Type 2: NULL, entropy 5, block_label "l", count 7
+    const uint8_t type2[] = {0, 5, 1, 'l', 7, 0, 0, 0};
+    context.data.mv_size = sizeof(type2);
+    context.data.mv_data = const_cast<uint8_t*>(type2);
+    TEST_EQ(mdb_put(context.txn, context.dbi, &context.key, &context.data,
+                    0), 0);
+
+    // Type 3: source 200 sub_count 4, source 1 sub_count 1,
+    // source 3 sub_count 2
+    const uint8_t type3[][4] = {{0xc8, 0x01, 4, 0}, {1, 1, 0}, {3, 2, 0}};
+    const size_t type3_size[] = {4, 3, 3};
+    for (size_t i=0; i<3; ++i) {
+      context.data.mv_size = type3_size[i];
+      context.data.mv_data = const_cast<uint8_t*>(type3[i]);
+      TEST_EQ(mdb_put(context.txn, context.dbi, &context.key, &context.data,
+                      0), 0);
+    }
+    context.close();
+    mdb_env_close(env);
+  }
+
+  hashdb::lmdb_hash_data_manager_t manager(hashdb_dir, hashdb::RW_MODIFY);
+  TEST_EQ(manager.upgrade(), 1);
+
+  // upgrade is done
+  TEST_EQ(manager.upgrade(), 0);
+  TEST_EQ(manager.find(binary_0, k_entropy, block_label, count,
+                       source_id_sub_counts), true);
+  TEST_EQ(k_entropy, 5);
+  TEST_EQ(block_label, "l");
+  TEST_EQ(count, 7);
+  TEST_EQ(source_id_sub_counts.size(), 3);
+  TEST_EQ(source_id_sub_counts[0].first, 1);
+  TEST_EQ(source_id_sub_counts[1].first, 3);
+  TEST_EQ(source_id_sub_counts[1].second, 2);
+  TEST_EQ(source_id_sub_counts[2].first, 200);
+  TEST_EQ(source_id_sub_counts[2].second, 4);
+
+  // upgraded records are found
+  TEST_EQ(manager.merge(binary_0, 5, "l", 200, 4, changes), 7);
+  TEST_EQ(manager.insert(binary_0, 5, "l", 3, changes), 8);
+  check_changes(changes,1,0,1,0,0);
+}
+
+void test_upgrade_batches() {
+
+  // variables
+  uint64_t k_entropy;
+  std::string block_label;
+  uint64_t count;
+  std::vector<std::pair<uint64_t, uint64_t> > source_id_sub_counts;
+
+  // create a store holding more hashes in the encoding used before
+  // settings version 5 than are rewritten in one batch
+  const size_t num_hashes = 10000;
+  make_new_hashdb_dir(hashdb_dir);
+  {
+    MDB_env* env = lmdb_helper::open_env(hashdb_dir + "/lmdb_hash_data_store",
+                                         hashdb::RW_NEW);
+    lmdb_helper::maybe_grow(env, num_hashes * 3, num_hashes * 3 * 30);
+    hashdb::lmdb_context_t context(env, true, true);
+    context.open();
+    for (size_t i=0; i<num_hashes; ++i) {
+      char key[4] = {static_cast<char>(i >> 24), static_cast<char>(i >> 16),
+                     static_cast<char>(i >> 8), static_cast<char>(i)};
+      context.key.mv_size = sizeof(key);
+      context.key.mv_data = key;
+
+      // Type 2: NULL, entropy 0, no block_label, count 3, then Type 3:
+      // source 1 sub_count 1, source 2 sub_count 2
+      const uint8_t type2[] = {0, 0, 0, 3, 0, 0, 0};
+      const uint8_t type3[][3] = {{1, 1, 0}, {2, 2, 0}};
+      context.data.mv_size = sizeof(type2);
+      context.data.mv_data = const_cast<uint8_t*>(type2);
+      TEST_EQ(mdb_put(context.txn, context.dbi, &context.key, &context.data,
+                      0), 0);
+      for (size_t j=0; j<2; ++j) {
+        context.data.mv_size = sizeof(type3[j]);
+        context.data.mv_data = const_cast<uint8_t*>(type3[j]);
+        TEST_EQ(mdb_put(context.txn, context.dbi, &context.key,
+                        &context.data, 0), 0);
+      }
+    }
+    context.close();
+    mdb_env_close(env);
+  }
+
+  hashdb::lmdb_hash_data_manager_t manager(hashdb_dir, hashdb::RW_MODIFY);
+  TEST_EQ(manager.upgrade(), num_hashes);
+  TEST_EQ(manager.upgrade(), 0);
+
+  // the first and last hashes are upgraded
+  const std::string first_hash("\0\0\0\0", 4);
+  const std::string last_hash("\0\0\x27\x0f", 4);
+  TEST_EQ(manager.find(first_hash, k_entropy, block_label, count,
+                       source_id_sub_counts), true);
+  TEST_EQ(count, 3);
+  TEST_EQ(source_id_sub_counts.size(), 2);
+  TEST_EQ(source_id_sub_counts[1].second, 2);
+  TEST_EQ(manager.find(last_hash, k_entropy, block_label, count,
+                       source_id_sub_counts), true);
+  TEST_EQ(source_id_sub_counts.size(), 2);
+  TEST_EQ(source_id_sub_counts[0].first, 1);
+  TEST_EQ(source_id_sub_counts[1].first, 2);
+}
+
 void test_maximums() {
 // hash_data_inserted
 // hash_data_merged
@@ -495,6 +869,12 @@ test_empty();
 test_insert_type1();
 test_insert_split();
 test_merge();
+test_merge_sources();
+test_many_sources();
+test_hot_hash();
+test_insert_batch();
+test_upgrade();
+test_upgrade_batches();
 test_maximums();
 test_block_label();
 test_other_manager_functions();
@@ -32,6 +32,9 @@
 #include "lmdb_source_data_manager.hpp"
 #include "lmdb_source_id_manager.hpp"
 #include "lmdb_source_name_manager.hpp"
+#include "lmdb_source_hash_manager.hpp"
+#include "lmdb_repository_manager.hpp"
+#include "lmdb_file_hash_cache_manager.hpp"
 #include "lmdb_helper.h"
 #include "lmdb_changes.hpp"
 #include "source_id_sub_counts.hpp"
@@ -146,6 +149,21 @@ void lmdb_hash_manager_count() {
   TEST_EQ(manager.find(binary_00), 1370);
   manager.insert(binary_00, 1495, changes);
   TEST_EQ(manager.find(binary_00), 1495);
+
+  // insert several in one transaction
+  std::vector<std::string> binary_hashes;
+  std::vector<size_t> counts;
+  binary_hashes.push_back(binary_12);
+  counts.push_back(3);
+  binary_hashes.push_back(binary_00);
+  counts.push_back(1495);
+  binary_hashes.push_back(binary_12);
+  counts.push_back(4);
+  manager.insert(binary_hashes, counts, changes);
+  TEST_EQ(changes.hash_inserted, 2);
+  TEST_EQ(changes.hash_count_not_changed, 1);
+  TEST_EQ(manager.find(binary_12), 4);
+  TEST_EQ(manager.size(), 2);
 }
 
 // ************************************************************
@@ -211,6 +229,30 @@ void lmdb_source_id_manager() {
   file_binary_hash = manager.next_source(binary_26);
   TEST_EQ(file_binary_hash, "")
 
+  // insert several in one transaction, new IDs count earlier ones
+  std::vector<std::string> file_binary_hashes;
+  file_binary_hashes.push_back(binary_10);
+  file_binary_hashes.push_back(binary_00);
+  file_binary_hashes.push_back(binary_11);
+  file_binary_hashes.push_back(binary_10);
+  std::vector<uint64_t> source_ids;
+  std::vector<bool> is_new_ids;
+  manager.insert(file_binary_hashes, changes, source_ids, is_new_ids);
+  TEST_EQ(source_ids.size(), 4);
+  TEST_EQ(source_ids[0], 4);
+  TEST_EQ(is_new_ids[0], true);
+  TEST_EQ(source_ids[1], 1);
+  TEST_EQ(is_new_ids[1], false);
+  TEST_EQ(source_ids[2], 5);
+  TEST_EQ(is_new_ids[2], true);
+  TEST_EQ(source_ids[3], 4);
+  TEST_EQ(is_new_ids[3], false);
+  TEST_EQ(changes.source_id_inserted, 5);
+  TEST_EQ(changes.source_id_already_present, 3);
+  did_find = manager.find(binary_11, source_id);
+  TEST_EQ(did_find, true);
+  TEST_EQ(source_id, 5)
+  TEST_EQ(manager.size(), 5);
 }
 
 // ************************************************************
@@ -358,6 +400,233 @@ void lmdb_source_name_manager() {
 
   // size
   TEST_EQ(manager.size(), 4);
+
+  // insert several in one transaction
+  std::vector<uint64_t> source_ids;
+  std::vector<std::string> filenames;
+  source_ids.push_back(3);
+  filenames.push_back("fn3");
+  source_ids.push_back(2);
+  filenames.push_back("fn11");
+  source_ids.push_back(3);
+  filenames.push_back("fn3");
+  manager.insert(source_ids, "rn11", filenames, changes);
+  TEST_EQ(changes.source_name_inserted, 5);
+  TEST_EQ(changes.source_name_already_present, 3);
+  found = manager.find(3, source_names);
+  TEST_EQ(found, true);
+  TEST_EQ(source_names.size(), 1);
+  TEST_EQ(source_names.begin()->first, "rn11");
+  TEST_EQ(source_names.begin()->second, "fn3");
+  TEST_EQ(manager.size(), 5);
+}
+
+// ************************************************************
+// lmdb_source_hash_manager
+// ************************************************************
+void lmdb_source_hash_manager() {
+
+  // variables
+  std::vector<std::string> block_hashes;
+  bool found;
+
+  // create new manager
+  make_new_hashdb_dir(hashdb_dir);
+  TEST_EQ(hashdb::lmdb_source_hash_manager_t::is_present(hashdb_dir), false);
+  hashdb::lmdb_source_hash_manager_t manager(hashdb_dir, hashdb::RW_NEW);
+  TEST_EQ(hashdb::lmdb_source_hash_manager_t::is_present(hashdb_dir), true);
+
+  // no source ID when DB is empty
+  found = manager.find(1, block_hashes);
+  TEST_EQ(found, false);
+
+  // held inserts are not found until they are written
+  manager.insert(1, binary_12);
+  manager.insert(1, binary_12);
+  manager.insert(1, binary_00);
+  found = manager.find(1, block_hashes);
+  TEST_EQ(found, false);
+  manager.flush();
+
+  // insert a batch
+  hashdb::lmdb_source_hash_manager_t::source_hashes_t source_hashes;
+  source_hashes.push_back(
+          hashdb::lmdb_source_hash_manager_t::source_hashes_t::value_type(
+                                                          2, binary_12));
+  source_hashes.push_back(
+          hashdb::lmdb_source_hash_manager_t::source_hashes_t::value_type(
+                                                          1, binary_00));
+  manager.insert(source_hashes);
+
+  // find first source, in block hash order
+  found = manager.find(1, block_hashes);
+  TEST_EQ(found, true);
+  TEST_EQ(block_hashes.size(), 2);
+  TEST_EQ(block_hashes[0], binary_00);
+  TEST_EQ(block_hashes[1], binary_12);
+
+  // find second source
+  found = manager.find(2, block_hashes);
+  TEST_EQ(found, true);
+  TEST_EQ(block_hashes.size(), 1);
+  TEST_EQ(block_hashes[0], binary_12);
+
+  // no source ID when DB is not empty
+  found = manager.find(3, block_hashes);
+  TEST_EQ(found, false);
+  TEST_EQ(block_hashes.size(), 0);
+
+  // size
+  TEST_EQ(manager.size(), 3);
+}
+
+// ************************************************************
+// lmdb_repository_manager
+// ************************************************************
+void lmdb_repository_manager() {
+
+  // variables
+  std::vector<uint64_t> source_ids;
+  bool found;
+
+  // create new manager
+  make_new_hashdb_dir(hashdb_dir);
+  TEST_EQ(hashdb::lmdb_repository_manager_t::is_present(hashdb_dir), false);
+  hashdb::lmdb_repository_manager_t manager(hashdb_dir, hashdb::RW_NEW);
+  TEST_EQ(hashdb::lmdb_repository_manager_t::is_present(hashdb_dir), true);
+
+  // no repository name when DB is empty
+  found = manager.find("rn", source_ids);
+  TEST_EQ(found, false);
+
+  // empty repository names are not indexed
+  TEST_EQ(manager.insert("", 1), false);
+  found = manager.find("", source_ids);
+  TEST_EQ(found, false);
+
+  // insert source IDs for two repository names
+  TEST_EQ(manager.insert("rn", 1), true);
+  TEST_EQ(manager.insert("rn", 1), false);
+  TEST_EQ(manager.insert("rn", 2), true);
+  TEST_EQ(manager.insert("rn2", 2), true);
+
+  // find first repository name
+  found = manager.find("rn", source_ids);
+  TEST_EQ(found, true);
+  TEST_EQ(source_ids.size(), 2);
+  TEST_EQ(source_ids[0], 1);
+  TEST_EQ(source_ids[1], 2);
+
+  // find second repository name
+  found = manager.find("rn2", source_ids);
+  TEST_EQ(found, true);
+  TEST_EQ(source_ids.size(), 1);
+  TEST_EQ(source_ids[0], 2);
+
+  // long repository names are keyed by prefix
+  const std::string long_name_a(600, 'a');
+  const std::string long_name_b = long_name_a + "b";
+  TEST_EQ(manager.insert(long_name_a, 3), true);
+  TEST_EQ(manager.insert(long_name_b, 4), true);
+  found = manager.find(long_name_b, source_ids);
+  TEST_EQ(found, true);
+  TEST_EQ(source_ids.size(), 2);
+
+  // no repository name when DB is not empty
+  found = manager.find("rn3", source_ids);
+  TEST_EQ(found, false);
+  TEST_EQ(source_ids.size(), 0);
+
+  // size
+  TEST_EQ(manager.size(), 5);
+
+  // insert several in one transaction
+  std::vector<uint64_t> new_source_ids;
+  new_source_ids.push_back(5);
+  new_source_ids.push_back(2);
+  new_source_ids.push_back(6);
+  manager.insert("rn2", new_source_ids);
+  found = manager.find("rn2", source_ids);
+  TEST_EQ(found, true);
+  TEST_EQ(source_ids.size(), 3);
+  TEST_EQ(source_ids[0], 2);
+  TEST_EQ(source_ids[1], 5);
+  TEST_EQ(source_ids[2], 6);
+  TEST_EQ(manager.size(), 7);
+
+  // insert several repository names in one transaction
+  std::vector<std::pair<std::string, uint64_t> > repository_source_ids;
+  repository_source_ids.push_back(std::pair<std::string, uint64_t>("rn3", 7));
+  repository_source_ids.push_back(std::pair<std::string, uint64_t>("", 7));
+  repository_source_ids.push_back(std::pair<std::string, uint64_t>("rn", 7));
+  repository_source_ids.push_back(std::pair<std::string, uint64_t>("rn", 1));
+  manager.insert(repository_source_ids);
+  found = manager.find("rn3", source_ids);
+  TEST_EQ(found, true);
+  TEST_EQ(source_ids.size(), 1);
+  found = manager.find("rn", source_ids);
+  TEST_EQ(source_ids.size(), 3);
+  TEST_EQ(manager.size(), 9);
+}
+
+// ************************************************************
+// lmdb_file_hash_cache_manager
+// ************************************************************
+void lmdb_file_hash_cache_manager() {
+
+  // variables
+  std::string file_hash;
+  bool found;
+  const hashdb::file_stat_t file_stat(1, 2, 3, 4);
+
+  // create new manager
+  make_new_hashdb_dir(hashdb_dir);
+  TEST_EQ(hashdb::lmdb_file_hash_cache_manager_t::is_present(hashdb_dir),
+          false);
+  hashdb::lmdb_file_hash_cache_manager_t manager(hashdb_dir, hashdb::RW_NEW);
+  TEST_EQ(hashdb::lmdb_file_hash_cache_manager_t::is_present(hashdb_dir),
+          true);
+
+  // no file hash when DB is empty
+  found = manager.find("f", file_stat, "rn", file_hash);
+  TEST_EQ(found, false);
+
+  // find unchanged file
+  manager.insert("f", file_stat, binary_00, "rn");
+  found = manager.find("f", file_stat, "rn", file_hash);
+  TEST_EQ(found, true);
+  TEST_EQ(file_hash, binary_00);
+
+  // changed file or other repository name
+  found = manager.find("f", hashdb::file_stat_t(1, 2, 3, 5), "rn",
+                       file_hash);
+  TEST_EQ(found, false);
+  TEST_EQ(file_hash, "");
+  found = manager.find("f", hashdb::file_stat_t(1, 9, 3, 4), "rn",
+                       file_hash);
+  TEST_EQ(found, false);
+  found = manager.find("f", file_stat, "rn2", file_hash);
+  TEST_EQ(found, false);
+  found = manager.find("g", file_stat, "rn", file_hash);
+  TEST_EQ(found, false);
+
+  // replace the file hash of a changed file
+  manager.insert("f", hashdb::file_stat_t(1, 2, 3, 5), binary_01, "rn");
+  found = manager.find("f", file_stat, "rn", file_hash);
+  TEST_EQ(found, false);
+  found = manager.find("f", hashdb::file_stat_t(1, 2, 3, 5), "rn",
+                       file_hash);
+  TEST_EQ(found, true);
+  TEST_EQ(file_hash, binary_01);
+
+  // long paths are not cached
+  const std::string long_path(600, 'a');
+  manager.insert(long_path, file_stat, binary_00, "rn");
+  found = manager.find(long_path, file_stat, "rn", file_hash);
+  TEST_EQ(found, false);
+
+  // size
+  TEST_EQ(manager.size(), 1);
 }
 
 // ************************************************************
@@ -380,6 +649,15 @@ int main(int argc, char* argv[]) {
   // source name manager
   lmdb_source_name_manager();
 
+  // source hash manager
+  lmdb_source_hash_manager();
+
+  // repository manager
+  lmdb_repository_manager();
+
+  // file hash cache manager
+  lmdb_file_hash_cache_manager();
+
   // done
   std::cout << "lmdb_other_managers_test Done.\n";
   return 0;
@@ -0,0 +1,99 @@
+// Author:  Bruce Allen
+// Created: 2/25/2013
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on February 25, 2013 by Bruce Allen.
+
+/**
+ * \file
+ * Test that the member set finds members and, when bounded, stays
+ * within its bound and counts every member it evicts.
+ */
+
+#include <config.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <stdint.h>
+#include "unit_test.h"
+#include "locked_member.hpp"
+
+static const size_t num_items = 20000;
+
+// a distinct key of the given size
+std::string make_key(const size_t i, const size_t key_size) {
+  std::string key(key_size, '\0');
+  uint64_t x = i;
+  for (size_t j=0; j<key_size; ++j) {
+    x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+    key[j] = static_cast<char>(x >> 56);
+  }
+  // keep keys distinct whatever the generator gives
+  for (size_t j=0; j<8 && j<key_size; ++j) {
+    key[j] = static_cast<char>(i >> (j * 8));
+  }
+  return key;
+}
+
+// unbounded, every member is kept
+void test_unbounded(const size_t key_size) {
+  hashdb::locked_member_t members;
+  for (size_t i=0; i<num_items; ++i) {
+    TEST_EQ(members.locked_insert(make_key(i, key_size)), true);
+  }
+  for (size_t i=0; i<num_items; ++i) {
+    TEST_EQ(members.locked_insert(make_key(i, key_size)), false);
+    TEST_EQ(members.locked_contains(make_key(i, key_size)), true);
+  }
+  TEST_EQ(members.locked_contains(make_key(num_items, key_size)), false);
+  TEST_EQ(members.size(), num_items);
+  TEST_EQ(members.evictions(), 0);
+}
+
+// bounded, the set stays within the bound and every member inserted is
+// either kept or counted as evicted
+void test_bounded(const size_t key_size) {
+  const size_t max_members = 1024;
+  hashdb::locked_member_t members(max_members);
+  for (size_t i=0; i<num_items; ++i) {
+    TEST_EQ(members.locked_insert(make_key(i, key_size)), true);
+    TEST_EQ(members.size() + members.evictions(), i + 1);
+  }
+  const bool is_bounded = (members.size() <= max_members);
+  TEST_EQ(is_bounded, true);
+  const bool is_evicted = (members.evictions() >= num_items - max_members);
+  TEST_EQ(is_evicted, true);
+
+  // the last member inserted is still there
+  TEST_EQ(members.locked_contains(make_key(num_items - 1, key_size)), true);
+
+  // inserting a member again does not evict
+  const size_t evictions = members.evictions();
+  TEST_EQ(members.locked_insert(make_key(num_items - 1, key_size)), false);
+  TEST_EQ(members.evictions(), evictions);
+}
+
+int main(int argc, char* argv[]) {
+  // hash keys are kept in tables, longer keys in overflow sets
+  test_unbounded(16);
+  test_unbounded(40);
+  test_bounded(16);
+  test_bounded(40);
+
+  // done
+  std::cout << "locked_member_test Done.\n";
+  return 0;
+}
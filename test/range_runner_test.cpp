@@ -0,0 +1,182 @@
+// Author:  Bruce Allen
+// Created: 2/25/2013
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on February 25, 2013 by Bruce Allen.
+
+/**
+ * \file
+ * Test that the range runner writes output and commits ranges in range
+ * order.
+ */
+
+#include <config.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "unit_test.h"
+#include "../src_libhashdb/hashdb.hpp"
+#include "../src/range_runner.hpp"
+#include "directory_helper.hpp"
+
+static const std::string hashdb_dir = "temp_dir_range_runner_test.hdb";
+static const size_t num_hashes = 5000;
+static const size_t num_workers = 8;
+
+// enough ranges that workers must wait for the output to catch up
+static const uint64_t total_hashes = 16384 * 200;
+
+// write each hash of the range
+class output_worker_t : public range_worker_t {
+  private:
+  hashdb::hash_cursor_t cursor;
+
+  // do not allow copy or assignment
+  output_worker_t(const output_worker_t&);
+  output_worker_t& operator=(const output_worker_t&);
+
+  public:
+  output_worker_t(const hashdb::scan_manager_t& manager) : cursor(manager) {
+  }
+
+  void run(const hash_range_t& range, std::ostream& os) {
+    for (range.start(cursor); range.contains(cursor); cursor.next()) {
+      os << hashdb::bin_to_hex(cursor.block_hash()) << "\n";
+    }
+  }
+};
+
+// stage each hash of the range and commit the staged hashes
+class commit_worker_t : public range_worker_t {
+  private:
+  hashdb::hash_cursor_t cursor;
+  std::vector<std::string> staged;
+  std::vector<std::string>& committed;
+
+  // do not allow copy or assignment
+  commit_worker_t(const commit_worker_t&);
+  commit_worker_t& operator=(const commit_worker_t&);
+
+  public:
+  commit_worker_t(const hashdb::scan_manager_t& manager,
+                  std::vector<std::string>& p_committed) :
+                       cursor(manager), staged(), committed(p_committed) {
+  }
+
+  void run(const hash_range_t& range, std::ostream& os) {
+    for (range.start(cursor); range.contains(cursor); cursor.next()) {
+      staged.push_back(cursor.block_hash());
+    }
+  }
+
+  void commit() {
+    committed.insert(committed.end(), staged.begin(), staged.end());
+    staged.clear();
+  }
+};
+
+// a pseudorandom 16-byte hash
+std::string make_hash(const uint64_t i) {
+  std::string hash(16, '\0');
+  uint64_t x = i;
+  for (size_t j=0; j<hash.size(); ++j) {
+    x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+    hash[j] = static_cast<char>(x >> 56);
+  }
+  return hash;
+}
+
+void make_hashdb() {
+  rm_hashdb_dir(hashdb_dir);
+  hashdb::settings_t settings;
+  std::string error_message = hashdb::create_hashdb(hashdb_dir, settings,
+                                                    "range_runner_test");
+  TEST_EQ(error_message, "");
+
+  // hashes that spread across the key space
+  hashdb::import_manager_t manager(hashdb_dir, "range_runner_test");
+  for (size_t i=0; i<num_hashes; ++i) {
+    manager.insert_hash(make_hash(i), 0, "", make_hash(num_hashes));
+  }
+}
+
+// the hashes in order, read serially
+void serial_hashes(const hashdb::scan_manager_t& manager,
+                   std::vector<std::string>& hashes) {
+  hashes.clear();
+  for (hashdb::hash_cursor_t cursor(manager); !cursor.at_end();
+                                                          cursor.next()) {
+    hashes.push_back(cursor.block_hash());
+  }
+  TEST_EQ(hashes.size(), num_hashes);
+}
+
+void test_ordered_output() {
+  hashdb::scan_manager_t manager(hashdb_dir);
+  std::vector<std::string> hashes;
+  serial_hashes(manager, hashes);
+  std::stringstream expected;
+  for (size_t i=0; i<hashes.size(); ++i) {
+    expected << hashdb::bin_to_hex(hashes[i]) << "\n";
+  }
+
+  std::vector<range_worker_t*> workers;
+  for (size_t i=0; i<num_workers; ++i) {
+    workers.push_back(new output_worker_t(manager));
+  }
+  std::stringstream os;
+  range_runner_t range_runner(workers, total_hashes, &os);
+  range_runner.run();
+  for (size_t i=0; i<workers.size(); ++i) {
+    delete workers[i];
+  }
+
+  const bool is_ordered = (os.str() == expected.str());
+  TEST_EQ(is_ordered, true);
+}
+
+void test_commit_in_order() {
+  hashdb::scan_manager_t manager(hashdb_dir);
+  std::vector<std::string> hashes;
+  serial_hashes(manager, hashes);
+
+  std::vector<std::string> committed;
+  std::vector<range_worker_t*> workers;
+  for (size_t i=0; i<num_workers; ++i) {
+    workers.push_back(new commit_worker_t(manager, committed));
+  }
+  range_runner_t range_runner(workers, total_hashes, NULL, true);
+  range_runner.run();
+  for (size_t i=0; i<workers.size(); ++i) {
+    delete workers[i];
+  }
+
+  TEST_EQ(committed.size(), hashes.size());
+  const bool is_ordered = (committed == hashes);
+  TEST_EQ(is_ordered, true);
+}
+
+int main(int argc, char* argv[]) {
+  make_hashdb();
+  test_ordered_output();
+  test_commit_in_order();
+
+  // done
+  std::cout << "range_runner_test Done.\n";
+  return 0;
+}
@@ -0,0 +1,156 @@
+// Author:  Bruce Allen
+// Created: 2/25/2013
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on February 25, 2013 by Bruce Allen.
+
+/**
+ * \file
+ * Test that the sample tracker queues neighbors of samples with matches
+ * and counts each primary sample once, including one that was pushed as
+ * a neighbor first, and that waiting for a neighbor returns when samples
+ * in flight are tracked.
+ */
+
+#include <config.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "unit_test.h"
+#include "../src_libhashdb/hasher/sample_tracker.hpp"
+
+static const uint64_t sample_size = 100;
+static const uint64_t filesize = 1000;   // 10 samples
+
+// the report of the tracker
+std::string report(const hasher::sample_tracker_t& sample_tracker) {
+  std::stringstream ss;
+  sample_tracker.report(ss);
+  return ss.str();
+}
+
+// true if the report has the text
+bool has(const std::string& report, const std::string& text) {
+  return report.find(text) != std::string::npos;
+}
+
+void test_neighbors() {
+  hasher::sample_tracker_t sample_tracker(filesize, sample_size);
+  TEST_EQ(sample_tracker.num_samples, 10);
+  TEST_EQ(sample_tracker.push(4, true), true);
+  TEST_EQ(sample_tracker.push(4, true), false);
+  TEST_EQ(sample_tracker.is_busy(), true);
+
+  // matches queue both neighbors
+  sample_tracker.track_matches(4 * sample_size, sample_size, 2);
+  uint64_t index;
+  TEST_EQ(sample_tracker.take_neighbor(index), true);
+  TEST_EQ(index, 3);
+  TEST_EQ(sample_tracker.push(index, false), true);
+  TEST_EQ(sample_tracker.take_neighbor(index), true);
+  TEST_EQ(index, 5);
+  TEST_EQ(sample_tracker.push(index, false), true);
+  TEST_EQ(sample_tracker.take_neighbor(index), false);
+
+  // no matches queue nothing, the last sample has no next neighbor
+  sample_tracker.track_matches(3 * sample_size, sample_size, 0);
+  sample_tracker.track_matches(5 * sample_size, sample_size, 0);
+  TEST_EQ(sample_tracker.is_busy(), false);
+  TEST_EQ(sample_tracker.push(9, true), true);
+  sample_tracker.track_matches(9 * sample_size, sample_size, 1);
+  TEST_EQ(sample_tracker.take_neighbor(index), true);
+  TEST_EQ(index, 8);
+  TEST_EQ(sample_tracker.take_neighbor(index), false);
+}
+
+void test_primary_after_neighbor() {
+  // primaries 1 and 6, with 6 tracked as a neighbor of 5 before it is
+  // drawn, and 2 pushed as a neighbor and drawn before it is tracked
+  hasher::sample_tracker_t sample_tracker(filesize, sample_size);
+  TEST_EQ(sample_tracker.push(5, false), true);
+  TEST_EQ(sample_tracker.push(6, false), true);
+  TEST_EQ(sample_tracker.push(2, false), true);
+  sample_tracker.track_matches(5 * sample_size, sample_size, 1);
+  sample_tracker.track_matches(6 * sample_size, sample_size, 4);
+  std::string text = report(sample_tracker);
+  TEST_EQ(has(text, "in 3 samples, 0 primary\n"), true);
+
+  // drawing them as primary does not push them again
+  TEST_EQ(sample_tracker.push(6, true), false);
+  TEST_EQ(sample_tracker.push(2, true), false);
+  TEST_EQ(sample_tracker.push(6, true), false);
+  text = report(sample_tracker);
+  TEST_EQ(has(text, "in 3 samples, 1 primary\n"), true);
+  sample_tracker.track_matches(2 * sample_size, sample_size, 2);
+
+  // primaries 2 and 6 with 2 and 4 matches estimate 30 in 10 samples
+  text = report(sample_tracker);
+  TEST_EQ(has(text, "Sampled 300 of 1000 bytes (30%) in 3 samples, "
+                    "2 primary\n"), true);
+  TEST_EQ(has(text, "Matching blocks found in samples: 7\n"), true);
+  TEST_EQ(has(text, "Estimated matching blocks in media: 30,"), true);
+
+  // drawing a neighbor does not make a primary a neighbor
+  TEST_EQ(sample_tracker.push(2, false), false);
+  text = report(sample_tracker);
+  TEST_EQ(has(text, "2 primary\n"), true);
+}
+
+// track sample 4 with matches, then sample 3 without, after a delay
+static void* track_later(void* arg) {
+  hasher::sample_tracker_t* const sample_tracker =
+                            static_cast<hasher::sample_tracker_t*>(arg);
+  usleep(100000);
+  sample_tracker->track_matches(4 * sample_size, sample_size, 1);
+  usleep(100000);
+  sample_tracker->track_matches(3 * sample_size, sample_size, 0);
+  return NULL;
+}
+
+void test_wait_for_neighbor() {
+  hasher::sample_tracker_t sample_tracker(filesize, sample_size);
+  uint64_t index;
+
+  // nothing in flight
+  TEST_EQ(sample_tracker.wait_for_neighbor(index), false);
+
+  // waits for sample 4 to queue its neighbors, then for the last sample
+  // in flight to be tracked
+  TEST_EQ(sample_tracker.push(4, true), true);
+  TEST_EQ(sample_tracker.push(3, true), true);
+  pthread_t thread;
+  TEST_EQ(pthread_create(&thread, NULL, track_later, &sample_tracker), 0);
+  TEST_EQ(sample_tracker.wait_for_neighbor(index), true);
+  TEST_EQ(index, 5);
+  TEST_EQ(sample_tracker.push(index, false), true);
+  sample_tracker.track_matches(5 * sample_size, sample_size, 0);
+  TEST_EQ(sample_tracker.wait_for_neighbor(index), false);
+  TEST_EQ(sample_tracker.is_busy(), false);
+  TEST_EQ(pthread_join(thread, NULL), 0);
+}
+
+int main(int argc, char* argv[]) {
+  test_neighbors();
+  test_primary_after_neighbor();
+  test_wait_for_neighbor();
+
+  // done
+  std::cout << "sample_tracker_test Done.\n";
+  return 0;
+}
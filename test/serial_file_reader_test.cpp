@@ -0,0 +1,152 @@
+// Author:  Bruce Allen
+// Created: 2/25/2013
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on February 25, 2013 by Bruce Allen.
+
+/**
+ * \file
+ * Test that split raw media is read as one file across segments, and
+ * that segments are closed as reads move past them.
+ */
+
+#include <config.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <stdint.h>
+#include <dirent.h>
+#include "unit_test.h"
+#include "../src_libhashdb/hasher/file_reader.hpp"
+
+static const std::string media_prefix = "temp_serial_file_reader_test.";
+static const size_t num_segments = 40;
+
+// the segment filename, numbered from 000
+std::string segment_filename(const size_t i) {
+  std::stringstream ss;
+  ss << media_prefix << (i / 100) << (i / 10 % 10) << (i % 10);
+  return ss.str();
+}
+
+// Make segments of different sizes, one of them empty, and return the
+// media they make.
+std::string make_media() {
+  std::string media;
+  for (size_t i=0; i<num_segments; ++i) {
+    const size_t size = (i == 7) ? 0 : 1000 + i * 37;
+    std::string segment(size, '\0');
+    for (size_t j=0; j<size; ++j) {
+      segment[j] = static_cast<char>((media.size() + j) * 131 + i);
+    }
+    std::ofstream out(segment_filename(i).c_str(), std::ios::binary);
+    out << segment;
+    media += segment;
+  }
+  // the segment after the last is not there
+  remove(segment_filename(num_segments).c_str());
+  return media;
+}
+
+void remove_media() {
+  for (size_t i=0; i<num_segments; ++i) {
+    remove(segment_filename(i).c_str());
+  }
+}
+
+// the number of open file descriptors, 0 if they cannot be counted
+size_t open_fd_count() {
+  DIR* dir = opendir("/proc/self/fd");
+  if (dir == NULL) {
+    return 0;
+  }
+  size_t count = 0;
+  while (readdir(dir) != NULL) {
+    ++count;
+  }
+  closedir(dir);
+  return count;
+}
+
+// read the media in reads of read_size and compare
+void test_read(const std::string& media, const size_t read_size) {
+  const hasher::file_reader_t file_reader(segment_filename(0));
+  TEST_EQ(file_reader.error_message, "");
+  const bool is_serial = (file_reader.file_reader_type == hasher::SERIAL);
+  TEST_EQ(is_serial, true);
+  TEST_EQ(file_reader.filesize, media.size());
+
+  const size_t fd_count = open_fd_count();
+  std::vector<uint8_t> buffer(read_size);
+  std::string read_media;
+  size_t max_fd_count = 0;
+  for (uint64_t offset = 0; offset < media.size(); offset += read_size) {
+    size_t bytes_read;
+    TEST_EQ(file_reader.read(offset, &buffer[0], read_size, &bytes_read), "");
+    const size_t expected_bytes_read = (media.size() - offset < read_size)
+                                       ? media.size() - offset : read_size;
+    TEST_EQ(bytes_read, expected_bytes_read);
+    read_media.append(reinterpret_cast<const char*>(&buffer[0]), bytes_read);
+    if (open_fd_count() > max_fd_count) {
+      max_fd_count = open_fd_count();
+    }
+  }
+  const bool is_equal = (read_media == media);
+  TEST_EQ(is_equal, true);
+
+  // the segment being read and the one read ahead are open at most,
+  // even when one read covers every segment
+  if (fd_count != 0) {
+    const bool is_closed = (max_fd_count <= fd_count + 2);
+    TEST_EQ(is_closed, true);
+  }
+}
+
+// read back and forth across segment boundaries
+void test_random_read(const std::string& media) {
+  const hasher::file_reader_t file_reader(segment_filename(0));
+  const size_t offsets[] = {media.size() - 10, 0, 1000, 5000, 990, 20000,
+                            media.size() - 1};
+  for (size_t i=0; i<7; ++i) {
+    uint8_t buffer[3000];
+    size_t bytes_read;
+    TEST_EQ(file_reader.read(offsets[i], buffer, sizeof(buffer),
+                             &bytes_read), "");
+    const std::string expected = media.substr(offsets[i], sizeof(buffer));
+    TEST_EQ(bytes_read, expected.size());
+    const bool is_equal = (std::string(reinterpret_cast<char*>(buffer),
+                                       bytes_read) == expected);
+    TEST_EQ(is_equal, true);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  const std::string media = make_media();
+  test_read(media, 1);
+  test_read(media, 100);
+  test_read(media, 1000);
+  test_read(media, 4096);
+  test_read(media, media.size() + 1);
+  test_random_read(media);
+  remove_media();
+
+  // done
+  std::cout << "serial_file_reader_test Done.\n";
+  return 0;
+}
@@ -91,6 +91,41 @@ def test_add_multiple():
     json_in3 = H.read_file("temp_3.json")
     H.lines_equals(json_in3, json3_db3)
 
+def test_add_multiple_precedence():
+    # the same source has a different sub_count for a hash in each DB
+    json_db1 = [
+'{"file_hash":"11","filesize":1,"file_type":"ft1","zero_count":15,"nonprobative_count":111,"name_pairs":["rn1","fn1"]}',
+'{"block_hash":"11111111","k_entropy":101,"block_label":"bl1","source_sub_counts":["11",1]}']
+    json_db2 = [
+'{"file_hash":"11","filesize":1,"file_type":"ft1","zero_count":15,"nonprobative_count":111,"name_pairs":["rn1","fn1"]}',
+'{"block_hash":"00000000","k_entropy":101,"block_label":"bl1","source_sub_counts":["11",1]}',
+'{"block_hash":"11111111","k_entropy":101,"block_label":"bl1","source_sub_counts":["11",2]}']
+    H.make_hashdb("temp_1.hdb", json_db1)
+    H.make_hashdb("temp_2.hdb", json_db2)
+
+    # the sub_count from the database listed first is kept
+    H.rm_tempdir("temp_3.hdb")
+    H.hashdb(["add_multiple", "temp_1.hdb", "temp_2.hdb", "temp_3.hdb"])
+    H.hashdb(["export", "temp_3.hdb", "temp_3.json"])
+    json_in3 = H.read_file("temp_3.json")
+    H.lines_equals(json_in3, [
+'# command: ','# hashdb-Version: ',
+'{"block_hash":"00000000","k_entropy":101,"block_label":"bl1","source_sub_counts":["11",1]}',
+'{"block_hash":"11111111","k_entropy":101,"block_label":"bl1","source_sub_counts":["11",1]}',
+'{"file_hash":"11","filesize":1,"file_type":"ft1","zero_count":15,"nonprobative_count":111,"name_pairs":["rn1","fn1"]}'
+])
+
+    H.rm_tempdir("temp_3.hdb")
+    H.hashdb(["add_multiple", "temp_2.hdb", "temp_1.hdb", "temp_3.hdb"])
+    H.hashdb(["export", "temp_3.hdb", "temp_3.json"])
+    json_in3 = H.read_file("temp_3.json")
+    H.lines_equals(json_in3, [
+'# command: ','# hashdb-Version: ',
+'{"block_hash":"00000000","k_entropy":101,"block_label":"bl1","source_sub_counts":["11",1]}',
+'{"block_hash":"11111111","k_entropy":101,"block_label":"bl1","source_sub_counts":["11",2]}',
+'{"file_hash":"11","filesize":1,"file_type":"ft1","zero_count":15,"nonprobative_count":111,"name_pairs":["rn1","fn1"]}'
+])
+
 def test_add_repository():
     # create new hashdb
     H.make_hashdb("temp_1.hdb", json_out1)
@@ -340,6 +375,7 @@ def test_subtract_repository():
 if __name__=="__main__":
     test_add()
     test_add_multiple()
+    test_add_multiple_precedence()
     test_add_repository()
     test_add_range()
     test_intersect()
@@ -8,9 +8,8 @@ import shutil
 import zipfile
 import gzip
 
-# run command array and return lines from it
-def hashdb(cmd):
-    # find hashdb
+# find hashdb and put it at the front of the command array
+def _hashdb_command(cmd):
     if os.path.isfile("../src/hashdb"):
         # path for "make check" from base dir
         cmd.insert(0, "../src/hashdb")
@@ -27,6 +26,10 @@ def hashdb(cmd):
         print("hashdb tool not found.  Aborting.\n")
         raise ValueError("hashdb not found")
 
+# run command array and return lines from it
+def hashdb(cmd):
+    _hashdb_command(cmd)
+
     # run hashdb command
     p = Popen(cmd, stdout=PIPE)
     lines = p.communicate()[0].decode('utf-8').split("\n")
@@ -38,6 +41,27 @@ def hashdb(cmd):
 
     return lines
 
+# run command array with optional input file and expected return code
+# and return stderr lines
+def hashdb_stderr(cmd, input_filename=None, returncode=0):
+    _hashdb_command(cmd)
+
+    # run hashdb command
+    stdin = None
+    if input_filename != None:
+        stdin = open(input_filename, 'rb')
+    p = Popen(cmd, stdin=stdin, stdout=PIPE, stderr=PIPE)
+    lines = p.communicate()[1].decode('utf-8').split("\n")
+    if stdin != None:
+        stdin.close()
+    if p.returncode != returncode:
+        print("error with command", cmd)
+        print("lines", lines)
+        print("Aborting.")
+        raise Exception("hashdb aborted.")
+
+    return lines
+
 def read_file(filename):
     with open(filename, 'r') as myfile:
         lines = myfile.readlines()
@@ -115,6 +115,39 @@ def test_import_tab4():
 ]
     H.lines_equals(returned_answer, expected_answer)
 
+# make an input file of comment lines spanning several import chunks,
+# with invalid lines at the given line numbers, return their line numbers
+def make_chunked_input(filename, invalid_line):
+    comment = "#" + "x" * 99
+    num_lines = 360000           # about 36 MiB, three chunks
+    invalid_line_numbers = [2, 170000, 340000, num_lines]
+    with open(filename, 'w') as f:
+        for i in range(1, num_lines + 1):
+            if i in invalid_line_numbers:
+                f.write(invalid_line + "\n")
+            else:
+                f.write(comment + "\n")
+    return invalid_line_numbers
+
+# test line numbers in messages about invalid lines in chunked input
+def test_import_tab_line_numbers():
+    H.rm_tempdir("temp_1.hdb")
+    H.hashdb(["create", "temp_1.hdb"])
+    line_numbers = make_chunked_input("temp_1.tab", "no tabs")
+    expected_answer = ["Tab not found on line " + str(n) + ": 'no tabs'"
+                       for n in line_numbers]
+
+    # from a file
+    returned_answer = H.hashdb_stderr(["import_tab", "temp_1.hdb",
+                                       "temp_1.tab"])
+    H.lines_equals(returned_answer, expected_answer + [""])
+
+    # from a stream
+    returned_answer = H.hashdb_stderr(["import_tab", "temp_1.hdb", "-"],
+                                      "temp_1.tab")
+    H.lines_equals(returned_answer, expected_answer + [""])
+    H.rm_tempfile("temp_1.tab")
+
 # test import JSON
 def test_import_json():
     H.rm_tempdir("temp_1.hdb")
@@ -148,6 +181,160 @@ def test_import_json():
     returned_answer = H.read_file("temp_2.json")
     H.lines_equals(returned_answer, expected_answer)
 
+# test line numbers in messages about invalid lines in chunked JSON input
+def test_import_json_line_numbers():
+    H.rm_tempdir("temp_1.hdb")
+    H.hashdb(["create", "temp_1.hdb"])
+    line_numbers = make_chunked_input("temp_1.json", "not json")
+    expected_answer = ["Invalid line " + str(n) +
+                       " error: Invalid JSON syntax: 'not json'"
+                       for n in line_numbers]
+
+    # from a file
+    returned_answer = H.hashdb_stderr(["import", "temp_1.hdb",
+                                       "temp_1.json"])
+    H.lines_equals(returned_answer, expected_answer + [""])
+
+    # from a stream
+    returned_answer = H.hashdb_stderr(["import", "temp_1.hdb", "-"],
+                                      "temp_1.json")
+    H.lines_equals(returned_answer, expected_answer + [""])
+    H.rm_tempfile("temp_1.json")
+
+# decode an unsigned LEB128 varint at offset, return it and the next offset
+def get_varint(data, offset):
+    n = 0
+    shift = 0
+    while True:
+        b = data[offset]
+        offset += 1
+        n |= (b & 0x7f) << shift
+        if b & 0x80 == 0:
+            return n, offset
+        shift += 7
+
+# return the (offset, payload) of each block of each section of a binary
+# export, keyed by section type
+def read_binary_blocks(filename):
+    with open(filename, 'rb') as f:
+        data = f.read()
+    H.bool_equals(data[:16] == b"hashdb binary 1\n", True)
+    offset = 16
+    sections = dict()
+    for section_type in "snh":
+        H.str_equals(chr(data[offset]), section_type)
+        offset += 1
+        blocks = list()
+        while True:
+            size = int.from_bytes(data[offset:offset+4], "little")
+            offset += 4
+            if size == 0:
+                break
+            blocks.append((offset, data[offset:offset+size]))
+            offset += size + 4
+        sections[section_type] = blocks
+    H.str_equals(chr(data[offset]), "e")
+    return sections
+
+# test that a binary export imports back to the same database
+def test_binary_round_trip():
+    H.rm_tempdir("temp_1.hdb")
+    H.rm_tempdir("temp_2.hdb")
+    H.rm_tempfile("temp_1.json")
+    H.rm_tempfile("temp_2.json")
+    H.rm_tempfile("temp_3.json")
+    H.rm_tempfile("temp_1.bin")
+    H.make_tempfile("temp_1.json", [
+'{"block_hash":"2222222222222222","k_entropy":1,"block_label":"bl1","source_sub_counts":["1111111111111111",2]}',
+'{"block_hash":"2222222222223333","k_entropy":2,"block_label":"","source_sub_counts":["0000000000000000",1,"1111111111111111",3]}',
+'{"block_hash":"8899aabbccddeeff","k_entropy":2,"block_label":"bl2","source_sub_counts":["0000000000000000",1,"0011223344556677",2]}',
+'{"file_hash":"0000000000000000","filesize":3,"file_type":"ftb","zero_count":4,"nonprobative_count":5,"name_pairs":["r2","f2","r3","f3"]}',
+'{"file_hash":"0011223344556677","filesize":6,"file_type":"fta","zero_count":7,"nonprobative_count":8,"name_pairs":["r1","f1"]}',
+'{"file_hash":"1111111111111111","filesize":9,"file_type":"ftc","zero_count":10,"nonprobative_count":11,"name_pairs":["r3","f3"]}'
+])
+    H.hashdb(["create", "temp_1.hdb"])
+    H.hashdb(["import", "temp_1.hdb", "temp_1.json"])
+    H.hashdb(["export", "temp_1.hdb", "temp_2.json"])
+    H.hashdb(["export_binary", "temp_1.hdb", "temp_1.bin"])
+    H.hashdb(["create", "temp_2.hdb"])
+    H.hashdb(["import_binary", "temp_2.hdb", "temp_1.bin"])
+    H.hashdb(["export", "temp_2.hdb", "temp_3.json"])
+    H.lines_equals(H.read_file("temp_3.json"), H.read_file("temp_2.json"))
+
+    # the hashes share prefixes within a block
+    sections = read_binary_blocks("temp_1.bin")
+    H.int_equals(len(sections["h"]), 1)
+    payload = sections["h"][0][1]
+    prefix_sizes = list()
+    offset = 0
+    while offset < len(payload):
+        prefix_size, offset = get_varint(payload, offset)
+        prefix_sizes.append(prefix_size)
+        rest_size, offset = get_varint(payload, offset)   # rest of hash
+        offset += rest_size
+        k_entropy, offset = get_varint(payload, offset)
+        label_size, offset = get_varint(payload, offset)  # block_label
+        offset += label_size
+        num_sources, offset = get_varint(payload, offset)
+        for i in range(2 * num_sources):
+            n, offset = get_varint(payload, offset)
+    H.bool_equals(prefix_sizes == [0, 6, 0], True)
+
+# test that a block with a bad checksum is rejected
+def test_binary_corrupt_block():
+    H.rm_tempdir("temp_2.hdb")
+    H.rm_tempfile("temp_2.bin")
+
+    # flip a bit in the first hash payload of the binary export
+    sections = read_binary_blocks("temp_1.bin")
+    offset = sections["h"][0][0]
+    with open("temp_1.bin", 'rb') as f:
+        data = bytearray(f.read())
+    data[offset + 1] ^= 0x01
+    with open("temp_2.bin", 'wb') as f:
+        f.write(data)
+
+    H.hashdb(["create", "temp_2.hdb"])
+    returned_answer = H.hashdb_stderr(["import_binary", "temp_2.hdb",
+                                       "temp_2.bin"], None, 1)
+    H.lines_equals(returned_answer, [
+        "Error: Invalid binary file temp_2.bin: block checksum mismatch, nothing was imported", ""])
+
+    # the sources before the corrupt block were not imported either
+    returned_answer = H.hashdb(["size", "temp_2.hdb"])
+    H.lines_equals(returned_answer, [
+'{"hash_data_store":0, "hash_store":0, "source_data_store":0, "source_id_store":0, "source_name_store":0}',
+''])
+    H.rm_tempfile("temp_2.bin")
+
+# test prefix sharing where the hashes span blocks
+def test_binary_block_boundary():
+    H.rm_tempdir("temp_1.hdb")
+    H.rm_tempdir("temp_2.hdb")
+    H.rm_tempfile("temp_1.json")
+    H.rm_tempfile("temp_2.json")
+    H.rm_tempfile("temp_1.bin")
+    H.hashdb(["create", "temp_1.hdb"])
+    H.hashdb(["add_random", "temp_1.hdb", "100000"])
+    H.hashdb(["export", "temp_1.hdb", "temp_1.json"])
+    H.hashdb(["export_binary", "temp_1.hdb", "temp_1.bin"])
+
+    # each hash block starts with an unshared hash, others share a prefix
+    sections = read_binary_blocks("temp_1.bin")
+    H.bool_equals(len(sections["h"]) > 1, True)
+    for block_offset, payload in sections["h"]:
+        prefix_size, offset = get_varint(payload, 0)
+        H.int_equals(prefix_size, 0)
+
+    # the hashes import back across the block boundaries
+    H.hashdb(["create", "temp_2.hdb"])
+    H.hashdb(["import_binary", "temp_2.hdb", "temp_1.bin"])
+    H.hashdb(["export", "temp_2.hdb", "temp_2.json"])
+    H.lines_equals(H.read_file("temp_2.json"), H.read_file("temp_1.json"))
+    H.rm_tempfile("temp_1.json")
+    H.rm_tempfile("temp_2.json")
+    H.rm_tempfile("temp_1.bin")
+
 # test import JSON hash partition range
 def test_export_json_hash_partition_range():
     H.rm_tempdir("temp_1.hdb")
@@ -208,8 +395,13 @@ if __name__=="__main__":
     test_import_tab2()
     test_import_tab3()
     test_import_tab4()
+    test_import_tab_line_numbers()
     test_import_json()
+    test_import_json_line_numbers()
     test_export_json_hash_partition_range()
+    test_binary_round_trip()
+    test_binary_corrupt_block()
+    test_binary_block_boundary()
     test_ingest()
     print("Test Done.")
 
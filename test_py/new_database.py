@@ -19,7 +19,7 @@ def test_basic_settings():
     # validate settings parameters
     lines = h.read_file(settings1)
     h.lines_equals(lines, [
-'{"settings_version":4, "block_size":4}'
+'{"settings_version":5, "block_size":4, "source_index":false}'
 
 ])
 
@@ -135,6 +135,21 @@ def test_hash_table():
 '1111111111111111	{"block_hash":"1111111111111111","k_entropy":0,"block_label":"","count":1,"source_list_id":1696784233,"sources":[{"file_hash":"0000000000000000","filesize":0,"file_type":"","zero_count":0,"nonprobative_count":0,"name_pairs":[]}],"source_sub_counts":["0000000000000000",1]}',
 '2222222222222222	{"block_hash":"2222222222222222","k_entropy":0,"block_label":"","count":2,"source_list_id":1696784233,"sources":[],"source_sub_counts":["0000000000000000",2]}',
 '# Processing 2 of 2 completed.',
+''])
+
+    # the same matches from the source indexes, which imports then update
+    H.hashdb(["index_sources", "temp_1.hdb"])
+    H.make_tempfile("temp_0.json", [
+'{"block_hash":"3333333333333333", "source_sub_counts":["0000000000000000", 1]}'])
+    H.hashdb(["import", "temp_1.hdb", "temp_0.json"])
+    returned_answer = H.hashdb(["hash_table", "temp_1.hdb", "0000000000000000"])
+    H.lines_equals(returned_answer, [
+'# command: ',
+'# hashdb-Version: ',
+'1111111111111111	{"block_hash":"1111111111111111","k_entropy":0,"block_label":"","count":1,"source_list_id":1696784233,"sources":[{"file_hash":"0000000000000000","filesize":0,"file_type":"","zero_count":0,"nonprobative_count":0,"name_pairs":[]}],"source_sub_counts":["0000000000000000",1]}',
+'2222222222222222	{"block_hash":"2222222222222222","k_entropy":0,"block_label":"","count":2,"source_list_id":1696784233,"sources":[],"source_sub_counts":["0000000000000000",2]}',
+'3333333333333333	{"block_hash":"3333333333333333","k_entropy":0,"block_label":"","count":1,"source_list_id":1696784233,"sources":[],"source_sub_counts":["0000000000000000",1]}',
+'# Processing 3 of 3 completed.',
 ''])
 
 def test_media():